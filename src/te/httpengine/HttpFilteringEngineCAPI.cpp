@@ -513,3 +513,256 @@ void fe_ctl_unload_rules_for_category(PHttpFilteringEngineCtl ptr, const uint8_t
 
 	assert(callSuccess == true && u8"In fe_ctl_get_rootca_pem(...) - Caught exception and failed to unload rules for category.");
 }
+
+void fe_ctl_add_tls_passthrough_host(PHttpFilteringEngineCtl ptr, const char* host, const size_t hostLength)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_add_tls_passthrough_host(PHttpFilteringEngineCtl, const char*, const size_t) - Supplied PHttpFilteringEngineCtl ptr is nullptr!");
+		assert(host != nullptr && u8"In fe_ctl_add_tls_passthrough_host(PHttpFilteringEngineCtl, const char*, const size_t) - Supplied host ptr is nullptr!");
+	#endif
+
+	bool callSuccess = false;
+
+	try
+	{
+		if (ptr != nullptr && host != nullptr)
+		{
+			std::string hostString(host, hostLength);
+			reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->AddTlsPassthroughHost(hostString);
+			callSuccess = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(callSuccess == true && u8"In fe_ctl_add_tls_passthrough_host(...) - Caught exception and failed to add TLS passthrough host.");
+}
+
+void fe_ctl_remove_tls_passthrough_host(PHttpFilteringEngineCtl ptr, const char* host, const size_t hostLength)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_remove_tls_passthrough_host(PHttpFilteringEngineCtl, const char*, const size_t) - Supplied PHttpFilteringEngineCtl ptr is nullptr!");
+		assert(host != nullptr && u8"In fe_ctl_remove_tls_passthrough_host(PHttpFilteringEngineCtl, const char*, const size_t) - Supplied host ptr is nullptr!");
+	#endif
+
+	bool callSuccess = false;
+
+	try
+	{
+		if (ptr != nullptr && host != nullptr)
+		{
+			std::string hostString(host, hostLength);
+			reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->RemoveTlsPassthroughHost(hostString);
+			callSuccess = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(callSuccess == true && u8"In fe_ctl_remove_tls_passthrough_host(...) - Caught exception and failed to remove TLS passthrough host.");
+}
+
+void fe_ctl_get_connection_pool_stats(PHttpFilteringEngineCtl ptr, uint64_t* hits, uint64_t* misses)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_connection_pool_stats(PHttpFilteringEngineCtl, uint64_t*, uint64_t*) - Supplied PHttpFilteringEngineCtl ptr is nullptr!");
+		assert(hits != nullptr && u8"In fe_ctl_get_connection_pool_stats(PHttpFilteringEngineCtl, uint64_t*, uint64_t*) - Supplied hits ptr is nullptr!");
+		assert(misses != nullptr && u8"In fe_ctl_get_connection_pool_stats(PHttpFilteringEngineCtl, uint64_t*, uint64_t*) - Supplied misses ptr is nullptr!");
+	#endif
+
+	bool callSuccess = false;
+
+	try
+	{
+		if (ptr != nullptr && hits != nullptr && misses != nullptr)
+		{
+			auto stats = reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetUpstreamConnectionPoolStats();
+			*hits = stats.hits;
+			*misses = stats.misses;
+			callSuccess = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(callSuccess == true && u8"In fe_ctl_get_connection_pool_stats(...) - Caught exception and failed to get connection pool stats.");
+}
+
+size_t fe_ctl_get_connect_time_histogram(PHttpFilteringEngineCtl ptr, uint64_t* counts, const size_t countsLength)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_connect_time_histogram(PHttpFilteringEngineCtl, uint64_t*, const size_t) - Supplied PHttpFilteringEngineCtl ptr is nullptr!");
+		assert(counts != nullptr && u8"In fe_ctl_get_connect_time_histogram(PHttpFilteringEngineCtl, uint64_t*, const size_t) - Supplied counts ptr is nullptr!");
+	#endif
+
+	bool callSuccess = false;
+
+	try
+	{
+		if (ptr != nullptr && counts != nullptr)
+		{
+			auto histogram = reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetUpstreamConnectTimeCounts();
+
+			for (size_t i = 0; i < histogram.size() && i < countsLength; ++i)
+			{
+				counts[i] = histogram[i];
+			}
+
+			callSuccess = true;
+
+			return histogram.size();
+		}
+	}
+	catch (std::exception& e)
+	{
+		reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(callSuccess == true && u8"In fe_ctl_get_connect_time_histogram(...) - Caught exception and failed to get connect time histogram.");
+
+	return 0;
+}
+
+void fe_ctl_set_stream_timeouts(
+	PHttpFilteringEngineCtl ptr,
+	const uint32_t connectMsec,
+	const uint32_t handshakeMsec,
+	const uint32_t idleKeepAliveMsec,
+	const uint32_t bodyMsec
+	)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_set_stream_timeouts(PHttpFilteringEngineCtl, const uint32_t, const uint32_t, const uint32_t, const uint32_t) - Supplied PHttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool callSuccess = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			te::httpengine::network::StreamTimeouts timeouts;
+			timeouts.connectMsec = connectMsec;
+			timeouts.handshakeMsec = handshakeMsec;
+			timeouts.idleKeepAliveMsec = idleKeepAliveMsec;
+			timeouts.bodyMsec = bodyMsec;
+
+			reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->SetStreamTimeouts(timeouts);
+			callSuccess = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(callSuccess == true && u8"In fe_ctl_set_stream_timeouts(...) - Caught exception and failed to set stream timeouts.");
+}
+
+void fe_ctl_set_payload_memory_limit(PHttpFilteringEngineCtl ptr, const uint64_t limit)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_set_payload_memory_limit(PHttpFilteringEngineCtl, const uint64_t) - Supplied PHttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool callSuccess = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->SetPayloadMemoryLimit(limit);
+			callSuccess = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(callSuccess == true && u8"In fe_ctl_set_payload_memory_limit(...) - Caught exception and failed to set payload memory limit.");
+}
+
+void fe_ctl_get_payload_memory_stats(PHttpFilteringEngineCtl ptr, uint64_t* usage, uint64_t* highWater, uint64_t* rejections)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_get_payload_memory_stats(PHttpFilteringEngineCtl, uint64_t*, uint64_t*, uint64_t*) - Supplied PHttpFilteringEngineCtl ptr is nullptr!");
+		assert(usage != nullptr && u8"In fe_ctl_get_payload_memory_stats(PHttpFilteringEngineCtl, uint64_t*, uint64_t*, uint64_t*) - Supplied usage ptr is nullptr!");
+		assert(highWater != nullptr && u8"In fe_ctl_get_payload_memory_stats(PHttpFilteringEngineCtl, uint64_t*, uint64_t*, uint64_t*) - Supplied highWater ptr is nullptr!");
+		assert(rejections != nullptr && u8"In fe_ctl_get_payload_memory_stats(PHttpFilteringEngineCtl, uint64_t*, uint64_t*, uint64_t*) - Supplied rejections ptr is nullptr!");
+	#endif
+
+	bool callSuccess = false;
+
+	try
+	{
+		if (ptr != nullptr && usage != nullptr && highWater != nullptr && rejections != nullptr)
+		{
+			auto stats = reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->GetPayloadMemoryStats();
+			*usage = stats.usage;
+			*highWater = stats.highWater;
+			*rejections = stats.rejections;
+			callSuccess = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(callSuccess == true && u8"In fe_ctl_get_payload_memory_stats(...) - Caught exception and failed to get payload memory stats.");
+}
+
+void fe_ctl_set_sharded_services(PHttpFilteringEngineCtl ptr, const bool val)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_set_sharded_services(PHttpFilteringEngineCtl, const bool) - Supplied PHttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool callSuccess = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->SetShardedServicesEnabled(val);
+			callSuccess = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(callSuccess == true && u8"In fe_ctl_set_sharded_services(...) - Caught exception and failed to set sharded services.");
+}
+
+void fe_ctl_set_drain_timeout(PHttpFilteringEngineCtl ptr, const uint32_t msec)
+{
+	#ifndef NDEBUG
+		assert(ptr != nullptr && u8"In fe_ctl_set_drain_timeout(PHttpFilteringEngineCtl, const uint32_t) - Supplied PHttpFilteringEngineCtl ptr is nullptr!");
+	#endif
+
+	bool callSuccess = false;
+
+	try
+	{
+		if (ptr != nullptr)
+		{
+			reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->SetDrainTimeout(msec);
+			callSuccess = true;
+		}
+	}
+	catch (std::exception& e)
+	{
+		reinterpret_cast<te::httpengine::HttpFilteringEngineControl*>(ptr)->ReportError(e.what());
+	}
+
+	assert(callSuccess == true && u8"In fe_ctl_set_drain_timeout(...) - Caught exception and failed to set drain timeout.");
+}
@@ -395,6 +395,153 @@ extern "C" {
 	/// </param>
 	HTTP_FILTERING_ENGINE_API void fe_ctl_unload_rules_for_category(PHttpFilteringEngineCtl ptr, const uint8_t category);
 
+	/// <summary>
+	/// Adds a host whose TLS connections should be relayed untouched, rather than intercepted
+	/// and filtered. Subdomains of the host are passed through as well.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="host">
+	/// A pointer to a string containing the host, without scheme, port or path.
+	/// </param>
+	/// <param name="hostLength">
+	/// The total length of the supplied host string.
+	/// </param>
+	HTTP_FILTERING_ENGINE_API void fe_ctl_add_tls_passthrough_host(PHttpFilteringEngineCtl ptr, const char* host, const size_t hostLength);
+
+	/// <summary>
+	/// Removes a host previously added through fe_ctl_add_tls_passthrough_host.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="host">
+	/// A pointer to a string containing the host to stop passing through.
+	/// </param>
+	/// <param name="hostLength">
+	/// The total length of the supplied host string.
+	/// </param>
+	HTTP_FILTERING_ENGINE_API void fe_ctl_remove_tls_passthrough_host(PHttpFilteringEngineCtl ptr, const char* host, const size_t hostLength);
+
+	/// <summary>
+	/// Gets how often new bridges were able to reuse an idle upstream connection, rather
+	/// than connecting, and for TLS handshaking, all over again.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="hits">
+	/// A pointer to a uint64_t that will receive the number of connections reused.
+	/// </param>
+	/// <param name="misses">
+	/// A pointer to a uint64_t that will receive the number of times no idle connection
+	/// was available.
+	/// </param>
+	HTTP_FILTERING_ENGINE_API void fe_ctl_get_connection_pool_stats(PHttpFilteringEngineCtl ptr, uint64_t* hits, uint64_t* misses);
+
+	/// <summary>
+	/// Gets a histogram of how long upstream connects took. There are ten buckets, with
+	/// upper bounds of 10, 25, 50, 100, 250, 500, 1000, 2500 and 5000 milliseconds, and a last
+	/// bucket for anything slower.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="counts">
+	/// A pointer to an array that will receive the count of each bucket, in order.
+	/// </param>
+	/// <param name="countsLength">
+	/// The number of elements in the supplied array. At most this many buckets are written.
+	/// </param>
+	/// <returns>
+	/// The total number of buckets, regardless of how many were written.
+	/// </returns>
+	HTTP_FILTERING_ENGINE_API size_t fe_ctl_get_connect_time_histogram(PHttpFilteringEngineCtl ptr, uint64_t* counts, const size_t countsLength);
+
+	/// <summary>
+	/// Sets how long connections are given to make progress in each phase before they are
+	/// dropped. Takes effect the next time the Engine is started.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="connectMsec">
+	/// Milliseconds allowed for resolving and connecting to the upstream host.
+	/// </param>
+	/// <param name="handshakeMsec">
+	/// Milliseconds allowed for each TLS handshake.
+	/// </param>
+	/// <param name="idleKeepAliveMsec">
+	/// Milliseconds a client connection may sit idle waiting for its next request.
+	/// </param>
+	/// <param name="bodyMsec">
+	/// Milliseconds allowed for each read or write of headers and payloads.
+	/// </param>
+	HTTP_FILTERING_ENGINE_API void fe_ctl_set_stream_timeouts(
+		PHttpFilteringEngineCtl ptr,
+		const uint32_t connectMsec,
+		const uint32_t handshakeMsec,
+		const uint32_t idleKeepAliveMsec,
+		const uint32_t bodyMsec
+		);
+
+	/// <summary>
+	/// Sets the number of bytes that payloads buffered for inspection may hold in total.
+	/// Payloads that would go beyond it are streamed through uninspected.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="limit">
+	/// The limit, in bytes.
+	/// </param>
+	HTTP_FILTERING_ENGINE_API void fe_ctl_set_payload_memory_limit(PHttpFilteringEngineCtl ptr, const uint64_t limit);
+
+	/// <summary>
+	/// Gets how much memory payloads buffered for inspection hold, and how many payloads
+	/// were streamed uninspected because of the limit.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="usage">
+	/// A pointer to a uint64_t that will receive the number of bytes currently held.
+	/// </param>
+	/// <param name="highWater">
+	/// A pointer to a uint64_t that will receive the most bytes ever held at once.
+	/// </param>
+	/// <param name="rejections">
+	/// A pointer to a uint64_t that will receive the number of payloads streamed because
+	/// of the limit.
+	/// </param>
+	HTTP_FILTERING_ENGINE_API void fe_ctl_get_payload_memory_stats(PHttpFilteringEngineCtl ptr, uint64_t* usage, uint64_t* highWater, uint64_t* rejections);
+
+	/// <summary>
+	/// Sets whether the Engine runs sharded, with an event loop of its own on each proxy
+	/// thread and every connection kept on just one of them, rather than a single event loop
+	/// run by every proxy thread. Takes effect the next time the Engine is started.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="val">
+	/// True to run sharded, false otherwise.
+	/// </param>
+	HTTP_FILTERING_ENGINE_API void fe_ctl_set_sharded_services(PHttpFilteringEngineCtl ptr, const bool val);
+
+	/// <summary>
+	/// Sets how long stopping the Engine waits on downloads and other transfers in flight to
+	/// finish before closing their connections. Idle connections are always closed at once.
+	/// </summary>
+	/// <param name="ptr">
+	/// A valid pointer to an existing Engine instance.
+	/// </param>
+	/// <param name="msec">
+	/// The drain timeout, in milliseconds. Zero closes every connection at once.
+	/// </param>
+	HTTP_FILTERING_ENGINE_API void fe_ctl_set_drain_timeout(PHttpFilteringEngineCtl ptr, const uint32_t msec);
+
 #ifdef __cplusplus
 };
 #endif // __cplusplus
\ No newline at end of file
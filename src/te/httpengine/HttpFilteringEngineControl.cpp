@@ -150,12 +150,34 @@ namespace te
 				if (m_service == nullptr)
 				{
 					m_service.reset(new boost::asio::io_service());
+					m_dnsResolver.reset(new network::AsyncDnsResolver(m_service.get()));
+
+					if (!m_dnsResolver->HasNameservers())
+					{
+						ReportWarning(u8"In HttpFilteringEngineControl::Start() - No nameservers found, falling back to the system resolver.");
+						m_dnsResolver.reset();
+					}
+
+					m_dnsCache.reset(new network::DnsCache(m_service.get(), m_dnsResolver.get()));
+					m_timingWheel.reset(new network::TimingWheel(m_service.get(), m_proxyNumThreads));
 				}
 				else					
 				{					
 					m_service->reset();
 				}				
 
+				network::IoServicePool* servicePool = nullptr;
+
+				if (m_shardedServices)
+				{
+					if (m_servicePool == nullptr)
+					{
+						m_servicePool.reset(new network::IoServicePool(m_proxyNumThreads));
+					}
+
+					servicePool = m_servicePool.get();
+				}
+
 				m_httpAcceptor.reset(
 					new mitm::secure::TcpAcceptor(
 						m_service.get(),
@@ -163,6 +185,12 @@ namespace te
 						m_httpListenerPort,
 						m_caBundleAbsolutePath,
 						nullptr,
+						m_dnsCache.get(),
+						m_timingWheel.get(),
+						m_streamTimeouts,
+						&m_payloadBudget,
+						&m_bufferPool,
+						servicePool,
 						m_onInfo,
 						m_onWarning,
 						m_onError
@@ -180,6 +208,12 @@ namespace te
 						m_httpsListenerPort,
 						m_caBundleAbsolutePath,
 						m_store.get(),
+						m_dnsCache.get(),
+						m_timingWheel.get(),
+						m_streamTimeouts,
+						&m_payloadBudget,
+						&m_bufferPool,
+						servicePool,
 						m_onInfo,
 						m_onWarning,
 						m_onError
@@ -198,7 +232,18 @@ namespace te
 
 				m_diversionControl->Run();
 
-				for (uint32_t i = 0; i < m_proxyNumThreads; ++i)
+				// When sharded, the proxy threads each run a shard of their own, and m_service
+				// is left with nothing but the listeners and DNS lookups, for which one thread
+				// is plenty.
+				uint32_t serviceThreads = m_proxyNumThreads;
+
+				if (servicePool != nullptr)
+				{
+					servicePool->Run();
+					serviceThreads = 1;
+				}
+
+				for (uint32_t i = 0; i < serviceThreads; ++i)
 				{
 					m_proxyServiceThreads.emplace_back(
 						std::thread
@@ -223,6 +268,11 @@ namespace te
 			{				
 				m_httpAcceptor->StopAccepting();
 				m_httpsAcceptor->StopAccepting();
+
+				// Diversion has to keep running while connections drain, or the traffic of those
+				// connections would stop being diverted to us mid-transfer.
+				DrainConnections();
+
 				m_diversionControl->Stop();
 				m_service->stop();
 
@@ -233,6 +283,11 @@ namespace te
 
 				m_proxyServiceThreads.clear();
 
+				if (m_servicePool != nullptr)
+				{
+					m_servicePool->Stop();
+				}
+
 				m_isRunning = false;
 			}
 		}
@@ -370,5 +425,130 @@ namespace te
 			}
 		}
 
+		void HttpFilteringEngineControl::AddTlsPassthroughHost(const std::string& host)
+		{
+			if (m_httpFilteringEngine != nullptr)
+			{
+				m_httpFilteringEngine->AddTlsPassthroughHost(host);
+			}
+		}
+
+		void HttpFilteringEngineControl::RemoveTlsPassthroughHost(const std::string& host)
+		{
+			if (m_httpFilteringEngine != nullptr)
+			{
+				m_httpFilteringEngine->RemoveTlsPassthroughHost(host);
+			}
+		}
+
+		mitm::secure::UpstreamConnectionPoolStats HttpFilteringEngineControl::GetUpstreamConnectionPoolStats() const
+		{
+			mitm::secure::UpstreamConnectionPoolStats stats;
+
+			if (m_isRunning && m_httpAcceptor != nullptr && m_httpsAcceptor != nullptr)
+			{
+				auto httpStats = m_httpAcceptor->GetConnectionPoolStats();
+				auto httpsStats = m_httpsAcceptor->GetConnectionPoolStats();
+
+				stats.hits = httpStats.hits + httpsStats.hits;
+				stats.misses = httpStats.misses + httpsStats.misses;
+				stats.checkIns = httpStats.checkIns + httpsStats.checkIns;
+				stats.evictions = httpStats.evictions + httpsStats.evictions;
+				stats.idle = httpStats.idle + httpsStats.idle;
+			}
+
+			return stats;
+		}
+
+		std::array<uint64_t, network::ConnectTimeHistogram::BucketCount> HttpFilteringEngineControl::GetUpstreamConnectTimeCounts() const
+		{
+			std::array<uint64_t, network::ConnectTimeHistogram::BucketCount> counts{};
+
+			if (m_isRunning && m_httpAcceptor != nullptr && m_httpsAcceptor != nullptr)
+			{
+				auto httpCounts = m_httpAcceptor->GetConnectTimeCounts();
+				auto httpsCounts = m_httpsAcceptor->GetConnectTimeCounts();
+
+				for (size_t i = 0; i < counts.size(); ++i)
+				{
+					counts[i] = httpCounts[i] + httpsCounts[i];
+				}
+			}
+
+			return counts;
+		}
+
+		void HttpFilteringEngineControl::SetStreamTimeouts(const network::StreamTimeouts& timeouts)
+		{
+			std::lock_guard<std::mutex> lock(m_ctlMutex);
+
+			m_streamTimeouts = timeouts;
+		}
+
+		void HttpFilteringEngineControl::SetPayloadMemoryLimit(const uint64_t limit)
+		{
+			m_payloadBudget.SetLimit(limit);
+		}
+
+		mitm::http::PayloadMemoryBudgetStats HttpFilteringEngineControl::GetPayloadMemoryStats() const
+		{
+			return m_payloadBudget.GetStats();
+		}
+
+		void HttpFilteringEngineControl::SetShardedServicesEnabled(const bool enabled)
+		{
+			std::lock_guard<std::mutex> lock(m_ctlMutex);
+
+			m_shardedServices = enabled;
+		}
+
+		void HttpFilteringEngineControl::SetDrainTimeout(const uint32_t msec)
+		{
+			std::lock_guard<std::mutex> lock(m_ctlMutex);
+
+			m_drainTimeoutMsec = msec;
+		}
+
+		void HttpFilteringEngineControl::DrainConnections()
+		{
+			m_httpAcceptor->DrainBridges();
+			m_httpsAcceptor->DrainBridges();
+
+			size_t remaining = WaitForConnections(std::chrono::steady_clock::now() + std::chrono::milliseconds(m_drainTimeoutMsec));
+
+			if (remaining > 0)
+			{
+				std::string warnMessage(u8"In HttpFilteringEngineControl::DrainConnections() - Drain timeout passed, closing connections still in flight:\t");
+				warnMessage.append(std::to_string(remaining));
+				ReportWarning(warnMessage);
+
+				m_httpAcceptor->TerminateBridges();
+				m_httpsAcceptor->TerminateBridges();
+
+				// Give the cancelled handlers a moment to unwind, so that the bridges are gone
+				// before the io_service is stopped with their handlers still queued.
+				const uint32_t pollMsec = DrainPollMsec;
+
+				WaitForConnections(std::chrono::steady_clock::now() + std::chrono::milliseconds(pollMsec * 20));
+			}
+		}
+
+		size_t HttpFilteringEngineControl::WaitForConnections(const std::chrono::steady_clock::time_point deadline)
+		{
+			const uint32_t pollMsec = DrainPollMsec;
+
+			for (;;)
+			{
+				size_t remaining = m_httpAcceptor->GetLiveBridgeCount() + m_httpsAcceptor->GetLiveBridgeCount();
+
+				if (remaining == 0 || std::chrono::steady_clock::now() >= deadline)
+				{
+					return remaining;
+				}
+
+				std::this_thread::sleep_for(std::chrono::milliseconds(pollMsec));
+			}
+		}
+
 	} /* namespace httpengine */
 } /* namespace te */
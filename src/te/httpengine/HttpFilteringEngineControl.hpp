@@ -31,6 +31,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <memory>
 #include <functional>
@@ -161,6 +162,10 @@ namespace te
 			/// Engine will cease diverting traffic to itself and cease listening for incoming
 			/// diverted HTTP and HTTPS connections. If the underlying Engine is not running, the
 			/// call will have no effect.
+			/// 
+			/// Connections already being served are drained first. Idle connections are closed
+			/// at once, and those with a transfer in flight are given until the drain timeout to
+			/// finish, after which they are closed too. See ::SetDrainTimeout(...).
 			/// </summary>
 			void Stop();
 
@@ -351,8 +356,123 @@ namespace te
 			/// </param>
 			void UnloadRulesForCategory(const uint8_t category);
 
+			/// <summary>
+			/// Adds a host whose TLS connections should be relayed untouched, rather than
+			/// intercepted and filtered. Subdomains of the host are passed through as well.
+			/// </summary>
+			/// <param name="host">
+			/// The host to pass through, without scheme, port or path.
+			/// </param>
+			void AddTlsPassthroughHost(const std::string& host);
+
+			/// <summary>
+			/// Removes a host previously added through ::AddTlsPassthroughHost(...).
+			/// </summary>
+			/// <param name="host">
+			/// The host to stop passing through.
+			/// </param>
+			void RemoveTlsPassthroughHost(const std::string& host);
+
+			/// <summary>
+			/// Gets the combined counters of the plain and TLS upstream connection pools. If
+			/// the engine is not running, all counters are zero.
+			/// </summary>
+			/// <returns>
+			/// The summed connection pool statistics of both acceptors.
+			/// </returns>
+			mitm::secure::UpstreamConnectionPoolStats GetUpstreamConnectionPoolStats() const;
+
+			/// <summary>
+			/// Gets how long the plain and TLS bridges combined took to connect upstream. If the
+			/// engine is not running, all counts are zero.
+			/// </summary>
+			/// <returns>
+			/// The count of each bucket of network::ConnectTimeHistogram.
+			/// </returns>
+			std::array<uint64_t, network::ConnectTimeHistogram::BucketCount> GetUpstreamConnectTimeCounts() const;
+
+			/// <summary>
+			/// Sets how long bridges are given to make progress in each phase before they are
+			/// terminated. Takes effect the next time the engine is started.
+			/// </summary>
+			/// <param name="timeouts">
+			/// The timeout for each phase, in milliseconds.
+			/// </param>
+			void SetStreamTimeouts(const network::StreamTimeouts& timeouts);
+
+			/// <summary>
+			/// Sets the number of bytes that payloads buffered for inspection may hold in total.
+			/// Payloads that would go beyond it are streamed through uninspected. Takes effect
+			/// immediately.
+			/// </summary>
+			/// <param name="limit">
+			/// The limit, in bytes.
+			/// </param>
+			void SetPayloadMemoryLimit(const uint64_t limit);
+
+			/// <summary>
+			/// Gets the limit, current usage and high water mark of the memory held by payloads
+			/// buffered for inspection, and how many payloads were streamed because of the limit.
+			/// </summary>
+			/// <returns>
+			/// A snapshot of the payload memory budget's counters.
+			/// </returns>
+			mitm::http::PayloadMemoryBudgetStats GetPayloadMemoryStats() const;
+
+			/// <summary>
+			/// Sets whether the proxy runs sharded. When sharded, rather than running a single
+			/// io_service on every proxy thread, each proxy thread runs an io_service of its
+			/// own, and every connection is kept on just one of them, from accept until close.
+			/// The listeners and DNS lookups then run on one extra thread. Takes effect the next
+			/// time the engine is started.
+			/// </summary>
+			/// <param name="enabled">
+			/// True to run sharded, false to run a single io_service on every proxy thread.
+			/// </param>
+			void SetShardedServicesEnabled(const bool enabled);
+
+			/// <summary>
+			/// Sets how long ::Stop() waits on transfers in flight to finish before closing
+			/// their connections. Zero closes every connection at once.
+			/// </summary>
+			/// <param name="msec">
+			/// The drain timeout, in milliseconds.
+			/// </param>
+			void SetDrainTimeout(const uint32_t msec);
+
 		private:
 
+			/// <summary>
+			/// The default number of milliseconds ::Stop() waits on transfers in flight.
+			/// </summary>
+			static constexpr uint32_t DefaultDrainTimeoutMsec = 30000;
+
+			/// <summary>
+			/// The number of milliseconds between checks on whether draining connections are
+			/// all gone.
+			/// </summary>
+			static constexpr uint32_t DrainPollMsec = 50;
+
+			/// <summary>
+			/// Drains the connections of both acceptors, waiting until they are all gone or
+			/// the drain timeout passes, and then closes whatever is left. Must be called
+			/// with the acceptors no longer accepting, and with the io_service threads still
+			/// running, so that the connections can actually wind down.
+			/// </summary>
+			void DrainConnections();
+
+			/// <summary>
+			/// Waits until both acceptors are left without any live connections, or until the
+			/// given time.
+			/// </summary>
+			/// <param name="deadline">
+			/// The time to stop waiting at.
+			/// </param>
+			/// <returns>
+			/// The number of connections still alive.
+			/// </returns>
+			size_t WaitForConnections(const std::chrono::steady_clock::time_point deadline);
+
 			/// <summary>
 			/// If defined, called whenever a packet flow is being considered for diversion to the
 			/// proxy, but the binary responsible for sending or receiving the flow has not yet been
@@ -428,11 +548,67 @@ namespace te
 			/// </summary>
 			std::unique_ptr<filtering::http::HttpFilteringEngine> m_httpFilteringEngine = nullptr;
 
+			/// <summary>
+			/// The budget that payloads buffered for inspection by both acceptors' bridges are
+			/// reserved against. Lives as long as this object, so that its counters survive
+			/// restarts. Declared ahead of every io_service, because handlers still queued on
+			/// them when they are destroyed can hold the last reference to a bridge, whose
+			/// transactions release their reservations as they go.
+			/// </summary>
+			mitm::http::PayloadMemoryBudget m_payloadBudget;
+
+			/// <summary>
+			/// Payload read buffers shared by both acceptors' bridges. Declared ahead of every
+			/// io_service for the same reason as m_payloadBudget, since transactions check
+			/// their buffers back in when they are destroyed.
+			/// </summary>
+			mitm::http::IoBufferPool m_bufferPool;
+
 			/// <summary>
 			/// The io_service that will drive the proxy.
 			/// </summary>
 			std::unique_ptr<boost::asio::io_service> m_service = nullptr;
 
+			/// <summary>
+			/// Resolver that sends DNS queries on m_service itself, behind m_dnsCache. Left
+			/// nullptr if no nameservers could be found, in which case m_dnsCache falls back to
+			/// the system resolver.
+			/// </summary>
+			std::unique_ptr<network::AsyncDnsResolver> m_dnsResolver = nullptr;
+
+			/// <summary>
+			/// Host name resolutions shared by both acceptors' bridges. Created along with,
+			/// and running on, m_service.
+			/// </summary>
+			std::unique_ptr<network::DnsCache> m_dnsCache = nullptr;
+
+			/// <summary>
+			/// Keeps the stream timeouts of both acceptors' bridges. Created along with, and
+			/// ticking on, m_service, with one shard per proxy thread.
+			/// </summary>
+			std::unique_ptr<network::TimingWheel> m_timingWheel = nullptr;
+
+			/// <summary>
+			/// Whether the proxy runs sharded over m_servicePool, rather than on m_service alone.
+			/// </summary>
+			bool m_shardedServices = false;
+
+			/// <summary>
+			/// One io_service per proxy thread, that both acceptors' bridges are dealt out to
+			/// when running sharded. Created the first time the engine is started sharded.
+			/// </summary>
+			std::unique_ptr<network::IoServicePool> m_servicePool = nullptr;
+
+			/// <summary>
+			/// How long ::Stop() waits on transfers in flight to finish.
+			/// </summary>
+			uint32_t m_drainTimeoutMsec = DefaultDrainTimeoutMsec;
+
+			/// <summary>
+			/// The stream timeouts supplied to both acceptors' bridges.
+			/// </summary>
+			network::StreamTimeouts m_streamTimeouts;
+
 			/// <summary>
 			/// The certificate store that will be used for secure clients.
 			/// </summary>
@@ -206,6 +206,37 @@ namespace Te {
 			}
 		}
 
+		void Engine::AddTlsPassthroughHost(System::String^ host)
+		{
+			if (System::String::IsNullOrWhiteSpace(host))
+			{
+				System::Exception^ err = gcnew System::Exception(u8"In void Engine::AddTlsPassthroughHost(System::String^) - Provided host is either null or whitespace.");
+				throw err;
+			}
+
+			if (m_handle != nullptr)
+			{
+				auto hostStr = msclr::interop::marshal_as<std::string>(host);
+
+				fe_ctl_add_tls_passthrough_host(m_handle, hostStr.c_str(), hostStr.size());
+			}
+		}
+
+		void Engine::RemoveTlsPassthroughHost(System::String^ host)
+		{
+			if (System::String::IsNullOrWhiteSpace(host))
+			{
+				return;
+			}
+
+			if (m_handle != nullptr)
+			{
+				auto hostStr = msclr::interop::marshal_as<std::string>(host);
+
+				fe_ctl_remove_tls_passthrough_host(m_handle, hostStr.c_str(), hostStr.size());
+			}
+		}
+
 		bool Engine::IsOptionEnabled(uint32_t option)
 		{
 			if (m_handle != nullptr)
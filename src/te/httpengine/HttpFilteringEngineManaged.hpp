@@ -286,6 +286,23 @@ namespace Te {
 			/// </param>
 			void UnloadAllRulesForCategory(const uint8_t category);
 
+			/// <summary>
+			/// Adds a host whose TLS connections should be relayed untouched, rather than
+			/// intercepted and filtered. Subdomains of the host are passed through as well.
+			/// </summary>
+			/// <param name="host">
+			/// The host to pass through, without scheme, port or path.
+			/// </param>
+			void AddTlsPassthroughHost(System::String^ host);
+
+			/// <summary>
+			/// Removes a host previously added through AddTlsPassthroughHost.
+			/// </summary>
+			/// <param name="host">
+			/// The host to stop passing through.
+			/// </param>
+			void RemoveTlsPassthroughHost(System::String^ host);
+
 			/// <summary>
 			/// Checks if the specified option is enabled.
 			/// </summary>
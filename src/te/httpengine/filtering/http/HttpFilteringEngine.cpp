@@ -709,13 +709,17 @@ namespace te
 
 					
 
-					// Report numberOfHtmlElementsRemoved
-					if (collection.Size() > 0)
+					if (collection.Size() == 0)
 					{
-						std::string fullRequestString = hostStringRef.to_string();
-						fullRequestString += request->RequestURI();
-						ReportElementsBlocked(static_cast<uint32_t>(collection.Size()), fullRequestString);
-					}					
+						// Nothing to remove, so the payload stays exactly as it is. Returning
+						// nothing lets the caller pass it on untouched.
+						return std::string();
+					}
+
+					// Report numberOfHtmlElementsRemoved
+					std::string fullRequestString = hostStringRef.to_string();
+					fullRequestString += request->RequestURI();
+					ReportElementsBlocked(static_cast<uint32_t>(collection.Size()), fullRequestString);
 
 					// Now we can serialize the result, removing our final collection of nodes.
 					auto serialized = gq::Serializer::Serialize(doc.get(), &collection);
@@ -1151,6 +1155,145 @@ namespace te
 					return domainFromStorage;
 				}
 
+				const bool HttpFilteringEngine::ShouldFetchBlockedResponseSize() const
+				{
+					return m_programOptions->GetIsHttpFilteringOptionEnabled(options::http::HttpFilteringOption::FetchBlockedResponseSize);
+				}
+
+				const bool HttpFilteringEngine::ShouldMaximizeRecompression() const
+				{
+					return m_programOptions->GetIsHttpFilteringOptionEnabled(options::http::HttpFilteringOption::MaximizeRecompression);
+				}
+
+				const bool HttpFilteringEngine::HasHtmlFilters(const mhttp::HttpRequest* request)
+				{
+					if (request == nullptr)
+					{
+						return false;
+					}
+
+					boost::string_ref hostStringRef;
+
+					auto hostHeaders = request->GetHeader(util::http::headers::Host);
+
+					if (hostHeaders.first != hostHeaders.second)
+					{
+						hostStringRef = boost::string_ref(hostHeaders.first->second);
+					}
+
+					// Reader lock.
+					Reader r(m_filterLock);
+
+					const auto& globalIncludeSelectors = m_inclusionSelectors.find(m_globalRuleKey);
+
+					if (globalIncludeSelectors != m_inclusionSelectors.end())
+					{
+						for (const auto& selector : globalIncludeSelectors->second)
+						{
+							if (m_programOptions->GetIsHttpCategoryFiltered(selector->GetCategory()))
+							{
+								return true;
+							}
+						}
+					}
+
+					if (hostStringRef.size() > 0)
+					{
+						const auto& hostIncludeSelectors = m_inclusionSelectors.find(hostStringRef);
+
+						if (hostIncludeSelectors != m_inclusionSelectors.end())
+						{
+							for (const auto& selector : hostIncludeSelectors->second)
+							{
+								if (m_programOptions->GetIsHttpCategoryFiltered(selector->GetCategory()))
+								{
+									return true;
+								}
+							}
+						}
+					}
+
+					return false;
+				}
+
+				void HttpFilteringEngine::AddTlsPassthroughHost(const std::string& host)
+				{
+					std::string normalized = boost::algorithm::to_lower_copy(boost::algorithm::trim_copy(host));
+
+					if (normalized.size() > 0 && normalized.back() == '.')
+					{
+						normalized.pop_back();
+					}
+
+					if (normalized.size() == 0)
+					{
+						return;
+					}
+
+					Writer w(m_tlsPassthroughLock);
+
+					m_tlsPassthroughHosts.insert(std::move(normalized));
+				}
+
+				void HttpFilteringEngine::RemoveTlsPassthroughHost(const std::string& host)
+				{
+					std::string normalized = boost::algorithm::to_lower_copy(boost::algorithm::trim_copy(host));
+
+					if (normalized.size() > 0 && normalized.back() == '.')
+					{
+						normalized.pop_back();
+					}
+
+					Writer w(m_tlsPassthroughLock);
+
+					m_tlsPassthroughHosts.erase(normalized);
+				}
+
+				const bool HttpFilteringEngine::ShouldPassthroughTls(boost::string_ref host)
+				{
+					if (host.size() > 0 && host.back() == '.')
+					{
+						host.remove_suffix(1);
+					}
+
+					if (host.size() == 0)
+					{
+						return false;
+					}
+
+					std::string lowered = boost::algorithm::to_lower_copy(host.to_string());
+
+					Reader r(m_tlsPassthroughLock);
+
+					if (m_tlsPassthroughHosts.size() == 0)
+					{
+						return false;
+					}
+
+					// Try the host itself, then each parent domain in turn, so that an entry
+					// matches on whole labels only.
+					size_t labelStart = 0;
+
+					while (labelStart < lowered.size())
+					{
+						if (m_tlsPassthroughHosts.find(lowered.substr(labelStart)) != m_tlsPassthroughHosts.end())
+						{
+							return true;
+						}
+
+						auto nextDot = lowered.find('.', labelStart);
+
+						if (nextDot == std::string::npos)
+						{
+							break;
+						}
+
+						labelStart = nextDot + 1;
+					}
+
+					return false;
+				}
+
 				void HttpFilteringEngine::ReportRequestBlocked(const uint8_t category, const uint32_t payloadSizeBlocked, boost::string_ref fullRequest) const
 				{
 					if (m_onRequestBlocked)
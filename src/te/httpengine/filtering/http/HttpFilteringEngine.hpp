@@ -295,7 +295,8 @@ namespace te
 					/// the third-party library GQ.
 					/// 
 					/// Note that if the payload on the response side in fact not valid or supported
-					/// HTML data, this function will return an empty string. This function does not
+					/// HTML data, or if no selectors matched anything in it, so that the payload
+					/// would not be changed, this function will return an empty string. This function does not
 					/// modify any input at all, but rather attempts to return a result that the
 					/// user can use in a fashion that the engine is agnostic of. However, common
 					/// practice and intended purpose are to simply replace the response payload
@@ -308,12 +309,81 @@ namespace te
 					/// The response side of the transaction. Must not be nullptr.
 					/// </param>
 					/// <returns>
-					/// If valid, supported HTML was found in the response payload and it was
-					/// successfully parsed, a string containing the filtered HTML. Otherwise, an
-					/// empty string.
+					/// If valid, supported HTML was found in the response payload, it was
+					/// successfully parsed and at least one element was removed, a string
+					/// containing the filtered HTML. Otherwise, an empty string.
 					/// </returns>
 					std::string ProcessHtmlResponse(const mhttp::HttpRequest* request, const mhttp::HttpResponse* response);
 
+					/// <summary>
+					/// Checks whether there are any enabled CSS selectors that could apply to HTML
+					/// served for the host of the supplied request. When there are none, there is
+					/// no point in collecting and decompressing the response payload, so that it
+					/// can be passed through untouched instead.
+					/// </summary>
+					/// <param name="request">
+					/// The request side of the transaction. Must not be nullptr.
+					/// </param>
+					/// <returns>
+					/// True if ::ProcessHtmlResponse(...) could possibly change an HTML response to
+					/// the supplied request, false otherwise.
+					/// </returns>
+					const bool HasHtmlFilters(const mhttp::HttpRequest* request);
+
+					/// <summary>
+					/// Check to see if blocked requests should still be sent upstream, so that the
+					/// response headers can be used to report the exact size of the blocked
+					/// payload. See HttpFilteringOption::FetchBlockedResponseSize.
+					/// </summary>
+					/// <returns>
+					/// True if blocked requests should be sent upstream, false if they should be
+					/// answered immediately without any upstream contact.
+					/// </returns>
+					const bool ShouldFetchBlockedResponseSize() const;
+
+					/// <summary>
+					/// Check to see if filtered payloads should be compressed at the best level,
+					/// rather than the fast one, when compressed again for the client. See
+					/// HttpFilteringOption::MaximizeRecompression.
+					/// </summary>
+					/// <returns>
+					/// True if the best compression level should be used, false if the fast one
+					/// should be.
+					/// </returns>
+					const bool ShouldMaximizeRecompression() const;
+
+					/// <summary>
+					/// Adds a host to the set of hosts whose TLS connections are never intercepted.
+					/// The host matches itself and all of its subdomains, so adding "example.com"
+					/// covers "www.example.com" as well.
+					/// </summary>
+					/// <param name="host">
+					/// The host to pass through, without scheme, port or path.
+					/// </param>
+					void AddTlsPassthroughHost(const std::string& host);
+
+					/// <summary>
+					/// Removes a host previously added through ::AddTlsPassthroughHost(...).
+					/// </summary>
+					/// <param name="host">
+					/// The host to stop passing through.
+					/// </param>
+					void RemoveTlsPassthroughHost(const std::string& host);
+
+					/// <summary>
+					/// Checks whether TLS connections to the supplied host should be relayed as is,
+					/// without being intercepted, meaning that the host or one of its parent
+					/// domains was added through ::AddTlsPassthroughHost(...).
+					/// </summary>
+					/// <param name="host">
+					/// The host name taken from the SNI extension of the client hello.
+					/// </param>
+					/// <returns>
+					/// True if the connection should be passed through untouched, false if it
+					/// should be intercepted and filtered as usual.
+					/// </returns>
+					const bool ShouldPassthroughTls(boost::string_ref host);
+
 				private:
 
 					using SharedFilter = std::shared_ptr<AbpFilter>;
@@ -412,6 +482,18 @@ namespace te
 					/// </summary>
 					std::unordered_set<std::string> m_allKnownListDomains;
 
+					/// <summary>
+					/// Hosts whose TLS connections are passed through without interception. Stored
+					/// in lower case, without any trailing dot. See ::AddTlsPassthroughHost(...).
+					/// </summary>
+					std::unordered_set<std::string> m_tlsPassthroughHosts;
+
+					/// <summary>
+					/// Shared mutex guarding m_tlsPassthroughHosts. Kept apart from m_filterLock so
+					/// that loading lists never stalls new TLS connections.
+					/// </summary>
+					boost::shared_mutex m_tlsPassthroughLock;
+
 					/* Not used. Allow users to estimate.
 					/// <summary>
 					/// When we block a response that uses chunked encoding, it's impossible to
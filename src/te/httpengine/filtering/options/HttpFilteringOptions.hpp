@@ -52,6 +52,16 @@ namespace te
 					/// 
 					/// When making additions to this enum, values must not be explicitly assigned and
 					/// NUMBER_OF_ENTRIES must always be the final entry.
+					/// 
+					/// FetchBlockedResponseSize makes the proxy send blocked requests upstream anyway
+					/// and wait for the response headers, purely so that the exact size of the
+					/// blocked payload can be reported. When disabled, which is the default, blocked
+					/// requests are answered immediately by the proxy without any upstream contact,
+					/// and the blocked size is reported as zero.
+					/// 
+					/// MaximizeRecompression makes filtered payloads that are compressed again for
+					/// delivery to the client use the best compression level instead of the fast
+					/// one, trading extra processing time for smaller transfers.
 					/// </summary>
 					enum class HttpFilteringOption : uint32_t
 					{
@@ -59,6 +69,8 @@ namespace te
 						StripGpsCoordinates,
 						RemoveImageMetaData,
 						UseDeepContentAnalysis,
+						FetchBlockedResponseSize,
+						MaximizeRecompression,
 						NUMBER_OF_ENTRIES
 					};					
 
@@ -35,11 +35,19 @@
 #include <utility>
 #include <algorithm>
 #include <chrono>
+#include <ctime>
+#include <cstdlib>
+#include <climits>
 #include <boost/algorithm/string.hpp>
-#include <boost/iostreams/filtering_stream.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
-#include <boost/iostreams/filter/zlib.hpp>
-#include <boost/iostreams/copy.hpp>
+#include <boost/asio/buffer.hpp>
+#include <zlib.h>
+#ifdef HTTP_FILTERING_ENGINE_USE_BROTLI
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+#endif
+#ifdef HTTP_FILTERING_ENGINE_USE_ZSTD
+#include <zstd.h>
+#endif
 #include "BaseHttpTransaction.hpp"
 #include "../../../util/http/KnownHttpHeaders.hpp"
 #include <stdexcept>
@@ -66,6 +74,23 @@ namespace te
 
 				const boost::string_ref BaseHttpTransaction::ContentTypeJavascript = u8"javascript";
 
+				const std::array<boost::string_ref, BaseHttpTransaction::BlockResponseTypeCount> BaseHttpTransaction::BlockResponseHeads{ {
+					u8"HTTP/1.1 204 No Content\r\nCache-Control: no-store\r\nExpires: Thu, 01 Jan 1970 00:00:00 GMT\r\nDate: ",
+					u8"HTTP/1.1 200 OK\r\nContent-Type: image/gif\r\nContent-Length: 43\r\nCache-Control: no-store\r\nExpires: Thu, 01 Jan 1970 00:00:00 GMT\r\nDate: ",
+					u8"HTTP/1.1 200 OK\r\nContent-Type: application/javascript\r\nContent-Length: 0\r\nCache-Control: no-store\r\nExpires: Thu, 01 Jan 1970 00:00:00 GMT\r\nDate: ",
+					u8"HTTP/1.1 200 OK\r\nContent-Type: text/css\r\nContent-Length: 0\r\nCache-Control: no-store\r\nExpires: Thu, 01 Jan 1970 00:00:00 GMT\r\nDate: ",
+					u8"HTTP/1.1 403 Forbidden\r\nContent-Type: text/html; charset=utf-8\r\nContent-Length: 135\r\nCache-Control: no-store\r\nExpires: Thu, 01 Jan 1970 00:00:00 GMT\r\nDate: "
+				} };
+
+				const std::array<boost::string_ref, BaseHttpTransaction::BlockResponseTypeCount> BaseHttpTransaction::BlockResponseBodies{ {
+					boost::string_ref(),
+					// A 1x1 transparent GIF.
+					boost::string_ref("GIF89a\x01\x00\x01\x00\x80\x00\x00\x00\x00\x00\xFF\xFF\xFF\x21\xF9\x04\x01\x00\x00\x00\x00\x2C\x00\x00\x00\x00\x01\x00\x01\x00\x00\x02\x02\x44\x01\x00\x3B", 43),
+					boost::string_ref(),
+					boost::string_ref(),
+					u8"<!DOCTYPE html><html><head><meta charset=\"utf-8\"><title>Blocked</title></head><body><p>This content has been blocked.</p></body></html>"
+				} };
+
 				BaseHttpTransaction::BaseHttpTransaction() 
 					: 
 					m_headerBuffer(MaxPayloadResize)
@@ -82,10 +107,40 @@ namespace te
 
 				BaseHttpTransaction::~BaseHttpTransaction()
 				{
+					ReleasePayloadBudget();
+
+					if (m_bufferPool != nullptr)
+					{
+						m_bufferPool->CheckIn(std::move(m_transactionData));
+						m_bufferPool->CheckIn(std::move(m_streamWriteData));
+						m_bufferPool->CheckIn(std::move(m_decodedPayload));
+						m_bufferPool->CheckIn(std::move(m_encodedPayload));
+					}
+
 					if (m_httpParser != nullptr)
 					{
 						free(m_httpParser);
 					}
+
+					if (m_inflateStream != nullptr)
+					{
+						inflateEnd(m_inflateStream);
+						delete m_inflateStream;
+					}
+
+					#ifdef HTTP_FILTERING_ENGINE_USE_BROTLI
+					if (m_brotliDecoder != nullptr)
+					{
+						BrotliDecoderDestroyInstance(m_brotliDecoder);
+					}
+					#endif
+
+					#ifdef HTTP_FILTERING_ENGINE_USE_ZSTD
+					if (m_zstdDecoder != nullptr)
+					{
+						ZSTD_freeDStream(m_zstdDecoder);
+					}
+					#endif
 				}
 
 				const HttpProtocolVersion BaseHttpTransaction::GetHttpVersion() const
@@ -185,12 +240,32 @@ namespace te
 					{
 						std::string hdrString{ (std::istreambuf_iterator<char>(&m_headerBuffer)), std::istreambuf_iterator<char>() };
 
+						m_headerBufferPrimed = false;
+
 						auto bytesToParse = hdrString.size();
 
+						// Any body data that bled over into the header buffer is copied out to the start
+						// of the payload vector below, so positions reported to ::OnBody(...) are mapped
+						// relative to the end of the headers.
+						m_parseBase = hdrString.c_str() + bytesReceived;
+
 						// The parser must ALWAYS be called first. The OnMessageBegin callback will reset the state
 						// of this object, clearing everything excluding the payload data.
 						auto nparsed = http_parser_execute(m_httpParser, &m_httpParserSettings, hdrString.c_str(), bytesToParse);
 
+						m_parseBase = nullptr;
+
+						if (HTTP_PARSER_ERRNO(m_httpParser) == HPE_PAUSED)
+						{
+							// The message ended before the data we read did. Whatever follows belongs to
+							// the next, pipelined message. See ::OnMessageComplete(...).
+							http_parser_pause(m_httpParser, 0);
+
+							m_pipelinedData.assign(hdrString.begin() + nparsed, hdrString.end());
+
+							bytesToParse = nparsed;
+						}
+
 						if (nparsed != bytesToParse)
 						{
 							if (m_httpParser->http_errno != 0)
@@ -217,18 +292,55 @@ namespace te
 							// Payload should be empty, so let's ensure it is.
 							m_transactionData.clear();
 
-							m_transactionData.assign(hdrString.begin() + bytesReceived, hdrString.end());
+							m_transactionData.assign(hdrString.begin() + bytesReceived, hdrString.begin() + bytesToParse);
 						}
 
 						success = true;
 					}
 					else 
 					{
+						const bool decodingChunks = m_payloadChunked && m_consumeAllBeforeSending;
+
+						m_parseBase = m_transactionData.data();
+						m_chunkDecodeOffset = m_unwrittenPayloadSize;
+
 						auto nparsed = http_parser_execute(m_httpParser, &m_httpParserSettings, m_transactionData.data() + m_unwrittenPayloadSize, bytesReceived);
 
-						unwrittenBytesCopy += bytesReceived;
+						m_parseBase = nullptr;
+
+						auto bytesToKeep = bytesReceived;
+
+						if (HTTP_PARSER_ERRNO(m_httpParser) == HPE_PAUSED)
+						{
+							// The message ended before the data we read did. Whatever follows belongs to
+							// the next, pipelined message. See ::OnMessageComplete(...).
+							http_parser_pause(m_httpParser, 0);
+
+							auto pipelinedStart = m_transactionData.begin() + m_unwrittenPayloadSize + nparsed;
+							m_pipelinedData.assign(pipelinedStart, pipelinedStart + (bytesReceived - nparsed));
+
+							bytesToKeep = nparsed;
+						}
+
+						if (!m_consumeAllBeforeSending && bytesReceived >= m_transactionData.size() && m_streamReadSize < PayloadBufferReadSize)
+						{
+							// The read filled the whole buffer, so this looks like a bulk transfer. Read
+							// the rest of it in bigger pieces.
+							m_streamReadSize *= 2;
+						}
+
+						if (decodingChunks)
+						{
+							// ::OnBody(...) has already moved the chunk data down over the chunk
+							// framing, so only the decoded bytes count as payload.
+							unwrittenBytesCopy = m_chunkDecodeOffset;
+						}
+						else
+						{
+							unwrittenBytesCopy += bytesToKeep;
+						}
 
-						if (nparsed != bytesReceived)
+						if (nparsed != bytesToKeep)
 						{
 							if (m_httpParser->http_errno != 0)
 							{
@@ -242,106 +354,27 @@ namespace te
 								ReportWarning(u8"In BaseHttpTransaction::Parse(const size_t&) - While parsing payload, not all bytes were parsed, but http_parser reports no error. This may be a sign that the parsing calculation is incorrect.");
 							}							
 						}
+
+						success = true;
 					}
 
 					// Now that the parser has run, we can set our member which holds the number of bytes
 					// ready to be written back.
 					m_unwrittenPayloadSize = unwrittenBytesCopy;
 
+					// Compressed payloads being consumed are decoded as each piece arrives, rather
+					// than all at once after the final read.
+					if (success && m_decodeCoding != ContentCoding::Identity && m_unwrittenPayloadSize > 0)
+					{
+						success = DecodeBufferedPayload();
+					}
+
 					// If the body is complete, then we need to provide some things which are guaranteed, such as
 					// automatic decompression when ::ConsumeAllBeforeSending() is true, and automatic conversion
 					// of chunked transfers to fixed-length/precalculated (content-length header defined) transfers.
-					if (m_payloadComplete && m_consumeAllBeforeSending)
-					{
-						bool finalizationFailed = false;
-
-						const auto transferEncoding = GetHeader(util::http::headers::TransferEncoding);
-						
-						if (transferEncoding.first != transferEncoding.second)
-						{
-							RemoveHeader(util::http::headers::TransferEncoding);
-							
-							if (!ConvertPayloadFromChunkedToFixedLength())
-							{
-								// No need to generate messages here, the method itself will do so.
-								finalizationFailed = true;
-							}
-						}
-
-						const auto contentEncoding = GetHeader(util::http::headers::ContentEncoding);
-
-						if (finalizationFailed == false && contentEncoding.first != contentEncoding.second)
-						{
-							if (boost::iequals(contentEncoding.first->second, u8"gzip"))
-							{
-								if (!DecompressGzip())
-								{
-									// We will report an error, but will not abort further operations, since even if this fails,
-									// the transaction can theoretically be simply passed on to the client. 
-									finalizationFailed = true;
-									ReportError("In BaseHttpTransaction::Parse(const size_t&) - Failed to decompress Gzip encoded payload!");
-								}
-								else
-								{
-									RemoveHeader(util::http::headers::ContentEncoding);
-								}
-							}
-							else if(boost::iequals(contentEncoding.first->second, u8"deflate"))
-							{
-								if (!DecompressDeflate())
-								{
-									// We will report an error, but will not abort further operations, since even if this fails,
-									// the transaction can theoretically be simply passed on to the client. 
-									finalizationFailed = true;
-									ReportError("In BaseHttpTransaction::Parse(const size_t&) - Failed to decompress Deflate encoded payload!");
-								}
-								else
-								{
-									RemoveHeader(util::http::headers::ContentEncoding);
-								}
-							}
-							else
-							{
-								finalizationFailed = true;
-								ReportError("In BaseHttpTransaction::Parse(const size_t&) - Unknown Content-Encoding, cannot decompress: " + contentEncoding.first->second);
-							}							
-						}
-
-						success = !finalizationFailed;
-
-						// Ensure that the terminating CRLF's are present and that they are not factored
-						// into Content-Length calculation.
-
-						if (success)
-						{
-							if (
-								m_transactionData.size() >= 4 &&
-								m_transactionData[m_transactionData.size() - 4] == '\r' &&
-								m_transactionData[m_transactionData.size() - 3] == '\n' &&
-								m_transactionData[m_transactionData.size() - 2] == '\r' &&
-								m_transactionData[m_transactionData.size() - 1] == '\n'
-								)
-							{
-								AddHeader(util::http::headers::ContentLength, std::to_string(m_transactionData.size() - 4), true);
-							}
-							else {
-
-								AddHeader(util::http::headers::ContentLength, std::to_string(m_transactionData.size()), true);
-
-								m_transactionData.push_back('\r');
-								m_transactionData.push_back('\n');
-								m_transactionData.push_back('\r');
-								m_transactionData.push_back('\n');
-							}
-
-							// Reset the size, in case pushing terminating CRLF's adjusted it. Must be done, otherwise
-							// we'll ruin keep-alive.
-							m_unwrittenPayloadSize = m_transactionData.size();
-						}						
-					}
-					else
+					if (success && m_payloadComplete && m_consumeAllBeforeSending)
 					{
-						success = true;
+						success = FinalizePayload();
 					}
 
 					return success;
@@ -349,7 +382,7 @@ namespace te
 
 				boost::asio::streambuf& BaseHttpTransaction::GetHeaderReadBuffer()
 				{
-					if (m_headerBuffer.size() > 0)
+					if (m_headerBuffer.size() > 0 && !m_headerBufferPrimed)
 					{
 						// Ensure all data already in the buffer is cleared before initiating
 						// a new read.
@@ -377,9 +410,18 @@ namespace te
 					// First thing we want to do is resize the buffer, if it needs to be resized. Warning, incoming
 					// hardcoded values. In my testing, 131072 gives a nice balance for keeping allocations to a 
 					// minimum, since most content that we're concerned about keeping should come in well under that.
-					if (m_transactionData.size() < PayloadBufferReadSize)
+					// Streamed payloads don't keep anything though, so with a buffer pool they start out much
+					// smaller, and only grow for bulk transfers. See ::Parse(...).
+					size_t readSize = PayloadBufferReadSize;
+
+					if (m_consumeAllBeforeSending == false && m_bufferPool != nullptr)
+					{
+						readSize = m_streamReadSize;
+					}
+
+					if (m_transactionData.size() < readSize)
 					{
-						m_transactionData.resize(PayloadBufferReadSize);
+						GrowReadBuffer(readSize);
 					}
 
 					if (m_consumeAllBeforeSending == false)
@@ -388,6 +430,7 @@ namespace te
 						// will be overwritten, and in the ::Parse(...) method, m_unwrittenPayloadSize will be
 						// adjusted to reflect the length of the accurate data.
 						m_unwrittenPayloadSize = 0;
+						m_rawChunkSpans.clear();
 						return boost::asio::mutable_buffers_1(m_transactionData.data(), m_transactionData.size());
 					}
 
@@ -407,6 +450,8 @@ namespace te
 							{
 								freeSpace = (PayloadBufferReadSize - freeSpace);
 								m_transactionData.resize(m_transactionData.size() + freeSpace);
+
+								ChargePayloadBudget();
 							}
 						}
 						else
@@ -418,31 +463,61 @@ namespace te
 					return boost::asio::mutable_buffers_1(m_transactionData.data() + m_unwrittenPayloadSize, PayloadBufferReadSize);
 				}
 
-				boost::asio::const_buffers_1 BaseHttpTransaction::GetWriteBuffer()
+				BaseHttpTransaction::WriteBufferSequence BaseHttpTransaction::GetWriteBuffer()
 				{
-					if (!m_headersSent)
+					const bool streamed = !m_consumeAllBeforeSending && !m_blockResponsePrepared && m_unwrittenPayloadSize > 0;
+
+					if (streamed)
 					{
-						auto headersVector = HeadersToVector();				
+						// Streamed payload. Hand out the data from the spare buffer instead, so the
+						// next read can land in m_transactionData while this write is in flight.
+						// After the first swap, both buffers are already allocated, so this costs
+						// nothing but the exchange of two pointers.
+						m_transactionData.swap(m_streamWriteData);
+					}
 
-						headersVector.reserve(headersVector.capacity() + m_transactionData.size());
+					const auto& payload = streamed ? m_streamWriteData : m_transactionData;
 
-						headersVector.insert(headersVector.end(), std::make_move_iterator(m_transactionData.begin()), std::make_move_iterator(m_transactionData.begin() + m_unwrittenPayloadSize));
+					WriteBufferSequence buffers{ { 
+						boost::asio::const_buffer(), 
+						boost::asio::const_buffer(), 
+						boost::asio::const_buffer(payload.data(), m_unwrittenPayloadSize) 
+					} };
 
-						m_transactionData = std::move(headersVector);
+					if (!m_headersSent && m_blockResponsePrepared)
+					{
+						// Prebuilt head, then the cached date to finish off the headers, then the
+						// prebuilt body. Nothing but the date is written anywhere.
+						const auto typeIndex = static_cast<size_t>(m_blockResponseType);
+						const auto& head = BlockResponseHeads[typeIndex];
+						const auto& body = BlockResponseBodies[typeIndex];
+
+						auto date = GetCachedHttpDate();
+						m_headerScratch.assign(date.data(), date.size());
+						m_headerScratch.append(u8"\r\n\r\n");
 
-						m_unwrittenPayloadSize = m_transactionData.size();
+						buffers[0] = boost::asio::const_buffer(head.data(), head.size());
+						buffers[1] = boost::asio::const_buffer(m_headerScratch.data(), m_headerScratch.size());
+						buffers[2] = boost::asio::const_buffer(body.data(), body.size());
 
 						m_headersSent = true;
 					}
+					else if (!m_headersSent)
+					{
+						HeadersToBuffer(m_headerScratch);
+
+						buffers[1] = boost::asio::const_buffer(m_headerScratch.data(), m_headerScratch.size());
 
-					size_t bytesToWrite = m_unwrittenPayloadSize;					
+						m_headersSent = true;
+					}
 
 					// When you've called for a write, you've called for a write. Everything is
 					// turned into a finalized state, the state information that was used for
 					// keeping track of things like partial reads etc is all gone.
 					m_unwrittenPayloadSize = 0;
+					m_rawChunkSpans.clear();
 
-					return boost::asio::const_buffers_1(m_transactionData.data(), bytesToWrite);
+					return buffers;
 				}
 
 				const std::vector<char>& BaseHttpTransaction::GetPayload() const
@@ -450,12 +525,20 @@ namespace te
 					return m_transactionData;
 				}
 
+				const size_t BaseHttpTransaction::GetPayloadSize() const
+				{
+					return m_unwrittenPayloadSize;
+				}
+
 				void BaseHttpTransaction::SetPayload(std::vector<char>&& payload)
 				{
 					// XXX TODO - Cleanup this code duplication.
 
 					m_transactionData = std::move(payload);					
 					m_payloadComplete = true;
+
+					// The original compressed payload no longer matches.
+					m_decodedContentEncoding.clear();
 										
 					RemoveHeader(util::http::headers::ContentLength);
 					RemoveHeader(util::http::headers::TransferEncoding);
@@ -498,6 +581,9 @@ namespace te
 					
 					m_payloadComplete = true;
 
+					// The original compressed payload no longer matches.
+					m_decodedContentEncoding.clear();
+
 					RemoveHeader(util::http::headers::ContentLength);
 					RemoveHeader(util::http::headers::TransferEncoding);
 					RemoveHeader(util::http::headers::ContentEncoding);
@@ -532,11 +618,86 @@ namespace te
 					m_unwrittenPayloadSize = m_transactionData.size();
 				}
 
+				void BaseHttpTransaction::SetPayloadMemoryBudget(PayloadMemoryBudget* budget)
+				{
+					ReleasePayloadBudget();
+
+					m_payloadBudget = budget;
+				}
+
+				void BaseHttpTransaction::SetIoBufferPool(IoBufferPool* pool)
+				{
+					m_bufferPool = pool;
+				}
+
+				void BaseHttpTransaction::GrowReadBuffer(const size_t size)
+				{
+					if (m_bufferPool == nullptr)
+					{
+						m_transactionData.resize(size);
+						return;
+					}
+
+					std::vector<char> buffer = m_bufferPool->CheckOut(size);
+
+					if (m_unwrittenPayloadSize > 0)
+					{
+						std::memcpy(buffer.data(), m_transactionData.data(), m_unwrittenPayloadSize);
+					}
+
+					m_bufferPool->CheckIn(std::move(m_transactionData));
+
+					m_transactionData = std::move(buffer);
+				}
+
+				void BaseHttpTransaction::ChargePayloadBudget()
+				{
+					if (m_payloadBudget == nullptr || !m_consumeAllBeforeSending)
+					{
+						return;
+					}
+
+					const uint64_t buffered = m_transactionData.size() + m_decodedPayload.size() + m_encodedPayload.size();
+
+					if (buffered > m_payloadBudgetReserved)
+					{
+						m_payloadBudget->ForceReserve(buffered - m_payloadBudgetReserved);
+						m_payloadBudgetReserved = buffered;
+					}
+				}
+
+				void BaseHttpTransaction::ReleasePayloadBudget()
+				{
+					if (m_payloadBudget != nullptr && m_payloadBudgetReserved > 0)
+					{
+						m_payloadBudget->Release(m_payloadBudgetReserved);
+					}
+
+					m_payloadBudgetReserved = 0;
+				}
+
 				const bool BaseHttpTransaction::IsPayloadComplete() const
 				{
 					return m_payloadComplete;
 				}
 
+				const uint64_t BaseHttpTransaction::GetUnreadPayloadSize() const
+				{
+					// http_parser counts content_length down as the body is parsed, and leaves it
+					// at ULLONG_MAX when there is no Content-Length to count down from.
+					if (m_payloadComplete || m_payloadChunked || !m_headersComplete || m_httpParser->content_length == ULLONG_MAX)
+					{
+						return 0;
+					}
+
+					return m_httpParser->content_length;
+				}
+
+				void BaseHttpTransaction::SetPayloadRelayed()
+				{
+					m_payloadComplete = true;
+				}
+
 				const uint8_t BaseHttpTransaction::GetShouldBlock() const
 				{
 					return m_shouldBlock;
@@ -554,49 +715,95 @@ namespace te
 
 				void BaseHttpTransaction::Make204()
 				{
-					std::stringstream os;
+					MakeBlockResponse(BlockResponseType::NoContent);
+				}
+
+				void BaseHttpTransaction::MakeBlockResponse(const BlockResponseType type)
+				{
+					m_blockResponsePrepared = true;
+					m_blockResponseType = type;
+
+					m_transactionData.clear();
+					m_unwrittenPayloadSize = 0;
+					m_rawChunkSpans.clear();
+
+					m_headersSent = false;
+					m_headersComplete = true;
+					m_payloadComplete = true;
+				}
+
+				const boost::string_ref BaseHttpTransaction::GetCachedHttpDate()
+				{
+					thread_local std::time_t cachedSecond = 0;
+					thread_local char cachedDate[64] = { 0 };
+					thread_local size_t cachedDateLength = 0;
 
-					os << u8"HTTP/"; 
+					std::time_t now = std::time(nullptr);
 
-					switch (m_httpVersion)
+					if (now != cachedSecond || cachedDateLength == 0)
 					{
+						std::tm utc;
 
-					case HttpProtocolVersion::HTTP1:
-						os << u8"1.0";
-						break;
-					case HttpProtocolVersion::HTTP1_1:
-						os << u8"1.1";
-						break;
-					case HttpProtocolVersion::HTTP2:
-						os << u8"2.0";
-						break;
+						#ifdef _MSC_VER
+						gmtime_s(&utc, &now);
+						#else
+						gmtime_r(&now, &utc);
+						#endif
 
-						default:
-							os << u8"1.1";
+						cachedDateLength = std::strftime(cachedDate, sizeof(cachedDate), u8"%a, %d %b %Y %H:%M:%S GMT", &utc);
+						cachedSecond = now;
 					}
 
-					os << u8" 204 No Content\r\nDate: ";
+					return boost::string_ref(cachedDate, cachedDateLength);
+				}
 
-					std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
-					std::time_t now_t = std::chrono::system_clock::to_time_t(now);
-					os << std::ctime(&now_t);
-					os << u8"\r\nExpires: ";
-					std::chrono::system_clock::time_point epoch;
-					std::time_t epoch_t = std::chrono::system_clock::to_time_t(epoch);
-					os << std::ctime(&epoch_t);
-					os << u8"\r\nContent-Length: 0\r\n\r\n";
+				const bool BaseHttpTransaction::HasPipelinedData() const
+				{
+					return m_pipelinedData.size() > 0;
+				}
 
-					std::string fs = os.str();
+				void BaseHttpTransaction::MovePipelinedDataTo(BaseHttpTransaction& next)
+				{
+					if (m_pipelinedData.size() == 0)
+					{
+						return;
+					}
 
-					m_transactionData.clear();
+					auto headerBuffers = next.m_headerBuffer.prepare(m_pipelinedData.size());
+					auto copied = boost::asio::buffer_copy(headerBuffers, boost::asio::buffer(m_pipelinedData));
+					next.m_headerBuffer.commit(copied);
+					next.m_headerBufferPrimed = true;
 
-					m_transactionData.assign(fs.begin(), fs.end());
+					m_pipelinedData.clear();
+				}
 
-					m_unwrittenPayloadSize = m_transactionData.size();
+				const size_t BaseHttpTransaction::GetBufferedHeaderLength() const
+				{
+					const boost::string_ref terminator = u8"\r\n\r\n";
 
-					m_headersSent = true;
-					m_headersComplete = true;
-					m_payloadComplete = true;
+					auto begin = boost::asio::buffers_begin(m_headerBuffer.data());
+					auto end = boost::asio::buffers_end(m_headerBuffer.data());
+
+					auto found = std::search(begin, end, terminator.begin(), terminator.end());
+
+					if (found == end)
+					{
+						return 0;
+					}
+
+					return static_cast<size_t>(std::distance(begin, found)) + terminator.size();
+				}
+
+				const bool BaseHttpTransaction::IsUpgrade() const
+				{
+					return m_upgrade;
+				}
+
+				std::vector<char> BaseHttpTransaction::ReleasePipelinedData()
+				{
+					std::vector<char> released = std::move(m_pipelinedData);
+					m_pipelinedData.clear();
+					return released;
 				}
 
 				const bool BaseHttpTransaction::GetConsumeAllBeforeSending() const
@@ -606,7 +813,86 @@ namespace te
 
 				void BaseHttpTransaction::SetConsumeAllBeforeSending(const bool value)
 				{
+					if (value == m_consumeAllBeforeSending)
+					{
+						return;
+					}
+
+					if (!value)
+					{
+						m_consumeAllBeforeSending = false;
+						ReleasePayloadBudget();
+						return;
+					}
+
+					if (m_payloadBudget != nullptr)
+					{
+						// Reserve what the whole payload is expected to need up front, since once
+						// buffering starts there's no going back to streaming.
+						uint64_t expected = m_unwrittenPayloadSize + GetUnreadPayloadSize();
+
+						if (expected < PayloadBufferReadSize)
+						{
+							expected = PayloadBufferReadSize;
+						}
+
+						if (expected > MaxPayloadResize)
+						{
+							expected = MaxPayloadResize;
+						}
+
+						if (expected < m_transactionData.size())
+						{
+							expected = m_transactionData.size();
+						}
+
+						if (expected > m_payloadBudgetReserved)
+						{
+							if (!m_payloadBudget->TryReserve(expected - m_payloadBudgetReserved))
+							{
+								ReportWarning(u8"In BaseHttpTransaction::SetConsumeAllBeforeSending(const bool) - Payload memory budget exhausted, streaming payload instead.");
+								return;
+							}
+
+							m_payloadBudgetReserved = expected;
+						}
+					}
+
+					if (value && m_payloadChunked)
+					{
+						// Any chunked data parsed before now was left in its raw form. Collapse it down
+						// over its own framing, after which ::OnBody(...) keeps decoding as data arrives.
+						size_t decodedSize = 0;
+
+						for (const auto& span : m_rawChunkSpans)
+						{
+							if (span.first != decodedSize)
+							{
+								std::memmove(m_transactionData.data() + decodedSize, m_transactionData.data() + span.first, span.second);
+							}
+
+							decodedSize += span.second;
+						}
+
+						m_rawChunkSpans.clear();
+						m_unwrittenPayloadSize = decodedSize;
+					}
+
 					m_consumeAllBeforeSending = value;
+
+					if (value && BeginDecode() && m_unwrittenPayloadSize > 0)
+					{
+						// Catch up on whatever compressed data has already been read. Failure is
+						// reported, and will be reported again by ::FinalizePayload().
+						DecodeBufferedPayload();
+					}
+
+					if (value && m_payloadComplete && m_shouldBlock == 0)
+					{
+						// The entire payload came in along with the headers, so there will be no further
+						// call to ::Parse(...) to provide our guarantees. Do it now.
+						FinalizePayload();
+					}
 				}
 
 				const bool BaseHttpTransaction::IsPayloadCompressed() const
@@ -706,311 +992,888 @@ namespace te
 
 				const bool BaseHttpTransaction::CompressGzip()
 				{
-					if (m_transactionData.size() == 0)
+					if (m_unwrittenPayloadSize == 0)
 					{
-						ReportError(u8"In BaseBridge::CompressDeflate() - There is no payload to compress.");
+						ReportError(u8"In BaseHttpTransaction::CompressGzip() - There is no payload to compress.");
 						return false;
 					}
 
-					std::vector<char> compressed;
-
-					try
-					{
-						boost::iostreams::filtering_ostream os;
-
-						os.push(boost::iostreams::gzip_compressor());
-						os.push(boost::iostreams::back_inserter(compressed));
+					return CompressPayload(ContentCoding::Gzip, CompressionLevel::Default);
+				}
 
-						boost::iostreams::write(os, m_transactionData.data(), m_unwrittenPayloadSize);
-					}
-					catch (std::exception &e)
+				const bool BaseHttpTransaction::CompressDeflate()
+				{
+					if (m_unwrittenPayloadSize == 0)
 					{
-						std::string errMessage("In BaseBridge::CompressGzip() - Exception while compressing: ");
-						errMessage.append(e.what());
-						ReportError(errMessage);
+						ReportError(u8"In BaseHttpTransaction::CompressDeflate() - There is no payload to compress.");
 						return false;
 					}
 
-					if (m_transactionData.size() > compressed.size())
+					return CompressPayload(ContentCoding::Deflate, CompressionLevel::Default);
+				}
+
+				const bool BaseHttpTransaction::CompressBrotli()
+				{
+					if (m_unwrittenPayloadSize == 0)
 					{
-						m_transactionData = std::move(compressed);
-						std::string gzip(u8"gzip");
-						AddHeader(util::http::headers::ContentEncoding, gzip);
-						return true;
-					}
-					else {
+						ReportError(u8"In BaseHttpTransaction::CompressBrotli() - There is no payload to compress.");
 						return false;
 					}
+
+					return CompressPayload(ContentCoding::Brotli, CompressionLevel::Default);
 				}
 
-				const bool BaseHttpTransaction::CompressDeflate()
+				const bool BaseHttpTransaction::CompressZstd()
 				{
-					if (m_transactionData.size() == 0)
+					if (m_unwrittenPayloadSize == 0)
 					{
-						ReportError(u8"In BaseBridge::CompressDeflate() - There is no payload to compress.");
+						ReportError(u8"In BaseHttpTransaction::CompressZstd() - There is no payload to compress.");
 						return false;
 					}
 
-					std::vector<char> compressed;
+					return CompressPayload(ContentCoding::Zstd, CompressionLevel::Default);
+				}
 
-					try
+				const bool BaseHttpTransaction::Compress(const ContentCoding coding, const CompressionLevel level)
+				{
+					if (m_unwrittenPayloadSize == 0)
 					{
-						boost::iostreams::filtering_ostream os;
+						ReportError(u8"In BaseHttpTransaction::Compress(const ContentCoding, const CompressionLevel) - There is no payload to compress.");
+						return false;
+					}
 
-						os.push(boost::iostreams::zlib_compressor());
-						os.push(boost::iostreams::back_inserter(compressed));
+					return CompressPayload(coding, level);
+				}
 
-						boost::iostreams::write(os, m_transactionData.data(), m_unwrittenPayloadSize);
-					}
-					catch (std::exception &e)
+				const bool BaseHttpTransaction::RestoreEncodedPayload()
+				{
+					if (!m_payloadComplete || m_decodedContentEncoding.empty())
 					{
-						std::string errMessage("In BaseBridge::CompressDeflate() - Exception while compressing: ");
-						errMessage.append(e.what());
-						ReportError(errMessage);
 						return false;
 					}
 
-					if (m_transactionData.size() > compressed.size())
-					{
-						m_transactionData = std::move(compressed);
-						std::string deflate(u8"deflate");
-						AddHeader(util::http::headers::ContentEncoding, deflate);
-						return true;
-					}
-					else {
-						return false;
-					}
+					// The decoded payload becomes the spare buffer for the next message.
+					m_transactionData.swap(m_encodedPayload);
+					m_encodedPayload.clear();
+
+					AddHeader(util::http::headers::ContentLength, std::to_string(m_transactionData.size()), true);
+					AddHeader(util::http::headers::ContentEncoding, m_decodedContentEncoding, true);
+
+					m_transactionData.push_back('\r');
+					m_transactionData.push_back('\n');
+					m_transactionData.push_back('\r');
+					m_transactionData.push_back('\n');
+
+					m_unwrittenPayloadSize = m_transactionData.size();
+
+					m_decodedContentEncoding.clear();
+
+					return true;
 				}
 
-				const bool BaseHttpTransaction::DecompressGzip()
+				const ContentCoding BaseHttpTransaction::SelectContentCoding(const boost::string_ref acceptEncoding)
 				{
-					if (m_transactionData.size() == 0)
+					// Codings we can produce, in order of preference. Used to break ties between
+					// codings the peer gave equal quality values.
+					const std::array<ContentCoding, 4> preferred{ {
+						ContentCoding::Brotli,
+						ContentCoding::Zstd,
+						ContentCoding::Gzip,
+						ContentCoding::Deflate
+					} };
+
+					// Quality value per coding, indexed by ContentCoding. Negative when the peer
+					// did not mention the coding.
+					std::array<double, 5> qualities;
+					qualities.fill(-1.0);
+
+					double wildcardQuality = -1.0;
+
+					auto remaining = acceptEncoding;
+
+					while (!remaining.empty())
 					{
-						ReportError(u8"In BaseBridge::DecompressGzip() - There is no payload to decompress.");
-						return false;
+						const auto itemEnd = remaining.find(',');
+						const auto item = remaining.substr(0, itemEnd);
+						remaining = itemEnd == boost::string_ref::npos ? boost::string_ref() : remaining.substr(itemEnd + 1);
+
+						const auto paramStart = item.find(';');
+
+						std::string name = item.substr(0, paramStart).to_string();
+						boost::trim(name);
+
+						double quality = 1.0;
+
+						if (paramStart != boost::string_ref::npos)
+						{
+							std::string params = item.substr(paramStart + 1).to_string();
+							boost::trim(params);
+
+							if (params.size() > 2 && (params[0] == 'q' || params[0] == 'Q') && params[1] == '=')
+							{
+								quality = std::strtod(params.c_str() + 2, nullptr);
+							}
+						}
+
+						ContentCoding coding = ContentCoding::Identity;
+
+						if (name == u8"*")
+						{
+							wildcardQuality = quality;
+							continue;
+						}
+						else if (boost::iequals(name, u8"gzip") || boost::iequals(name, u8"x-gzip"))
+						{
+							coding = ContentCoding::Gzip;
+						}
+						else if (boost::iequals(name, u8"deflate"))
+						{
+							coding = ContentCoding::Deflate;
+						}
+						#ifdef HTTP_FILTERING_ENGINE_USE_BROTLI
+						else if (boost::iequals(name, u8"br"))
+						{
+							coding = ContentCoding::Brotli;
+						}
+						#endif
+						#ifdef HTTP_FILTERING_ENGINE_USE_ZSTD
+						else if (boost::iequals(name, u8"zstd"))
+						{
+							coding = ContentCoding::Zstd;
+						}
+						#endif
+
+						if (coding != ContentCoding::Identity)
+						{
+							qualities[static_cast<size_t>(coding)] = quality;
+						}
 					}
 
-					// Must trim off unusued allocated space.
-					if (m_transactionData.size() > m_unwrittenPayloadSize)
+					ContentCoding selected = ContentCoding::Identity;
+					double selectedQuality = 0.0;
+
+					for (const auto coding : preferred)
 					{
-						m_transactionData.resize(m_unwrittenPayloadSize);
+						auto quality = qualities[static_cast<size_t>(coding)];
+
+						if (quality < 0.0)
+						{
+							#ifndef HTTP_FILTERING_ENGINE_USE_BROTLI
+							if (coding == ContentCoding::Brotli)
+							{
+								continue;
+							}
+							#endif
+							#ifndef HTTP_FILTERING_ENGINE_USE_ZSTD
+							if (coding == ContentCoding::Zstd)
+							{
+								continue;
+							}
+							#endif
+
+							// Not named, so covered by the wildcard if there is one.
+							quality = wildcardQuality;
+						}
+
+						// Strictly greater, so that earlier, preferred codings win ties. A quality
+						// of zero means not acceptable.
+						if (quality > selectedQuality)
+						{
+							selected = coding;
+							selectedQuality = quality;
+						}
 					}
 
-					// If the terminating CRLF's on the payload are left, they'll screw with
-					// decompression. They need to be trimmed first.
+					return selected;
+				}
+
+				const boost::string_ref BaseHttpTransaction::GetSupportedContentCodings()
+				{
+					// Only codings we can decode may be advertised upstream, since anything the
+					// upstream server sends back has to be decompressed for filtering.
+					#if defined(HTTP_FILTERING_ENGINE_USE_BROTLI) && defined(HTTP_FILTERING_ENGINE_USE_ZSTD)
+					return boost::string_ref(u8"br, zstd, gzip, deflate");
+					#elif defined(HTTP_FILTERING_ENGINE_USE_BROTLI)
+					return boost::string_ref(u8"br, gzip, deflate");
+					#elif defined(HTTP_FILTERING_ENGINE_USE_ZSTD)
+					return boost::string_ref(u8"zstd, gzip, deflate");
+					#else
+					return boost::string_ref(u8"gzip, deflate");
+					#endif
+				}
+
+				const bool BaseHttpTransaction::CompressPayload(const ContentCoding coding, const CompressionLevel level)
+				{
+					// The terminating CRLF's are not part of the payload and must not be compressed
+					// along with it.
+					size_t payloadSize = m_unwrittenPayloadSize;
+
 					if (
-						m_transactionData.at(m_transactionData.size() - 4) == '\r' &&
-						m_transactionData.at(m_transactionData.size() - 3) == '\n' &&
-						m_transactionData.at(m_transactionData.size() - 2) == '\r' &&
-						m_transactionData.at(m_transactionData.size() - 1) == '\n'
+						payloadSize >= 4 &&
+						m_transactionData[payloadSize - 4] == '\r' &&
+						m_transactionData[payloadSize - 3] == '\n' &&
+						m_transactionData[payloadSize - 2] == '\r' &&
+						m_transactionData[payloadSize - 1] == '\n'
 						)
 					{
-						m_transactionData.resize(m_transactionData.size() - 4);
+						payloadSize -= 4;
 					}
 
-					std::vector<char> decompressed;
+					// Each encoder is given the worst case output size for the input, so that the
+					// whole payload can be compressed in a single call, straight into the spare
+					// buffer.
+					size_t compressedSize = 0;
+					std::string codingName;
 
-					try
+					switch (coding)
 					{
-						boost::iostreams::filtering_streambuf<boost::iostreams::input> in;
+						case ContentCoding::Gzip:
+						case ContentCoding::Deflate:
+						{
+							const bool gzip = coding == ContentCoding::Gzip;
+
+							int zlibLevel = Z_DEFAULT_COMPRESSION;
+
+							switch (level)
+							{
+								case CompressionLevel::Fast:
+									zlibLevel = Z_BEST_SPEED;
+								break;
+
+								case CompressionLevel::Best:
+									zlibLevel = Z_BEST_COMPRESSION;
+								break;
+
+								default:
+								break;
+							}
+
+							auto stream = GetThreadDeflateStream(gzip, zlibLevel);
+
+							if (stream == nullptr)
+							{
+								ReportError(u8"In BaseHttpTransaction::CompressPayload(const ContentCoding, const CompressionLevel) - Failed to initialize deflate stream.");
+								return false;
+							}
+
+							const auto bound = deflateBound(stream, static_cast<uLong>(payloadSize));
+
+							m_decodedPayload.resize(bound);
+
+							stream->next_in = reinterpret_cast<Bytef*>(m_transactionData.data());
+							stream->avail_in = static_cast<uInt>(payloadSize);
+							stream->next_out = reinterpret_cast<Bytef*>(m_decodedPayload.data());
+							stream->avail_out = static_cast<uInt>(bound);
+
+							auto result = deflate(stream, Z_FINISH);
+
+							if (result != Z_STREAM_END)
+							{
+								std::string errMessage(u8"In BaseHttpTransaction::CompressPayload(const ContentCoding, const CompressionLevel) - Error while compressing: ");
+								errMessage.append(stream->msg != nullptr ? stream->msg : std::to_string(result));
+								ReportError(errMessage);
+								m_decodedPayload.clear();
+								return false;
+							}
+
+							compressedSize = bound - stream->avail_out;
+							codingName = gzip ? u8"gzip" : u8"deflate";
+						}
+						break;
+
+						case ContentCoding::Brotli:
+						{
+							#ifdef HTTP_FILTERING_ENGINE_USE_BROTLI
+							compressedSize = BrotliEncoderMaxCompressedSize(payloadSize);
 
-						in.push(boost::iostreams::gzip_decompressor());
-						in.push(boost::iostreams::array_source(m_transactionData.data(), m_transactionData.size()));
+							if (compressedSize == 0)
+							{
+								ReportError(u8"In BaseHttpTransaction::CompressPayload(const ContentCoding, const CompressionLevel) - Payload is too large to compress with Brotli.");
+								return false;
+							}
+
+							m_decodedPayload.resize(compressedSize);
+
+							// Quality 4 is the usual choice for compressing on the fly, the library
+							// default of 11 is far too slow for anything but Best.
+							int quality = 6;
+
+							switch (level)
+							{
+								case CompressionLevel::Fast:
+									quality = 4;
+								break;
+
+								case CompressionLevel::Best:
+									quality = BROTLI_MAX_QUALITY;
+								break;
+
+								default:
+								break;
+							}
+
+							auto result = BrotliEncoderCompress(
+								quality,
+								BROTLI_DEFAULT_WINDOW,
+								BROTLI_MODE_GENERIC,
+								payloadSize,
+								reinterpret_cast<const uint8_t*>(m_transactionData.data()),
+								&compressedSize,
+								reinterpret_cast<uint8_t*>(m_decodedPayload.data())
+								);
+
+							if (result == BROTLI_FALSE)
+							{
+								ReportError(u8"In BaseHttpTransaction::CompressPayload(const ContentCoding, const CompressionLevel) - Error while compressing with Brotli.");
+								m_decodedPayload.clear();
+								return false;
+							}
+
+							codingName = u8"br";
+							#else
+							ReportError(u8"In BaseHttpTransaction::CompressPayload(const ContentCoding, const CompressionLevel) - Built without Brotli support.");
+							return false;
+							#endif
+						}
+						break;
+
+						case ContentCoding::Zstd:
+						{
+							#ifdef HTTP_FILTERING_ENGINE_USE_ZSTD
+							struct ThreadCompressionContext
+							{
+								ZSTD_CCtx* context = ZSTD_createCCtx();
+
+								~ThreadCompressionContext()
+								{
+									ZSTD_freeCCtx(context);
+								}
+							};
+
+							// Compression contexts are expensive to create and are reused freely
+							// between frames, so one is kept per worker thread.
+							thread_local ThreadCompressionContext threadContext;
+
+							if (threadContext.context == nullptr)
+							{
+								ReportError(u8"In BaseHttpTransaction::CompressPayload(const ContentCoding, const CompressionLevel) - Failed to create zstd compression context.");
+								return false;
+							}
+
+							m_decodedPayload.resize(ZSTD_compressBound(payloadSize));
+
+							// Level 3 is the zstd default. Levels above 19 need far more memory to
+							// decompress, so Best stops there.
+							int zstdLevel = 3;
+
+							switch (level)
+							{
+								case CompressionLevel::Fast:
+									zstdLevel = 1;
+								break;
 
-						boost::iostreams::copy(in, std::back_insert_iterator<std::vector<char>>(decompressed));
+								case CompressionLevel::Best:
+									zstdLevel = 19;
+								break;
+
+								default:
+								break;
+							}
+
+							compressedSize = ZSTD_compressCCtx(threadContext.context, m_decodedPayload.data(), m_decodedPayload.size(), m_transactionData.data(), payloadSize, zstdLevel);
+
+							if (ZSTD_isError(compressedSize))
+							{
+								std::string errMessage(u8"In BaseHttpTransaction::CompressPayload(const ContentCoding, const CompressionLevel) - Error while compressing: ");
+								errMessage.append(ZSTD_getErrorName(compressedSize));
+								ReportError(errMessage);
+								m_decodedPayload.clear();
+								return false;
+							}
+
+							codingName = u8"zstd";
+							#else
+							ReportError(u8"In BaseHttpTransaction::CompressPayload(const ContentCoding, const CompressionLevel) - Built without zstd support.");
+							return false;
+							#endif
+						}
+						break;
 
+						default:
+						{
+							ReportError(u8"In BaseHttpTransaction::CompressPayload(const ContentCoding, const CompressionLevel) - Not a compressing content coding.");
+							return false;
+						}
+						break;
 					}
-					catch (std::exception& e)
+
+					if (compressedSize >= payloadSize)
 					{
-						std::string errMessage(u8"In BaseBridge::DecompressGzip() - Exception while decompressing: ");
-						errMessage.append(e.what());
-						ReportError(errMessage);
+						m_decodedPayload.clear();
 						return false;
 					}
 
-					m_transactionData = std::move(decompressed);
+					m_decodedPayload.resize(compressedSize);
+					m_decodedPayload.push_back('\r');
+					m_decodedPayload.push_back('\n');
+					m_decodedPayload.push_back('\r');
+					m_decodedPayload.push_back('\n');
+
+					// Keep the uncompressed buffer around as the spare, rather than freeing it.
+					m_transactionData.swap(m_decodedPayload);
+					m_decodedPayload.clear();
 					m_unwrittenPayloadSize = m_transactionData.size();
 
-					if (m_transactionData.size() > 0)
-					{						
-						return true;
+					m_decodedContentEncoding.clear();
+
+					AddHeader(util::http::headers::ContentLength, std::to_string(compressedSize), true);
+					AddHeader(util::http::headers::ContentEncoding, codingName, true);
+
+					return true;
+				}
+
+				z_stream_s* BaseHttpTransaction::GetThreadDeflateStream(const bool gzip, const int level)
+				{
+					struct ThreadDeflateStream
+					{
+						z_stream stream{};
+						bool initialized = false;
+						int level = Z_DEFAULT_COMPRESSION;
+
+						~ThreadDeflateStream()
+						{
+							if (initialized)
+							{
+								deflateEnd(&stream);
+							}
+						}
+					};
+
+					// deflateReset(...) can't change the wrapper a stream produces, so each thread
+					// keeps one stream for gzip and one for plain deflate.
+					thread_local ThreadDeflateStream gzipStream;
+					thread_local ThreadDeflateStream deflateStream;
+
+					auto& entry = gzip ? gzipStream : deflateStream;
+
+					if (!entry.initialized)
+					{
+						// Adding 16 to the window bits has zlib write a gzip wrapper. 8 is the default
+						// memory level.
+						if (deflateInit2(&entry.stream, level, Z_DEFLATED, gzip ? MAX_WBITS + 16 : MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+						{
+							return nullptr;
+						}
+
+						entry.initialized = true;
+						entry.level = level;
 					}
-					else 
+					else if (deflateReset(&entry.stream) != Z_OK)
 					{
-						return false;
+						return nullptr;
+					}
+					else if (entry.level != level)
+					{
+						// Safe to change here, since no data has been given to the stream since
+						// it was reset.
+						if (deflateParams(&entry.stream, level, Z_DEFAULT_STRATEGY) != Z_OK)
+						{
+							return nullptr;
+						}
+
+						entry.level = level;
 					}
+
+					return &entry.stream;
 				}
 
-				const bool BaseHttpTransaction::DecompressDeflate()
+				const bool BaseHttpTransaction::BeginDecode()
 				{
-					if (m_transactionData.size() == 0)
+					m_decodeCoding = ContentCoding::Identity;
+					m_decodeFinished = false;
+					m_decodeStarted = false;
+					m_decodedPayload.clear();
+					m_encodedPayload.clear();
+					m_decodedContentEncoding.clear();
+
+					const auto contentEncoding = GetHeader(util::http::headers::ContentEncoding);
+
+					if (contentEncoding.first == contentEncoding.second)
 					{
-						ReportError(u8"In BaseBridge::DecompressDeflate() - There is no payload to decompress.");
 						return false;
 					}
 
-					// Must trim off unusued allocated space.
-					if (m_transactionData.size() > m_unwrittenPayloadSize)
-					{
-						m_transactionData.resize(m_unwrittenPayloadSize);
-					}
+					const auto& codingName = contentEncoding.first->second;
 
-					// If the terminating CRLF's on the payload are left, they'll screw with
-					// decompression. They need to be trimmed first.
-					if (
-						m_transactionData.at(m_transactionData.size() - 4) == '\r' &&
-						m_transactionData.at(m_transactionData.size() - 3) == '\n' &&
-						m_transactionData.at(m_transactionData.size() - 2) == '\r' &&
-						m_transactionData.at(m_transactionData.size() - 1) == '\n'
-						)
+					if (boost::iequals(codingName, u8"gzip") || boost::iequals(codingName, u8"deflate"))
 					{
-						m_transactionData.resize(m_transactionData.size() - 4);
-					}
+						// Adding 16 to the window bits has zlib expect a gzip wrapper.
+						const bool gzip = boost::iequals(codingName, u8"gzip");
+						const int windowBits = gzip ? MAX_WBITS + 16 : MAX_WBITS;
 
-					std::vector<char> decompressed;
+						if (m_inflateStream == nullptr)
+						{
+							m_inflateStream = new z_stream();
 
-					try
+							if (inflateInit2(m_inflateStream, windowBits) != Z_OK)
+							{
+								ReportError(u8"In BaseHttpTransaction::BeginDecode() - Failed to initialize inflate stream.");
+								delete m_inflateStream;
+								m_inflateStream = nullptr;
+								return false;
+							}
+						}
+						else if (inflateReset2(m_inflateStream, windowBits) != Z_OK)
+						{
+							ReportError(u8"In BaseHttpTransaction::BeginDecode() - Failed to reset inflate stream.");
+							return false;
+						}
+
+						m_decodeCoding = gzip ? ContentCoding::Gzip : ContentCoding::Deflate;
+
+						return true;
+					}
+
+					#ifdef HTTP_FILTERING_ENGINE_USE_BROTLI
+					if (boost::iequals(codingName, u8"br"))
 					{
-						boost::iostreams::filtering_streambuf<boost::iostreams::input> in;
+						// The Brotli decoder has no way to be reset, so a fresh one is made for
+						// each message.
+						if (m_brotliDecoder != nullptr)
+						{
+							BrotliDecoderDestroyInstance(m_brotliDecoder);
+						}
+
+						m_brotliDecoder = BrotliDecoderCreateInstance(nullptr, nullptr, nullptr);
 
-						in.push(boost::iostreams::zlib_decompressor());
-						in.push(boost::iostreams::array_source(m_transactionData.data(), m_transactionData.size()));
+						if (m_brotliDecoder == nullptr)
+						{
+							ReportError(u8"In BaseHttpTransaction::BeginDecode() - Failed to create Brotli decoder.");
+							return false;
+						}
 
-						boost::iostreams::copy(in, std::back_insert_iterator<std::vector<char>>(decompressed));
+						m_decodeCoding = ContentCoding::Brotli;
 
+						return true;
 					}
-					catch (std::exception& e)
+					#endif
+
+					#ifdef HTTP_FILTERING_ENGINE_USE_ZSTD
+					if (boost::iequals(codingName, u8"zstd"))
 					{
-						std::string errMessage(u8"In BaseBridge::DecompressDeflate() - Exception while decompressing: ");
-						errMessage.append(e.what());
-						ReportError(errMessage);
-						return false;
-					}
+						if (m_zstdDecoder == nullptr)
+						{
+							m_zstdDecoder = ZSTD_createDStream();
 
-					m_transactionData = std::move(decompressed);
-					m_unwrittenPayloadSize = m_transactionData.size();
+							if (m_zstdDecoder == nullptr)
+							{
+								ReportError(u8"In BaseHttpTransaction::BeginDecode() - Failed to create zstd decoder.");
+								return false;
+							}
+						}
+
+						if (ZSTD_isError(ZSTD_initDStream(m_zstdDecoder)))
+						{
+							ReportError(u8"In BaseHttpTransaction::BeginDecode() - Failed to reset zstd decoder.");
+							return false;
+						}
+
+						m_decodeCoding = ContentCoding::Zstd;
 
-					if (m_transactionData.size() > 0)
-					{						
 						return true;
 					}
-					else {
-						return false;
-					}
+					#endif
+
+					// Nothing we can decompress. ::FinalizePayload() will report it.
+					return false;
 				}
 
-				const bool BaseHttpTransaction::ConvertPayloadFromChunkedToFixedLength()
+				const bool BaseHttpTransaction::DecodeBufferedPayload()
 				{
-					const boost::string_ref crlf = u8"\r\n";
+					const auto size = m_unwrittenPayloadSize;
 
-					// First we need to cut down the payload buffer to the exact size of how many bytes
-					// we've received.
-					if (m_transactionData.size() > m_unwrittenPayloadSize)
+					// Whatever happens below, the compressed data is done with. The next read will
+					// land at the start of the payload buffer again, so it never has to grow past a
+					// single read's worth of compressed data.
+					m_unwrittenPayloadSize = 0;
+
+					if (size == 0 || m_decodeFinished)
 					{
-						m_transactionData.resize(m_unwrittenPayloadSize);
-					}					
+						// Anything following the end of the compressed data is ignored.
+						return true;
+					}
 
-					boost::string_ref payloadStrRef(m_transactionData.data(), m_transactionData.size());
+					m_decodeStarted = true;
 
-					// All chunked content will be moved into this container, and m_transactionData
-					// will be reassigned to it on a successful conversion.
-					std::vector<char> result;
-					result.reserve(m_transactionData.size());
+					// Hold on to the compressed data as received, in case it can be passed on
+					// untouched. See ::RestoreEncodedPayload().
+					m_encodedPayload.insert(m_encodedPayload.end(), m_transactionData.data(), m_transactionData.data() + size);
 
-					// Get the first position of the end of the first chunk header
-					auto pos = payloadStrRef.find(crlf);
+					switch (m_decodeCoding)
+					{
+						case ContentCoding::Gzip:
+						case ContentCoding::Deflate:
+							return Inflate(m_transactionData.data(), size);
 
-					std::stringstream ss;
+						case ContentCoding::Brotli:
+							return DecodeBrotli(m_transactionData.data(), size);
 
-					size_t chunkLength = 0;
+						case ContentCoding::Zstd:
+							return DecodeZstd(m_transactionData.data(), size);
 
-					bool noError = false;
+						default:
+							return false;
+					}
+				}
 
-					size_t globalPos = 0;
+				const size_t BaseHttpTransaction::ReserveDecodeOutput()
+				{
+					const auto decodedSize = m_decodedPayload.size();
 
-					while (pos != boost::string_ref::npos)
+					if (decodedSize >= MaxPayloadResize)
 					{
-						chunkLength = 0;
+						ReportError(u8"In BaseHttpTransaction::ReserveDecodeOutput() - Maximum buffer size reached.");
+						return 0;
+					}
 
-						// Completely reset the stream
-						ss.str(std::string());
-						ss.clear();
+					const auto outputSize = std::min(static_cast<size_t>(PayloadBufferReadSize), MaxPayloadResize - decodedSize);
 
-						boost::string_ref chunkLenStr = payloadStrRef.substr(0, pos);
+					m_decodedPayload.resize(decodedSize + outputSize);
 
-						auto chunkLengthTrailerPos = chunkLenStr.find(';');
+					ChargePayloadBudget();
 
-						if (chunkLengthTrailerPos != boost::string_ref::npos)
+					return outputSize;
+				}
+
+				const bool BaseHttpTransaction::Inflate(const char* data, const size_t size)
+				{
+					m_inflateStream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+					m_inflateStream->avail_in = static_cast<uInt>(size);
+
+					while (!m_decodeFinished)
+					{
+						const auto outputSize = ReserveDecodeOutput();
+
+						if (outputSize == 0)
 						{
-							chunkLenStr = chunkLenStr.substr(0, chunkLengthTrailerPos);
+							return false;
 						}
 
-						ss << std::hex << chunkLenStr;
+						m_inflateStream->next_out = reinterpret_cast<Bytef*>(m_decodedPayload.data() + m_decodedPayload.size() - outputSize);
+						m_inflateStream->avail_out = static_cast<uInt>(outputSize);
+
+						auto result = inflate(m_inflateStream, Z_NO_FLUSH);
+
+						m_decodedPayload.resize(m_decodedPayload.size() - m_inflateStream->avail_out);
 
-						if (ss.fail())
+						if (result == Z_STREAM_END)
 						{
-							ReportError(u8"In BaseHttpTransaction::ConvertPayloadFromChunkedToFixedLength() - Chunk length conversion to integer value failed.");
+							m_decodeFinished = true;
+						}
+						else if (result == Z_BUF_ERROR)
+						{
+							// No progress can be made until more compressed data arrives.
 							break;
 						}
+						else if (result != Z_OK)
+						{
+							std::string errMessage(u8"In BaseHttpTransaction::Inflate(const char*, const size_t) - Error while decompressing: ");
+							errMessage.append(m_inflateStream->msg != nullptr ? m_inflateStream->msg : std::to_string(result));
+							ReportError(errMessage);
+							return false;
+						}
 
-						ss >> chunkLength;
-
-						if (chunkLength == 0)
+						if (m_inflateStream->avail_in == 0 && m_inflateStream->avail_out != 0)
 						{
-							// All data has been read if we've reached the terminating chunk header
-							// which defines a length of zero.
-							noError = true;
+							// All input consumed and all pending output flushed.
 							break;
 						}
+					}
+
+					return true;
+				}
 
-						// Advance beyond the chunk length terminating crlf.
-						pos += crlf.size();
+				const bool BaseHttpTransaction::DecodeBrotli(const char* data, const size_t size)
+				{
+					#ifdef HTTP_FILTERING_ENGINE_USE_BROTLI
+					auto nextIn = reinterpret_cast<const uint8_t*>(data);
+					size_t availableIn = size;
+
+					while (!m_decodeFinished)
+					{
+						const auto outputSize = ReserveDecodeOutput();
 
-						if ((pos + chunkLength) > payloadStrRef.size())
+						if (outputSize == 0)
 						{
-							ReportError(u8"In BaseHttpTransaction::ConvertPayloadFromChunkedToFixedLength() - New chunk length specified is greater than the total payload container size.");
-							break;
+							return false;
 						}
 
-						globalPos += pos;
+						auto nextOut = reinterpret_cast<uint8_t*>(m_decodedPayload.data() + m_decodedPayload.size() - outputSize);
+						size_t availableOut = outputSize;
 
-						// We know have a chunk, its start position and its end position. Move it.
-						// XXX TODO - Change this to a straight up copy, moving char is slower.
-						result.insert(result.end(), (m_transactionData.begin() + globalPos), (m_transactionData.begin() + (globalPos + chunkLength)));
+						auto result = BrotliDecoderDecompressStream(m_brotliDecoder, &availableIn, &nextIn, &availableOut, &nextOut, nullptr);
 
-						// Advance pos beyond clrf at the start of the chunk, then beyond the chunk length, then again beyond the
-						// terminating clrf before we search again.
-						pos += (chunkLength + crlf.size());
-						globalPos += (chunkLength + crlf.size());
-						
-						if (pos > payloadStrRef.length())
+						m_decodedPayload.resize(m_decodedPayload.size() - availableOut);
+
+						switch (result)
 						{
-							ReportError(u8"In BaseHttpTransaction::ConvertPayloadFromChunkedToFixedLength() - Next chunk length specified is greater than the total payload container size.");
+							case BROTLI_DECODER_RESULT_SUCCESS:
+								m_decodeFinished = true;
 							break;
-						}						
 
-						payloadStrRef = payloadStrRef.substr(pos);
+							case BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT:
+								// All input consumed and all pending output flushed.
+								return true;
 
-						pos = payloadStrRef.find(crlf);
+							case BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT:
+							break;
+
+							default:
+							{
+								std::string errMessage(u8"In BaseHttpTransaction::DecodeBrotli(const char*, const size_t) - Error while decompressing: ");
+								errMessage.append(BrotliDecoderErrorString(BrotliDecoderGetErrorCode(m_brotliDecoder)));
+								ReportError(errMessage);
+								return false;
+							}
+						}
+					}
+
+					return true;
+					#else
+					ReportError(u8"In BaseHttpTransaction::DecodeBrotli(const char*, const size_t) - Built without Brotli support.");
+					return false;
+					#endif
+				}
 
-						if (pos == boost::string_ref::npos)
+				const bool BaseHttpTransaction::DecodeZstd(const char* data, const size_t size)
+				{
+					#ifdef HTTP_FILTERING_ENGINE_USE_ZSTD
+					ZSTD_inBuffer input{ data, size, 0 };
+
+					while (!m_decodeFinished)
+					{
+						const auto outputSize = ReserveDecodeOutput();
+
+						if (outputSize == 0)
 						{
-							ReportError(u8"In BaseHttpTransaction::ConvertPayloadFromChunkedToFixedLength() - Final chunk not yet encountered, but failed to locate the next chunk header.");
+							return false;
+						}
+
+						ZSTD_outBuffer output{ m_decodedPayload.data() + m_decodedPayload.size() - outputSize, outputSize, 0 };
+
+						auto result = ZSTD_decompressStream(m_zstdDecoder, &output, &input);
+
+						m_decodedPayload.resize(m_decodedPayload.size() - (outputSize - output.pos));
+
+						if (ZSTD_isError(result))
+						{
+							std::string errMessage(u8"In BaseHttpTransaction::DecodeZstd(const char*, const size_t) - Error while decompressing: ");
+							errMessage.append(ZSTD_getErrorName(result));
+							ReportError(errMessage);
+							return false;
+						}
+
+						if (result == 0)
+						{
+							// A return of zero means the frame has been fully decoded and flushed.
+							m_decodeFinished = true;
+						}
+						else if (input.pos == input.size && output.pos < output.size)
+						{
+							// All input consumed and all pending output flushed.
 							break;
 						}
 					}
 
-					if (noError)
+					return true;
+					#else
+					ReportError(u8"In BaseHttpTransaction::DecodeZstd(const char*, const size_t) - Built without zstd support.");
+					return false;
+					#endif
+				}
+
+				const bool BaseHttpTransaction::FinalizePayload()
+				{
+					bool finalizationFailed = false;
+
+					// Trim off any unused space left over from sizing the buffer for reads, so that
+					// the container holds exactly the payload.
+					if (m_transactionData.size() > m_unwrittenPayloadSize)
+					{
+						m_transactionData.resize(m_unwrittenPayloadSize);
+					}
+
+					if (m_payloadChunked)
 					{
-						m_transactionData = std::move(result);
-						m_unwrittenPayloadSize = m_transactionData.size();
+						// The chunk framing has already been stripped out of the payload as it was
+						// parsed, see ::OnBody(...), so all that remains is to drop the header.
+						RemoveHeader(util::http::headers::TransferEncoding);
 					}
-					else
+
+					const auto contentEncoding = GetHeader(util::http::headers::ContentEncoding);
+
+					if (m_decodeCoding != ContentCoding::Identity)
 					{
-						ReportError(u8"In BaseHttpTransaction::ConvertPayloadFromChunkedToFixedLength() - Failed to convert chunked content to fixed-length transfer.");
+						// The payload has already been decoded as it was parsed, see
+						// ::DecodeBufferedPayload(), so the result only has to be put in place.
+						m_decodeCoding = ContentCoding::Identity;
+
+						if (m_decodeFinished || !m_decodeStarted)
+						{
+							if (contentEncoding.first != contentEncoding.second)
+							{
+								m_decodedContentEncoding = contentEncoding.first->second;
+							}
+
+							m_transactionData.swap(m_decodedPayload);
+							m_decodedPayload.clear();
+							m_unwrittenPayloadSize = m_transactionData.size();
+							RemoveHeader(util::http::headers::ContentEncoding);
+						}
+						else
+						{
+							finalizationFailed = true;
+							ReportError("In BaseHttpTransaction::FinalizePayload() - Failed to decompress payload, the compressed stream is incomplete or corrupt!");
+						}
+					}
+					else if (contentEncoding.first != contentEncoding.second)
+					{
+						finalizationFailed = true;
+						ReportError("In BaseHttpTransaction::FinalizePayload() - Unknown Content-Encoding, cannot decompress: " + contentEncoding.first->second);
 					}
 
-					return noError;
+					if (finalizationFailed)
+					{
+						return false;
+					}
+
+					// Ensure that the terminating CRLF's are present and that they are not factored
+					// into Content-Length calculation.
+					if (
+						m_transactionData.size() >= 4 &&
+						m_transactionData[m_transactionData.size() - 4] == '\r' &&
+						m_transactionData[m_transactionData.size() - 3] == '\n' &&
+						m_transactionData[m_transactionData.size() - 2] == '\r' &&
+						m_transactionData[m_transactionData.size() - 1] == '\n'
+						)
+					{
+						AddHeader(util::http::headers::ContentLength, std::to_string(m_transactionData.size() - 4), true);
+					}
+					else {
+
+						AddHeader(util::http::headers::ContentLength, std::to_string(m_transactionData.size()), true);
+
+						m_transactionData.push_back('\r');
+						m_transactionData.push_back('\n');
+						m_transactionData.push_back('\r');
+						m_transactionData.push_back('\n');
+					}
+
+					// Reset the size, in case pushing terminating CRLF's adjusted it. Must be done, otherwise
+					// we'll ruin keep-alive.
+					m_unwrittenPayloadSize = m_transactionData.size();
+
+					return true;
 				}
 
 				int BaseHttpTransaction::OnMessageBegin(http_parser* parser)
@@ -1025,6 +1888,7 @@ namespace te
 						}
 						
 						trans->m_payloadComplete = false;
+						trans->ReleasePayloadBudget();
 						trans->m_consumeAllBeforeSending = false;
 						trans->m_shouldBlock = 0;
 						trans->m_headers.clear();
@@ -1032,6 +1896,13 @@ namespace te
 						trans->m_headersSent = false;
 						trans->m_headersComplete = false;
 						trans->m_lastHeader = std::string("");
+						trans->m_payloadChunked = false;
+						trans->m_rawChunkSpans.clear();
+						trans->m_upgrade = false;
+						trans->m_blockResponsePrepared = false;
+						trans->m_decodeCoding = ContentCoding::Identity;
+						trans->m_decodeFinished = false;
+						trans->m_decodedContentEncoding.clear();
 						
 					}
 					else
@@ -1058,6 +1929,7 @@ namespace te
 
 						trans->m_headersComplete = true;
 						trans->m_headersSent = false;
+						trans->m_payloadChunked = (parser->flags & F_CHUNKED) != 0;
 
 					}
 					else
@@ -1083,6 +1955,16 @@ namespace te
 						}
 
 						trans->m_payloadComplete = true;
+
+						// The parser only settles on whether or not this is an upgrade once it has seen
+						// the whole message, so this is the first place it can be trusted.
+						trans->m_upgrade = parser->upgrade == 1;
+
+						// Pause the parser so that it stops at the end of this message. Anything beyond it
+						// in the data being parsed is the start of the next, pipelined message, and must
+						// not be parsed as part of this transaction. ::Parse(...) will unpause it and set
+						// the remaining data aside.
+						http_parser_pause(parser, 1);
 					
 					}
 					else
@@ -1110,11 +1992,10 @@ namespace te
 							throw std::runtime_error(u8"In BaseHttpTransaction::OnChunkHeader() - http_parser->data is nullptr when it should contain a pointer the http_parser's owning BaseHttpTransaction object.");
 						}
 
-						// TODO - Do we even need this callback? I think not, as the only state information it
-						// provides is the determined length of the upcoming chunk, which might be useful for 
-						// adjusting payload/body storage containers for when the actual chunk content comes
-						// in through the OnBody callback. Leaving the code here anyway, just for the sake
-						// of wasting time calling a function that does nothing. ;)
+						// The chunk header itself never reaches ::OnBody(...), only the chunk data that
+						// follows it does. So when chunked payloads are being decoded, the header bytes
+						// are simply overwritten by the data of the chunk they describe. Nothing else
+						// needs to be tracked here.
 
 					}
 					else
@@ -1223,18 +2104,6 @@ namespace te
 				{
 					if (parser != nullptr)
 					{
-						/*
-
-						This method has been disabled due to a design change decision. Formerly, this object
-						was not going to own the buffers used for reading the raw data it is intended to parse.
-						However, having considered design issues that are much uglier than this object owning
-						read buffers, I've decided to make this object own the read buffers. As such, this
-						method is no longer required for copying out body data, as the body data will already
-						exist inside this object however it comes in over the wire. From there, the body
-						may or may not be converted from chunked to a fixed-length body, etc, depending
-						on configuration options, at which time the same raw read buffers will be mutated
-						accordingly. See notes on the ::Parse(const size_t&) method for more information.
-
 						BaseHttpTransaction* trans = static_cast<BaseHttpTransaction*>(parser->data);
 
 						if (trans == nullptr)
@@ -1242,8 +2111,34 @@ namespace te
 							throw std::runtime_error(u8"In BaseHttpTransaction::OnBody() - http_parser->data is nullptr when it should contain a pointer the http_parser's owning BaseHttpTransaction object.");
 						}
 
-						trans->m_transactionData.insert(trans->m_transactionData.end(), at, at + length);
-						*/
+						// Body data already lives inside of this object's own buffers, so there's nothing
+						// to copy out for fixed-length payloads. Chunked payloads however are decoded here,
+						// as they arrive, so that the payload is ready the moment the last chunk is parsed.
+						if (!trans->m_payloadChunked || trans->m_parseBase == nullptr)
+						{
+							return 0;
+						}
+
+						if (trans->m_consumeAllBeforeSending)
+						{
+							// Chunk data always sits at or beyond the decode offset, since the chunk
+							// framing that precedes it is being dropped, so move it down in place.
+							char* decodePosition = trans->m_transactionData.data() + trans->m_chunkDecodeOffset;
+
+							if (decodePosition != at)
+							{
+								std::memmove(decodePosition, at, length);
+							}
+
+							trans->m_chunkDecodeOffset += length;
+						}
+						else
+						{
+							// The raw chunked data must stay intact in case it's simply forwarded, but we
+							// remember where the chunk data lives in case the transaction is switched over
+							// to ::ConsumeAllBeforeSending() later on.
+							trans->m_rawChunkSpans.emplace_back(static_cast<size_t>(at - trans->m_parseBase), length);
+						}
 					}
 					else
 					{
@@ -34,17 +34,26 @@
 #include <cstring>
 #include <string>
 #include <map>
+#include <array>
+#include <vector>
+#include <utility>
 #include <boost/asio/buffers_iterator.hpp>
 #include <boost/asio/streambuf.hpp>
 #include <boost/utility/string_ref.hpp>
 #include "http_parser.h"
 #include "../../util/cb/EventReporter.hpp"
+#include "PayloadMemoryBudget.hpp"
+#include "IoBufferPool.hpp"
 
 #ifdef _MSC_VER 
 	#define strncasecmp _strnicmp
 	#define strcasecmp _stricmp
 #endif
 
+struct z_stream_s;
+struct BrotliDecoderStateStruct;
+struct ZSTD_DCtx_s;
+
 namespace te
 {
 	namespace httpengine
@@ -65,6 +74,47 @@ namespace te
 					HTTP2
 				};
 
+				/// <summary>
+				/// The kinds of prebuilt responses that blocked transactions can be answered
+				/// with. Answering a blocked script with an empty script, or a blocked image with
+				/// an image, keeps browsers from retrying or stalling on the blocked resource.
+				/// See BaseHttpTransaction::MakeBlockResponse(...).
+				/// </summary>
+				enum class BlockResponseType
+				{
+					NoContent,
+					Image,
+					Script,
+					Stylesheet,
+					Html
+				};
+
+				/// <summary>
+				/// The content codings that payloads may be decoded from and encoded with.
+				/// Brotli and zstd are only available when built with
+				/// HTTP_FILTERING_ENGINE_USE_BROTLI and HTTP_FILTERING_ENGINE_USE_ZSTD
+				/// respectively. See BaseHttpTransaction::GetSupportedContentCodings().
+				/// </summary>
+				enum class ContentCoding
+				{
+					Identity,
+					Gzip,
+					Deflate,
+					Brotli,
+					Zstd
+				};
+
+				/// <summary>
+				/// How hard payloads should be compressed. Fast is meant for compressing on the
+				/// fly, Best for when the smallest output is worth the extra time spent.
+				/// </summary>
+				enum class CompressionLevel
+				{
+					Fast,
+					Default,
+					Best
+				};
+
 				/// <summary>
 				/// Binary predicate for case insensitive lookups in std::multimap.
 				/// </summary>
@@ -237,6 +287,16 @@ namespace te
 					/// </returns>
 					virtual std::vector<char> HeadersToVector() const = 0;
 
+					/// <summary>
+					/// Formats the transaction headers into the supplied string, replacing its
+					/// contents. The string's existing capacity is reused, so repeatedly formatting
+					/// into the same string does not allocate once it has grown large enough.
+					/// </summary>
+					/// <param name="buffer">
+					/// The string to format the complete transaction headers into.
+					/// </param>
+					virtual void HeadersToBuffer(std::string& buffer) const = 0;
+
 					/// <summary>
 					/// Force the transaction to parse its content. This method absolutely must be
 					/// called immediately following any completed read operations using this
@@ -276,17 +336,16 @@ namespace te
 					/// As such, this object will always retain the buffers in the original state
 					/// that they arrived at over the socket. These buffers will only ever be
 					/// modified when the modifications are guaranteed to produce a valid state for
-					/// the object. The OnBody callbacks of the internal http_parser will be
-					/// ignored, as will the OnChunk methods, because no copy is necessary. Chunked
-					/// encoding will only ever be converted to fixed-length (content-length header
-					/// defined) transactions when ::ConsumeAllBeforeSending() is configured to
-					/// true.
-					/// 
-					/// Conversion from chunked to fixed-length content and decompression will be
-					/// done entirely manually by this objects own conversion implementation, thus
-					/// making the sole purpose of the http_parser object to accurately extract
-					/// header information and signal when the end of the transaction has been
-					/// reached.
+					/// the object. Chunked encoding will only ever be converted to fixed-length
+					/// (content-length header defined) transactions when
+					/// ::ConsumeAllBeforeSending() is configured to true.
+					/// 
+					/// In that case, chunked content is decoded in place as it is parsed, inside
+					/// the OnBody callback of the internal http_parser, so the payload buffer only
+					/// ever holds the decoded body and no second pass over the payload is required
+					/// once the final chunk arrives. Compressed payloads are likewise inflated
+					/// piece by piece as they are parsed, so the decompressed body is ready the
+					/// moment the last byte arrives.
 					/// </summary>
 					/// <param name="bytes_transferred">
 					/// The number of bytes_transferred indicated in the asio::async_read* handler
@@ -312,7 +371,8 @@ namespace te
 					/// ::Parse(...) absolutely must be called immediately in the completion handler
 					/// wherever this buffer is used.
 					/// 
-					/// If the streambuf already contains any data, it will be consumed first.
+					/// If the streambuf already contains any data, it will be consumed first,
+					/// unless that data was placed there by ::MovePipelinedDataTo(...).
 					/// </summary>
 					/// <returns>
 					/// A reference to the internal boost::asio::streambuf object. 
@@ -343,21 +403,38 @@ namespace te
 					boost::asio::mutable_buffers_1 GetPayloadReadBuffer();
 
 					/// <summary>
-					/// Retrieve a boost::asio::const_buffers_1 object which wraps the internal
-					/// transaction payload. Call this method when you intend to write the entire
-					/// contents of the transaction outbound from the proxy.
+					/// The buffer sequence returned by ::GetWriteBuffer(). The first buffer holds
+					/// the prebuilt head of a block response, if any, the second holds the
+					/// serialized headers, if they have yet to be written, and the third holds the
+					/// payload.
+					/// </summary>
+					using WriteBufferSequence = std::array<boost::asio::const_buffer, 3>;
+
+					/// <summary>
+					/// Retrieve a buffer sequence which wraps the serialized transaction headers,
+					/// if they have not yet been written, followed by the internal transaction
+					/// payload. Call this method when you intend to write the entire contents of
+					/// the transaction outbound from the proxy. The sequence can be handed
+					/// directly to asio::async_write(...) as a single gather write, so no payload
+					/// data is ever copied just to put the headers in front of it.
 					/// 
 					/// Note that this method lacks a right-hand const declaration. The internal
 					/// state of the object will be irreversibly altered once this method is called,
-					/// as if the headers have not yet been set, the headers must be merged into the
-					/// final, separated payload storage before being supplied as a single buffer
-					/// for writing.
+					/// as the headers are serialized into a scratch buffer owned by this object
+					/// and marked as sent. The returned buffers remain valid until the transaction
+					/// is next parsed or modified.
+					/// 
+					/// When the payload is being streamed rather than consumed in full, the payload
+					/// written is swapped out of the read buffer first. In that case the returned
+					/// buffers remain valid until the next call to this method, so exactly one new
+					/// read from ::GetPayloadReadBuffer() may be issued and parsed while the write
+					/// is still in flight.
 					/// </summary>
 					/// <returns>
-					/// A boost::asio::const_buffers_1 object wrapping the internal transaction
-					/// payload data.
+					/// A buffer sequence wrapping the serialized headers, if any, and the internal
+					/// transaction payload data.
 					/// </returns>
-					boost::asio::const_buffers_1 GetWriteBuffer();
+					WriteBufferSequence GetWriteBuffer();
 
 					/// <summary>
 					/// Fetch the raw payload data. In the event that ::ConsumeAllBeforeSending() is
@@ -377,6 +454,22 @@ namespace te
 					/// </returns>
 					const std::vector<char>& GetPayload() const;
 
+					/// <summary>
+					/// Gets the number of valid bytes held at the start of the container returned
+					/// by ::GetPayload(). The container itself may be larger, as it is sized for
+					/// reading.
+					/// 
+					/// When ::ConsumeAllBeforeSending() is true, this can be used along with
+					/// ::GetPayload() to inspect a partially received body. Chunked bodies are
+					/// decoded as they arrive, so the bytes reported here never contain any chunk
+					/// framing in that case, but may still be compressed until the payload is
+					/// complete.
+					/// </summary>
+					/// <returns>
+					/// The number of valid payload bytes currently held by this transaction.
+					/// </returns>
+					const size_t GetPayloadSize() const;
+
 					/// <summary>
 					/// Moves the supplied payload to the internal transaction payload buffer. Sets
 					/// the state of the transaction to complete, removes all headers about
@@ -384,8 +477,8 @@ namespace te
 					/// content-length header with the size of the supplied payload.
 					/// 
 					/// As such, this method assumes that the supplied payload is uncompressed. If
-					/// compression is required, pass uncompressed data here, then call the
-					/// ::CompressDeflate() or ::CompressGzip() members.
+					/// compression is required, pass uncompressed data here, then call
+					/// ::Compress(...) or one of the other compression members.
 					/// </summary>
 					/// <param name="payload">
 					/// The payload to be moved to the internal payload buffer.
@@ -399,8 +492,8 @@ namespace te
 					/// content-length header with the size of the supplied payload.
 					/// 
 					/// As such, this method assumes that the supplied payload is uncompressed. If
-					/// compression is required, pass uncompressed data here, then call the
-					/// ::CompressDeflate() or ::CompressGzip() members.
+					/// compression is required, pass uncompressed data here, then call
+					/// ::Compress(...) or one of the other compression members.
 					/// </summary>
 					/// <param name="payload">
 					/// The payload to be copied to the internal payload buffer.
@@ -425,6 +518,46 @@ namespace te
 					/// </returns>
 					const bool IsPayloadComplete() const;
 
+					/// <summary>
+					/// Gets the number of payload bytes that the remote peer has yet to send, when
+					/// that is known in advance, meaning that the payload has a Content-Length and
+					/// is not chunked.
+					/// </summary>
+					/// <returns>
+					/// The number of payload bytes that have yet to be read, or zero if the
+					/// payload is complete or its remaining length isn't known.
+					/// </returns>
+					const uint64_t GetUnreadPayloadSize() const;
+
+					/// <summary>
+					/// Marks the payload as complete without it having been read through this
+					/// transaction, for when the remainder of a payload whose size is known is
+					/// relayed directly between sockets. See ::GetUnreadPayloadSize(). The
+					/// transaction cannot be parsed any further afterwards.
+					/// </summary>
+					void SetPayloadRelayed();
+
+					/// <summary>
+					/// Sets the budget that payloads consumed in full are reserved against. See
+					/// ::SetConsumeAllBeforeSending(...).
+					/// </summary>
+					/// <param name="budget">
+					/// A pointer to the budget, which must outlive the transaction. May be nullptr,
+					/// in which case payloads are buffered without limit.
+					/// </param>
+					void SetPayloadMemoryBudget(PayloadMemoryBudget* budget);
+
+					/// <summary>
+					/// Sets the pool that payload read buffers are checked out from, and checked
+					/// back into when the transaction is destroyed. Must be set before the first
+					/// payload read.
+					/// </summary>
+					/// <param name="pool">
+					/// A pointer to the pool, which must outlive the transaction. May be nullptr,
+					/// in which case payload buffers are allocated by the transaction itself.
+					/// </param>
+					void SetIoBufferPool(IoBufferPool* pool);
+
 					/// <summary>
 					/// Check to see if the transaction has been marked for blocking. If any
 					/// non-zero value is returned, the transaction has been assigned a category
@@ -486,6 +619,81 @@ namespace te
 					/// </summary>
 					void Make204();
 
+					/// <summary>
+					/// Transforms the transaction into one of the prebuilt block responses, in the
+					/// same fashion as ::Make204(). The headers and body of every block response
+					/// are built once and never copied. Only the Date header, which is cached and
+					/// refreshed at most once a second, is written per response. The whole response
+					/// goes out as a single gather write through ::GetWriteBuffer().
+					/// 
+					/// Block responses always declare HTTP/1.1, which is valid for HTTP/1.0
+					/// clients as well.
+					/// </summary>
+					/// <param name="type">
+					/// The kind of block response to serve. This should match the kind of resource
+					/// that the client was expecting.
+					/// </param>
+					void MakeBlockResponse(const BlockResponseType type);
+
+					/// <summary>
+					/// Check to see if data belonging to one or more messages following this one
+					/// was read along with this transaction. This happens when a client pipelines
+					/// requests, or when a server sends responses to pipelined requests back to
+					/// back. The parser always stops at the end of this transaction's message, so
+					/// such data is never treated as part of this transaction's payload.
+					/// </summary>
+					/// <returns>
+					/// True if data for a subsequent message is being held, false otherwise.
+					/// </returns>
+					const bool HasPipelinedData() const;
+
+					/// <summary>
+					/// Moves any data held for the message following this one into the header
+					/// read buffer of the supplied transaction, which is expected to be a fresh
+					/// transaction of the same type. The data is left in place for the next call
+					/// to ::GetHeaderReadBuffer() on the supplied transaction, so it can be used
+					/// directly with asio::async_read_until(...), which will complete without
+					/// touching the socket if the pipelined headers are already complete.
+					/// </summary>
+					/// <param name="next">
+					/// The transaction that should receive the pipelined data.
+					/// </param>
+					void MovePipelinedDataTo(BaseHttpTransaction& next);
+
+					/// <summary>
+					/// Searches the data already held in the header read buffer for the end of a
+					/// header block. Used along with ::MovePipelinedDataTo(...) to determine if
+					/// pipelined data can be parsed immediately, without any further reads.
+					/// </summary>
+					/// <returns>
+					/// The length of the complete header block held in the header read buffer,
+					/// including the terminating CRLF's, or zero if no complete header block is
+					/// held.
+					/// </returns>
+					const size_t GetBufferedHeaderLength() const;
+
+					/// <summary>
+					/// Check to see if the parsed message asks to leave HTTP behind once it has
+					/// completed. For requests, this means the client sent an Upgrade request
+					/// (WebSocket, h2c etc) or a CONNECT. For responses, this means the server
+					/// answered with 101 Switching Protocols. Either way, anything following the
+					/// message is no longer HTTP, and is held as pipelined data.
+					/// </summary>
+					/// <returns>
+					/// True if the message is an upgrade, false otherwise.
+					/// </returns>
+					const bool IsUpgrade() const;
+
+					/// <summary>
+					/// Hands over any data held beyond the end of this transaction's message. This
+					/// is used when the connection has been upgraded and the data is not the start
+					/// of another HTTP message, but rather the first bytes of the new protocol.
+					/// </summary>
+					/// <returns>
+					/// The data read beyond the end of this transaction's message, if any.
+					/// </returns>
+					std::vector<char> ReleasePipelinedData();
+
 					/// <summary>
 					/// Check to see if the transaction has been configured so that all headers and
 					/// the transaction payload (body) must be consumed and held in memory before
@@ -510,8 +718,9 @@ namespace te
 					/// When set to true, if the transaction uses chunked transfer encoding, the
 					/// headers specifying information about the chunked transfer will be removed
 					/// and the transaction will be transformed into a precalculated, fixed-length
-					/// (Content-Length specified) transaction. Also, the entire transaction payload
-					/// will be decompressed. Recompression is not automatic, not even for upstream
+					/// (Content-Length specified) transaction. Chunks are decoded from the moment
+					/// this is set, including any chunked data that was already read along with the
+					/// headers. Also, the entire transaction payload will be decompressed. Recompression is not automatic, not even for upstream
 					/// payloads, rather this is left to the user to determine and apply using the
 					/// provided convenience functions.
 					/// 
@@ -519,6 +728,9 @@ namespace te
 					/// payload/body of a transaction until the parser signals that it is complete.
 					/// The only burden placed on the user is to ensure you're not telling the
 					/// library to consume multi-gigabyte files!
+					/// 
+					/// If a payload memory budget has been set and cannot cover the payload, the
+					/// payload is left to stream, and ::GetConsumeAllBeforeSending() remains false.
 					/// </summary>
 					/// <param name="value">
 					/// </param>
@@ -647,6 +859,86 @@ namespace te
 					/// </returns>
 					const bool CompressDeflate();
 
+					/// <summary>
+					/// Compress the transaction payload using Brotli. Only available when built
+					/// with HTTP_FILTERING_ENGINE_USE_BROTLI.
+					/// </summary>
+					/// <returns>
+					/// True if the compression operation succeeded, false otherwise. Warnings and
+					/// or errors would have been generated in the case of a return value of false,
+					/// so subscribe to appropriate events through the EventReporter interface.
+					/// </returns>
+					const bool CompressBrotli();
+
+					/// <summary>
+					/// Compress the transaction payload using zstd. Only available when built with
+					/// HTTP_FILTERING_ENGINE_USE_ZSTD.
+					/// </summary>
+					/// <returns>
+					/// True if the compression operation succeeded, false otherwise. Warnings and
+					/// or errors would have been generated in the case of a return value of false,
+					/// so subscribe to appropriate events through the EventReporter interface.
+					/// </returns>
+					const bool CompressZstd();
+
+					/// <summary>
+					/// Gets the content codings that this build is able to decode, formatted for
+					/// use as the value of an Accept-Encoding header.
+					/// </summary>
+					/// <returns>
+					/// The supported content codings, most preferred first.
+					/// </returns>
+					static const boost::string_ref GetSupportedContentCodings();
+
+					/// <summary>
+					/// Compress the transaction payload using the given content coding and level.
+					/// As with the other compression members, the payload is only replaced if the
+					/// compressed result is smaller.
+					/// </summary>
+					/// <param name="coding">
+					/// The content coding to compress the payload with.
+					/// </param>
+					/// <param name="level">
+					/// How hard to compress the payload.
+					/// </param>
+					/// <returns>
+					/// True if the compression operation succeeded, false otherwise. Warnings and
+					/// or errors would have been generated in the case of a return value of false,
+					/// so subscribe to appropriate events through the EventReporter interface.
+					/// </returns>
+					const bool Compress(const ContentCoding coding, const CompressionLevel level);
+
+					/// <summary>
+					/// Puts back the payload exactly as it was received, still compressed, after
+					/// it was decompressed for inspection. This lets payloads that inspection did
+					/// not change be passed on untouched, instead of being sent decompressed or
+					/// compressed a second time.
+					/// 
+					/// Only possible once the payload is complete, and only until the payload is
+					/// replaced through ::SetPayload(...) or recompressed.
+					/// </summary>
+					/// <returns>
+					/// True if the original compressed payload was put back, false if the payload
+					/// was never decompressed or can no longer be restored.
+					/// </returns>
+					const bool RestoreEncodedPayload();
+
+					/// <summary>
+					/// Picks the content coding to compress a payload with for a peer that sent
+					/// the given Accept-Encoding header value. Only codings that this build can
+					/// produce are considered. The coding with the highest quality value wins,
+					/// and ties go to whichever coding compresses better.
+					/// </summary>
+					/// <param name="acceptEncoding">
+					/// The value of the peer's Accept-Encoding header. If the peer sent more than
+					/// one such header, their values joined with commas.
+					/// </param>
+					/// <returns>
+					/// The selected content coding, or ContentCoding::Identity if the peer does not
+					/// accept any coding that this build can produce.
+					/// </returns>
+					static const ContentCoding SelectContentCoding(const boost::string_ref acceptEncoding);
+
 				protected:
 					
 					/// <summary>
@@ -685,6 +977,34 @@ namespace te
 					/// </summary>
 					static const boost::string_ref ContentTypeJavascript;
 
+					/// <summary>
+					/// The number of members in the BlockResponseType enum.
+					/// </summary>
+					static constexpr size_t BlockResponseTypeCount = 5;
+
+					/// <summary>
+					/// Prebuilt status line and headers for each BlockResponseType, indexed by the
+					/// enum value. Each ends with the name of the Date header, so that the cached
+					/// date can follow immediately.
+					/// </summary>
+					static const std::array<boost::string_ref, BlockResponseTypeCount> BlockResponseHeads;
+
+					/// <summary>
+					/// Prebuilt bodies for each BlockResponseType, indexed by the enum value.
+					/// </summary>
+					static const std::array<boost::string_ref, BlockResponseTypeCount> BlockResponseBodies;
+
+					/// <summary>
+					/// Gets the current date, formatted for use in the HTTP Date header. The
+					/// formatted date is cached per thread and only refreshed when the second
+					/// changes.
+					/// </summary>
+					/// <returns>
+					/// The current date formatted according to RFC 7231. Remains valid until the
+					/// next call on the same thread.
+					/// </returns>
+					static const boost::string_ref GetCachedHttpDate();
+
 					/// <summary>
 					/// Increments by which the payload buffer will be resized, also the initial
 					/// reserved size.
@@ -742,6 +1062,15 @@ namespace te
 					/// </summary>
 					std::vector<char> m_transactionData;
 
+					/// <summary>
+					/// The second half of the double buffer used for streamed payloads. When a
+					/// payload is not being consumed in full before sending, ::GetWriteBuffer()
+					/// swaps the data it is about to hand out for writing into this container, so
+					/// that the next read can be issued into m_transactionData while the write
+					/// is still in flight.
+					/// </summary>
+					std::vector<char> m_streamWriteData;
+
 					/// <summary>
 					/// This object uses a vector of char for storing our payload data. This object
 					/// owns this payload data container in order to attempt to maintain a valid
@@ -777,6 +1106,25 @@ namespace te
 					/// </summary>
 					bool m_headersSent = false;
 
+					/// <summary>
+					/// Scratch area that headers are serialized into when the transaction is
+					/// written. Kept for the lifetime of the transaction so that its capacity is
+					/// reused by every message handled with this object. See ::GetWriteBuffer().
+					/// </summary>
+					std::string m_headerScratch;
+
+					/// <summary>
+					/// Flag used to indicate that the transaction has been turned into one of the
+					/// prebuilt block responses. See ::MakeBlockResponse(...).
+					/// </summary>
+					bool m_blockResponsePrepared = false;
+
+					/// <summary>
+					/// The kind of prebuilt block response the transaction has been turned into,
+					/// if m_blockResponsePrepared is set.
+					/// </summary>
+					BlockResponseType m_blockResponseType = BlockResponseType::NoContent;
+
 					/// <summary>
 					/// Flag used to indicate if the payload for the transaction has been fully
 					/// read from the client/remote peer.
@@ -799,20 +1147,265 @@ namespace te
 					bool m_consumeAllBeforeSending = false;
 
 					/// <summary>
-					/// Decompress the payload contents, expecting gzip format.
+					/// zlib inflate state used to decompress gzip and deflate payloads as they
+					/// are read. Created the first time such a payload is consumed and then only
+					/// reset, not recreated, for each following message handled by this
+					/// transaction. Decoder state has to belong to the transaction rather than the
+					/// thread, since successive reads of the same payload can complete on
+					/// different io_service threads.
+					/// </summary>
+					z_stream_s* m_inflateStream = nullptr;
+
+					/// <summary>
+					/// Brotli decoder state used to decompress br payloads as they are read. Only
+					/// ever created when built with HTTP_FILTERING_ENGINE_USE_BROTLI.
+					/// </summary>
+					BrotliDecoderStateStruct* m_brotliDecoder = nullptr;
+
+					/// <summary>
+					/// zstd decoder state used to decompress zstd payloads as they are read. Only
+					/// ever created when built with HTTP_FILTERING_ENGINE_USE_ZSTD.
+					/// </summary>
+					ZSTD_DCtx_s* m_zstdDecoder = nullptr;
+
+					/// <summary>
+					/// The content coding of the payload currently being decoded as it is parsed,
+					/// or ContentCoding::Identity if the payload is not being decoded. See
+					/// ::BeginDecode().
+					/// </summary>
+					ContentCoding m_decodeCoding = ContentCoding::Identity;
+
+					/// <summary>
+					/// Flag used to indicate that the decoder has reached the end of the
+					/// compressed data.
+					/// </summary>
+					bool m_decodeFinished = false;
+
+					/// <summary>
+					/// Flag used to indicate that the decoder has been given compressed data.
+					/// </summary>
+					bool m_decodeStarted = false;
+
+					/// <summary>
+					/// Receives the decompressed payload while it is being decoded, and the
+					/// compressed payload while it is being encoded. Once done, this trades places
+					/// with m_transactionData, so the capacity of both is kept and reused by the
+					/// following messages.
+					/// </summary>
+					std::vector<char> m_decodedPayload;
+
+					/// <summary>
+					/// Keeps the compressed payload as it was received while it is being decoded,
+					/// so that it can be passed on untouched if inspection does not change it. See
+					/// ::RestoreEncodedPayload().
+					/// </summary>
+					std::vector<char> m_encodedPayload;
+
+					/// <summary>
+					/// The budget that payloads consumed in full are reserved against. May be
+					/// nullptr.
+					/// </summary>
+					PayloadMemoryBudget* m_payloadBudget = nullptr;
+
+					/// <summary>
+					/// The number of bytes this transaction has reserved against m_payloadBudget.
+					/// </summary>
+					uint64_t m_payloadBudgetReserved = 0;
+
+					/// <summary>
+					/// Reserves whatever the payload buffers have grown beyond what was already
+					/// reserved against m_payloadBudget. Growth is reserved regardless of the
+					/// budget's limit, since a payload that has started buffering can't be
+					/// streamed anymore.
+					/// </summary>
+					void ChargePayloadBudget();
+
+					/// <summary>
+					/// Releases everything this transaction has reserved against m_payloadBudget.
+					/// </summary>
+					void ReleasePayloadBudget();
+
+					/// <summary>
+					/// The pool that payload read buffers are checked out from. May be nullptr.
+					/// </summary>
+					IoBufferPool* m_bufferPool = nullptr;
+
+					/// <summary>
+					/// The size of the buffer that streamed payloads are read into when
+					/// m_bufferPool is set. Starts out small, and doubles up to
+					/// PayloadBufferReadSize every time a read fills the whole buffer.
+					/// </summary>
+					size_t m_streamReadSize = IoBufferPool::MinBufferSize;
+
+					/// <summary>
+					/// Makes m_transactionData at least the given size, keeping the first
+					/// m_unwrittenPayloadSize bytes. With m_bufferPool set, the new buffer is
+					/// checked out from the pool and the old one checked back in.
+					/// </summary>
+					/// <param name="size">
+					/// The minimum size of m_transactionData.
+					/// </param>
+					void GrowReadBuffer(const size_t size);
+
+					/// <summary>
+					/// The Content-Encoding header value that was removed when the payload was
+					/// decoded. Empty if the payload was not decoded, or can no longer be
+					/// restored.
 					/// </summary>
+					std::string m_decodedContentEncoding;
+
+					/// <summary>
+					/// Checks the Content-Encoding of the transaction and, if it is one that this
+					/// build can decode, readies the matching decoder to decompress the payload as
+					/// it arrives.
+					/// </summary>
+					/// <returns>
+					/// True if the payload will be decoded as it arrives, false otherwise.
+					/// </returns>
+					const bool BeginDecode();
+
+					/// <summary>
+					/// Decodes all of the compressed payload data currently held in
+					/// m_transactionData into m_decodedPayload. The compressed data is no longer
+					/// needed after this, so m_unwrittenPayloadSize is reset and the next read
+					/// reuses the same space in the payload buffer.
+					/// </summary>
+					/// <returns>
+					/// True if the data was decoded successfully, false otherwise.
+					/// </returns>
+					const bool DecodeBufferedPayload();
+
+					/// <summary>
+					/// Grows m_decodedPayload to make room for the next piece of decoder output,
+					/// without going beyond MaxPayloadResize. Whatever room is left unused must be
+					/// trimmed off again by the caller.
+					/// </summary>
+					/// <returns>
+					/// The number of bytes of room made at the end of m_decodedPayload. Zero if the
+					/// maximum size has been reached, in which case an error has been reported.
+					/// </returns>
+					const size_t ReserveDecodeOutput();
+
+					/// <summary>
+					/// Feeds compressed data to m_inflateStream.
+					/// </summary>
+					/// <param name="data">
+					/// The compressed data.
+					/// </param>
+					/// <param name="size">
+					/// The number of bytes of compressed data.
+					/// </param>
+					/// <returns>
+					/// True if the data was decoded successfully, false otherwise.
+					/// </returns>
+					const bool Inflate(const char* data, const size_t size);
+
+					/// <summary>
+					/// Feeds compressed data to m_brotliDecoder.
+					/// </summary>
+					/// <param name="data">
+					/// The compressed data.
+					/// </param>
+					/// <param name="size">
+					/// The number of bytes of compressed data.
+					/// </param>
+					/// <returns>
+					/// True if the data was decoded successfully, false otherwise.
+					/// </returns>
+					const bool DecodeBrotli(const char* data, const size_t size);
+
+					/// <summary>
+					/// Feeds compressed data to m_zstdDecoder.
+					/// </summary>
+					/// <param name="data">
+					/// The compressed data.
+					/// </param>
+					/// <param name="size">
+					/// The number of bytes of compressed data.
+					/// </param>
+					/// <returns>
+					/// True if the data was decoded successfully, false otherwise.
+					/// </returns>
+					const bool DecodeZstd(const char* data, const size_t size);
+
+					/// <summary>
+					/// Compresses the payload with the given coding, and replaces the payload with
+					/// the result if the result is smaller.
+					/// </summary>
+					/// <param name="coding">
+					/// The content coding to compress the payload with.
+					/// </param>
+					/// <param name="level">
+					/// How hard to compress the payload.
+					/// </param>
 					/// <returns>
-					/// True if the decompression succeeded, false otherwise.
+					/// True if the payload was replaced with the compressed output, false otherwise.
 					/// </returns>
-					const bool DecompressGzip();
+					const bool CompressPayload(const ContentCoding coding, const CompressionLevel level);
 
 					/// <summary>
-					/// Decompress the payload contents, expecting deflate format.
+					/// Gets the calling thread's deflate stream for the requested format, reset
+					/// and ready for use. Compression happens start to finish in a single call, so
+					/// unlike decoding, one stream per worker thread is enough.
 					/// </summary>
+					/// <param name="gzip">
+					/// True to get the stream that produces gzip output, false to get the one that
+					/// produces zlib wrapped deflate output.
+					/// </param>
+					/// <param name="level">
+					/// The zlib compression level the stream should use.
+					/// </param>
 					/// <returns>
-					/// True if the decompression succeeded, false otherwise.
+					/// The stream on success, nullptr if the stream could not be initialized.
 					/// </returns>
-					const bool DecompressDeflate();
+					static z_stream_s* GetThreadDeflateStream(const bool gzip, const int level);
+
+					/// <summary>
+					/// Holds any data read beyond the end of this transaction's message, which is
+					/// the start of the next pipelined message. See ::MovePipelinedDataTo(...).
+					/// </summary>
+					std::vector<char> m_pipelinedData;
+
+					/// <summary>
+					/// Flag used to indicate that the header read buffer was primed with pipelined
+					/// data from a previous transaction, and that this data must not be discarded
+					/// by ::GetHeaderReadBuffer().
+					/// </summary>
+					bool m_headerBufferPrimed = false;
+
+					/// <summary>
+					/// Flag used to indicate that the parsed message is an upgrade. See ::IsUpgrade().
+					/// </summary>
+					bool m_upgrade = false;
+
+					/// <summary>
+					/// Flag used to indicate that the transaction payload uses chunked transfer
+					/// encoding. Set once the parser has completed reading the headers.
+					/// </summary>
+					bool m_payloadChunked = false;
+
+					/// <summary>
+					/// While ::Parse(...) is running the http_parser, points to the position in the
+					/// buffer being parsed that maps to the start of m_transactionData. This lets
+					/// ::OnBody(...) translate the positions it is given into offsets within the
+					/// payload buffer. Null at all other times.
+					/// </summary>
+					const char* m_parseBase = nullptr;
+
+					/// <summary>
+					/// When chunked content is being decoded, the offset in m_transactionData
+					/// where the next piece of decoded chunk data will be written.
+					/// </summary>
+					size_t m_chunkDecodeOffset = 0;
+
+					/// <summary>
+					/// Offset and length pairs within m_transactionData of the chunk data parsed
+					/// while chunked content is not being decoded. If the transaction is later
+					/// switched to ::ConsumeAllBeforeSending(), these are used to collapse the raw
+					/// chunked data already held down to its decoded form, without having to walk
+					/// the chunk framing a second time.
+					/// </summary>
+					std::vector<std::pair<size_t, size_t>> m_rawChunkSpans;
 
 					/// <summary>
 					/// In the even that the user has specified that they wish collect the entire
@@ -820,24 +1413,20 @@ namespace te
 					/// that chunked content will be converted to a normal,
 					/// fixed-length/precalculated transfer, and the payload will be decompressed.
 					/// 
-					/// Since this object owns the buffers directly used on the sockets, and in
-					/// order to maintain a valid state during and up-till a completely read
-					/// request/response, even though the http_parser is parsing the data on every
-					/// read, chunked data is not being extracted during any read operation leading
-					/// up to a completed transaction. This is to avoid fragmenting the object state
-					/// so that it remains valid. See notes on ::Parse(..) for more on that.
+					/// Chunked content is decoded and compressed content is inflated as it is
+					/// parsed, so by the time this is called, only the headers are left to deal
+					/// with and the decompressed payload has to be swapped into place.
 					/// 
-					/// As such, when and only when the the following two conditions are met, the
-					/// transaction payload can/should be converted to a normal precalcuated
-					/// transfer and decompressed: ::ConsumeAllBeforeSending() is true, and
-					/// ::IsPayloadComplete() is also true. If these conditions are met, this object
-					/// will automatically provide the described functionality via this method once
-					/// the final ::Parse(...) has been called.
+					/// This is called when and only when the the following two conditions are met:
+					/// ::ConsumeAllBeforeSending() is true, and ::IsPayloadComplete() is also true.
+					/// If these conditions are met, this object will automatically provide the
+					/// described functionality via this method once the final ::Parse(...) has
+					/// been called.
 					/// </summary>
 					/// <returns>
-					/// True if the conversion succeeded, false otherwise. 
+					/// True if finalization succeeded, false otherwise. 
 					/// </returns>
-					const bool ConvertPayloadFromChunkedToFixedLength();					
+					const bool FinalizePayload();
 
 					/// <summary>
 					/// Called when the http_parser has begun reading a new transaction.
@@ -872,6 +1461,8 @@ namespace te
 
 					/// <summary>
 					/// Called when the http_parser has completed reading all data for a transaction.
+					/// The parser is paused here so that it never runs on into a following,
+					/// pipelined message. See ::HasPipelinedData().
 					/// </summary>
 					/// <param name="parser">
 					/// The http_parser, returned in the callback for establishing context, since
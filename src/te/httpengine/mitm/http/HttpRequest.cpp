@@ -73,10 +73,29 @@ namespace te
 					m_requestMethod = method;
 				}
 
+				const ContentCoding HttpRequest::AcceptedResponseCoding() const
+				{
+					return m_acceptedResponseCoding;
+				}
+
+				void HttpRequest::AcceptedResponseCoding(const ContentCoding coding)
+				{
+					m_acceptedResponseCoding = coding;
+				}
+
 				std::string HttpRequest::HeadersToString() const
 				{
 					std::string ret;
 
+					HeadersToBuffer(ret);
+
+					return ret;
+				}
+
+				void HttpRequest::HeadersToBuffer(std::string& ret) const
+				{
+					ret.clear();
+
 					ret.append(http_method_str(m_requestMethod));
 					ret.append(u8" ");
 
@@ -101,8 +120,6 @@ namespace te
 					}
 
 					ret.append(u8"\r\n\r\n");
-
-					return ret;
 				}
 
 				std::vector<char> HttpRequest::HeadersToVector() const
@@ -104,6 +104,29 @@ namespace te
 					/// </param>
 					void Method(const HttpRequestMethod method);
 
+					/// <summary>
+					/// Getter for the content coding that the client will accept the response
+					/// payload in. Recorded from the client's own Accept-Encoding header, before
+					/// that header is replaced with the codings the proxy asks of the upstream
+					/// server.
+					/// </summary>
+					/// <returns>
+					/// The content coding to use if the response payload has to be compressed for
+					/// the client. ContentCoding::Identity if the client did not accept any coding
+					/// that can be produced, or if this has not been set.
+					/// </returns>
+					const ContentCoding AcceptedResponseCoding() const;
+
+					/// <summary>
+					/// Setter for the content coding that the client will accept the response
+					/// payload in.
+					/// </summary>
+					/// <param name="coding">
+					/// The content coding selected from the client's Accept-Encoding header. See
+					/// BaseHttpTransaction::SelectContentCoding(...).
+					/// </param>
+					void AcceptedResponseCoding(const ContentCoding coding);
+
 					/// <summary>
 					/// Convenience function for formatting the transaction headers into a
 					/// std::string container.
@@ -124,6 +147,16 @@ namespace te
 					/// </returns>
 					virtual std::vector<char> HeadersToVector() const;
 
+					/// <summary>
+					/// Formats the transaction headers into the supplied string, replacing its
+					/// contents. The string's existing capacity is reused, so repeatedly formatting
+					/// into the same string does not allocate once it has grown large enough.
+					/// </summary>
+					/// <param name="buffer">
+					/// The string to format the complete transaction headers into.
+					/// </param>
+					virtual void HeadersToBuffer(std::string& buffer) const;
+
 				protected:
 
 					/// <summary>
@@ -136,6 +169,11 @@ namespace te
 					/// </summary>
 					HttpRequestMethod m_requestMethod;
 
+					/// <summary>
+					/// The content coding that the client will accept the response payload in.
+					/// </summary>
+					ContentCoding m_acceptedResponseCoding = ContentCoding::Identity;
+
 					/// <summary>
 					/// Called when the url read has been completed by http_parser. 
 					/// </summary>
@@ -96,6 +96,15 @@ namespace te
 				{
 					std::string ret;
 
+					HeadersToBuffer(ret);
+
+					return ret;
+				}
+
+				void HttpResponse::HeadersToBuffer(std::string& ret) const
+				{
+					ret.clear();
+
 					ret.append(m_statusString);					
 
 					for (auto header = m_headers.begin(); header != m_headers.end(); ++header)
@@ -104,8 +113,6 @@ namespace te
 					}
 
 					ret.append(u8"\r\n\r\n");
-
-					return ret;
 				}
 
 				std::vector<char> HttpResponse::HeadersToVector() const
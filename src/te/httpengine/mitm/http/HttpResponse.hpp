@@ -149,6 +149,16 @@ namespace te
 					/// </returns>
 					virtual std::vector<char> HeadersToVector() const;
 
+					/// <summary>
+					/// Formats the transaction headers into the supplied string, replacing its
+					/// contents. The string's existing capacity is reused, so repeatedly formatting
+					/// into the same string does not allocate once it has grown large enough.
+					/// </summary>
+					/// <param name="buffer">
+					/// The string to format the complete transaction headers into.
+					/// </param>
+					virtual void HeadersToBuffer(std::string& buffer) const;
+
 				protected:
 
 					/// <summary>
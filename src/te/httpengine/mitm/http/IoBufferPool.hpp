@@ -0,0 +1,223 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace http
+			{
+
+				/// <summary>
+				/// A pool of payload read buffers shared by every transaction. Buffers come in
+				/// sizes doubling from MinBufferSize up to MaxBufferSize. Transactions check a
+				/// buffer out the first time they read a payload and check it back in when
+				/// they're destroyed, once their message is done. The next transaction to read a
+				/// payload then reuses it as is, rather than allocating and zeroing a fresh one.
+				/// 
+				/// Since transactions are replaced for every message, a connection sitting idle
+				/// between requests holds no payload buffers at all.
+				/// 
+				/// All members are safe to call from any thread.
+				/// </summary>
+				class IoBufferPool
+				{
+
+				public:
+
+					/// <summary>
+					/// The size of the smallest buffers, which streamed payloads start out with.
+					/// </summary>
+					static constexpr size_t MinBufferSize = 16384;
+
+					/// <summary>
+					/// The size of the largest buffers, which bulk payloads grow to. Buffers
+					/// bigger than this are never pooled.
+					/// </summary>
+					static constexpr size_t MaxBufferSize = 131072;
+
+					/// <summary>
+					/// The number of distinct buffer sizes, from MinBufferSize to MaxBufferSize.
+					/// </summary>
+					static constexpr size_t SizeClassCount = 4;
+
+					/// <summary>
+					/// The most memory held idle by the buffers of any one size. Anything
+					/// checked in beyond this is simply freed.
+					/// </summary>
+					static constexpr size_t MaxIdleBytesPerSize = 8388608;
+
+					/// <summary>
+					/// Constructs a new, empty IoBufferPool.
+					/// </summary>
+					IoBufferPool()
+					{
+
+					}
+
+					/// <summary>
+					/// No copy no move no thx.
+					/// </summary>
+					IoBufferPool(const IoBufferPool&) = delete;
+					IoBufferPool(IoBufferPool&&) = delete;
+					IoBufferPool& operator=(const IoBufferPool&) = delete;
+
+					/// <summary>
+					/// Default destructor.
+					/// </summary>
+					~IoBufferPool()
+					{
+
+					}
+
+					/// <summary>
+					/// Checks out a buffer of at least the given size. The contents of a
+					/// recycled buffer are whatever its last user left in it.
+					/// </summary>
+					/// <param name="size">
+					/// The minimum size of the buffer.
+					/// </param>
+					/// <returns>
+					/// A buffer of the smallest pooled size that fits the given size, or exactly
+					/// the given size if it is bigger than MaxBufferSize.
+					/// </returns>
+					std::vector<char> CheckOut(const size_t size)
+					{
+						if (size > MaxBufferSize)
+						{
+							return std::vector<char>(size);
+						}
+
+						size_t index = 0;
+
+						while (SizeOf(index) < size)
+						{
+							++index;
+						}
+
+						auto& sizeClass = m_sizeClasses[index];
+
+						{
+							std::lock_guard<std::mutex> lock(sizeClass.mutex);
+
+							if (!sizeClass.idle.empty())
+							{
+								std::vector<char> buffer = std::move(sizeClass.idle.back());
+								sizeClass.idle.pop_back();
+								return buffer;
+							}
+						}
+
+						return std::vector<char>(SizeOf(index));
+					}
+
+					/// <summary>
+					/// Checks a buffer back in. The buffer need not have come from the pool. It
+					/// is pooled under the biggest size its allocation can hold, unless that is
+					/// outside the pooled sizes or enough buffers of that size are idle already,
+					/// in which case it is freed.
+					/// </summary>
+					/// <param name="buffer">
+					/// The buffer to check in. Left empty.
+					/// </param>
+					void CheckIn(std::vector<char>&& buffer)
+					{
+						std::vector<char> checkedIn = std::move(buffer);
+						buffer.clear();
+
+						const auto capacity = checkedIn.capacity();
+
+						if (capacity < MinBufferSize || capacity > MaxBufferSize)
+						{
+							return;
+						}
+
+						size_t index = SizeClassCount - 1;
+
+						while (SizeOf(index) > capacity)
+						{
+							--index;
+						}
+
+						// Within the existing allocation, so this never reallocates.
+						checkedIn.resize(SizeOf(index));
+
+						auto& sizeClass = m_sizeClasses[index];
+
+						std::lock_guard<std::mutex> lock(sizeClass.mutex);
+
+						if ((sizeClass.idle.size() + 1) * SizeOf(index) <= MaxIdleBytesPerSize)
+						{
+							sizeClass.idle.emplace_back(std::move(checkedIn));
+						}
+					}
+
+				private:
+
+					/// <summary>
+					/// The idle buffers of a single size.
+					/// </summary>
+					struct SizeClass
+					{
+						std::mutex mutex;
+						std::vector<std::vector<char>> idle;
+					};
+
+					/// <summary>
+					/// The idle buffers of each size, smallest first.
+					/// </summary>
+					std::array<SizeClass, SizeClassCount> m_sizeClasses;
+
+					/// <summary>
+					/// Gets the size of the buffers in the size class at the given index.
+					/// </summary>
+					static size_t SizeOf(const size_t index)
+					{
+						return MinBufferSize << index;
+					}
+
+				};
+
+			} /* namespace http */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
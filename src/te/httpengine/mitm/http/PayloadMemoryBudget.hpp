@@ -0,0 +1,255 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace http
+			{
+
+				/// <summary>
+				/// A snapshot of the counters kept by a PayloadMemoryBudget.
+				/// </summary>
+				struct PayloadMemoryBudgetStats
+				{
+					/// <summary>
+					/// The number of bytes that may be reserved in total.
+					/// </summary>
+					uint64_t limit = 0;
+
+					/// <summary>
+					/// The number of bytes reserved when the snapshot was taken.
+					/// </summary>
+					uint64_t usage = 0;
+
+					/// <summary>
+					/// The most bytes that were ever reserved at once.
+					/// </summary>
+					uint64_t highWater = 0;
+
+					/// <summary>
+					/// The number of payloads that were streamed rather than buffered, because
+					/// the budget could not cover them.
+					/// </summary>
+					uint64_t rejections = 0;
+				};
+
+				/// <summary>
+				/// A process wide limit on the memory held by payloads that are buffered in full
+				/// for inspection. Every transaction may buffer up to
+				/// BaseHttpTransaction::MaxPayloadResize on its own, but with thousands of
+				/// transactions in flight at once, that alone puts no meaningful limit on the
+				/// total.
+				/// 
+				/// A transaction reserves an estimate of what it needs before it starts
+				/// buffering. If the reservation is refused, the payload is streamed through
+				/// uninspected instead. Once buffering has begun, the payload can no longer be
+				/// streamed, so any growth beyond the estimate is reserved regardless of the
+				/// limit. Refused reservations then keep new payloads from buffering until enough
+				/// has been released.
+				/// 
+				/// All members are safe to call from any thread.
+				/// </summary>
+				class PayloadMemoryBudget
+				{
+
+				public:
+
+					/// <summary>
+					/// The default number of bytes that may be reserved in total.
+					/// </summary>
+					static constexpr uint64_t DefaultLimit = 268435456;
+
+					/// <summary>
+					/// Constructs a new PayloadMemoryBudget with nothing reserved.
+					/// </summary>
+					/// <param name="limit">
+					/// The number of bytes that may be reserved in total.
+					/// </param>
+					PayloadMemoryBudget(const uint64_t limit = DefaultLimit)
+						:
+						m_limit(limit)
+					{
+
+					}
+
+					/// <summary>
+					/// No copy no move no thx.
+					/// </summary>
+					PayloadMemoryBudget(const PayloadMemoryBudget&) = delete;
+					PayloadMemoryBudget(PayloadMemoryBudget&&) = delete;
+					PayloadMemoryBudget& operator=(const PayloadMemoryBudget&) = delete;
+
+					/// <summary>
+					/// Default destructor.
+					/// </summary>
+					~PayloadMemoryBudget()
+					{
+
+					}
+
+					/// <summary>
+					/// Reserves the given number of bytes, if doing so doesn't take the total
+					/// reserved beyond the limit.
+					/// </summary>
+					/// <param name="bytes">
+					/// The number of bytes to reserve.
+					/// </param>
+					/// <returns>
+					/// True if the bytes were reserved, false if the reservation was refused.
+					/// </returns>
+					const bool TryReserve(const uint64_t bytes)
+					{
+						const uint64_t limit = m_limit.load();
+
+						uint64_t usage = m_usage.load();
+
+						do
+						{
+							if (bytes > limit || usage > limit - bytes)
+							{
+								++m_rejections;
+								return false;
+							}
+						} 
+						while (!m_usage.compare_exchange_weak(usage, usage + bytes));
+
+						UpdateHighWater(usage + bytes);
+
+						return true;
+					}
+
+					/// <summary>
+					/// Reserves the given number of bytes, whatever the limit.
+					/// </summary>
+					/// <param name="bytes">
+					/// The number of bytes to reserve.
+					/// </param>
+					void ForceReserve(const uint64_t bytes)
+					{
+						UpdateHighWater(m_usage.fetch_add(bytes) + bytes);
+					}
+
+					/// <summary>
+					/// Releases bytes previously reserved.
+					/// </summary>
+					/// <param name="bytes">
+					/// The number of bytes to release.
+					/// </param>
+					void Release(const uint64_t bytes)
+					{
+						m_usage.fetch_sub(bytes);
+					}
+
+					/// <summary>
+					/// Sets the number of bytes that may be reserved in total. Lowering the limit
+					/// below what is already reserved doesn't take anything back, but refuses new
+					/// reservations until usage has dropped below the new limit.
+					/// </summary>
+					/// <param name="limit">
+					/// The number of bytes that may be reserved in total.
+					/// </param>
+					void SetLimit(const uint64_t limit)
+					{
+						m_limit.store(limit);
+					}
+
+					/// <summary>
+					/// Gets a snapshot of the budget's counters.
+					/// </summary>
+					/// <returns>
+					/// The current limit, usage, high water mark and number of refusals.
+					/// </returns>
+					PayloadMemoryBudgetStats GetStats() const
+					{
+						PayloadMemoryBudgetStats stats;
+
+						stats.limit = m_limit.load();
+						stats.usage = m_usage.load();
+						stats.highWater = m_highWater.load();
+						stats.rejections = m_rejections.load();
+
+						return stats;
+					}
+
+				private:
+
+					/// <summary>
+					/// The number of bytes that may be reserved in total.
+					/// </summary>
+					std::atomic<uint64_t> m_limit;
+
+					/// <summary>
+					/// The number of bytes currently reserved.
+					/// </summary>
+					std::atomic<uint64_t> m_usage{ 0 };
+
+					/// <summary>
+					/// The most bytes that were ever reserved at once.
+					/// </summary>
+					std::atomic<uint64_t> m_highWater{ 0 };
+
+					/// <summary>
+					/// The number of refused reservations.
+					/// </summary>
+					std::atomic<uint64_t> m_rejections{ 0 };
+
+					/// <summary>
+					/// Raises the high water mark to the given usage, if it is higher.
+					/// </summary>
+					/// <param name="usage">
+					/// The usage just reached.
+					/// </param>
+					void UpdateHighWater(const uint64_t usage)
+					{
+						uint64_t highWater = m_highWater.load();
+
+						while (usage > highWater && !m_highWater.compare_exchange_weak(highWater, usage))
+						{
+						}
+					}
+
+				};
+
+			} /* namespace http */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
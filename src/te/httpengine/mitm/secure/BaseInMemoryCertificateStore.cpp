@@ -316,6 +316,25 @@ namespace te
 
 						SSL_CTX_set_tmp_ecdh(ctx->native_handle(), tmpNegotiationEcKey);
 
+						// Sessions are cached on the default server context that every connection
+						// starts out with, whatever context it is switched to afterwards, so without
+						// this a session issued under one spoofed certificate could be resumed by a
+						// connection served another. Scoping sessions to the digest of the spoofed
+						// certificate rules that out. Resumption under the same certificate is no
+						// different than before.
+						unsigned char spoofedCertDigest[EVP_MAX_MD_SIZE];
+						unsigned int spoofedCertDigestLength = 0;
+
+						if (X509_digest(spoofedCert, EVP_sha1(), spoofedCertDigest, &spoofedCertDigestLength) != 1 || 
+							SSL_CTX_set_session_id_context(ctx->native_handle(), spoofedCertDigest, spoofedCertDigestLength) != 1)
+						{
+							EC_KEY_free(tmpNegotiationEcKey);
+							EVP_PKEY_free(spoofedCertKeypair);
+							X509_free(spoofedCert);
+							delete ctx;
+							throw std::runtime_error(u8"In BaseInMemoryCertificateStore::GetServerContext(std::string, X509*) - Failed to set server context session id context.");
+						}
+
 						bool atLeastOneInsert = false;
 
 						if (sanDomains.size() > 0)
@@ -0,0 +1,267 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace secure
+			{
+
+				/// <summary>
+				/// Keeps track of the live bridges of an acceptor, so that they can be reached
+				/// when it's time to wind them down. Bridges otherwise only live through the
+				/// handlers they have outstanding, and nothing else can find them.
+				/// 
+				/// Bridges are held weakly in a singly linked list. Registering pushes onto the
+				/// front of the list with a single compare and swap, and bridges never need to
+				/// unregister. Once a bridge is gone, its entry is simply dropped the next time
+				/// the list is walked. Only one thread walks the list at a time. Walks happen
+				/// when ::ForEach(...) is called, and now and then during a registration, which
+				/// skips the walk rather than wait on another thread's walk. Walks only ever
+				/// unlink entries behind the front of the list, so they never get in the way of
+				/// registrations.
+				/// 
+				/// All members are safe to call from any thread.
+				/// </summary>
+				template<typename BridgeType>
+				class BridgeRegistry
+				{
+
+				public:
+
+					/// <summary>
+					/// How many registrations pass between attempts to drop the entries of bridges
+					/// that are gone.
+					/// </summary>
+					static constexpr size_t SweepInterval = 64;
+
+					/// <summary>
+					/// Constructs a new, empty BridgeRegistry.
+					/// </summary>
+					BridgeRegistry()
+					{
+
+					}
+
+					/// <summary>
+					/// No copy no move no thx.
+					/// </summary>
+					BridgeRegistry(const BridgeRegistry&) = delete;
+					BridgeRegistry(BridgeRegistry&&) = delete;
+					BridgeRegistry& operator=(const BridgeRegistry&) = delete;
+
+					/// <summary>
+					/// Default destructor. Frees every entry. Bridges are only held weakly, so none
+					/// are affected.
+					/// </summary>
+					~BridgeRegistry()
+					{
+						Entry* entry = m_head.load();
+
+						while (entry != nullptr)
+						{
+							Entry* next = entry->next;
+							delete entry;
+							entry = next;
+						}
+					}
+
+					/// <summary>
+					/// Adds a bridge to the registry.
+					/// </summary>
+					/// <param name="bridge">
+					/// The bridge to add.
+					/// </param>
+					void Register(const std::shared_ptr<BridgeType>& bridge)
+					{
+						Entry* entry = new Entry();
+						entry->bridge = bridge;
+						entry->next = m_head.load(std::memory_order_relaxed);
+
+						while (!m_head.compare_exchange_weak(entry->next, entry, std::memory_order_release, std::memory_order_relaxed))
+						{
+							// entry->next has been updated to the current head. Try again.
+						}
+
+						if (m_registrations.fetch_add(1, std::memory_order_relaxed) % SweepInterval == SweepInterval - 1)
+						{
+							if (!m_walking.test_and_set(std::memory_order_acquire))
+							{
+								Walk(&BridgeRegistry::Ignore);
+								m_walking.clear(std::memory_order_release);
+							}
+						}
+					}
+
+					/// <summary>
+					/// Invokes the given visitor on every live bridge, dropping the entries of
+					/// bridges that are gone along the way. Bridges registered while the walk is
+					/// underway may or may not be visited.
+					/// </summary>
+					/// <param name="visitor">
+					/// Function invoked with each live bridge. Must not register bridges.
+					/// </param>
+					/// <returns>
+					/// The number of live bridges visited.
+					/// </returns>
+					template<typename Visitor>
+					size_t ForEach(Visitor visitor)
+					{
+						while (m_walking.test_and_set(std::memory_order_acquire))
+						{
+							std::this_thread::yield();
+						}
+
+						size_t live = Walk(visitor);
+
+						m_walking.clear(std::memory_order_release);
+
+						return live;
+					}
+
+					/// <summary>
+					/// Counts the live bridges, dropping the entries of bridges that are gone.
+					/// </summary>
+					/// <returns>
+					/// The number of live bridges.
+					/// </returns>
+					size_t Count()
+					{
+						return ForEach(&BridgeRegistry::Ignore);
+					}
+
+				private:
+
+					struct Entry
+					{
+						/// <summary>
+						/// The registered bridge.
+						/// </summary>
+						std::weak_ptr<BridgeType> bridge;
+
+						/// <summary>
+						/// The next entry. Set before the entry is pushed, and afterwards only ever
+						/// changed by a walk.
+						/// </summary>
+						Entry* next = nullptr;
+					};
+
+					/// <summary>
+					/// The front of the list.
+					/// </summary>
+					std::atomic<Entry*> m_head{ nullptr };
+
+					/// <summary>
+					/// Held by the one thread walking the list.
+					/// </summary>
+					std::atomic_flag m_walking = ATOMIC_FLAG_INIT;
+
+					/// <summary>
+					/// The number of registrations made, for spacing out sweeps.
+					/// </summary>
+					std::atomic<size_t> m_registrations{ 0 };
+
+					/// <summary>
+					/// Visitor that does nothing, for walks made only to drop entries.
+					/// </summary>
+					static void Ignore(const std::shared_ptr<BridgeType>&)
+					{
+
+					}
+
+					/// <summary>
+					/// Walks the list, invoking the visitor on every live bridge and unlinking
+					/// and freeing the entries of bridges that are gone. The entry at the front is
+					/// kept even if its bridge is gone, since registrations may be linking new
+					/// entries in ahead of it. Must only be called with m_walking held.
+					/// </summary>
+					template<typename Visitor>
+					size_t Walk(Visitor visitor)
+					{
+						Entry* previous = m_head.load(std::memory_order_acquire);
+
+						if (previous == nullptr)
+						{
+							return 0;
+						}
+
+						size_t live = 0;
+
+						auto front = previous->bridge.lock();
+
+						if (front != nullptr)
+						{
+							++live;
+							visitor(front);
+						}
+
+						Entry* entry = previous->next;
+
+						while (entry != nullptr)
+						{
+							auto bridge = entry->bridge.lock();
+
+							if (bridge == nullptr)
+							{
+								previous->next = entry->next;
+								delete entry;
+								entry = previous->next;
+								continue;
+							}
+
+							++live;
+							visitor(bridge);
+
+							previous = entry;
+							entry = entry->next;
+						}
+
+						return live;
+					}
+
+				};
+
+			} /* namespace secure */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -32,6 +32,8 @@
 #pragma once
 
 #include "TlsCapableHttpBridge.hpp"
+#include "BridgeRegistry.hpp"
+#include "../../network/IoServicePool.hpp"
 #include "../../util/cb/EventReporter.hpp"
 
 #include <boost/asio.hpp>
@@ -133,6 +135,31 @@ namespace te
 					/// 
 					/// This parameter is only required when AcceptorType is network::TlsSocket.
 					/// </param>
+					/// <param name="dnsCache">
+					/// An optional pointer to a DNS cache to be supplied to each client bridge, for
+					/// resolving upstream hosts.
+					/// </param>
+					/// <param name="timingWheel">
+					/// An optional pointer to a timing wheel to be supplied to each client bridge,
+					/// for keeping its stream timeout.
+					/// </param>
+					/// <param name="streamTimeouts">
+					/// The stream timeouts for each phase, supplied to each client bridge.
+					/// </param>
+					/// <param name="payloadBudget">
+					/// An optional pointer to the payload memory budget to be supplied to each
+					/// client bridge.
+					/// </param>
+					/// <param name="bufferPool">
+					/// An optional pointer to the payload read buffer pool to be supplied to each
+					/// client bridge.
+					/// </param>
+					/// <param name="servicePool">
+					/// An optional pointer to a pool of io_services to deal client bridges out to.
+					/// When supplied, every bridge is built on the io_service and timing wheel of
+					/// one of the pool's shards, rather than on the acceptor's own io_service and
+					/// the supplied timing wheel.
+					/// </param>
 					/// <param name="onInfoCb">
 					/// An optional callback for general information about non-critical events.
 					/// </param>
@@ -149,6 +176,12 @@ namespace te
 						uint16_t port = 0,
 						const std::string& caBundleAbsPath = std::string(u8"none"),
 						BaseInMemoryCertificateStore* store = nullptr,
+						network::DnsCache* dnsCache = nullptr,
+						network::TimingWheel* timingWheel = nullptr,
+						const network::StreamTimeouts& streamTimeouts = network::StreamTimeouts(),
+						http::PayloadMemoryBudget* payloadBudget = nullptr,
+						http::IoBufferPool* bufferPool = nullptr,
+						network::IoServicePool* servicePool = nullptr,
 						util::cb::MessageFunction onInfoCb = nullptr,
 						util::cb::MessageFunction onWarnCb = nullptr,
 						util::cb::MessageFunction onErrorCb = nullptr
@@ -159,6 +192,12 @@ namespace te
 						m_engine(filteringEngine),
 						m_caBundleAbsolutePath(caBundleAbsPath),
 						m_store(store),
+						m_dnsCache(dnsCache),
+						m_timingWheel(timingWheel),
+						m_streamTimeouts(streamTimeouts),
+						m_payloadBudget(payloadBudget),
+						m_bufferPool(bufferPool),
+						m_servicePool(servicePool),
 						m_acceptor(*service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address(), port)),
 						m_clientContext(*service, boost::asio::ssl::context::sslv23_client),
 						m_defaultServerContext(*service, boost::asio::ssl::context::tlsv12_server)
@@ -192,6 +231,19 @@ namespace te
 							ReportError(errMessage);
 						}
 
+						// Put the listener in non-blocking mode, so that clients already queued in
+						// the backlog can be drained synchronously after each async accept
+						// completes. See ::DrainPendingAccepts().
+						boost::system::error_code nonBlockingEc;
+						m_acceptor.non_blocking(true, nonBlockingEc);
+
+						if (nonBlockingEc)
+						{
+							std::string errMessage(u8"In TlsCapableHttpAcceptor::TlsCapableHttpAcceptor(...) - While setting listener non-blocking, got error:\t");
+							errMessage.append(nonBlockingEc.message());
+							ReportWarning(errMessage);
+						}
+
 						if (std::is_same<AcceptorType, network::TlsSocket>::value)
 						{
 							if (m_store == nullptr)
@@ -241,15 +293,9 @@ namespace te
 						{
 							try
 							{
-								SharedBridge session = std::make_shared<TlsCapableHttpBridge<AcceptorType>>(m_service, m_engine, m_store, &m_defaultServerContext, &m_clientContext, m_onInfo, m_onWarning, m_onError);
+								PrepareClientSocket();
 
-								if (session == nullptr)
-								{
-									ReportError(u8"In TlsCapableHttpAcceptor::HandleAccept(const boost::system::error_code&) - Failed to allocate new session!");
-									return false;
-								}
-
-								m_acceptor.async_accept(session->DownstreamSocket(), std::bind(&TlsCapableHttpAcceptor::HandleAccept, this, std::placeholders::_1, session));
+								m_acceptor.async_accept(*m_client, std::bind(&TlsCapableHttpAcceptor::HandleAccept, this, std::placeholders::_1));
 								return true;
 							}
 							catch (std::exception& e)
@@ -263,6 +309,61 @@ namespace te
 						return false;
 					}
 
+					/// <summary>
+					/// Gets a snapshot of the counters kept by the pool of idle upstream
+					/// connections shared by this acceptor's bridges.
+					/// </summary>
+					/// <returns>
+					/// The current connection pool statistics.
+					/// </returns>
+					UpstreamConnectionPoolStats GetConnectionPoolStats()
+					{
+						return m_connectionPool->GetStats();
+					}
+
+					/// <summary>
+					/// Gets how long this acceptor's bridges took to connect upstream.
+					/// </summary>
+					/// <returns>
+					/// The count of each bucket of network::ConnectTimeHistogram.
+					/// </returns>
+					std::array<uint64_t, network::ConnectTimeHistogram::BucketCount> GetConnectTimeCounts() const
+					{
+						return m_connectTimes.GetCounts();
+					}
+
+					/// <summary>
+					/// Asks every live bridge to wind down. Idle bridges close at once, and the
+					/// rest close as soon as their current transaction is done. Should follow
+					/// ::StopAccepting(), or new bridges will keep on coming. Each bridge does this
+					/// on its own io_service, so this returns before any of them have closed.
+					/// </summary>
+					void DrainBridges()
+					{
+						m_bridges.ForEach(std::bind(&TlsCapableHttpBridge<AcceptorType>::Drain, std::placeholders::_1));
+					}
+
+					/// <summary>
+					/// Closes every live bridge at once, whatever it is doing. As with
+					/// ::DrainBridges(), each bridge closes on its own io_service, shortly after
+					/// this returns.
+					/// </summary>
+					void TerminateBridges()
+					{
+						m_bridges.ForEach(std::bind(&TlsCapableHttpBridge<AcceptorType>::Terminate, std::placeholders::_1));
+					}
+
+					/// <summary>
+					/// Gets the number of bridges accepted by this acceptor that are still alive.
+					/// </summary>
+					/// <returns>
+					/// The number of live bridges.
+					/// </returns>
+					size_t GetLiveBridgeCount()
+					{
+						return m_bridges.Count();
+					}
+
 					/// <summary>
 					/// Cancels any pending async_accept calls, breaking the accept loop and thus
 					/// stopping the acceptor from accepting any new client connections.
@@ -351,15 +452,13 @@ namespace te
 					/// Error code that will indicate if any errors were handled during the async
 					/// operation, providing details if an error did occur and was handled.
 					/// </param>
-					/// <param name="session">
-					/// The session constructed that should contain the newly accept client socket
-					/// or ssl_stream.
-					/// </param>
-					void HandleAccept(const boost::system::error_code& error, SharedBridge session)
+					void HandleAccept(const boost::system::error_code& error)
 					{
-						if (!error && session.get() != nullptr)
+						if (!error)
 						{
-							session->Start();
+							StartBridge();
+
+							DrainPendingAccepts();
 
 							if (!AcceptConnections())
 							{
@@ -368,18 +467,149 @@ namespace te
 						}
 						else
 						{
-							if (error)
+							std::string errMessage(u8"In TlsCapableHttpAcceptor::HandleAccept(const boost::system::error_code&) - Got error:\t");
+							errMessage.append(error.message());
+						}
+					}
+
+					/// <summary>
+					/// Builds the bare socket that the next client is to be accepted into, unless
+					/// the one built last time is still waiting for a client. The socket is built
+					/// on the io_service of the next shard of the io_service pool if one was
+					/// supplied, or else on the acceptor's own io_service, since an accepted socket
+					/// can't be moved to a different io_service afterwards. Since a socket is only
+					/// used up by a successful accept, the pool advances exactly once for every
+					/// bridge started, and clients are dealt out evenly across every shard.
+					/// </summary>
+					void PrepareClientSocket()
+					{
+						if (m_client != nullptr)
+						{
+							return;
+						}
+
+						boost::asio::io_service* service = m_service;
+
+						m_clientShard = 0;
+
+						if (m_servicePool != nullptr)
+						{
+							m_clientShard = m_servicePool->Next();
+							service = m_servicePool->GetService(m_clientShard);
+						}
+
+						m_client.reset(new boost::asio::ip::tcp::socket(*service));
+					}
+
+					/// <summary>
+					/// Constructs a new client bridge, on the given shard of the io_service pool if
+					/// one was supplied, or else on the acceptor's own io_service.
+					/// </summary>
+					/// <param name="shard">
+					/// The index of the shard to build the bridge on. Ignored without a pool.
+					/// </param>
+					/// <returns>
+					/// The new client bridge.
+					/// </returns>
+					SharedBridge CreateBridge(const size_t shard)
+					{
+						boost::asio::io_service* service = m_service;
+						network::TimingWheel* timingWheel = m_timingWheel;
+
+						if (m_servicePool != nullptr)
+						{
+							service = m_servicePool->GetService(shard);
+							timingWheel = m_servicePool->GetTimingWheel(shard);
+						}
+
+						// Each shard is run by a single thread, so bridges on a shard need no strands.
+						return std::make_shared<TlsCapableHttpBridge<AcceptorType>>(service, m_engine, m_store, &m_defaultServerContext, &m_clientContext, m_connectionPool, m_dnsCache, &m_connectTimes, timingWheel, m_streamTimeouts, m_payloadBudget, m_bufferPool, m_servicePool != nullptr, m_onInfo, m_onWarning, m_onError);
+					}
+
+					/// <summary>
+					/// Builds a bridge for the client that was just accepted into m_client, on the
+					/// same io_service as the client's socket, then moves the socket into the
+					/// bridge and starts it. The bridge is only ever built once there is a client
+					/// to hand it. If the bridge can't be built, the client is dropped.
+					/// </summary>
+					void StartBridge()
+					{
+						try
+						{
+							SharedBridge session = CreateBridge(m_clientShard);
+
+							session->DownstreamSocket() = std::move(*m_client);
+							m_client.reset();
+
+							m_bridges.Register(session);
+							session->Start();
+						}
+						catch (std::exception& e)
+						{
+							m_client.reset();
+
+							std::string errMessage(u8"In TlsCapableHttpAcceptor::StartBridge() - Got error:\t");
+							errMessage.append(e.what());
+							ReportError(errMessage);
+						}
+					}
+
+					/// <summary>
+					/// Accepts, without waiting, clients that are already queued in the listen
+					/// backlog, up to MaxAcceptsPerWakeup of them, starting a bridge for each one
+					/// that is accepted.
+					/// This lets a single readiness wakeup of the listener admit a burst of
+					/// clients, rather than paying a full trip through the reactor for each one.
+					/// Stops at the first would_block or error, leaving the rest to the next
+					/// async_accept.
+					/// </summary>
+					void DrainPendingAccepts()
+					{
+						if (m_service == nullptr || !m_acceptor.non_blocking())
+						{
+							return;
+						}
+
+						for (size_t i = 0; i < MaxAcceptsPerWakeup; ++i)
+						{
+							try
 							{
-								std::string errMessage(u8"In TlsCapableHttpAcceptor::HandleAccept(const boost::system::error_code&) - Got error:\t");
-								errMessage.append(error.message());
+								PrepareClientSocket();
 							}
-							else
+							catch (std::exception& e)
+							{
+								std::string errMessage(u8"In TlsCapableHttpAcceptor::DrainPendingAccepts() - Got error:\t");
+								errMessage.append(e.what());
+								ReportError(errMessage);
+								return;
+							}
+
+							boost::system::error_code acceptEc;
+							m_acceptor.accept(*m_client, acceptEc);
+
+							if (acceptEc)
 							{
-								ReportError(u8"In TlsCapableHttpAcceptor::HandleAccept(const boost::system::error_code&) - session is nullptr!");
+								if (acceptEc != boost::asio::error::would_block && acceptEc != boost::asio::error::try_again)
+								{
+									std::string errMessage(u8"In TlsCapableHttpAcceptor::DrainPendingAccepts() - Got error:\t");
+									errMessage.append(acceptEc.message());
+									ReportWarning(errMessage);
+								}
+
+								return;
 							}
+
+							StartBridge();
 						}
 					}
 
+					/// <summary>
+					/// The most clients that ::DrainPendingAccepts() will take from the backlog
+					/// following a single async accept completion, so that a flood of new clients
+					/// can't starve the other handlers queued on the io_service.
+					/// </summary>
+					static constexpr size_t MaxAcceptsPerWakeup = 32;
+
 					/// <summary>
 					/// Pointer to the io_service driving the acceptor.
 					/// </summary>
@@ -408,11 +638,58 @@ namespace te
 					/// </summary>
 					BaseInMemoryCertificateStore* m_store = nullptr;
 
+					/// <summary>
+					/// Pointer to the DNS cache to be supplied to each client bridge. May be
+					/// nullptr, in which case each bridge resolves upstream hosts on its own.
+					/// </summary>
+					network::DnsCache* m_dnsCache = nullptr;
+
+					/// <summary>
+					/// Pointer to the timing wheel to be supplied to each client bridge. May be
+					/// nullptr, in which case bridges never time out.
+					/// </summary>
+					network::TimingWheel* m_timingWheel = nullptr;
+
+					/// <summary>
+					/// The stream timeouts for each phase, supplied to each client bridge.
+					/// </summary>
+					const network::StreamTimeouts m_streamTimeouts;
+
+					/// <summary>
+					/// Pointer to the payload memory budget to be supplied to each client bridge.
+					/// May be nullptr.
+					/// </summary>
+					http::PayloadMemoryBudget* m_payloadBudget = nullptr;
+
+					/// <summary>
+					/// Pointer to the payload read buffer pool to be supplied to each client
+					/// bridge. May be nullptr.
+					/// </summary>
+					http::IoBufferPool* m_bufferPool = nullptr;
+
+					/// <summary>
+					/// Pointer to the pool of io_services that client bridges are dealt out to. May
+					/// be nullptr, in which case every bridge is built on m_service.
+					/// </summary>
+					network::IoServicePool* m_servicePool = nullptr;
+
 					/// <summary>
 					/// The underlying TCP acceptor itself.
 					/// </summary>
 					boost::asio::ip::tcp::acceptor m_acceptor;
 
+					/// <summary>
+					/// The bare socket that the next client is to be accepted into. Built by
+					/// ::PrepareClientSocket() and handed to a bridge by ::StartBridge().
+					/// </summary>
+					std::unique_ptr<boost::asio::ip::tcp::socket> m_client;
+
+					/// <summary>
+					/// The index of the io_service pool shard that m_client was built on.
+					/// Meaningless when there is no pool.
+					/// </summary>
+					size_t m_clientShard = 0;
+
 					/// <summary>
 					/// The client context for each Tls client bridge. Only used when AcceptorType
 					/// is network::TlsSocket.
@@ -427,6 +704,24 @@ namespace te
 					/// </summary>
 					boost::asio::ssl::context m_defaultServerContext;				
 
+					/// <summary>
+					/// Idle upstream connections left behind by finished bridges, to be reused by
+					/// new bridges headed for the same host. Declared after the contexts so that
+					/// pooled Tls sockets are destroyed before the context they were built with.
+					/// Bridges only hold it weakly, since they can outlive this acceptor.
+					/// </summary>
+					std::shared_ptr< UpstreamConnectionPool<AcceptorType> > m_connectionPool = std::make_shared< UpstreamConnectionPool<AcceptorType> >();
+
+					/// <summary>
+					/// How long this acceptor's bridges took to connect upstream.
+					/// </summary>
+					network::ConnectTimeHistogram m_connectTimes;
+
+					/// <summary>
+					/// Every bridge this acceptor has started, for as long as it lives.
+					/// </summary>
+					BridgeRegistry<TlsCapableHttpBridge<AcceptorType>> m_bridges;
+
 				};
 
 				using TcpAcceptor = TlsCapableHttpAcceptor<network::TcpSocket>;
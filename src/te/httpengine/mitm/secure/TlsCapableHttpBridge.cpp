@@ -47,6 +47,14 @@ namespace te
 					BaseInMemoryCertificateStore* certStore,
 					boost::asio::ssl::context* defaultServerContext,
 					boost::asio::ssl::context* clientContext,
+					std::weak_ptr< UpstreamConnectionPool<network::TcpSocket> > connectionPool,
+					network::DnsCache* dnsCache,
+					network::ConnectTimeHistogram* connectTimes,
+					network::TimingWheel* timingWheel,
+					const network::StreamTimeouts& streamTimeouts,
+					http::PayloadMemoryBudget* payloadBudget,
+					http::IoBufferPool* bufferPool,
+					const bool singleThreadedService,
 					util::cb::MessageFunction onInfoCb,
 					util::cb::MessageFunction onWarnCb,
 					util::cb::MessageFunction onErrorCb
@@ -56,14 +64,20 @@ namespace te
 						onWarnCb, 
 						onErrorCb
 						),
-					m_upstreamSocket(*service), 
+					m_upstreamSocket(new network::TcpSocket(*service)), 
 					m_downstreamSocket(*service),
-					m_upstreamStrand(*service),
-					m_downstreamStrand(*service),
+					m_upstreamStrand(*service, singleThreadedService),
+					m_downstreamStrand(*service, singleThreadedService),
 					m_resolver(*service),
-					m_streamTimer(*service),				
+					m_timingWheel(timingWheel),
+					m_streamTimeouts(streamTimeouts),
 					m_filteringEngine(filteringEngine),
-					m_certStore(certStore)				
+					m_certStore(certStore),
+					m_connectionPool(connectionPool),
+					m_dnsCache(dnsCache),
+					m_connectTimes(connectTimes),
+					m_payloadBudget(payloadBudget),
+					m_bufferPool(bufferPool)
 				{
 					#ifndef NDEBUG						
 						assert(m_filteringEngine != nullptr && u8"In TlsCapableHttpBridge<network::TcpSocket>::TlsCapableHttpBridge(... args) - Supplied filtering engine pointer is nullptr!");
@@ -86,6 +100,10 @@ namespace te
 					m_response->SetOnInfo(m_onInfo);
 					m_response->SetOnWarning(m_onWarning);
 					m_response->SetOnError(m_onError);
+					m_request->SetPayloadMemoryBudget(m_payloadBudget);
+					m_response->SetPayloadMemoryBudget(m_payloadBudget);
+					m_request->SetIoBufferPool(m_bufferPool);
+					m_response->SetIoBufferPool(m_bufferPool);
 				}
 				
 				TlsCapableHttpBridge<network::TlsSocket>::TlsCapableHttpBridge(
@@ -94,6 +112,14 @@ namespace te
 					BaseInMemoryCertificateStore* certStore,
 					boost::asio::ssl::context* defaultServerContext,
 					boost::asio::ssl::context* clientContext,
+					std::weak_ptr< UpstreamConnectionPool<network::TlsSocket> > connectionPool,
+					network::DnsCache* dnsCache,
+					network::ConnectTimeHistogram* connectTimes,
+					network::TimingWheel* timingWheel,
+					const network::StreamTimeouts& streamTimeouts,
+					http::PayloadMemoryBudget* payloadBudget,
+					http::IoBufferPool* bufferPool,
+					const bool singleThreadedService,
 					util::cb::MessageFunction onInfoCb,
 					util::cb::MessageFunction onWarnCb,
 					util::cb::MessageFunction onErrorCb
@@ -104,14 +130,20 @@ namespace te
 						onWarnCb,
 						onErrorCb
 						),
-					m_upstreamSocket(*service, *clientContext),
+					m_upstreamSocket(new network::TlsSocket(*service, *clientContext)),
 					m_downstreamSocket(*service, *defaultServerContext),
-					m_upstreamStrand(*service),
-					m_downstreamStrand(*service),
+					m_upstreamStrand(*service, singleThreadedService),
+					m_downstreamStrand(*service, singleThreadedService),
 					m_resolver(*service),
-					m_streamTimer(*service),					
+					m_timingWheel(timingWheel),
+					m_streamTimeouts(streamTimeouts),
 					m_filteringEngine(filteringEngine),
-					m_certStore(certStore)
+					m_certStore(certStore),
+					m_connectionPool(connectionPool),
+					m_dnsCache(dnsCache),
+					m_connectTimes(connectTimes),
+					m_payloadBudget(payloadBudget),
+					m_bufferPool(bufferPool)
 				{
 					#ifndef NDEBUG					
 						assert(m_filteringEngine != nullptr && u8"In TlsCapableHttpBridge<network::TlsSocket>::TlsCapableHttpBridge(... args) - Supplied certificate store is nullptr!");
@@ -143,73 +175,11 @@ namespace te
 					m_response->SetOnWarning(m_onWarning);
 					m_response->SetOnError(m_onError);
 
-				}
-
-				template<>
-				void TlsCapableHttpBridge<network::TcpSocket>::Start()
-				{
-					try
-					{
-						SetStreamTimeout(10000);
-
-						// We start off by simply reading the client request headers.
-						boost::asio::async_read_until(
-							m_downstreamSocket, 
-							m_request->GetHeaderReadBuffer(), 
-							u8"\r\n\r\n",
-							m_downstreamStrand.wrap(
-								std::bind(
-									&TlsCapableHttpBridge::OnDownstreamHeaders, 
-									shared_from_this(), 
-									std::placeholders::_1, 
-									std::placeholders::_2
-									)
-								)
-							);
+					m_request->SetPayloadMemoryBudget(m_payloadBudget);
+					m_response->SetPayloadMemoryBudget(m_payloadBudget);
+					m_request->SetIoBufferPool(m_bufferPool);
+					m_response->SetIoBufferPool(m_bufferPool);
 
-						return;
-					}
-					catch (std::exception& e)
-					{
-						std::string errMessage(u8"IN TlsCapableHttpBridge<network::TcpSocket>::Start() - Got error:\t");
-						errMessage.append(e.what());
-						ReportError(errMessage);
-					}
-
-					Kill();
-				}
-
-				template<>
-				void TlsCapableHttpBridge<network::TlsSocket>::Start()
-				{					
-					try
-					{
-						SetStreamTimeout(10000);
-
-						// Start a peek read on the connected secure client, so we can attempt to extract the
-						// SNI hostname in the handler without screwing up the pending handshake.
-						m_downstreamSocket.next_layer().async_receive(
-							boost::asio::buffer(*m_tlsPeekBuffer.get(), m_tlsPeekBuffer->size()), 
-							boost::asio::ip::tcp::socket::message_peek, 
-							m_downstreamStrand.wrap(
-								std::bind(&TlsCapableHttpBridge::OnTlsPeek, 
-									shared_from_this(), 
-									std::placeholders::_1,
-									std::placeholders::_2
-									)
-								)
-							);
-
-						return;
-					}
-					catch (std::exception& e)
-					{
-						std::string errMessage(u8"IN TlsCapableHttpBridge<network::TlsSocket>::Start() - Got error:\t");
-						errMessage.append(e.what());						
-						ReportError(errMessage);
-					}
-
-					Kill();
 				}
 
 				template<>
@@ -227,267 +197,339 @@ namespace te
 				template<>
 				boost::asio::ip::tcp::socket& TlsCapableHttpBridge<network::TcpSocket>::UpstreamSocket()
 				{
-					return m_upstreamSocket;
+					return *m_upstreamSocket;
 				}
 
 				template<>
 				boost::asio::ip::tcp::socket& TlsCapableHttpBridge<network::TlsSocket>::UpstreamSocket()
 				{
-					return m_upstreamSocket.next_layer();
+					return m_upstreamSocket->next_layer();
 				}
 
 				template<>
-				void TlsCapableHttpBridge<network::TcpSocket>::OnUpstreamConnect(const boost::system::error_code& error)
+				void TlsCapableHttpBridge<network::TcpSocket>::ConnectionFlow::Run(const boost::system::error_code& error, const size_t bytesTransferred)
 				{
+					BOOST_ASIO_CORO_REENTER(this)
+					{
+
+						#ifndef NDEBUG
+						m_bridge->ReportInfo(u8"TlsCapableHttpBridge<network::TcpSocket>::ConnectionFlow::Run");
+						#endif // !NDEBUG
+
+						m_bridge->SetStreamTimeout(network::StreamPhase::Connect);
 
-					#ifndef NDEBUG
-					ReportInfo(u8"TlsCapableHttpBridge<network::TcpSocket>::OnUpstreamConnect");
-					#endif // !NDEBUG
+						BOOST_ASIO_CORO_YIELD m_bridge->ResolveUpstream(u8"http", *this);
 
-					if (!error)
-					{					
-						if (m_request->IsPayloadComplete() == false && m_request->GetConsumeAllBeforeSending() == true)
+						if (error)
 						{
-							// Means that there is a request payload, it's not complete, and it's been flagged
-							// for inspection before being sent upstream. Another read from the client is
-							// required.
-							
-							try
-							{
-								auto requestReadBuffer = m_request->GetPayloadReadBuffer();
+							std::string errMsg(u8"In TlsCapableHttpBridge<network::TcpSocket>::ConnectionFlow::Run(const boost::system::error_code&, const size_t) - While resolving, got error:\t");
+							errMsg.append(error.message());
+							m_bridge->ReportError(errMsg);
 
-								boost::asio::async_read(
-									m_downstreamSocket,
-									requestReadBuffer,
-									boost::asio::transfer_at_least(1),
-									m_downstreamStrand.wrap(
-										std::bind(
-											&TlsCapableHttpBridge::OnDownstreamRead,
-											shared_from_this(),
-											std::placeholders::_1,
-											std::placeholders::_2
-											)
-										)
-									);
+							m_bridge->Kill();
+							return;
+						}
 
-								return;
-							}
-							catch (std::exception& e)
-							{
-								std::string errMsg(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamConnect(const boost::system::error_code&) - Got error:\t");
-								errMsg.append(e.what());
-								ReportError(errMsg);
-							}							
+						BOOST_ASIO_CORO_YIELD m_bridge->ConnectUpstream(m_bridge->ToUpstreamEndpoints(m_endpoints), *this);
+
+						if (error || m_winner == nullptr)
+						{
+							std::string errMsg(u8"In TlsCapableHttpBridge<network::TcpSocket>::ConnectionFlow::Run(const boost::system::error_code&, const size_t) - While connecting, got error:\t");
+							errMsg.append(error ? error.message() : u8"No resolved endpoint could be connected to.");
+							m_bridge->ReportError(errMsg);
+
+							m_bridge->Kill();
+							return;
 						}
 
-						// Means that we need to start off by simply writing whatever we've got from the client to 
-						// the server. In the completion handler for this op, it will be determined if the client
-						// has more to give or not, and this will be handled correctly.
-
-						auto writeBuffer = m_request->GetWriteBuffer();
-						
-						boost::asio::async_write(
-							m_upstreamSocket, 
-							writeBuffer, 
-							boost::asio::transfer_all(), 
-							m_upstreamStrand.wrap(
-								std::bind(
-									&TlsCapableHttpBridge::OnUpstreamWrite, 
-									shared_from_this(), 
-									std::placeholders::_1
-									)
-								)
-							);
+						m_bridge->UpstreamSocket() = std::move(*m_winner);
+						m_winner.reset();
 
-						return;
+						m_bridge->OnUpstreamConnected();
 					}
-					else
-					{
-						std::string errMsg(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamConnect(const boost::system::error_code&) - Got error:\t");
-						errMsg.append(error.message());
-						ReportError(errMsg);
-					}
-					
-					Kill();
 				}
 
 				template<>
-				void TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamConnect(const boost::system::error_code& error)
+				void TlsCapableHttpBridge<network::TlsSocket>::ConnectionFlow::Run(const boost::system::error_code& error, const size_t bytesTransferred)
 				{
+					BOOST_ASIO_CORO_REENTER(this)
+					{
 
-					#ifndef NDEBUG
-					ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamConnect");
-					#endif // !NDEBUG
+						#ifndef NDEBUG
+						m_bridge->ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::ConnectionFlow::Run");
+						#endif // !NDEBUG
 
-					if (!error)
-					{						
-						SetStreamTimeout(5000);
+						m_bridge->SetStreamTimeout(network::StreamPhase::Handshake);
 
-						m_upstreamSocket.set_verify_mode(boost::asio::ssl::verify_peer | boost::asio::ssl::verify_fail_if_no_peer_cert);
+						// Start with a peek read on the connected secure client, so we can attempt to extract
+						// the SNI hostname without screwing up the pending handshake.
+						BOOST_ASIO_CORO_YIELD m_bridge->m_downstreamSocket.next_layer().async_receive(
+							boost::asio::buffer(*m_bridge->m_tlsPeekBuffer.get(), m_bridge->m_tlsPeekBuffer->size()),
+							boost::asio::ip::tcp::socket::message_peek,
+							m_bridge->m_downstreamStrand.wrap(network::MakeArenaHandler(m_bridge->m_handlerArena, *this))
+							);
 
-						boost::system::error_code scerr;
+						if (!m_bridge->ReadSniHost(error, bytesTransferred))
+						{
+							m_bridge->Kill();
+							return;
+						}
 
-						// Verification callback does not require a shared_ptr for the bind, because the async_handshake
-						// completion handler will "out-live" the verification callback, so it will hold the shared_ptr
-						// that will ensure this object survives the async handshake.
+						if (!m_bridge->m_tlsPassthrough)
+						{
+							auto connectionPool = m_bridge->m_connectionPool.lock();
 
-						m_upstreamSocket.set_verify_callback(
-							std::bind(
-								&TlsCapableHttpBridge::VerifyServerCertificateCallback, 
-								this, 
-								std::placeholders::_1, 
-								std::placeholders::_2
-								), 
-							scerr
-							);
+							if (connectionPool != nullptr)
+							{
+								// A pooled connection was made with this very host as its SNI name and
+								// has already been verified, so resolving, connecting and the upstream
+								// handshake can all be skipped. The certificate is only needed long
+								// enough to fetch the spoofed server context.
+								auto pooled = connectionPool->CheckOut(m_bridge->m_upstreamHost, m_bridge->m_upstreamHostPort, m_bridge->m_upstreamStrand.get_io_service());
+
+								if (pooled != nullptr)
+								{
+									m_bridge->m_upstreamSocket = std::move(pooled);
+
+									// The verification callback still points at the bridge that made the
+									// connection, so point it at this one, in case of a renegotiation.
+									boost::system::error_code scerr;
+									m_bridge->m_upstreamSocket->set_verify_callback(
+										std::bind(
+											&TlsCapableHttpBridge::VerifyServerCertificateCallback,
+											m_bridge.get(),
+											std::placeholders::_1,
+											std::placeholders::_2
+											),
+										scerr
+										);
 
-						if (!scerr)
+									m_bridge->m_upstreamCert = SSL_get_peer_certificate(m_bridge->m_upstreamSocket->native_handle());
+
+									m_pooled = true;
+								}
+							}
+						}
+
+						if (!m_pooled)
 						{
-							m_upstreamSocket.async_handshake(
-								network::TlsSocket::client, 
-								m_upstreamStrand.wrap(
+							BOOST_ASIO_CORO_YIELD m_bridge->ResolveUpstream(u8"https", *this);
+
+							if (error)
+							{
+								std::string errMsg(u8"In TlsCapableHttpBridge<network::TlsSocket>::ConnectionFlow::Run(const boost::system::error_code&, const size_t) - While resolving, got error:\t");
+								errMsg.append(error.message());
+								m_bridge->ReportError(errMsg);
+
+								m_bridge->Kill();
+								return;
+							}
+
+							m_bridge->SetStreamTimeout(network::StreamPhase::Connect);
+
+							SSL_set_tlsext_host_name(m_bridge->m_upstreamSocket->native_handle(), m_bridge->m_upstreamHost.c_str());
+
+							// Note that unlike plain bridges, the port is not parsed out of the upstream
+							// host. It's always 443, because, AFAIK, there is no such data in the SNI
+							// extension, the place where we get the hostname from.
+							//
+							// This could become a problem only depending on our implementation in the 
+							// packet diversion system. If we intercept TLS packets that are not destined
+							// for 443 and send them to this proxy, then we'll break the connection entirely.
+							// Care therefore needs to be taken, or a more robust system needs to be put in
+							// place starting at the diversion level.
+							BOOST_ASIO_CORO_YIELD m_bridge->ConnectUpstream(m_bridge->ToUpstreamEndpoints(m_endpoints), *this);
+
+							if (error || m_winner == nullptr)
+							{
+								std::string errMsg(u8"In TlsCapableHttpBridge<network::TlsSocket>::ConnectionFlow::Run(const boost::system::error_code&, const size_t) - While connecting, got error:\t");
+								errMsg.append(error ? error.message() : u8"No resolved endpoint could be connected to.");
+								m_bridge->ReportError(errMsg);
+
+								m_bridge->Kill();
+								return;
+							}
+
+							m_bridge->UpstreamSocket() = std::move(*m_winner);
+							m_winner.reset();
+
+							if (m_bridge->m_tlsPassthrough)
+							{
+								m_bridge->StartTlsPassthrough();
+								return;
+							}
+
+							m_bridge->SetStreamTimeout(network::StreamPhase::Handshake);
+
+							m_bridge->m_upstreamSocket->set_verify_mode(boost::asio::ssl::verify_peer | boost::asio::ssl::verify_fail_if_no_peer_cert);
+
+							{
+								boost::system::error_code scerr;
+
+								// Verification callback does not require a shared_ptr for the bind, because this
+								// flow, which holds one, will "out-live" the verification callback and so ensures
+								// this object survives the async handshake.
+								m_bridge->m_upstreamSocket->set_verify_callback(
 									std::bind(
-										&TlsCapableHttpBridge::OnUpstreamHandshake, 
-										shared_from_this(), 
-										std::placeholders::_1
-										)
-									)
+										&TlsCapableHttpBridge::VerifyServerCertificateCallback,
+										m_bridge.get(),
+										std::placeholders::_1,
+										std::placeholders::_2
+										),
+									scerr
+									);
+
+								if (scerr)
+								{
+									std::string errMsg(u8"In TlsCapableHttpBridge<network::TlsSocket>::ConnectionFlow::Run(const boost::system::error_code&, const size_t) - While setting verification callback, got error:\t");
+									errMsg.append(scerr.message());
+									m_bridge->ReportError(errMsg);
+
+									m_bridge->Kill();
+									return;
+								}
+							}
+
+							BOOST_ASIO_CORO_YIELD m_bridge->m_upstreamSocket->async_handshake(
+								network::TlsSocket::client,
+								m_bridge->m_upstreamStrand.wrap(network::MakeArenaHandler(m_bridge->m_handlerArena, *this))
 								);
 
-							return;
+							if (error)
+							{
+								std::string errMsg(u8"In TlsCapableHttpBridge<network::TlsSocket>::ConnectionFlow::Run(const boost::system::error_code&, const size_t) - During upstream handshake, got error:\t");
+								errMsg.append(error.message());
+								m_bridge->ReportError(errMsg);
+
+								m_bridge->Kill();
+								return;
+							}
 						}
-						else
+
+						// Serve the client with a context spoofed from the upstream certificate, which
+						// will either be retrieved, or created, stored and then retrieved.
 						{
-							std::string errMsg(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamConnect(const boost::system::error_code&) - While setting verification callback, got error:\t");
-							errMsg.append(error.message());
-							ReportError(errMsg);
-						}
-					}
-					else
-					{
-						std::string errMsg(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamConnect(const boost::system::error_code&) - Got error:\t");
-						errMsg.append(error.message());
-						ReportError(errMsg);
-					}
+							boost::asio::ssl::context* serverCtx = nullptr;
 
-					Kill();
-				}
+							if (m_bridge->m_upstreamCert != nullptr)
+							{
+								try
+								{
+									serverCtx = m_bridge->m_certStore->GetServerContext(m_bridge->m_upstreamHost, m_bridge->m_upstreamCert);
+								}
+								catch (std::exception& e)
+								{
+									serverCtx = nullptr;
+									std::string errMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::ConnectionFlow::Run(const boost::system::error_code&, const size_t) - Got error:\t");
+									errMessage.append(e.what());
+									m_bridge->ReportError(errMessage);
+								}
+							}
+							else
+							{
+								m_bridge->ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::ConnectionFlow::Run(const boost::system::error_code&, const size_t) - Upstream cert is nullptr!");
+							}
 
-				template<>
-				void TlsCapableHttpBridge<network::TcpSocket>::OnResolve(const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator endpointIterator)
-				{
+							const bool contextSet = serverCtx != nullptr && SSL_set_SSL_CTX(m_bridge->m_downstreamSocket.native_handle(), serverCtx->native_handle()) == serverCtx->native_handle();
 
-					#ifndef NDEBUG
-					ReportInfo(u8"TlsCapableHttpBridge<network::TcpSocket>::OnResolve");
-					#endif // !NDEBUG
+							if (m_pooled && m_bridge->m_upstreamCert != nullptr)
+							{
+								X509_free(m_bridge->m_upstreamCert);
+								m_bridge->m_upstreamCert = nullptr;
+							}
 
-					if (!error)
-					{
-						SetStreamTimeout(5000);
-
-						auto ep = *endpointIterator;
-
-						// Perhaps client requested a port other than 80. We should have already parsed
-						// this before initiating the resolve of the upstream host, so that this information
-						// was not polluting the hostname during resolution.
-						//
-						// RFC2616 Section 14.23 demands that non-port-80 requests include the port in with
-						// the host name, so this should be reliable. If m_upstreamHostPort is zero, the 
-						// default value, then we leave the configured port alone, because we resolved this
-						// using "http" as the service parameter on the resolver. The service parameter consults
-						// something unknown to me (I vaguely remember the details) which has a list of port
-						// numbers associated with specific services. So by default, every iterator result
-						// here should be preconfigured to port 80.
-						if (m_upstreamHostPort != 0 && ep.endpoint().port() != m_upstreamHostPort)
+							if (!contextSet)
+							{
+								if (serverCtx != nullptr)
+								{
+									m_bridge->ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::ConnectionFlow::Run(const boost::system::error_code&, const size_t) - Failed to correctly set context.");
+								}
+								else
+								{
+									m_bridge->ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::ConnectionFlow::Run(const boost::system::error_code&, const size_t) - Failed to fetch spoofed context.");
+								}
+
+								m_bridge->Kill();
+								return;
+							}
+						}
+
+						m_bridge->SetStreamTimeout(network::StreamPhase::Handshake);
+
+						BOOST_ASIO_CORO_YIELD m_bridge->m_downstreamSocket.async_handshake(
+							network::TlsSocket::server,
+							m_bridge->m_downstreamStrand.wrap(network::MakeArenaHandler(m_bridge->m_handlerArena, *this))
+							);
+
+						if (error)
 						{
-							ep.endpoint().port(m_upstreamHostPort);
+							std::string errMsg(u8"In TlsCapableHttpBridge<network::TlsSocket>::ConnectionFlow::Run(const boost::system::error_code&, const size_t) - During downstream handshake, got error:\t");
+							errMsg.append(error.message());
+							m_bridge->ReportError(errMsg);
+
+							m_bridge->Kill();
+							return;
 						}
 
-						// XXX TODO. The correct thing to do here is keep the iterator somehow, then in
-						// the completion handler, in the event of a connection related error, keep
-						// incrementing through the iterator until all possible endpoints for the
-						// requested host have been exhausted. Doing things this way means that we
-						// only take a crack at connecting to the first A record entry resolved, then
-						// quit if that first record does not work.
-
-						m_upstreamSocket.async_connect(
-							ep, 
-							m_upstreamStrand.wrap(
-								std::bind(
-									&TlsCapableHttpBridge::OnUpstreamConnect, 
-									shared_from_this(), 
-									std::placeholders::_1
-									)
-								)
+						m_bridge->SetNoDelay(m_bridge->UpstreamSocket(), true);
+						m_bridge->SetNoDelay(m_bridge->DownstreamSocket(), true);
+
+						BOOST_ASIO_CORO_YIELD boost::asio::async_read_until(
+							m_bridge->m_downstreamSocket,
+							m_bridge->m_request->GetHeaderReadBuffer(),
+							u8"\r\n\r\n",
+							m_bridge->m_downstreamStrand.wrap(network::MakeArenaHandler(m_bridge->m_handlerArena, *this))
 							);
 
-						return;
+						m_bridge->OnDownstreamHeaders(error, bytesTransferred);
 					}
-					else
-					{
-						std::string errMsg(u8"In TlsCapableHttpBridge<network::TcpSocket>::OnResolve(const boost::system::error_code&, boost::asio::ip::tcp::resolver::iterator) - Got error:\t");
-						errMsg.append(error.message());
-						ReportError(errMsg);
-					}
-
-					Kill();
 				}
 
 				template<>
-				void TlsCapableHttpBridge<network::TlsSocket>::OnResolve(const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator endpointIterator)
+				void TlsCapableHttpBridge<network::TcpSocket>::Start()
 				{
-
-					#ifndef NDEBUG
-					ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnResolve");
-					#endif // !NDEBUG
-
-					if (!error)
+					try
 					{
-						SetStreamTimeout(5000);
-
-						SSL_set_tlsext_host_name(m_upstreamSocket.native_handle(), m_upstreamHost.c_str());
-
-						// XXX TODO. The correct thing to do here is keep the iterator somehow, then in
-						// the completion handler, in the event of a connection related error, keep
-						// incrementing through the iterator until all possible endpoints for the
-						// requested host have been exhausted. Doing things this way means that we
-						// only take a crack at connecting to the first A record entry resolved, then
-						// quit if that first record does not work.
-
-						// Note also that unlike the TCP version of this handler, we do not check the
-						// upstream host member for a port number. This is because, AFAIK, there is no
-						// such data in the SNI extension, the place where we get the hostname from.
-						//
-						// This could become a problem only depending on our implementation in the 
-						// packet diversion system. If we intercept TLS packets that are not destined
-						// for 443 and send them to this proxy, then we'll break the connection entirely.
-						// Care therefore needs to be taken, or a more robust system needs to be put in
-						// place starting at the diversion level.
-
-						boost::asio::ip::tcp::endpoint requestedEndpoint = *endpointIterator;
-
-						m_upstreamSocket.lowest_layer().async_connect(
-							boost::asio::ip::tcp::endpoint(requestedEndpoint.address(), m_upstreamHostPort),
-							m_upstreamStrand.wrap(
-								std::bind(
-									&TlsCapableHttpBridge::OnUpstreamConnect, 
-									shared_from_this(), 
-									std::placeholders::_1
+						SetStreamTimeout(network::StreamPhase::IdleKeepAlive);
+
+						// We start off by simply reading the client request headers.
+						boost::asio::async_read_until(
+							m_downstreamSocket, 
+							m_request->GetHeaderReadBuffer(), 
+							u8"\r\n\r\n",
+							m_downstreamStrand.wrap(
+								network::MakeArenaHandler(
+									m_handlerArena,
+									std::bind(
+										&TlsCapableHttpBridge::OnDownstreamHeaders, 
+										shared_from_this(), 
+										std::placeholders::_1, 
+										std::placeholders::_2
+										)
 									)
 								)
 							);
 
 						return;
 					}
-					else
+					catch (std::exception& e)
 					{
-						std::string errMsg(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnResolve(const boost::system::error_code&, boost::asio::ip::tcp::resolver::iterator) - Got error:\t");
-						errMsg.append(error.message());
-						ReportError(errMsg);
+						std::string errMessage(u8"IN TlsCapableHttpBridge<network::TcpSocket>::Start() - Got error:\t");
+						errMessage.append(e.what());
+						ReportError(errMessage);
 					}
 
 					Kill();
-				}				
+				}
+
+				template<>
+				void TlsCapableHttpBridge<network::TlsSocket>::Start()
+				{
+					// Everything up to and including the read of the client's first request headers
+					// is done by the ConnectionFlow.
+					ConnectionFlow flow(shared_from_this());
+					flow();
+				}
 
 			} /* namespace secure */
 		} /* namespace mitm */
@@ -31,11 +31,18 @@
 
 #pragma once
 
+#include <boost/asio/coroutine.hpp>
 #include <boost/predef/architecture.h>
 #include <boost/predef/os.h>
 #include <boost/predef/compiler.h>
 #include "../../network/SocketTypes.hpp"
+#include "../../network/DnsCache.hpp"
+#include "../../network/HandlerArena.hpp"
+#include "../../network/HandlerSerializer.hpp"
+#include "../../network/HappyEyeballsConnector.hpp"
+#include "../../network/TimingWheel.hpp"
 #include "BaseInMemoryCertificateStore.hpp"
+#include "UpstreamConnectionPool.hpp"
 #include "../../filtering/http/HttpFilteringEngine.hpp"
 #include "../http/HttpRequest.hpp"
 #include "../http/HttpResponse.hpp"
@@ -43,6 +50,10 @@
 #include "../../../util/http/KnownHttpHeaders.hpp"
 #include <memory>
 #include <atomic>
+#include <deque>
+#include <vector>
+#include <array>
+#include <algorithm>
 #include <type_traits>
 
 #if BOOST_OS_WINDOWS
@@ -237,6 +248,42 @@ namespace te
 					/// uses this for verifying server certificates. In this context, the "client"
 					/// is the proxy.
 					/// </param>
+					/// <param name="connectionPool">
+					/// An optional reference to the pool of idle upstream connections, owned by the
+					/// acceptor. When supplied, the bridge tries to check out a warm connection to
+					/// its host before connecting on its own, and checks its upstream connection in
+					/// when it finishes, if that connection can be reused and the pool still exists.
+					/// </param>
+					/// <param name="dnsCache">
+					/// An optional pointer to the DNS cache shared by all bridges. When supplied,
+					/// upstream hosts are resolved through it, rather than by the bridge's own
+					/// resolver.
+					/// </param>
+					/// <param name="connectTimes">
+					/// An optional pointer to the histogram that upstream connect times are
+					/// recorded into.
+					/// </param>
+					/// <param name="timingWheel">
+					/// An optional pointer to the timing wheel shared by all bridges, which keeps
+					/// the bridge's stream timeout. If nullptr, the bridge's streams never time out.
+					/// </param>
+					/// <param name="streamTimeouts">
+					/// The number of milliseconds the bridge is given to make progress in each
+					/// phase before it is terminated.
+					/// </param>
+					/// <param name="payloadBudget">
+					/// An optional pointer to the process wide budget that payloads buffered for
+					/// inspection are reserved against.
+					/// </param>
+					/// <param name="bufferPool">
+					/// An optional pointer to the pool that transactions take their payload read
+					/// buffers from.
+					/// </param>
+					/// <param name="singleThreadedService">
+					/// Whether the supplied io_service is run by exactly one thread, as each shard
+					/// of an io_service pool is. When true, the bridge serializes its handlers
+					/// through the io_service itself and builds no strands.
+					/// </param>
 					/// <param name="onInfoCb">
 					/// A callback to receive generated information about general events. Data that
 					/// may be sent through this callback, if provided, is simply "verbose" output
@@ -268,6 +315,14 @@ namespace te
 						BaseInMemoryCertificateStore* certStore = nullptr,
 						boost::asio::ssl::context* defaultServerContext = nullptr,
 						boost::asio::ssl::context* clientContext = nullptr,
+						std::weak_ptr< UpstreamConnectionPool<BridgeSocketType> > connectionPool = std::weak_ptr< UpstreamConnectionPool<BridgeSocketType> >(),
+						network::DnsCache* dnsCache = nullptr,
+						network::ConnectTimeHistogram* connectTimes = nullptr,
+						network::TimingWheel* timingWheel = nullptr,
+						const network::StreamTimeouts& streamTimeouts = network::StreamTimeouts(),
+						http::PayloadMemoryBudget* payloadBudget = nullptr,
+						http::IoBufferPool* bufferPool = nullptr,
+						const bool singleThreadedService = false,
 						util::cb::MessageFunction onInfoCb = nullptr,
 						util::cb::MessageFunction onWarnCb = nullptr,
 						util::cb::MessageFunction onErrorCb = nullptr
@@ -281,11 +336,22 @@ namespace te
 					TlsCapableHttpBridge& operator=(const TlsCapableHttpBridge&) = delete;
 
 					/// <summary>
-					/// Default destructor.
+					/// Default destructor. If the upstream connection was left idle and reusable,
+					/// it is handed to the connection pool here, once no handler can touch it. The
+					/// bridge may well outlive the acceptor that owns the pool, in which case the
+					/// connection is simply closed.
 					/// </summary>
 					~TlsCapableHttpBridge()
 					{
+						if (m_upstreamReusable && m_upstreamSocket != nullptr)
+						{
+							auto connectionPool = m_connectionPool.lock();
 
+							if (connectionPool != nullptr)
+							{
+								connectionPool->CheckIn(m_upstreamHost, m_upstreamHostPort, std::move(m_upstreamSocket));
+							}
+						}
 					}
 
 				private:
@@ -303,9 +369,18 @@ namespace te
 					std::unique_ptr<http::HttpResponse> m_response = nullptr;
 
 					/// <summary>
-					/// Socket used to connect to the client's desired host.
+					/// The memory that every async operation on the bridge's sockets is allocated
+					/// from, so that steady relaying never goes to the heap. Declared ahead of the
+					/// sockets and strands, so that it is destroyed after them.
 					/// </summary>
-					BridgeSocketType m_upstreamSocket;
+					network::HandlerArena m_handlerArena;
+
+					/// <summary>
+					/// Socket used to connect to the client's desired host. Held by pointer, so
+					/// that a warm connection can be swapped in from, and handed back to, the
+					/// connection pool.
+					/// </summary>
+					std::unique_ptr<BridgeSocketType> m_upstreamSocket;
 
 					/// <summary>
 					/// Socket used for connecting to the client.
@@ -313,16 +388,22 @@ namespace te
 					BridgeSocketType m_downstreamSocket;
 
 					/// <summary>
-					/// For ensuring that asynchronous operation callback handlers involving the
-					/// upstream server connection are not concurrently executed.
+					/// For ensuring that the handlers that set up the upstream server connection,
+					/// those for resolving, connecting and the upstream handshake, are not
+					/// concurrently executed. Only an actual strand when the bridge's io_service is
+					/// run by more than one thread.
 					/// </summary>
-					boost::asio::strand m_upstreamStrand;
+					network::HandlerSerializer m_upstreamStrand;
 
 					/// <summary>
 					/// For ensuring that asynchronous operation callback handlers involving the
-					/// downstream client connection are not concurrently executed.
+					/// downstream client connection are not concurrently executed. Every handler
+					/// that reads or writes the transactions or the relay state, in either
+					/// direction, runs here as well, since reads and writes in both directions may
+					/// be in flight at once. Only an actual strand when the bridge's io_service is
+					/// run by more than one thread.
 					/// </summary>
-					boost::asio::strand m_downstreamStrand;
+					network::HandlerSerializer m_downstreamStrand;
 
 					/// <summary>
 					/// Used for resolving the target upstream server after it has been discovered
@@ -330,15 +411,24 @@ namespace te
 					/// </summary>
 					boost::asio::ip::tcp::resolver m_resolver;					
 
+					/// <summary>
+					/// The timing wheel shared by all bridges, which keeps m_streamTimeout. May be
+					/// nullptr, in which case the bridge's streams never time out.
+					/// </summary>
+					network::TimingWheel* m_timingWheel;
+
+					/// <summary>
+					/// How long the bridge is given to make progress in each phase.
+					/// </summary>
+					const network::StreamTimeouts m_streamTimeouts;
+
 					/// <summary>
 					/// To prevent asynchronous operations from hanging forever. This should be
-					/// reset with a specific timeout every time a new asynchrous operation is
-					/// initiated, and also when completed. The idea is that you must keep the timer
-					/// spinning beyond the previously set timeout, because once the timeout is
-					/// reached, the completion handler for the timeout will be invoked which will
-					/// cause the bridge to be terminated.
+					/// rearmed for the current phase every time a new asynchrous operation is
+					/// initiated. Once the timeout is reached without having been rearmed, the
+					/// bridge is terminated. Registered with m_timingWheel on first use.
 					/// </summary>
-					boost::asio::deadline_timer m_streamTimer;					
+					network::TimingWheel::TimeoutHandle m_streamTimeout = nullptr;
 
 					/// <summary>
 					/// Every bridge requires a valid pointer to a filtering engine which may or may
@@ -353,6 +443,44 @@ namespace te
 					/// </summary>
 					BaseInMemoryCertificateStore* m_certStore;
 
+					/// <summary>
+					/// The pool of idle upstream connections shared by all bridges of this type.
+					/// Held weakly, because the acceptor that owns it may be destroyed first. May be
+					/// empty, in which case connections are never pooled.
+					/// </summary>
+					std::weak_ptr< UpstreamConnectionPool<BridgeSocketType> > m_connectionPool;
+
+					/// <summary>
+					/// Indicates whether or not the upstream connection is idle and may be reused
+					/// by another bridge, meaning that every request sent on it has had its
+					/// response read in full and the server agreed to keep the connection alive.
+					/// </summary>
+					bool m_upstreamReusable = false;
+
+					/// <summary>
+					/// The DNS cache shared by all bridges. May be nullptr, in which case every
+					/// upstream host is resolved by m_resolver.
+					/// </summary>
+					network::DnsCache* m_dnsCache = nullptr;
+
+					/// <summary>
+					/// The histogram that upstream connect times are recorded into. May be
+					/// nullptr.
+					/// </summary>
+					network::ConnectTimeHistogram* m_connectTimes = nullptr;
+
+					/// <summary>
+					/// The budget that payloads buffered for inspection are reserved against.
+					/// Handed to every transaction. May be nullptr.
+					/// </summary>
+					http::PayloadMemoryBudget* m_payloadBudget = nullptr;
+
+					/// <summary>
+					/// The pool that transactions take their payload read buffers from. Handed to
+					/// every transaction. May be nullptr.
+					/// </summary>
+					http::IoBufferPool* m_bufferPool = nullptr;
+
 					/// <summary>
 					/// Member that is to be set whenever the upstream certificate verification
 					/// callback method is invoked. This member is held, then used to request the in
@@ -452,11 +580,181 @@ namespace te
 					/// </summary>
 					std::atomic_flag m_killLock = ATOMIC_FLAG_INIT;	
 
+					/// <summary>
+					/// Set by ::Drain(), after which the bridge closes as soon as it is idle rather
+					/// than waiting on the client's next request.
+					/// </summary>
+					std::atomic<bool> m_draining{ false };
+
+					/// <summary>
+					/// The phase the bridge is in, as last given to ::SetStreamTimeout(...). Read
+					/// by ::Drain() to tell idle bridges from those with a transfer in flight.
+					/// </summary>
+					std::atomic<network::StreamPhase> m_streamPhase{ network::StreamPhase::IdleKeepAlive };
+
 					/// <summary>
 					/// Indicates whether or not keep-alive should be used, at the client's request.
 					/// </summary>
 					bool m_keepAlive = true;
 
+					/// <summary>
+					/// The maximum number of pipelined requests that will be queued behind the
+					/// current request. Anything beyond this is left to be read and handled once
+					/// the queue drains.
+					/// </summary>
+					static constexpr size_t MaxPipelinedRequests = 16;
+
+					/// <summary>
+					/// Complete requests that the client pipelined behind the current request, in
+					/// the order that they were received. Responses are matched to these in FIFO
+					/// order. See ::QueuePipelinedRequests().
+					/// </summary>
+					std::deque< std::unique_ptr<http::HttpRequest> > m_pipelinedRequests;
+
+					/// <summary>
+					/// The number of entries at the front of m_pipelinedRequests that have already
+					/// been written upstream or skipped because they are blocked.
+					/// </summary>
+					size_t m_pipelineForwardIndex = 0;
+
+					/// <summary>
+					/// A request that the client pipelined, but that could not be queued because it
+					/// is incomplete, or for a different host. It is picked up as the next request
+					/// once the pipeline queue has drained.
+					/// </summary>
+					std::unique_ptr<http::HttpRequest> m_nextRequest = nullptr;
+
+					/// <summary>
+					/// Holds the response generated for a blocked pipelined request while it is
+					/// being written to the client. See ::AnswerBlockedRequestLocally().
+					/// </summary>
+					std::unique_ptr<http::HttpResponse> m_localResponse = nullptr;
+
+					/// <summary>
+					/// Indicates whether or not the current request was answered locally, without
+					/// upstream contact. Such requests do not prevent keep-alive.
+					/// </summary>
+					bool m_answeredLocally = false;
+
+					/// <summary>
+					/// The size of each of the buffers used to relay data in either direction
+					/// once the bridge has become an opaque tunnel. See ::StartTunnel().
+					/// </summary>
+					static constexpr size_t TunnelBufferSize = 65536;
+
+					/// <summary>
+					/// Indicates whether or not the server has accepted an upgrade requested by the
+					/// client, meaning that once the 101 Switching Protocols response is written
+					/// to the client, the bridge stops speaking HTTP and becomes an opaque tunnel.
+					/// </summary>
+					bool m_tunneling = false;
+
+					/// <summary>
+					/// Holds data read from the client that is being relayed to the server, once
+					/// the bridge has become an opaque tunnel. Allocated only for tunnels, and
+					/// reused for every read.
+					/// </summary>
+					std::vector<char> m_tunnelClientBuffer;
+
+					/// <summary>
+					/// Holds data read from the server that is being relayed to the client, once
+					/// the bridge has become an opaque tunnel. Allocated only for tunnels, and
+					/// reused for every read.
+					/// </summary>
+					std::vector<char> m_tunnelServerBuffer;
+
+					/// <summary>
+					/// Indicates whether or not the SNI host of this TLS connection is on the
+					/// passthrough list, meaning the bridge relays the raw TLS bytes between the
+					/// client and server, without ever decrypting anything. See
+					/// ::StartTlsPassthrough().
+					/// </summary>
+					bool m_tlsPassthrough = false;
+
+					/// <summary>
+					/// Tracks the operations outstanding in one direction of the bridge while a
+					/// payload is streamed through it, rather than consumed in full. While one
+					/// piece of the payload is being written, the next piece is read into the other
+					/// half of the transaction's double buffer. See ::RelayRequestPayload() and
+					/// ::RelayResponsePayload().
+					/// </summary>
+					struct StreamRelayState
+					{
+						/// <summary>
+						/// Indicates whether or not a write of payload data is outstanding.
+						/// </summary>
+						bool writeInFlight = false;
+
+						/// <summary>
+						/// Indicates whether or not a read of payload data is outstanding.
+						/// </summary>
+						bool readInFlight = false;
+
+						/// <summary>
+						/// Indicates whether or not a piece of the payload has been read and
+						/// parsed, and is waiting on the outstanding write before it can be
+						/// written itself.
+						/// </summary>
+						bool chunkPending = false;
+
+						/// <summary>
+						/// Indicates whether or not the read side failed or closed while a write
+						/// was outstanding. The bridge is killed once that write completes.
+						/// </summary>
+						bool closePending = false;
+					};
+
+					/// <summary>
+					/// The relay state of the request payload, from client to server.
+					/// </summary>
+					StreamRelayState m_requestRelay;
+
+					/// <summary>
+					/// The relay state of the response payload, from server to client.
+					/// </summary>
+					StreamRelayState m_responseRelay;
+
+					/// <summary>
+					/// The minimum number of payload bytes that must remain to be read for a
+					/// response payload to be relayed raw. See ::StartRawResponseRelay().
+					/// </summary>
+					static constexpr uint64_t RawRelayThreshold = 1048576;
+
+					/// <summary>
+					/// The size of each of the two buffers used to relay raw response payloads.
+					/// </summary>
+					static constexpr size_t RawRelayBufferSize = 65536;
+
+					/// <summary>
+					/// Indicates whether or not the remainder of the current response payload is
+					/// being relayed raw, bypassing the response transaction entirely.
+					/// </summary>
+					bool m_rawRelay = false;
+
+					/// <summary>
+					/// The number of payload bytes the server has yet to send while the response
+					/// payload is being relayed raw.
+					/// </summary>
+					uint64_t m_rawRelayRemaining = 0;
+
+					/// <summary>
+					/// The double buffer used to relay raw response payloads. One buffer is read
+					/// into while the other is being written. Allocated only when first needed,
+					/// and reused for every raw relay on this bridge.
+					/// </summary>
+					std::array<std::vector<char>, 2> m_rawRelayBuffers;
+
+					/// <summary>
+					/// The index of the buffer in m_rawRelayBuffers that is read into next.
+					/// </summary>
+					size_t m_rawRelayReadIndex = 0;
+
+					/// <summary>
+					/// The number of bytes last read into m_rawRelayBuffers, waiting to be
+					/// written to the client.
+					/// </summary>
+					size_t m_rawRelayReadSize = 0;
+
 				public:
 
 					/// <summary>
@@ -488,6 +786,46 @@ namespace te
 					/// </summary>
 					void Start();
 
+					/// <summary>
+					/// Winds the bridge down without cutting off any transfer in flight. If the
+					/// bridge is idle, waiting on the client's next request, it is closed at once.
+					/// Otherwise the current transaction is allowed to finish, after which the
+					/// bridge closes rather than keeping the connection alive. Safe to call from
+					/// any thread, as the work is dispatched through the downstream strand, where
+					/// the bridge's own handlers run.
+					/// </summary>
+					void Drain()
+					{
+						auto sharedThis = shared_from_this();
+
+						m_downstreamStrand.dispatch([sharedThis, this]()
+						{
+							m_draining.store(true);
+
+							// Runs on the same strand as ::OnDownstreamWrite(...), so the bridge can't
+							// move on from the idle phase to its next transaction while this looks.
+							if (m_streamPhase.load() == network::StreamPhase::IdleKeepAlive)
+							{
+								Kill();
+							}
+						});
+					}
+
+					/// <summary>
+					/// Closes the bridge at once, whatever it is doing. Safe to call from any
+					/// thread, as the work is dispatched through the downstream strand, where the
+					/// bridge's own handlers run.
+					/// </summary>
+					void Terminate()
+					{
+						auto sharedThis = shared_from_this();
+
+						m_downstreamStrand.dispatch([sharedThis, this]()
+						{
+							Kill();
+						});
+					}
+
 				private:
 
 					/// <summary>
@@ -531,19 +869,17 @@ namespace te
 							this->DownstreamSocket().close(downstreamCloseErr);
 
 							// To try and cut down annoying error messages about shutdown failures when the upstream
-							// socket hasn't even been used yet and ::Kill() has been called.
-							if (m_upstreamHost.size() > 0)
+							// socket hasn't even been used yet and ::Kill() has been called. An idle, reusable
+							// upstream connection is left open, to be checked into the pool on destruction.
+							if (m_upstreamHost.size() > 0 && !(m_upstreamReusable && !m_connectionPool.expired()))
 							{						
 								this->UpstreamSocket().shutdown(boost::asio::socket_base::shutdown_both, upstreamShutdownErr);
 								this->UpstreamSocket().close(upstreamCloseErr);
 							}							
 
-							// We set the stream timeout to any negative value to force the stream
-							// to have any pending async_wait's cancelled and the new timeout set to
-							// positive infinity. This way, we don't have any unfinished async calls
-							// on account of the timer that are preserving the lifetime of this object
-							// unnecessarily via the shared_from_this that the handler(s) obtain(ed).
-							SetStreamTimeout(-1);
+							// Disarm the stream timeout, so that it can't go off again while the
+							// pending handlers drain.
+							ClearStreamTimeout();
 
 							if (downstreamShutdownErr)
 							{
@@ -580,52 +916,273 @@ namespace te
 					}
 
 					/// <summary>
-					/// Completion handler for when the DNS resolution for the desired upstream host
-					/// has completed. This method is specialized, because when dealing with a
-					/// secure client, before initiating the upstream connection, we want to set the
-					/// SNI hostname entry on the socket.
+					/// The setup of a connection, from its first byte up to the client's first
+					/// request, written as a single stackless coroutine rather than as a chain of
+					/// completion handlers that pass their state along through members. The
+					/// coroutine object is itself the completion handler of every operation it
+					/// starts, so nothing needs binding, and it runs each operation through the
+					/// same strand and handler arena the bridge uses everywhere else.
 					/// 
-					/// In the event that this operation was a failure, meaning that the supplied
-					/// error parameter was set and the code was one unexpected, the bridge will be 
-					/// terminated.
+					/// The flow differs by socket type, so ::Run(...) is specialized. For a plain
+					/// bridge, the request has already been read by the time an upstream connection
+					/// is needed, so the flow resolves the host, connects to it and then hands over
+					/// to ::OnUpstreamConnected(). For a secure bridge the flow starts as soon as
+					/// the client is accepted: the client hello is peeked at for the SNI host, which
+					/// is then resolved and connected to, unless a verified connection to it can be
+					/// taken from the pool. Unless the host is passed through, the upstream
+					/// handshake is done, the certificate is spoofed, the client handshake is done
+					/// and finally the client's request headers are read and handed to
+					/// ::OnDownstreamHeaders(...).
+					/// 
+					/// Any failure along the way is reported and kills the bridge.
 					/// </summary>
-					/// <param name="error">
-					/// Error code that will indicate if any errors were handled during the async
-					/// operation, providing details if an error did occur and was handled.
+					class ConnectionFlow : public boost::asio::coroutine
+					{
+
+					public:
+
+						/// <summary>
+						/// Constructs a new ConnectionFlow.
+						/// </summary>
+						/// <param name="bridge">
+						/// The bridge whose connection is to be set up.
+						/// </param>
+						explicit ConnectionFlow(std::shared_ptr<TlsCapableHttpBridge> bridge)
+							:
+							m_bridge(std::move(bridge))
+						{
+
+						}
+
+						/// <summary>
+						/// Runs the flow up to its next asynchronous operation, or to its end.
+						/// Invoked once to start it, and then as the completion handler of every
+						/// read, handshake and peek it starts.
+						/// </summary>
+						/// <param name="error">
+						/// Error code that will indicate if any errors were handled during the async
+						/// operation, providing details if an error did occur and was handled.
+						/// </param>
+						/// <param name="bytesTransferred">
+						/// The number of bytes read, if the operation was a read.
+						/// </param>
+						void operator()(const boost::system::error_code& error = boost::system::error_code(), const size_t bytesTransferred = 0)
+						{
+							Resume(error, bytesTransferred);
+						}
+
+						/// <summary>
+						/// Completion handler for resolving the upstream host.
+						/// </summary>
+						/// <param name="error">
+						/// Error code that will indicate if any errors were handled during the async
+						/// operation, providing details if an error did occur and was handled.
+						/// </param>
+						/// <param name="endpointIterator">
+						/// The resolved endpoints of the upstream host.
+						/// </param>
+						void operator()(const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator endpointIterator)
+						{
+							m_endpoints = endpointIterator;
+							Resume(error, 0);
+						}
+
+						/// <summary>
+						/// Completion handler for the race of connection attempts to the upstream
+						/// host. See ::ConnectUpstream(...).
+						/// </summary>
+						/// <param name="error">
+						/// Error code that will indicate if any errors were handled during the async
+						/// operation, providing details if an error did occur and was handled.
+						/// </param>
+						/// <param name="winner">
+						/// The connected socket, or nullptr if every attempt failed.
+						/// </param>
+						void operator()(const boost::system::error_code& error, std::shared_ptr<network::TcpSocket> winner)
+						{
+							m_winner = std::move(winner);
+							Resume(error, 0);
+						}
+
+					private:
+
+						/// <summary>
+						/// Runs the flow, killing the bridge if anything it does throws.
+						/// </summary>
+						void Resume(const boost::system::error_code& error, const size_t bytesTransferred)
+						{
+							try
+							{
+								Run(error, bytesTransferred);
+							}
+							catch (std::exception& e)
+							{
+								std::string errMessage(u8"In TlsCapableHttpBridge::ConnectionFlow::Resume(const boost::system::error_code&, const size_t) - Got error:\t");
+								errMessage.append(e.what());
+								m_bridge->ReportError(errMessage);
+
+								m_bridge->Kill();
+							}
+						}
+
+						/// <summary>
+						/// The body of the coroutine. Specialized for each type of bridge.
+						/// </summary>
+						void Run(const boost::system::error_code& error, const size_t bytesTransferred);
+
+						/// <summary>
+						/// The bridge whose connection is being set up. Holding it here keeps it
+						/// alive for as long as the flow has an operation outstanding.
+						/// </summary>
+						std::shared_ptr<TlsCapableHttpBridge> m_bridge;
+
+						/// <summary>
+						/// The endpoints the upstream host was resolved to.
+						/// </summary>
+						boost::asio::ip::tcp::resolver::iterator m_endpoints;
+
+						/// <summary>
+						/// The socket that won the race to connect upstream.
+						/// </summary>
+						std::shared_ptr<network::TcpSocket> m_winner;
+
+						/// <summary>
+						/// Whether the upstream connection was taken from the connection pool,
+						/// rather than being made by this flow.
+						/// </summary>
+						bool m_pooled = false;
+
+					};
+
+					/// <summary>
+					/// Races connection attempts to the resolved endpoints of the upstream host,
+					/// rather than trying them one by one, so that an unreachable address doesn't
+					/// cost the whole connect timeout. The race is given the configured connect
+					/// timeout. See network::HappyEyeballsConnector.
+					/// </summary>
+					/// <param name="endpoints">
+					/// The endpoints of the upstream host, with the port already set.
 					/// </param>
-					/// <param name="endpointIterator">
-					/// Returned enpoint iterator, populated with addresses from returned A record
-					/// entries during the resolution process. The endpoints are preconfigured with
-					/// address and port number, as the "service" parameter for the resolver is
-					/// used. The port numbers configured correspond to the supplied service during
-					/// resolution. "http" == port 80, "https" == port 443, etc.
+					/// <param name="handler">
+					/// The completion handler, which is run through the upstream strand and given
+					/// the winning socket.
 					/// </param>
-					void OnResolve(const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator endpointIterator);
-
-					/// <summary>
-					/// Completion handler for when the asynchronous operation of establishing a
-					/// socket connection to a the resolved upstream host has returned. This method
-					/// is specialized, because when dealing with a secure client, the order of
-					/// operations varies from a regular TCP/HTTP client. With a secure client, once
-					/// a connection is established, a handshake with the connected remote upstream
-					/// peer must take place, at which time the remote server's certificate will be
-					/// verified, and if verified spoofed, the a downstream client handshake will
-					/// occur. After all this, the client's request headers will be read, then
-					/// written upstream.
-					/// 
-					/// In the case of a regular TCP/HTTP client, the process on upstream connect
-					/// simply jumps immediately to writing the client's request data to the server,
-					/// then fetching a response from the server.
+					template<typename Handler>
+					void ConnectUpstream(std::vector<boost::asio::ip::tcp::endpoint> endpoints, Handler handler)
+					{
+						auto connector = std::make_shared<network::HappyEyeballsConnector>(UpstreamSocket().get_io_service(), std::move(endpoints), m_connectTimes, m_streamTimeouts.connectMsec);
+
+						connector->AsyncConnect(m_upstreamStrand.wrap(network::MakeArenaHandler(m_handlerArena, std::move(handler))));
+					}
+
+					/// <summary>
+					/// Collects the resolved endpoints of the upstream host, with the port the
+					/// client asked for.
 					/// 
-					/// In the event that this operation was a failure, meaning that the supplied
-					/// error parameter was set and the code was one unexpected, the bridge will be 
-					/// terminated.
+					/// Perhaps client requested a port other than 80. We should have already parsed
+					/// this before initiating the resolve of the upstream host, so that this
+					/// information was not polluting the hostname during resolution. RFC2616
+					/// Section 14.23 demands that non-port-80 requests include the port in with the
+					/// host name, so this should be reliable. If m_upstreamHostPort is zero, the
+					/// default value, then we leave the port alone, because we resolved with the
+					/// service name and every endpoint already carries its port.
 					/// </summary>
-					/// <param name="error">
-					/// Error code that will indicate if any errors were handled during the async
-					/// operation, providing details if an error did occur and was handled.
+					/// <param name="endpointIterator">
+					/// The resolved endpoints.
 					/// </param>
-					void OnUpstreamConnect(const boost::system::error_code& error);
+					/// <returns>
+					/// The endpoints to connect to.
+					/// </returns>
+					std::vector<boost::asio::ip::tcp::endpoint> ToUpstreamEndpoints(boost::asio::ip::tcp::resolver::iterator endpointIterator)
+					{
+						std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+
+						for (boost::asio::ip::tcp::resolver::iterator end; endpointIterator != end; ++endpointIterator)
+						{
+							boost::asio::ip::tcp::endpoint ep = *endpointIterator;
+
+							if (m_upstreamHostPort != 0 && ep.port() != m_upstreamHostPort)
+							{
+								ep.port(m_upstreamHostPort);
+							}
+
+							endpoints.push_back(ep);
+						}
+
+						return endpoints;
+					}
+
+					/// <summary>
+					/// Carries on with the current request once the upstream connection of a plain
+					/// bridge is established, either by the ConnectionFlow or by checking one out of
+					/// the connection pool. If the request payload is incomplete and must be
+					/// inspected before being sent upstream, the rest of it is read first.
+					/// Otherwise, whatever we've got from the client is written to the server, and
+					/// the completion handler of that write determines whether the client has more
+					/// to give.
+					/// </summary>
+					void OnUpstreamConnected()
+					{
+
+						#ifndef NDEBUG
+						ReportInfo(u8"TlsCapableHttpBridge::OnUpstreamConnected");
+						#endif // !NDEBUG
+
+						if (m_request->IsPayloadComplete() == false && m_request->GetConsumeAllBeforeSending() == true)
+						{
+							// Means that there is a request payload, it's not complete, and it's been flagged
+							// for inspection before being sent upstream. Another read from the client is
+							// required.
+
+							try
+							{
+								auto requestReadBuffer = m_request->GetPayloadReadBuffer();
+
+								boost::asio::async_read(
+									m_downstreamSocket,
+									requestReadBuffer,
+									boost::asio::transfer_at_least(1),
+									m_downstreamStrand.wrap(
+										network::MakeArenaHandler(
+											m_handlerArena,
+											std::bind(
+												&TlsCapableHttpBridge::OnDownstreamRead,
+												shared_from_this(),
+												std::placeholders::_1,
+												std::placeholders::_2
+												)
+											)
+										)
+									);
+
+								return;
+							}
+							catch (std::exception& e)
+							{
+								std::string errMsg(u8"In TlsCapableHttpBridge::OnUpstreamConnected() - Got error:\t");
+								errMsg.append(e.what());
+								ReportError(errMsg);
+							}
+						}
+
+						auto writeBuffer = m_request->GetWriteBuffer();
+
+						boost::asio::async_write(
+							*m_upstreamSocket,
+							writeBuffer,
+							boost::asio::transfer_all(),
+							m_downstreamStrand.wrap(
+								network::MakeArenaHandler(
+									m_handlerArena,
+									std::bind(
+										&TlsCapableHttpBridge::OnUpstreamWrite,
+										shared_from_this(),
+										std::placeholders::_1
+										)
+									)
+								)
+							);
+					}
 
 					/// <summary>
 					/// Completion handler for when the initial asynchronous read from the upstream
@@ -686,10 +1243,10 @@ namespace te
 									// By setting ShouldBlock to a non-zero value, this adjusts the internal
 									// state of the response to be "complete", meaning that as far as this
 									// bridge is concerned, this transaction is finished. Setting shouldblock
-									// **does not** make the response a 204 response. This needs to be done
+									// **does not** make the response a block response. This needs to be done
 									// explicitly.
 									m_response->SetShouldBlock(blockResult);
-									m_response->Make204();
+									m_response->MakeBlockResponse(SelectBlockResponseType(*m_request, m_response.get()));
 
 									auto responseBuffer = m_response->GetWriteBuffer();
 
@@ -698,10 +1255,13 @@ namespace te
 										responseBuffer,
 										boost::asio::transfer_all(), 
 										m_downstreamStrand.wrap(
-											std::bind(
-												&TlsCapableHttpBridge::OnDownstreamWrite, 
-												shared_from_this(), 
-												std::placeholders::_1
+											network::MakeArenaHandler(
+												m_handlerArena,
+												std::bind(
+													&TlsCapableHttpBridge::OnDownstreamWrite, 
+													shared_from_this(), 
+													std::placeholders::_1
+													)
 												)
 											)
 										);
@@ -714,32 +1274,63 @@ namespace te
 								// so we'd have no way to handle content compressed with this method.
 								m_response->RemoveHeader(util::http::headers::GetDictionary);
 
-								// Set m_keepAlive to what the server has specified. The client may have requested it, but
-								// ultimately it's up to the server how it's going to serve us.
-								auto connectionHeader = m_response->GetHeader(util::http::headers::Connection);
-
-								bool keepAlive = false;
-
-								if (m_request->GetHttpVersion() != http::HttpProtocolVersion::HTTP1)
+								if (m_request->IsUpgrade() && m_response->IsUpgrade())
 								{
-									keepAlive = true;
-								}								
+									// The server has agreed to switch protocols. Everything after this
+									// response is no longer HTTP, so once the response has been written to
+									// the client, the bridge becomes an opaque tunnel.
+									m_tunneling = true;
 
-								while (connectionHeader.first != connectionHeader.second)
-								{
-									if (connectionHeader.first->second.compare(u8"close") == 0)
-									{
-										keepAlive = false;										
-									}
-									++connectionHeader.first;
-								}
+									SetStreamTimeout(network::StreamPhase::Body);
 
-								m_keepAlive = keepAlive;
+									auto writeBuffer = m_response->GetWriteBuffer();
 
-								if (m_response->IsPayloadHtml())
+									boost::asio::async_write(
+										m_downstreamSocket,
+										writeBuffer,
+										boost::asio::transfer_all(),
+										m_downstreamStrand.wrap(
+											network::MakeArenaHandler(
+												m_handlerArena,
+												std::bind(
+													&TlsCapableHttpBridge::OnDownstreamWrite,
+													shared_from_this(),
+													std::placeholders::_1
+													)
+												)
+											)
+										);
+
+									return;
+								}
+
+								// Set m_keepAlive to what the server has specified. The client may have requested it, but
+								// ultimately it's up to the server how it's going to serve us.
+								auto connectionHeader = m_response->GetHeader(util::http::headers::Connection);
+
+								bool keepAlive = false;
+
+								if (m_request->GetHttpVersion() != http::HttpProtocolVersion::HTTP1)
+								{
+									keepAlive = true;
+								}								
+
+								while (connectionHeader.first != connectionHeader.second)
+								{
+									if (connectionHeader.first->second.compare(u8"close") == 0)
+									{
+										keepAlive = false;										
+									}
+									++connectionHeader.first;
+								}
+
+								m_keepAlive = keepAlive;
+
+								if (m_response->IsPayloadHtml() && m_filteringEngine->HasHtmlFilters(m_request.get()))
 								{
 									// We filter with CSS filters, so we want to consume entire HTML responses before
-									// sending them back to the client, so we can filter them first.
+									// sending them back to the client, so we can filter them first. If no selectors
+									// can apply, the response is left to stream through untouched.
 									m_response->SetConsumeAllBeforeSending(true);
 								}
 
@@ -756,18 +1347,21 @@ namespace te
 									{
 										auto readBuffer = m_response->GetPayloadReadBuffer();
 
-										SetStreamTimeout(5000);
+										SetStreamTimeout(network::StreamPhase::Body);
 
 										boost::asio::async_read(
-											m_upstreamSocket,
+											*m_upstreamSocket,
 											readBuffer,
 											boost::asio::transfer_at_least(1),
-											m_upstreamStrand.wrap(
-												std::bind(
-													&TlsCapableHttpBridge::OnUpstreamRead,
-													shared_from_this(),
-													std::placeholders::_1,
-													std::placeholders::_2
+											m_downstreamStrand.wrap(
+												network::MakeArenaHandler(
+													m_handlerArena,
+													std::bind(
+														&TlsCapableHttpBridge::OnUpstreamRead,
+														shared_from_this(),
+														std::placeholders::_1,
+														std::placeholders::_2
+														)
 													)
 												)
 											);
@@ -783,22 +1377,22 @@ namespace te
 								{
 									// We need to write what we have to the client.
 
-									SetStreamTimeout(5000);
+									if (m_response->IsPayloadComplete() && m_response->GetConsumeAllBeforeSending())
+									{
+										// The entire payload came in along with the headers.
+										ProcessResponsePayload();
+									}
 
-									auto writeBuffer = m_response->GetWriteBuffer();
+									if (!std::is_same<BridgeSocketType, network::TlsSocket>::value &&
+										!m_response->GetConsumeAllBeforeSending() &&
+										m_response->GetUnreadPayloadSize() >= RawRelayThreshold)
+									{
+										// A large plain text payload that nothing is going to look at.
+										StartRawResponseRelay();
+										return;
+									}
 
-									boost::asio::async_write(
-										m_downstreamSocket,
-										writeBuffer,
-										boost::asio::transfer_all(),
-										m_downstreamStrand.wrap(
-											std::bind(
-												&TlsCapableHttpBridge::OnDownstreamWrite,
-												shared_from_this(),
-												std::placeholders::_1
-												)
-											)
-										);
+									RelayResponsePayload();
 
 									return;
 								}								
@@ -843,6 +1437,8 @@ namespace te
 						ReportInfo(u8"TlsCapableHttpBridge::OnUpstreamRead");
 						#endif // !NDEBUG
 
+						m_responseRelay.readInFlight = false;
+
 						// EOF doesn't necessarily mean something critical happened. Could simply be
 						// that we got the entire valid response, and the server closed the connection
 						// after.
@@ -857,37 +1453,31 @@ namespace te
 							if (m_response->Parse(bytesTransferred))
 							{
 								// Let CSS selectors rip through the payload if it's complete and its HTML.
-								if (m_response->IsPayloadComplete() && m_response->GetConsumeAllBeforeSending() && m_response->IsPayloadHtml())
+								if (m_response->IsPayloadComplete() && m_response->GetConsumeAllBeforeSending())
 								{
-									ReportInfo(u8"TlsCapableHttpBridge::OnUpstreamRead - Processing HTML response.");
-									
-									auto processedHtmlString = m_filteringEngine->ProcessHtmlResponse(m_request.get(), m_response.get());
-									
-									if (processedHtmlString.size() > 0)
-									{
-										std::vector<char> processedHtmlVector(processedHtmlString.begin(), processedHtmlString.end());
-
-										m_response->SetPayload(std::move(processedHtmlVector));
-									}									
+									ProcessResponsePayload();
 								}
 								else if (m_response->IsPayloadComplete() == false && m_response->GetConsumeAllBeforeSending() == true)
 								{
-									SetStreamTimeout(5000);
+									SetStreamTimeout(network::StreamPhase::Body);
 
 									try
 									{
 										auto readBuffer = m_response->GetPayloadReadBuffer();
 
 										boost::asio::async_read(
-											m_upstreamSocket,
+											*m_upstreamSocket,
 											readBuffer,
 											boost::asio::transfer_at_least(1),
-											m_upstreamStrand.wrap(
-												std::bind(
-													&TlsCapableHttpBridge::OnUpstreamRead,
-													shared_from_this(),
-													std::placeholders::_1,
-													std::placeholders::_2
+											m_downstreamStrand.wrap(
+												network::MakeArenaHandler(
+													m_handlerArena,
+													std::bind(
+														&TlsCapableHttpBridge::OnUpstreamRead,
+														shared_from_this(),
+														std::placeholders::_1,
+														std::placeholders::_2
+														)
 													)
 												)
 											);
@@ -904,21 +1494,16 @@ namespace te
 									}
 								}
 								
-								// Simply write what we've got to the client.
-								auto writeBuffer = m_response->GetWriteBuffer();
+								if (m_responseRelay.writeInFlight)
+								{
+									// The previous piece is still being written to the client. This
+									// one goes out as soon as that write completes.
+									m_responseRelay.chunkPending = true;
+									return;
+								}
 
-								boost::asio::async_write(
-									m_downstreamSocket,
-									writeBuffer,
-									boost::asio::transfer_all(),
-									m_downstreamStrand.wrap(
-										std::bind(
-											&TlsCapableHttpBridge::OnDownstreamWrite,
-											shared_from_this(),
-											std::placeholders::_1
-											)
-										)
-									);
+								// Simply write what we've got to the client.
+								RelayResponsePayload();
 
 								return;
 							}
@@ -927,7 +1512,7 @@ namespace te
 								ReportError(u8"In TlsCapableHttpBridge::OnUpstreamRead(const boost::system::error_code&, const size_t) - Failed to parse response.");
 							}
 						}
-						
+
 						if (error)
 						{
 							std::string errMsg(u8"In TlsCapableHttpBridge::OnUpstreamRead(const boost::system::error_code&, const size_t) - Got error:\t");
@@ -935,6 +1520,13 @@ namespace te
 							ReportError(errMsg);
 						}
 
+						if (m_responseRelay.writeInFlight)
+						{
+							// Let the client have what was already read before tearing down.
+							m_responseRelay.closePending = true;
+							return;
+						}
+
 						Kill();
 					}
 
@@ -962,11 +1554,32 @@ namespace te
 						// after.
 						if (!error)
 						{
+							m_requestRelay.writeInFlight = false;
+
+							if (m_requestRelay.chunkPending)
+							{
+								// The next piece was read while this one was being written.
+								RelayRequestPayload();
+								return;
+							}
+
+							if (m_requestRelay.closePending)
+							{
+								Kill();
+								return;
+							}
+
+							if (m_requestRelay.readInFlight)
+							{
+								// The next piece is already on its way from the client.
+								return;
+							}
+
 							if (m_request->IsPayloadComplete() == false)
 							{
 								// The client has more to write to the server.
 
-								SetStreamTimeout(5000);
+								SetStreamTimeout(network::StreamPhase::Body);
 
 								try
 								{
@@ -977,11 +1590,14 @@ namespace te
 										readBuffer,
 										boost::asio::transfer_at_least(1),
 										m_downstreamStrand.wrap(
-											std::bind(
-												&TlsCapableHttpBridge::OnDownstreamRead,
-												shared_from_this(),
-												std::placeholders::_1,
-												std::placeholders::_2
+											network::MakeArenaHandler(
+												m_handlerArena,
+												std::bind(
+													&TlsCapableHttpBridge::OnDownstreamRead,
+													shared_from_this(),
+													std::placeholders::_1,
+													std::placeholders::_2
+													)
 												)
 											)
 										);
@@ -997,20 +1613,29 @@ namespace te
 							}
 							else
 							{
-								// Client is all done, get the response headers.
+								// Client is all done. Send any requests the client pipelined behind this
+								// one back to back, then get the response headers.
+
+								if (ForwardNextPipelinedRequest())
+								{
+									return;
+								}
 
-								SetStreamTimeout(5000);
+								SetStreamTimeout(network::StreamPhase::Body);
 
 								boost::asio::async_read_until(
-									m_upstreamSocket,
+									*m_upstreamSocket,
 									m_response->GetHeaderReadBuffer(), 
 									u8"\r\n\r\n",
-									m_upstreamStrand.wrap(
-										std::bind(
-											&TlsCapableHttpBridge::OnUpstreamHeaders, 
-											shared_from_this(), 
-											std::placeholders::_1,
-											std::placeholders::_2
+									m_downstreamStrand.wrap(
+										network::MakeArenaHandler(
+											m_handlerArena,
+											std::bind(
+												&TlsCapableHttpBridge::OnUpstreamHeaders, 
+												shared_from_this(), 
+												std::placeholders::_1,
+												std::placeholders::_2
+												)
 											)
 										)
 									);
@@ -1077,124 +1702,14 @@ namespace te
 						// after.
 						if ((!error || (error.value() == boost::asio::error::eof)) && bytesTransferred > 0)
 						{
-							if (m_request->Parse(bytesTransferred))
-							{								
-								auto requestBlockResult = m_filteringEngine->ShouldBlock(m_request.get(), nullptr, std::is_same<BridgeSocketType, network::TlsSocket>::value);
-								m_request->SetShouldBlock(requestBlockResult);
-
-								// This little business is for dealing with browsers like Chrome, who just have
-								// to use their own "I'm too cool for skool" compression methods like SDHC. We
-								// want to be sure that we get normal, non-hipster encoded, non-organic smoothie
-								// encoded reponses that sane people can decompress. So we just always replace
-								// the Accept-Encoding header with this.
-								std::string standardEncoding(u8"gzip, deflate");
-								m_request->AddHeader(util::http::headers::AcceptEncoding, standardEncoding);
-
-								// Modifying content-encoding isn't enough for that sweet organic spraytanned
-								// browser Chrome and its server cartel buddies. If these special headers make
-								// it through, even though we've explicitly defined our accepted encoding,
-								// you're still going to get SDHC encoded data.
-								m_request->RemoveHeader(util::http::headers::XSDHC);
-								m_request->RemoveHeader(util::http::headers::AvailDictionary);
-
-								auto hostHeader = m_request->GetHeader(util::http::headers::Host);
-
-								if (hostHeader.first != hostHeader.second)
-								{
-									auto hostWithoutPort = hostHeader.first->second;
-
-									boost::trim(hostWithoutPort);
-
-									auto portInd = hostWithoutPort.find(':');
-
-									if (portInd != std::string::npos)
-									{
-										hostWithoutPort = hostWithoutPort.substr(0, portInd);
-										
-										auto portString = hostWithoutPort.substr(portInd + 1);
-
-										try
-										{
-											m_upstreamHostPort = static_cast<uint16_t>(std::stoi(portString));
-										}
-										catch (...)
-										{
-											// We don't really care what went wrong. We failed to parse the port in the host. We'll
-											// simply issue a warning, and assume port 80.
-											ReportWarning(u8"In TlsCapableHttpBridge::OnDownstreamHeaders(const boost::system::error_code&, const size_t) - Failed to parse port in host entry. Assuming port 80.");
-										}										
-									}
-
-									// If the we're already connected to a host and it's not the same, just quit.
-									bool needsResolve = true;
-									if (m_upstreamHost.size() > 0)
-									{
-										auto hostComparison = hostWithoutPort.compare(m_upstreamHost);
-										
-										if (hostComparison != 0)
-										{
-											Kill();
-											return;
-										}
-
-										needsResolve = false;
-									}
-
-									if (needsResolve)
-									{
-										// If we're not already connected to a host, then we need to resolve it and
-										// connect to it. This **should** only ever be true in the event that its a 
-										// non-TLS (plain HTTP) connection.
-										SetStreamTimeout(5000);
-
-										m_upstreamHost = hostWithoutPort;
-										boost::asio::ip::tcp::resolver::query query(m_upstreamHost, std::is_same<BridgeSocketType, network::TlsSocket>::value ? "https" : "http");
-
-										m_resolver.async_resolve(
-											query,
-											m_upstreamStrand.wrap(
-												std::bind(
-													&TlsCapableHttpBridge::OnResolve,
-													shared_from_this(),
-													std::placeholders::_1,
-													std::placeholders::_2
-													)
-												)
-											);
-
-										return;
-									}
-									
-									// Just write to the server that we're apparently already connected to. We
-									// don't concern ourselves with the ShouldBlock value here on the request.
-									// Once we get the upstream response headers, which gives us data about the
-									// size of a yet-to-be-completed request, we will block if the value was set
-									// here, but not before the http filtering engine reports this data to
-									// any observer(s).
+							// A request is now in flight, so the bridge is no longer idle as far as
+							// ::Drain() is concerned.
+							m_streamPhase.store(network::StreamPhase::Body);
 
-									SetStreamTimeout(5000);
-
-									auto writeBuffer = m_request->GetWriteBuffer();
-
-									boost::asio::async_write(
-										m_upstreamSocket,
-										writeBuffer,
-										boost::asio::transfer_all(),
-										m_upstreamStrand.wrap(
-											std::bind(
-												&TlsCapableHttpBridge::OnUpstreamWrite,
-												shared_from_this(),
-												std::placeholders::_1
-												)
-											)
-										);
-
-									return;
-								}
-								else
-								{
-									ReportError(u8"In TlsCapableHttpBridge::OnDownstreamHeaders(const boost::system::error_code&, const size_t) - Failed to read Host header from request.");
-								}
+							if (m_request->Parse(bytesTransferred))
+							{
+								ForwardRequest();
+								return;
 							}
 							else
 							{
@@ -1213,103 +1728,943 @@ namespace te
 					}
 
 					/// <summary>
-					/// Completion handler for when an asynchronous read of the request payload from
-					/// the connected client completes. Requests the request payload to be parsed
-					/// and, depending on configured options, may write the data to the remote
-					/// upstream server, or resize the read buffer and continue reading the request
-					/// payload until completion.
-					/// 
-					/// In the event that this operation was a failure, meaning that the supplied
-					/// error parameter was set and the code was one unexpected, the bridge will be 
-					/// terminated.
+					/// Runs HTML filtering over a response payload that has been read in full, then
+					/// readies the payload for the client. A payload that filtering changed is
+					/// compressed again if the client accepts a coding we can produce, using the
+					/// fast compression level unless HttpFilteringOption::MaximizeRecompression is
+					/// enabled. A payload that filtering left alone is put back exactly as the
+					/// server sent it, still compressed if it was.
 					/// </summary>
-					/// <param name="error">
-					/// Error code that will indicate if any errors were handled during the async
-					/// operation, providing details if an error did occur and was handled.
-					/// </param>
-					/// <param name="bytesTransferred">
-					/// The number of bytes read from the connected client.
-					/// </param>
-					void OnDownstreamRead(const boost::system::error_code& error, const size_t bytesTransferred)
+					void ProcessResponsePayload()
 					{
-						#ifndef NDEBUG
-						ReportInfo(u8"TlsCapableHttpBridge::OnDownstreamRead");
-						#endif // !NDEBUG
-
-						// EOF doesn't necessarily mean something critical happened. Could simply be
-						// that we got the entire valid response, and the server closed the connection
-						// after.
-						if ((!error || (error.value() == boost::asio::error::eof)) && bytesTransferred > 0)
+						if (m_response->IsPayloadHtml())
 						{
-							if (m_request->Parse(bytesTransferred))
-							{
-								if (m_request->IsPayloadComplete() == false && m_request->GetConsumeAllBeforeSending())
-								{
-									// The client has more to send and it's been flagged for inspection. Must
-									// initiate a read again.
+							ReportInfo(u8"TlsCapableHttpBridge::ProcessResponsePayload - Processing HTML response.");
 
-									SetStreamTimeout(5000);
-
-									try
-									{
-										auto readBuffer = m_request->GetPayloadReadBuffer();
+							auto processedHtmlString = m_filteringEngine->ProcessHtmlResponse(m_request.get(), m_response.get());
 
-										boost::asio::async_read(
-											m_downstreamSocket,
-											readBuffer,
-											boost::asio::transfer_at_least(1),
-											m_downstreamStrand.wrap(
-												std::bind(
-													&TlsCapableHttpBridge::OnDownstreamRead,
-													shared_from_this(),
-													std::placeholders::_1,
-													std::placeholders::_2
-													)
-												)
-											);
+							if (processedHtmlString.size() > 0)
+							{
+								std::vector<char> processedHtmlVector(processedHtmlString.begin(), processedHtmlString.end());
 
-										return;
-									}
-									catch (std::exception& e)
-									{
-										std::string errMsg(u8"In TlsCapableHttpBridge::OnDownstreamRead(const boost::system::error_code&, const size_t) - Got error:\t");
-										errMsg.append(e.what());
-										ReportError(errMsg);
-									}
-								}
+								m_response->SetPayload(std::move(processedHtmlVector));
 
-								SetStreamTimeout(5000);
+								const auto coding = m_request->AcceptedResponseCoding();
 
-								// Just write whatever we've got to the server.
-								auto writeBuffer = m_request->GetWriteBuffer();
+								if (coding != http::ContentCoding::Identity)
+								{
+									const auto level = m_filteringEngine->ShouldMaximizeRecompression() ? http::CompressionLevel::Best : http::CompressionLevel::Fast;
 
-								boost::asio::async_write(
-									m_upstreamSocket, 
-									writeBuffer, 
-									boost::asio::transfer_all(), 
-									m_upstreamStrand.wrap(
-										std::bind(
-											&TlsCapableHttpBridge::OnUpstreamWrite, 
-											shared_from_this(), 
-											std::placeholders::_1
-											)
-										)
-									);
+									m_response->Compress(coding, level);
+								}
 
 								return;
 							}
-							else
-							{
-								ReportError(u8"In TlsCapableHttpBridge::OnDownstreamHeaders(const boost::system::error_code&, const size_t) - Failed to parse request.");
-							}
 						}
 
-						if (error)
-						{
-							std::string errMsg(u8"In TlsCapableHttpBridge::OnDownstreamRead(const boost::system::error_code&, const size_t) - Got error:\t");
-							errMsg.append(error.message());
-							ReportError(errMsg);
-						}
+						m_response->RestoreEncodedPayload();
+					}
+
+					/// <summary>
+					/// Writes the request data parsed so far to the server. If the request payload
+					/// is being streamed and is not yet complete, the next piece is read from the
+					/// client while this write is in flight, rather than after it completes. The
+					/// transaction hands the written data out of its double buffer, so the read
+					/// never lands in data still being written.
+					/// 
+					/// The completion handlers of both operations run through the downstream
+					/// strand, since they share m_requestRelay. Whichever completes last moves
+					/// the relay along. See ::OnDownstreamRead(...) and ::OnUpstreamWrite(...).
+					/// </summary>
+					void RelayRequestPayload()
+					{
+						SetStreamTimeout(network::StreamPhase::Body);
+
+						auto writeBuffer = m_request->GetWriteBuffer();
+
+						m_requestRelay.chunkPending = false;
+						m_requestRelay.writeInFlight = true;
+
+						const bool readAhead = !m_requestRelay.readInFlight && !m_request->IsPayloadComplete() && !m_request->GetConsumeAllBeforeSending();
+
+						// The read buffer is fetched before either operation is started, since the
+						// handlers of either may run as soon as it is.
+						boost::asio::mutable_buffers_1 readBuffer(nullptr, 0);
+
+						if (readAhead)
+						{
+							try
+							{
+								readBuffer = m_request->GetPayloadReadBuffer();
+							}
+							catch (std::exception& e)
+							{
+								std::string errMsg(u8"In TlsCapableHttpBridge::RelayRequestPayload() - Got error:\t");
+								errMsg.append(e.what());
+								ReportError(errMsg);
+								Kill();
+								return;
+							}
+
+							m_requestRelay.readInFlight = true;
+						}
+
+						boost::asio::async_write(
+							*m_upstreamSocket,
+							writeBuffer,
+							boost::asio::transfer_all(),
+							m_downstreamStrand.wrap(
+								network::MakeArenaHandler(
+									m_handlerArena,
+									std::bind(
+										&TlsCapableHttpBridge::OnUpstreamWrite,
+										shared_from_this(),
+										std::placeholders::_1
+										)
+									)
+								)
+							);
+
+						if (readAhead)
+						{
+							boost::asio::async_read(
+								m_downstreamSocket,
+								readBuffer,
+								boost::asio::transfer_at_least(1),
+								m_downstreamStrand.wrap(
+									network::MakeArenaHandler(
+										m_handlerArena,
+										std::bind(
+											&TlsCapableHttpBridge::OnDownstreamRead,
+											shared_from_this(),
+											std::placeholders::_1,
+											std::placeholders::_2
+											)
+										)
+									)
+								);
+						}
+					}
+
+					/// <summary>
+					/// Writes the response data parsed so far to the client. If the response
+					/// payload is being streamed and is not yet complete, the next piece is read
+					/// from the server while this write is in flight, rather than after it
+					/// completes. The transaction hands the written data out of its double buffer,
+					/// so the read never lands in data still being written.
+					/// 
+					/// The completion handlers of both operations run through the downstream
+					/// strand, since they share m_responseRelay. Whichever completes last moves
+					/// the relay along. See ::OnUpstreamRead(...) and ::OnDownstreamWrite(...).
+					/// </summary>
+					void RelayResponsePayload()
+					{
+						SetStreamTimeout(network::StreamPhase::Body);
+
+						auto writeBuffer = m_response->GetWriteBuffer();
+
+						m_responseRelay.chunkPending = false;
+						m_responseRelay.writeInFlight = true;
+
+						const bool readAhead = !m_responseRelay.readInFlight && !m_response->IsPayloadComplete() && !m_response->GetConsumeAllBeforeSending();
+
+						// The read buffer is fetched before either operation is started, since the
+						// handlers of either may run as soon as it is.
+						boost::asio::mutable_buffers_1 readBuffer(nullptr, 0);
+
+						if (readAhead)
+						{
+							try
+							{
+								readBuffer = m_response->GetPayloadReadBuffer();
+							}
+							catch (std::exception& e)
+							{
+								std::string errMsg(u8"In TlsCapableHttpBridge::RelayResponsePayload() - Got error:\t");
+								errMsg.append(e.what());
+								ReportError(errMsg);
+								Kill();
+								return;
+							}
+
+							m_responseRelay.readInFlight = true;
+						}
+
+						boost::asio::async_write(
+							m_downstreamSocket,
+							writeBuffer,
+							boost::asio::transfer_all(),
+							m_downstreamStrand.wrap(
+								network::MakeArenaHandler(
+									m_handlerArena,
+									std::bind(
+										&TlsCapableHttpBridge::OnDownstreamWrite,
+										shared_from_this(),
+										std::placeholders::_1
+										)
+									)
+								)
+							);
+
+						if (readAhead)
+						{
+							boost::asio::async_read(
+								*m_upstreamSocket,
+								readBuffer,
+								boost::asio::transfer_at_least(1),
+								m_downstreamStrand.wrap(
+									network::MakeArenaHandler(
+										m_handlerArena,
+										std::bind(
+											&TlsCapableHttpBridge::OnUpstreamRead,
+											shared_from_this(),
+											std::placeholders::_1,
+											std::placeholders::_2
+											)
+										)
+									)
+								);
+						}
+					}
+
+					/// <summary>
+					/// Applies filtering and our standard header adjustments to a request that
+					/// has had its headers parsed, before it is sent upstream. This is done for
+					/// every request independently, including pipelined requests, so that each one
+					/// is subject to its own ShouldBlock decision.
+					/// </summary>
+					/// <param name="request">
+					/// The request to filter and adjust.
+					/// </param>
+					void PrepareRequest(http::HttpRequest& request)
+					{
+						auto requestBlockResult = m_filteringEngine->ShouldBlock(&request, nullptr, std::is_same<BridgeSocketType, network::TlsSocket>::value);
+						request.SetShouldBlock(requestBlockResult);
+
+						// Before the client's Accept-Encoding is replaced below, note what it will
+						// accept, so that filtered responses can be compressed again for it.
+						std::string clientEncodings;
+
+						auto acceptEncodingHeaders = request.GetHeader(util::http::headers::AcceptEncoding);
+
+						while (acceptEncodingHeaders.first != acceptEncodingHeaders.second)
+						{
+							if (!clientEncodings.empty())
+							{
+								clientEncodings.append(u8", ");
+							}
+
+							clientEncodings.append(acceptEncodingHeaders.first->second);
+							++acceptEncodingHeaders.first;
+						}
+
+						request.AcceptedResponseCoding(http::BaseHttpTransaction::SelectContentCoding(clientEncodings));
+
+						// This little business is for dealing with browsers like Chrome, who just have
+						// to use their own "I'm too cool for skool" compression methods like SDHC. We
+						// want to be sure that we get normal, non-hipster encoded, non-organic smoothie
+						// encoded reponses that sane people can decompress. So we just always replace
+						// the Accept-Encoding header with the codings that we're able to decode.
+						auto supportedEncodings = http::BaseHttpTransaction::GetSupportedContentCodings();
+						request.AddHeader(util::http::headers::AcceptEncoding, supportedEncodings.to_string());
+
+						// Modifying content-encoding isn't enough for that sweet organic spraytanned
+						// browser Chrome and its server cartel buddies. If these special headers make
+						// it through, even though we've explicitly defined our accepted encoding,
+						// you're still going to get SDHC encoded data.
+						request.RemoveHeader(util::http::headers::XSDHC);
+						request.RemoveHeader(util::http::headers::AvailDictionary);
+					}
+
+					/// <summary>
+					/// Extracts the host name and, if present, the port from the Host header of the
+					/// supplied request.
+					/// </summary>
+					/// <param name="request">
+					/// The request to extract the host from.
+					/// </param>
+					/// <param name="host">
+					/// Will be set to the host name, without any port information.
+					/// </param>
+					/// <param name="port">
+					/// Will be set to the port specified in the Host header, or left at zero if
+					/// no port was specified or the port could not be parsed.
+					/// </param>
+					/// <returns>
+					/// True if the request has a Host header, false otherwise.
+					/// </returns>
+					const bool ExtractRequestHost(const http::HttpRequest& request, std::string& host, uint16_t& port)
+					{
+						auto hostHeader = request.GetHeader(util::http::headers::Host);
+
+						if (hostHeader.first == hostHeader.second)
+						{
+							return false;
+						}
+
+						host = hostHeader.first->second;
+
+						boost::trim(host);
+
+						auto portInd = host.find(':');
+
+						if (portInd != std::string::npos)
+						{
+							auto portString = host.substr(portInd + 1);
+
+							host = host.substr(0, portInd);
+
+							try
+							{
+								port = static_cast<uint16_t>(std::stoi(portString));
+							}
+							catch (...)
+							{
+								// We don't really care what went wrong. We failed to parse the port in the host. We'll
+								// simply issue a warning, and assume port 80.
+								ReportWarning(u8"In TlsCapableHttpBridge::ExtractRequestHost(const http::HttpRequest&, std::string&, uint16_t&) - Failed to parse port in host entry. Assuming port 80.");
+							}
+						}
+
+						return true;
+					}
+
+					/// <summary>
+					/// Sends the current request, which must have its headers parsed, on its way
+					/// upstream. The request is filtered, any complete requests that the client
+					/// pipelined behind it are queued, then the upstream host is either resolved
+					/// and connected to, or, if the bridge is already connected, the request is
+					/// simply written to it.
+					/// </summary>
+					void ForwardRequest()
+					{
+						// Blocking marks the request as complete, so take note of whether or not the
+						// client actually finished sending it first.
+						const bool requestFullyRead = m_request->IsPayloadComplete();
+
+						PrepareRequest(*m_request);
+
+						std::string hostWithoutPort;
+						uint16_t hostPort = 0;
+
+						if (!ExtractRequestHost(*m_request, hostWithoutPort, hostPort))
+						{
+							ReportError(u8"In TlsCapableHttpBridge::ForwardRequest() - Failed to read Host header from request.");
+							Kill();
+							return;
+						}
+
+						if (m_request->GetShouldBlock() != 0 && !m_filteringEngine->ShouldFetchBlockedResponseSize())
+						{
+							// No need to resolve, connect or write anything upstream just to learn the
+							// size of something we're not going to deliver. This is done before the
+							// host is checked against or assigned as the upstream host, since a blocked
+							// request for another host is harmless when we never send it anywhere.
+							if (!requestFullyRead)
+							{
+								// The rest of the request body is still on its way, and would be taken
+								// for the next request, so the connection can't be kept alive.
+								m_keepAlive = false;
+							}
+
+							AnswerBlockedRequestLocally();
+							return;
+						}
+
+						// Whatever this request writes upstream, the connection is busy until its
+						// response has been relayed in full.
+						m_upstreamReusable = false;
+
+						if (hostPort != 0)
+						{
+							m_upstreamHostPort = hostPort;
+						}
+
+						// If the we're already connected to a host and it's not the same, just quit.
+						bool needsResolve = true;
+						if (m_upstreamHost.size() > 0)
+						{
+							if (hostWithoutPort.compare(m_upstreamHost) != 0)
+							{
+								Kill();
+								return;
+							}
+
+							needsResolve = false;
+						}
+
+						m_upstreamHost = hostWithoutPort;
+
+						// Requests pipelined behind this one are only queued once the host is known,
+						// since they must all be destined for the same host.
+						if (m_request->IsPayloadComplete() && m_request->GetShouldBlock() == 0)
+						{
+							QueuePipelinedRequests();
+						}
+
+						if (!needsResolve)
+						{
+							// Just write to the server that we're apparently already connected to. We
+							// don't concern ourselves with the ShouldBlock value here on the request.
+							// Once we get the upstream response headers, which gives us data about the
+							// size of a yet-to-be-completed request, we will block if the value was set
+							// here, but not before the http filtering engine reports this data to
+							// any observer(s).
+
+							SetStreamTimeout(network::StreamPhase::Body);
+
+							auto writeBuffer = m_request->GetWriteBuffer();
+
+							boost::asio::async_write(
+								*m_upstreamSocket,
+								writeBuffer,
+								boost::asio::transfer_all(),
+								m_downstreamStrand.wrap(
+									network::MakeArenaHandler(
+										m_handlerArena,
+										std::bind(
+											&TlsCapableHttpBridge::OnUpstreamWrite,
+											shared_from_this(),
+											std::placeholders::_1
+											)
+										)
+									)
+								);
+
+							return;
+						}
+
+						// If we're not already connected to a host, then we need to resolve it and
+						// connect to it. This is only ever reached by plain bridges, because a secure
+						// bridge learns its host from SNI and its ConnectionFlow has connected it
+						// before its first request is read.
+						auto connectionPool = m_connectionPool.lock();
+
+						if (connectionPool != nullptr && !std::is_same<BridgeSocketType, network::TlsSocket>::value)
+						{
+							// Another bridge may have left an idle connection to this host behind,
+							// in which case we can write the request straight away.
+							auto pooled = connectionPool->CheckOut(m_upstreamHost, m_upstreamHostPort, m_upstreamStrand.get_io_service());
+
+							if (pooled != nullptr)
+							{
+								m_upstreamSocket = std::move(pooled);
+								OnUpstreamConnected();
+								return;
+							}
+						}
+
+						ConnectionFlow flow(shared_from_this());
+						flow();
+					}
+
+					/// <summary>
+					/// Resolves the upstream host, through the shared DNS cache when one was
+					/// supplied, or else directly with our own resolver.
+					/// </summary>
+					/// <param name="service">
+					/// The service name with which the resolved endpoints are preconfigured.
+					/// </param>
+					/// <param name="handler">
+					/// The completion handler, which is run through the upstream strand and given
+					/// the resolved endpoints.
+					/// </param>
+					template<typename Handler>
+					void ResolveUpstream(const std::string& service, Handler handler)
+					{
+						auto onResolve = m_upstreamStrand.wrap(network::MakeArenaHandler(m_handlerArena, std::move(handler)));
+
+						if (m_dnsCache != nullptr)
+						{
+							m_dnsCache->AsyncResolve(m_upstreamHost, service, onResolve);
+							return;
+						}
+
+						boost::asio::ip::tcp::resolver::query query(m_upstreamHost, service);
+
+						m_resolver.async_resolve(query, onResolve);
+					}
+
+					/// <summary>
+					/// Parses any requests that the client pipelined behind the current request
+					/// out of the data that was read along with it. Every complete request for the
+					/// same host is filtered and queued, to be written upstream back to back with
+					/// the current request. Responses are then matched to the queued requests in
+					/// FIFO order, with blocked requests being answered locally, in sequence,
+					/// without ever being sent upstream.
+					/// 
+					/// Parsing stops at the first request that is not complete within the data
+					/// already read, or that is for a different host. Such a request is held in
+					/// m_nextRequest and picked up through the regular read path once all queued
+					/// requests have been answered.
+					/// </summary>
+					void QueuePipelinedRequests()
+					{
+						http::HttpRequest* previous = m_request.get();
+
+						// Nothing that follows an upgrade request can be assumed to be HTTP, so
+						// queuing stops there. If the server declines the upgrade, the data is picked
+						// up as the next request through the regular read path.
+						while (previous->HasPipelinedData() && !previous->IsUpgrade())
+						{
+							std::unique_ptr<http::HttpRequest> next(new http::HttpRequest());
+							InitTransaction(*next);
+
+							previous->MovePipelinedDataTo(*next);
+
+							if (m_pipelinedRequests.size() >= MaxPipelinedRequests)
+							{
+								m_nextRequest = std::move(next);
+								return;
+							}
+
+							auto headerLength = next->GetBufferedHeaderLength();
+
+							if (headerLength == 0 || !next->Parse(headerLength) || !next->IsPayloadComplete())
+							{
+								m_nextRequest = std::move(next);
+								return;
+							}
+
+							std::string nextHost;
+							uint16_t nextPort = 0;
+
+							if (!ExtractRequestHost(*next, nextHost, nextPort) || nextHost.compare(m_upstreamHost) != 0)
+							{
+								m_nextRequest = std::move(next);
+								return;
+							}
+
+							PrepareRequest(*next);
+
+							previous = next.get();
+							m_pipelinedRequests.push_back(std::move(next));
+						}
+					}
+
+					/// <summary>
+					/// Writes the next queued pipelined request that has not yet been sent upstream,
+					/// skipping over any blocked requests, which are answered locally instead.
+					/// </summary>
+					/// <returns>
+					/// True if a write was initiated, false if there are no more pipelined requests
+					/// to send upstream.
+					/// </returns>
+					const bool ForwardNextPipelinedRequest()
+					{
+						while (m_pipelineForwardIndex < m_pipelinedRequests.size())
+						{
+							auto& next = m_pipelinedRequests[m_pipelineForwardIndex++];
+
+							if (next->GetShouldBlock() != 0)
+							{
+								continue;
+							}
+
+							SetStreamTimeout(network::StreamPhase::Body);
+
+							auto writeBuffer = next->GetWriteBuffer();
+
+							boost::asio::async_write(
+								*m_upstreamSocket,
+								writeBuffer,
+								boost::asio::transfer_all(),
+								m_downstreamStrand.wrap(
+									network::MakeArenaHandler(
+										m_handlerArena,
+										std::bind(
+											&TlsCapableHttpBridge::OnUpstreamWrite,
+											shared_from_this(),
+											std::placeholders::_1
+											)
+										)
+									)
+								);
+
+							return true;
+						}
+
+						return false;
+					}
+
+					/// <summary>
+					/// Moves the bridge on to the next transaction once the current response has
+					/// been fully written to the client on a keep-alive connection. If requests are
+					/// waiting in the pipeline queue, the next one becomes current, and its
+					/// response is either read from upstream or, if it was blocked, generated
+					/// locally. Otherwise, the next request is read from the client, starting with
+					/// any data the client already sent.
+					/// </summary>
+					void StartNextTransaction()
+					{
+						m_answeredLocally = false;
+						m_rawRelay = false;
+
+						if (!m_pipelinedRequests.empty())
+						{
+							m_request = std::move(m_pipelinedRequests.front());
+							m_pipelinedRequests.pop_front();
+
+							if (m_pipelineForwardIndex > 0)
+							{
+								--m_pipelineForwardIndex;
+							}
+
+							if (m_request->GetShouldBlock() != 0)
+							{
+								AnswerBlockedRequestLocally();
+								return;
+							}
+
+							ReplaceResponse();
+
+							// The request was already written upstream, so just read its response.
+							boost::asio::async_read_until(
+								*m_upstreamSocket,
+								m_response->GetHeaderReadBuffer(),
+								u8"\r\n\r\n",
+								m_downstreamStrand.wrap(
+									network::MakeArenaHandler(
+										m_handlerArena,
+										std::bind(
+											&TlsCapableHttpBridge::OnUpstreamHeaders,
+											shared_from_this(),
+											std::placeholders::_1,
+											std::placeholders::_2
+											)
+										)
+									)
+								);
+
+							return;
+						}
+
+						ReplaceResponse();
+
+						if (m_nextRequest)
+						{
+							m_request = std::move(m_nextRequest);
+						}
+						else
+						{
+							std::unique_ptr<http::HttpRequest> next(new http::HttpRequest());
+							InitTransaction(*next);
+
+							if (m_request)
+							{
+								// Only ever holds data here if the previous request was never handed
+								// to ::QueuePipelinedRequests(). That happens when it asked for an
+								// upgrade that the server declined, or when it was blocked and
+								// answered locally by ::AnswerBlockedRequestLocally(). In both cases,
+								// whatever the client pipelined behind it is carried over here.
+								m_request->MovePipelinedDataTo(*next);
+							}
+
+							m_request = std::move(next);
+						}
+
+						if (m_request->HeadersComplete())
+						{
+							// This request was pipelined and already parsed along with a previous one.
+							ForwardRequest();
+							return;
+						}
+
+						boost::asio::async_read_until(
+							m_downstreamSocket,
+							m_request->GetHeaderReadBuffer(),
+							u8"\r\n\r\n",
+							m_downstreamStrand.wrap(
+								network::MakeArenaHandler(
+									m_handlerArena,
+									std::bind(
+										&TlsCapableHttpBridge::OnDownstreamHeaders,
+										shared_from_this(),
+										std::placeholders::_1,
+										std::placeholders::_2
+										)
+									)
+								)
+							);
+					}
+
+					/// <summary>
+					/// Replaces the current response with a fresh one, carrying over any data the
+					/// server already sent for the next response.
+					/// </summary>
+					void ReplaceResponse()
+					{
+						std::unique_ptr<http::HttpResponse> next(new http::HttpResponse());
+						InitTransaction(*next);
+
+						if (m_response)
+						{
+							m_response->MovePipelinedDataTo(*next);
+						}
+
+						m_response = std::move(next);
+					}
+
+					/// <summary>
+					/// Answers the current, blocked request with a locally generated response,
+					/// without any upstream contact. The current response object is left untouched,
+					/// since it may still be holding data the server sent for the response to the
+					/// next forwarded request.
+					/// </summary>
+					void AnswerBlockedRequestLocally()
+					{
+						m_localResponse.reset(new http::HttpResponse());
+						InitTransaction(*m_localResponse);
+						m_localResponse->SetHttpVersion(m_request->GetHttpVersion());
+
+						// With the response supplied and the request already blocked, this only reports
+						// the blocked request. The response is empty, so no size can be reported.
+						m_filteringEngine->ShouldBlock(m_request.get(), m_localResponse.get(), std::is_same<BridgeSocketType, network::TlsSocket>::value);
+
+						m_localResponse->SetShouldBlock(m_request->GetShouldBlock());
+						m_localResponse->MakeBlockResponse(SelectBlockResponseType(*m_request, nullptr));
+
+						m_answeredLocally = true;
+
+						SetStreamTimeout(network::StreamPhase::Body);
+
+						auto responseBuffer = m_localResponse->GetWriteBuffer();
+
+						boost::asio::async_write(
+							m_downstreamSocket,
+							responseBuffer,
+							boost::asio::transfer_all(),
+							m_downstreamStrand.wrap(
+								network::MakeArenaHandler(
+									m_handlerArena,
+									std::bind(
+										&TlsCapableHttpBridge::OnDownstreamWrite,
+										shared_from_this(),
+										std::placeholders::_1
+										)
+									)
+								)
+							);
+					}
+
+					/// <summary>
+					/// Picks the kind of prebuilt block response that best matches what the client
+					/// was expecting to get back for the supplied request. If the response headers
+					/// are available, the response content type decides. Otherwise, the request's
+					/// Accept header and then the extension in the request URI are used as hints.
+					/// When nothing matches, an empty 204 is used.
+					/// </summary>
+					/// <param name="request">
+					/// The blocked request.
+					/// </param>
+					/// <param name="response">
+					/// The response to the blocked request, if its headers have been read.
+					/// Otherwise, nullptr.
+					/// </param>
+					/// <returns>
+					/// The kind of block response to answer the request with.
+					/// </returns>
+					const http::BlockResponseType SelectBlockResponseType(const http::HttpRequest& request, const http::HttpResponse* response) const
+					{
+						if (response != nullptr && response->HeadersComplete())
+						{
+							if (response->IsPayloadImage())
+							{
+								return http::BlockResponseType::Image;
+							}
+
+							if (response->IsPayloadJavascript())
+							{
+								return http::BlockResponseType::Script;
+							}
+
+							if (response->IsPayloadCss())
+							{
+								return http::BlockResponseType::Stylesheet;
+							}
+
+							if (response->IsPayloadHtml())
+							{
+								return http::BlockResponseType::Html;
+							}
+						}
+
+						// Browsers lead the Accept header with the type they want most for
+						// navigations, images and stylesheets. Scripts are requested with */*.
+						auto acceptHeader = request.GetHeader(util::http::headers::Accept);
+
+						if (acceptHeader.first != acceptHeader.second)
+						{
+							const auto& accept = acceptHeader.first->second;
+
+							if (boost::istarts_with(accept, u8"text/html"))
+							{
+								return http::BlockResponseType::Html;
+							}
+
+							if (boost::istarts_with(accept, u8"image/"))
+							{
+								return http::BlockResponseType::Image;
+							}
+
+							if (boost::istarts_with(accept, u8"text/css"))
+							{
+								return http::BlockResponseType::Stylesheet;
+							}
+						}
+
+						const auto& uri = request.RequestURI();
+						auto pathEnd = uri.find_first_of(u8"?#");
+						boost::string_ref path(uri.data(), pathEnd == std::string::npos ? uri.size() : pathEnd);
+
+						if (boost::iends_with(path, u8".js"))
+						{
+							return http::BlockResponseType::Script;
+						}
+
+						if (boost::iends_with(path, u8".css"))
+						{
+							return http::BlockResponseType::Stylesheet;
+						}
+
+						if (
+							boost::iends_with(path, u8".gif") || boost::iends_with(path, u8".png") ||
+							boost::iends_with(path, u8".jpg") || boost::iends_with(path, u8".jpeg") ||
+							boost::iends_with(path, u8".ico") || boost::iends_with(path, u8".webp")
+							)
+						{
+							return http::BlockResponseType::Image;
+						}
+
+						return http::BlockResponseType::NoContent;
+					}
+
+					/// <summary>
+					/// Configures a newly created transaction to report through the same callbacks
+					/// as this bridge.
+					/// </summary>
+					/// <param name="transaction">
+					/// The transaction to configure.
+					/// </param>
+					void InitTransaction(http::BaseHttpTransaction& transaction)
+					{
+						// XXX TODO - This is ugly, our bad design is showing. See notes in the
+						// EventReporter class header.
+						transaction.SetOnInfo(m_onInfo);
+						transaction.SetOnWarning(m_onWarning);
+						transaction.SetOnError(m_onError);
+						transaction.SetPayloadMemoryBudget(m_payloadBudget);
+						transaction.SetIoBufferPool(m_bufferPool);
+					}
+
+					/// <summary>
+					/// Completion handler for when an asynchronous read of the request payload from
+					/// the connected client completes. Requests the request payload to be parsed
+					/// and, depending on configured options, may write the data to the remote
+					/// upstream server, or resize the read buffer and continue reading the request
+					/// payload until completion.
+					/// 
+					/// In the event that this operation was a failure, meaning that the supplied
+					/// error parameter was set and the code was one unexpected, the bridge will be 
+					/// terminated.
+					/// </summary>
+					/// <param name="error">
+					/// Error code that will indicate if any errors were handled during the async
+					/// operation, providing details if an error did occur and was handled.
+					/// </param>
+					/// <param name="bytesTransferred">
+					/// The number of bytes read from the connected client.
+					/// </param>
+					void OnDownstreamRead(const boost::system::error_code& error, const size_t bytesTransferred)
+					{
+						#ifndef NDEBUG
+						ReportInfo(u8"TlsCapableHttpBridge::OnDownstreamRead");
+						#endif // !NDEBUG
+
+						m_requestRelay.readInFlight = false;
+
+						// EOF doesn't necessarily mean something critical happened. Could simply be
+						// that we got the entire valid response, and the server closed the connection
+						// after.
+						if ((!error || (error.value() == boost::asio::error::eof)) && bytesTransferred > 0)
+						{
+							if (m_request->Parse(bytesTransferred))
+							{
+								if (m_request->IsPayloadComplete() && m_request->GetShouldBlock() == 0)
+								{
+									QueuePipelinedRequests();
+								}
+
+								if (m_request->IsPayloadComplete() == false && m_request->GetConsumeAllBeforeSending())
+								{
+									// The client has more to send and it's been flagged for inspection. Must
+									// initiate a read again.
+
+									SetStreamTimeout(network::StreamPhase::Body);
+
+									try
+									{
+										auto readBuffer = m_request->GetPayloadReadBuffer();
+
+										boost::asio::async_read(
+											m_downstreamSocket,
+											readBuffer,
+											boost::asio::transfer_at_least(1),
+											m_downstreamStrand.wrap(
+												network::MakeArenaHandler(
+													m_handlerArena,
+													std::bind(
+														&TlsCapableHttpBridge::OnDownstreamRead,
+														shared_from_this(),
+														std::placeholders::_1,
+														std::placeholders::_2
+														)
+													)
+												)
+											);
+
+										return;
+									}
+									catch (std::exception& e)
+									{
+										std::string errMsg(u8"In TlsCapableHttpBridge::OnDownstreamRead(const boost::system::error_code&, const size_t) - Got error:\t");
+										errMsg.append(e.what());
+										ReportError(errMsg);
+									}
+								}
+
+								if (m_requestRelay.writeInFlight)
+								{
+									// The previous piece is still being written to the server. This
+									// one goes out as soon as that write completes.
+									m_requestRelay.chunkPending = true;
+									return;
+								}
+
+								// Just write whatever we've got to the server.
+								RelayRequestPayload();
+
+								return;
+							}
+							else
+							{
+								ReportError(u8"In TlsCapableHttpBridge::OnDownstreamHeaders(const boost::system::error_code&, const size_t) - Failed to parse request.");
+							}
+						}
+
+						if (error)
+						{
+							std::string errMsg(u8"In TlsCapableHttpBridge::OnDownstreamRead(const boost::system::error_code&, const size_t) - Got error:\t");
+							errMsg.append(error.message());
+							ReportError(errMsg);
+						}
+
+						if (m_requestRelay.writeInFlight)
+						{
+							// Let the server have what was already read before tearing down.
+							m_requestRelay.closePending = true;
+							return;
+						}
 
 						Kill();
 					}
@@ -1337,26 +2692,64 @@ namespace te
 						// after.
 						if (!error)
 						{
-							if (m_response->IsPayloadComplete() == false)
+							if (m_tunneling)
+							{
+								StartTunnel();
+								return;
+							}
+
+							m_responseRelay.writeInFlight = false;
+
+							if (m_responseRelay.chunkPending)
+							{
+								// The next piece was read while this one was being written.
+								if (m_rawRelay)
+								{
+									WriteRawResponsePayload();
+								}
+								else
+								{
+									RelayResponsePayload();
+								}
+
+								return;
+							}
+
+							if (m_responseRelay.closePending)
+							{
+								Kill();
+								return;
+							}
+
+							if (m_responseRelay.readInFlight)
+							{
+								// The next piece is already on its way from the server.
+								return;
+							}
+
+							if (!m_answeredLocally && m_response->IsPayloadComplete() == false)
 							{
 								// The server has more to write.
 
-								SetStreamTimeout(5000);
+								SetStreamTimeout(network::StreamPhase::Body);
 
 								try
 								{
 									auto readBuffer = m_response->GetPayloadReadBuffer();
 
 									boost::asio::async_read(
-										m_upstreamSocket,
+										*m_upstreamSocket,
 										readBuffer,
 										boost::asio::transfer_at_least(1),
-										m_upstreamStrand.wrap(
-											std::bind(
-												&TlsCapableHttpBridge::OnUpstreamRead,
-												shared_from_this(),
-												std::placeholders::_1,
-												std::placeholders::_2
+										m_downstreamStrand.wrap(
+											network::MakeArenaHandler(
+												m_handlerArena,
+												std::bind(
+													&TlsCapableHttpBridge::OnUpstreamRead,
+													shared_from_this(),
+													std::placeholders::_1,
+													std::placeholders::_2
+													)
 												)
 											)
 										);
@@ -1386,41 +2779,29 @@ namespace te
 									// polluted by the left over data from the previous, aborted
 									// (blocked) request. Therefore, we have no choice but to
 									// entirely terminate the bridge and force the client to open a
-									// new connection.
+									// new connection. This does not apply to requests we answered
+									// locally, since those never went upstream at all.
 
-									if ((m_request && m_request->GetShouldBlock() != 0) || (m_response && m_response->GetShouldBlock() != 0))
+									if (!m_answeredLocally && ((m_request && m_request->GetShouldBlock() != 0) || (m_response && m_response->GetShouldBlock() != 0)))
 									{
 										Kill();
 										return;
 									}
 
-									SetStreamTimeout(5000);
+									// With nothing left in flight upstream, the connection is idle until the
+									// client sends another request. Should the client go away first, the
+									// connection can be handed to the pool rather than closed.
+									m_upstreamReusable = m_pipelinedRequests.empty() && !m_tunneling && !m_tlsPassthrough && m_upstreamHost.size() > 0 && UpstreamSocket().is_open();
 
-									m_request.reset(new http::HttpRequest());
-									m_response.reset(new http::HttpResponse());
+									SetStreamTimeout(network::StreamPhase::IdleKeepAlive);
 
-									// XXX TODO - This is ugly, our bad design is showing. See notes in the
-									// EventReporter class header.
-									m_request->SetOnInfo(m_onInfo);
-									m_request->SetOnWarning(m_onWarning);
-									m_request->SetOnError(m_onError);
-									m_response->SetOnInfo(m_onInfo);
-									m_response->SetOnWarning(m_onWarning);
-									m_response->SetOnError(m_onError);
-
-									boost::asio::async_read_until(
-										m_downstreamSocket,
-										m_request->GetHeaderReadBuffer(),
-										u8"\r\n\r\n",
-										m_downstreamStrand.wrap(
-											std::bind(
-												&TlsCapableHttpBridge::OnDownstreamHeaders,
-												shared_from_this(),
-												std::placeholders::_1,
-												std::placeholders::_2
-												)
-											)
-										);
+									if (m_draining.load())
+									{
+										Kill();
+										return;
+									}
+
+									StartNextTransaction();
 
 									return;
 								}
@@ -1437,238 +2818,560 @@ namespace te
 					}
 
 					/// <summary>
-					/// Completion handler for when the asynchrous wait operation on the stream
-					/// timer is finished, meaning that the timeout period has been reached, or that
-					/// the operation was cancelled. If the timeout has been reached, then the
-					/// bridge should be terminated. If the operation was aborted, then the function
-					/// will return without calling for a termination of the bridge.
+					/// Turns the bridge into an opaque, full-duplex byte relay, once the 101
+					/// Switching Protocols response has been written to the client. From here on,
+					/// nothing is parsed or filtered. Data is read from either side into a large,
+					/// reused buffer and written straight through to the other side, with a read
+					/// outstanding on both sides at all times, so long-lived connections such as
+					/// WebSockets cost next to nothing per message.
 					/// 
-					/// In the event that this operation was a failure, meaning that the supplied
-					/// error parameter was set and the code was one unexpected, the bridge will be 
-					/// terminated.
+					/// All handlers for both directions run through the downstream strand. Reads
+					/// and writes in each direction still overlap on the wire, but since the SSL
+					/// stream objects are not safe for concurrent use, the relay must never touch
+					/// the same stream from two handlers at once. The stream timeout is disabled,
+					/// as idle tunnels are normal. The tunnel lives until either side closes.
 					/// </summary>
-					/// <param name="error">
-					/// Error code that will indicate if any errors were handled during the async
-					/// operation, providing details if an error did occur and was handled.
-					/// </param>
-					void OnStreamTimeout(const boost::system::error_code& error)
+					void StartTunnel()
 					{
-
 						#ifndef NDEBUG
-						ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnStreamTimeout");
+						ReportInfo(u8"TlsCapableHttpBridge::StartTunnel");
 						#endif // !NDEBUG
 
-						if (error)
+						ClearStreamTimeout();
+
+						// Either side may already have sent data in the new protocol, which was read
+						// along with the upgrade request or the 101 response.
+						m_tunnelClientBuffer = m_request->ReleasePipelinedData();
+						m_tunnelServerBuffer = m_response->ReleasePipelinedData();
+
+						const size_t clientPending = m_tunnelClientBuffer.size();
+						const size_t serverPending = m_tunnelServerBuffer.size();
+
+						if (m_tunnelClientBuffer.size() < TunnelBufferSize)
 						{
-							if (error.value() == boost::asio::error::operation_aborted)
-							{
-								// Aborts are normal, as pending async_waits are cancelled every time that
-								// the timeout is reset. Therefore, we safely ignore them.
-								return;
-							}
-							else
-							{
-								// XXX TODO - Perhaps in the event of an error, we should return and avoid
-								// calling ::Kill()?
-								std::string errMessage(u8"In TlsCapableHttpBridge<BridgeSocketType>::OnStreamTimeout(const boost::system::error_code&) - Got error:\t");
-								errMessage.append(error.message());
-								ReportError(errMessage);
-							}
+							m_tunnelClientBuffer.resize(TunnelBufferSize);
 						}
 
-						ReportWarning(u8"In TlsCapableHttpBridge<BridgeSocketType>::OnStreamTimeout(const boost::system::error_code&) - Stream timed out.");
+						if (m_tunnelServerBuffer.size() < TunnelBufferSize)
+						{
+							m_tunnelServerBuffer.resize(TunnelBufferSize);
+						}
 
-						Kill();
+						TunnelPump(shared_from_this(), true, clientPending)();
+						TunnelPump(shared_from_this(), false, serverPending)();
 					}
 
 					/// <summary>
-					/// Sets or resets the timeout for the bridge's stream operations. If the
-					/// timeout is reached and the completion handler invoked, then the bridge will
-					/// be killed, with both downstream and upstream operations cancelled in an
-					/// asynchrous manner, at which time the bridge's reference count will reach
-					/// zero and the destructor will be called.
+					/// Turns the bridge into an opaque relay of raw TLS bytes, once the upstream TCP
+					/// connection is established for a host on the passthrough list. Neither side
+					/// of the bridge does a handshake, so no certificate is spoofed and nothing is
+					/// decrypted. The client hello that was only peeked at is still waiting on the
+					/// client socket, so it is the first thing relayed. Otherwise this is the same
+					/// relay as ::StartTunnel(), only on the underlying TCP sockets.
 					/// </summary>
-					/// <param name="millisecondsFromNow">
-					/// The number of milliseconds from now until the timeout. If any negative value
-					/// is supplied, the timeout will be set to positive infinity, so it never expires.
-					/// </param>
-					void SetStreamTimeout(int millisecondsFromNow)
+					void StartTlsPassthrough()
 					{
-						m_streamTimer.cancel();
+						#ifndef NDEBUG
+						ReportInfo(u8"TlsCapableHttpBridge::StartTlsPassthrough");
+						#endif // !NDEBUG
 
-						if (millisecondsFromNow < 0)
-						{
-							m_streamTimer.expires_at(boost::posix_time::pos_infin);
-							return;
-						}
-						
-						m_streamTimer.async_wait(std::bind(&TlsCapableHttpBridge::OnStreamTimeout, shared_from_this(), std::placeholders::_1));
+						ClearStreamTimeout();
+
+						m_tunnelClientBuffer.resize(TunnelBufferSize);
+						m_tunnelServerBuffer.resize(TunnelBufferSize);
+
+						TunnelPump(shared_from_this(), true, 0)();
+						TunnelPump(shared_from_this(), false, 0)();
 					}
 
 					/// <summary>
-					/// Completion handler for when the asynchrous handshake operation with the
-					/// remote upstream host has finished. If the operation was a success, then a
-					/// context by which to serve the connected client will either be retrieved, or
-					/// created, stored and then retrieved.
+					/// One direction of the opaque tunnel, written as a stackless coroutine rather
+					/// than as a ring of completion handlers. Reads from one side into that side's
+					/// tunnel buffer, writes what was read through to the other side, and repeats
+					/// until either side closes or errs, at which point the bridge is killed. The
+					/// coroutine object is itself the completion handler of every operation it
+					/// starts, so all of its state travels with it and nothing needs binding.
 					/// 
-					/// In the event that this operation was a failure, meaning that the supplied
-					/// error parameter was set and the code was one unexpected, the bridge will be 
-					/// terminated.
+					/// Each tunnel runs one coroutine per direction, and both run through the
+					/// downstream strand. See ::StartTunnel().
 					/// </summary>
-					/// <param name="error">
-					/// Error code that will indicate if any errors were handled during the async
-					/// operation, providing details if an error did occur and was handled.
-					/// </param>
-					void OnUpstreamHandshake(const boost::system::error_code& error)
+					class TunnelPump : public boost::asio::coroutine
 					{
 
-						#ifndef NDEBUG
-						ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake");
-						#endif // !NDEBUG
+					public:
+
+						/// <summary>
+						/// Constructs a new TunnelPump.
+						/// </summary>
+						/// <param name="bridge">
+						/// The bridge whose tunnel is to be pumped.
+						/// </param>
+						/// <param name="fromClient">
+						/// True to pump data from the client to the server, false to pump data from
+						/// the server to the client.
+						/// </param>
+						/// <param name="pending">
+						/// The number of bytes already at the front of the source side's tunnel
+						/// buffer, to be written before anything is read.
+						/// </param>
+						TunnelPump(std::shared_ptr<TlsCapableHttpBridge> bridge, const bool fromClient, const size_t pending)
+							:
+							m_bridge(std::move(bridge)),
+							m_fromClient(fromClient),
+							m_pending(pending)
+						{
+
+						}
 
-						if (!error && m_upstreamCert != nullptr)
+						/// <summary>
+						/// Runs the coroutine up to its next read or write, or to its end. Invoked
+						/// once to start it, and then as the completion handler of every read and
+						/// write it starts.
+						/// </summary>
+						/// <param name="error">
+						/// Error code that will indicate if any errors were handled during the async
+						/// operation, providing details if an error did occur and was handled.
+						/// </param>
+						/// <param name="bytesTransferred">
+						/// The number of bytes read or written.
+						/// </param>
+						void operator()(const boost::system::error_code& error = boost::system::error_code(), const size_t bytesTransferred = 0)
 						{
-							boost::asio::ssl::context* serverCtx = nullptr;
+							BOOST_ASIO_CORO_REENTER(this)
+							{
+								for (;;)
+								{
+									if (m_pending == 0)
+									{
+										BOOST_ASIO_CORO_YIELD m_bridge->TunnelRead(m_fromClient, *this);
 
-							try
+										if (error || bytesTransferred == 0)
+										{
+											break;
+										}
+
+										m_pending = bytesTransferred;
+									}
+
+									BOOST_ASIO_CORO_YIELD m_bridge->TunnelWrite(m_fromClient, m_pending, *this);
+
+									if (error)
+									{
+										break;
+									}
+
+									m_pending = 0;
+								}
+
+								if (error && error.value() != boost::asio::error::eof && error.value() != boost::asio::error::operation_aborted)
+								{
+									std::string errMsg(u8"In TlsCapableHttpBridge::TunnelPump::operator()(const boost::system::error_code&, const size_t) - Got error:\t");
+									errMsg.append(error.message());
+									m_bridge->ReportError(errMsg);
+								}
+
+								m_bridge->Kill();
+							}
+						}
+
+					private:
+
+						/// <summary>
+						/// The bridge whose tunnel is being pumped. Holding it here keeps it alive for
+						/// as long as the coroutine has an operation outstanding.
+						/// </summary>
+						std::shared_ptr<TlsCapableHttpBridge> m_bridge;
+
+						/// <summary>
+						/// Whether data is pumped from the client to the server, or the reverse.
+						/// </summary>
+						bool m_fromClient;
+
+						/// <summary>
+						/// The number of bytes read and not yet written.
+						/// </summary>
+						size_t m_pending;
+
+					};
+
+					/// <summary>
+					/// Reads whatever is available from one side of the tunnel into that side's
+					/// tunnel buffer. Reads the raw TCP socket when passing TLS through, or else
+					/// the socket type of the bridge.
+					/// </summary>
+					/// <param name="fromClient">
+					/// True to read from the client, false to read from the server.
+					/// </param>
+					/// <param name="handler">
+					/// The completion handler, which is run through the downstream strand.
+					/// </param>
+					template<typename Handler>
+					void TunnelRead(const bool fromClient, Handler handler)
+					{
+						auto wrapped = m_downstreamStrand.wrap(network::MakeArenaHandler(m_handlerArena, std::move(handler)));
+
+						if (fromClient)
+						{
+							auto buffer = boost::asio::buffer(m_tunnelClientBuffer.data(), m_tunnelClientBuffer.size());
+
+							if (m_tlsPassthrough)
 							{
-								serverCtx = m_certStore->GetServerContext(m_upstreamHost, m_upstreamCert);
+								DownstreamSocket().async_read_some(buffer, wrapped);
 							}
-							catch (std::exception& e)
+							else
 							{
-								serverCtx = nullptr;
-								std::string errMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake(const boost::system::error_code&) - Got error:\t");
-								errMessage.append(e.what());
-								ReportError(errMessage);
+								m_downstreamSocket.async_read_some(buffer, wrapped);
 							}
+						}
+						else
+						{
+							auto buffer = boost::asio::buffer(m_tunnelServerBuffer.data(), m_tunnelServerBuffer.size());
 
-							if (serverCtx != nullptr)
+							if (m_tlsPassthrough)
 							{
-								if (SSL_set_SSL_CTX(m_downstreamSocket.native_handle(), serverCtx->native_handle()) == serverCtx->native_handle())
-								{
-									// Set timeouts
-									SetStreamTimeout(5000);
-									//
-									
-									m_downstreamSocket.async_handshake(
-										network::TlsSocket::server, 
-										m_downstreamStrand.wrap(
-											std::bind(
-												&TlsCapableHttpBridge::OnDownstreamHandshake, 
-												shared_from_this(), 
-												std::placeholders::_1
-												)
-											)
-										);
+								UpstreamSocket().async_read_some(buffer, wrapped);
+							}
+							else
+							{
+								m_upstreamSocket->async_read_some(buffer, wrapped);
+							}
+						}
+					}
 
-									return;
-								}
-								else
-								{
-									ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake(const boost::system::error_code&) - Failed to correctly set context.");
-								}
+					/// <summary>
+					/// Writes the front of one side's tunnel buffer, in full, through to the other
+					/// side of the tunnel.
+					/// </summary>
+					/// <param name="fromClient">
+					/// True to write data read from the client to the server, false to write data
+					/// read from the server to the client.
+					/// </param>
+					/// <param name="size">
+					/// The number of bytes to write.
+					/// </param>
+					/// <param name="handler">
+					/// The completion handler, which is run through the downstream strand.
+					/// </param>
+					template<typename Handler>
+					void TunnelWrite(const bool fromClient, const size_t size, Handler handler)
+					{
+						auto wrapped = m_downstreamStrand.wrap(network::MakeArenaHandler(m_handlerArena, std::move(handler)));
+
+						if (fromClient)
+						{
+							auto buffer = boost::asio::buffer(m_tunnelClientBuffer.data(), size);
+
+							if (m_tlsPassthrough)
+							{
+								boost::asio::async_write(UpstreamSocket(), buffer, boost::asio::transfer_all(), wrapped);
 							}
 							else
 							{
-								ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake(const boost::system::error_code&) - Failed to fetch spoofed context.");
+								boost::asio::async_write(*m_upstreamSocket, buffer, boost::asio::transfer_all(), wrapped);
 							}
 						}
 						else
 						{
-							if (error)
+							auto buffer = boost::asio::buffer(m_tunnelServerBuffer.data(), size);
+
+							if (m_tlsPassthrough)
 							{
-								std::string errMsg(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake(const boost::system::error_code&) - Got error:\t");
-								errMsg.append(error.message());
-								ReportError(errMsg);
+								boost::asio::async_write(DownstreamSocket(), buffer, boost::asio::transfer_all(), wrapped);
 							}
+							else
+							{
+								boost::asio::async_write(m_downstreamSocket, buffer, boost::asio::transfer_all(), wrapped);
+							}
+						}
+					}
+
+					/// <summary>
+					/// Relays the remainder of a plain text response payload straight from the
+					/// server to the client, without it passing through the response transaction.
+					/// Used for large payloads of a known size that are not being inspected, such
+					/// as binary downloads, so that no parsing or transaction bookkeeping is done
+					/// for any of the bulk of the data.
+					/// 
+					/// The headers and any payload data read along with them are written first,
+					/// after which the response is marked complete and the exact number of bytes
+					/// that remain are relayed through a double buffer of their own, reading one
+					/// piece while writing the last. Reads never ask for more than what remains, so
+					/// data belonging to a following response is never consumed. Once the last
+					/// byte is written, the bridge carries on with keep-alive as usual.
+					/// 
+					/// This uses the same relay state, strand and timeouts as streamed payloads.
+					/// See ::RelayResponsePayload().
+					/// </summary>
+					void StartRawResponseRelay()
+					{
+						#ifndef NDEBUG
+						ReportInfo(u8"TlsCapableHttpBridge::StartRawResponseRelay");
+						#endif // !NDEBUG
+
+						m_rawRelay = true;
+						m_rawRelayRemaining = m_response->GetUnreadPayloadSize();
+						m_rawRelayReadIndex = 0;
 
-							if (m_upstreamCert != nullptr)
+						for (auto& buffer : m_rawRelayBuffers)
+						{
+							if (buffer.size() < RawRelayBufferSize)
 							{
-								ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake(const boost::system::error_code&) - Upstream cert is nullptr!");
+								buffer.resize(RawRelayBufferSize);
 							}
 						}
 
-						Kill();
+						SetStreamTimeout(network::StreamPhase::Body);
+
+						auto writeBuffer = m_response->GetWriteBuffer();
+
+						m_response->SetPayloadRelayed();
+
+						m_responseRelay.chunkPending = false;
+						m_responseRelay.writeInFlight = true;
+						m_responseRelay.readInFlight = true;
+
+						boost::asio::async_write(
+							m_downstreamSocket,
+							writeBuffer,
+							boost::asio::transfer_all(),
+							m_downstreamStrand.wrap(
+								network::MakeArenaHandler(
+									m_handlerArena,
+									std::bind(
+										&TlsCapableHttpBridge::OnDownstreamWrite,
+										shared_from_this(),
+										std::placeholders::_1
+										)
+									)
+								)
+							);
+
+						ReadRawResponsePayload();
+					}
+
+					/// <summary>
+					/// Initiates a read of raw response payload data from the server into the
+					/// buffer that is not being written. See ::StartRawResponseRelay().
+					/// </summary>
+					void ReadRawResponsePayload()
+					{
+						auto& buffer = m_rawRelayBuffers[m_rawRelayReadIndex];
+
+						const size_t readSize = static_cast<size_t>(std::min<uint64_t>(buffer.size(), m_rawRelayRemaining));
+
+						m_responseRelay.readInFlight = true;
+
+						boost::asio::async_read(
+							*m_upstreamSocket,
+							boost::asio::buffer(buffer.data(), readSize),
+							boost::asio::transfer_at_least(1),
+							m_downstreamStrand.wrap(
+								network::MakeArenaHandler(
+									m_handlerArena,
+									std::bind(
+										&TlsCapableHttpBridge::OnRawUpstreamRead,
+										shared_from_this(),
+										std::placeholders::_1,
+										std::placeholders::_2
+										)
+									)
+								)
+							);
+					}
+
+					/// <summary>
+					/// Writes the raw response payload data last read to the client and, if the
+					/// server has more to send, reads the next piece into the other buffer while
+					/// the write is in flight. See ::StartRawResponseRelay().
+					/// </summary>
+					void WriteRawResponsePayload()
+					{
+						auto& buffer = m_rawRelayBuffers[m_rawRelayReadIndex];
+
+						m_rawRelayReadIndex ^= 1;
+
+						const bool readAhead = m_rawRelayRemaining > 0;
+
+						m_responseRelay.chunkPending = false;
+						m_responseRelay.writeInFlight = true;
+						m_responseRelay.readInFlight = readAhead;
+
+						SetStreamTimeout(network::StreamPhase::Body);
+
+						boost::asio::async_write(
+							m_downstreamSocket,
+							boost::asio::buffer(buffer.data(), m_rawRelayReadSize),
+							boost::asio::transfer_all(),
+							m_downstreamStrand.wrap(
+								network::MakeArenaHandler(
+									m_handlerArena,
+									std::bind(
+										&TlsCapableHttpBridge::OnDownstreamWrite,
+										shared_from_this(),
+										std::placeholders::_1
+										)
+									)
+								)
+							);
+
+						if (readAhead)
+						{
+							ReadRawResponsePayload();
+						}
 					}
 
 					/// <summary>
-					/// Completion handler for when the asynchrous handshake operation with the
-					/// connected client has finished. If the operation was a success, then the
-					/// process of reading the client's request headers will begin.
+					/// Completion handler for when a read of raw response payload data from the
+					/// server has completed. The data is written to the client right away, or as
+					/// soon as the write of the previous piece completes.
 					/// 
 					/// In the event that this operation was a failure, meaning that the supplied
 					/// error parameter was set and the code was one unexpected, the bridge will be 
-					/// terminated.
+					/// terminated, once any data already read has been written.
 					/// </summary>
 					/// <param name="error">
 					/// Error code that will indicate if any errors were handled during the async
 					/// operation, providing details if an error did occur and was handled.
 					/// </param>
-					void OnDownstreamHandshake(const boost::system::error_code& error)
+					/// <param name="bytesTransferred">
+					/// The number of bytes read from the remote upstream server.
+					/// </param>
+					void OnRawUpstreamRead(const boost::system::error_code& error, const size_t bytesTransferred)
 					{
+						m_responseRelay.readInFlight = false;
 
-						#ifndef NDEBUG
-						ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnDownstreamHandshake");
-						#endif // !NDEBUG
+						if ((!error || (error.value() == boost::asio::error::eof)) && bytesTransferred > 0)
+						{
+							m_rawRelayRemaining -= bytesTransferred;
+							m_rawRelayReadSize = bytesTransferred;
 
-						if (!error)
+							if (m_responseRelay.writeInFlight)
+							{
+								m_responseRelay.chunkPending = true;
+								return;
+							}
+
+							WriteRawResponsePayload();
+							return;
+						}
+
+						if (error)
 						{
-							SetNoDelay(UpstreamSocket(), true);
-							SetNoDelay(DownstreamSocket(), true);
+							std::string errMsg(u8"In TlsCapableHttpBridge::OnRawUpstreamRead(const boost::system::error_code&, const size_t) - Got error:\t");
+							errMsg.append(error.message());
+							ReportError(errMsg);
+						}
 
-							boost::asio::async_read_until(
-								m_downstreamSocket, 
-								m_request->GetHeaderReadBuffer(), 
-								u8"\r\n\r\n", 
-								m_downstreamStrand.wrap(
-									std::bind(
-										&TlsCapableHttpBridge::OnDownstreamHeaders,
-										shared_from_this(), 
-										std::placeholders::_1, 
-										std::placeholders::_2
-										)
-									)
-								);
-							
+						if (m_responseRelay.writeInFlight)
+						{
+							m_responseRelay.closePending = true;
 							return;
 						}
 
-						std::string errMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnUpstreamHandshake(const boost::system::error_code&) - Got error:\t");
-						errMessage.append(error.message());
-						ReportError(errMessage);
+						Kill();
+					}
+
+					/// <summary>
+					/// Invoked by the timing wheel when the stream timeout expires, meaning that
+					/// the bridge failed to make progress within the time allowed for its current
+					/// phase. The bridge is terminated.
+					/// </summary>
+					void OnStreamTimeout()
+					{
+
+						#ifndef NDEBUG
+						ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnStreamTimeout");
+						#endif // !NDEBUG
+
+						ReportWarning(u8"In TlsCapableHttpBridge<BridgeSocketType>::OnStreamTimeout() - Stream timed out.");
 
 						Kill();
 					}
-	
-					/// <summary>
-					/// Handler for the peek read operation on newly connected TLS clients. Only
-					/// ever used in the case that BridgeSocketType is network::TlsSocket. In this
-					/// handler, we manually parse the TLS client hello message, search for the SNI
-					/// extension and attempt to extract the value. If we succeed, then the
-					/// extracted host will be resolved with "https" as the service, so that we get
-					/// endpoints already configured to connect to port 443. The OnResolve handlers
-					/// are specialized, so the correct functionality and order of operations will
-					/// be initiated once the resolver handler is invoked depending for TLS or
-					/// non-TLS clients. For TLS clients, handshakes and upstream server certificate
-					/// verification will occur when the resolver returns valid enpoints.
+
+					/// <summary>
+					/// Expiry handler registered with the timing wheel. Holds the bridge only
+					/// weakly, so that a pending timeout never keeps a finished bridge alive.
+					/// </summary>
+					/// <param name="weakSelf">
+					/// Weak reference to the bridge whose stream timed out.
+					/// </param>
+					static void OnStreamTimeoutExpired(const std::weak_ptr<TlsCapableHttpBridge>& weakSelf)
+					{
+						auto self = weakSelf.lock();
+
+						if (self != nullptr)
+						{
+							self->OnStreamTimeout();
+						}
+					}
+
+					/// <summary>
+					/// Sets or resets the timeout for the bridge's stream operations to the time
+					/// allowed for the given phase, counted from now. If the timeout is reached
+					/// before being set again, the bridge will be killed, with both downstream and
+					/// upstream operations cancelled in an asynchrous manner.
 					/// 
-					/// In the event that this operation was a failure, meaning that the supplied
-					/// error parameter was set and the code was one unexpected, the bridge will be 
-					/// terminated.
+					/// Resetting only records the new deadline with the timing wheel, which checks
+					/// it lazily, so this is cheap enough to call before every async operation.
+					/// </summary>
+					/// <param name="phase">
+					/// The phase the bridge is entering.
+					/// </param>
+					void SetStreamTimeout(const network::StreamPhase phase)
+					{
+						m_streamPhase.store(phase);
+
+						if (m_timingWheel == nullptr)
+						{
+							return;
+						}
+
+						if (m_streamTimeout == nullptr)
+						{
+							// Can't be registered in the constructor, as there's no shared_from_this()
+							// until construction is finished. The first call is always from ::Start().
+							std::weak_ptr<TlsCapableHttpBridge> weakSelf = this->shared_from_this();
+							m_streamTimeout = m_timingWheel->Register(std::bind(&TlsCapableHttpBridge::OnStreamTimeoutExpired, weakSelf));
+						}
+
+						m_timingWheel->Arm(m_streamTimeout, m_streamTimeouts.Get(phase));
+					}
+
+					/// <summary>
+					/// Disables the stream timeout, so that the bridge never times out until
+					/// ::SetStreamTimeout(...) is called again.
+					/// </summary>
+					void ClearStreamTimeout()
+					{
+						if (m_timingWheel != nullptr)
+						{
+							m_timingWheel->Disarm(m_streamTimeout);
+						}
+					}
+
+					/// <summary>
+					/// Parses the client hello that the ConnectionFlow of a secure bridge peeked at,
+					/// searching for the SNI extension and extracting its value. If we succeed, then
+					/// the extracted host becomes the upstream host, to be connected to on port 443,
+					/// and whether its TLS is to be passed through untouched is decided.
 					/// </summary>
 					/// <param name="error">
 					/// Error code that will indicate if any errors were handled during the async
-					/// operation, providing details if an error did occur and was handled.
+					/// peek read operation, providing details if an error did occur and was handled.
 					/// </param>
 					/// <param name="bytesTransferred">
 					/// The amount of bytes read during the async peek read operation. This is how
 					/// many valid bytes were written to the m_tlsPeekBuffer member array.
 					/// </param>
-					void OnTlsPeek(const boost::system::error_code& error, const size_t bytesTransferred)
+					/// <returns>
+					/// True if the upstream host was extracted, false if the bridge should be
+					/// terminated.
+					/// </returns>
+					const bool ReadSniHost(const boost::system::error_code& error, const size_t bytesTransferred)
 					{
 					
 						#ifndef NDEBUG
-						ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek");
+						ReportInfo(u8"TlsCapableHttpBridge<network::TlsSocket>::ReadSniHost");
 						#endif // !NDEBUG
 
 						// Parsing Numbers
@@ -1700,7 +3403,7 @@ namespace te
 									if (position >= arr->size() || position > validDataLength)
 									{
 										#ifndef NDEBUG
-											std::string errMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - ");
+											std::string errMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::ReadSniHost(const boost::system::error_code&, const size_t) - ");
 											errMessage.append(u8"Index in buffer is out of bounds at position ").append(std::to_string(position)).append(u8".\n\n");
 											errMessage.append(u8"Went out of bounds at check ").append(std::to_string(crumb)).append(u8".");
 											ReportError(errMessage);
@@ -1734,8 +3437,7 @@ namespace te
 
 										if (!WithinBounds(m_tlsPeekBuffer, position + 1, bytesTransferred))
 										{
-											Kill();
-											return;
+											return false;
 										}
 
 										// Get cipher suites length.
@@ -1746,8 +3448,7 @@ namespace te
 
 										if (!WithinBounds(m_tlsPeekBuffer, position, bytesTransferred, 1))
 										{
-											Kill();
-											return;
+											return false;
 										}
 
 										// Get compression methods length.
@@ -1758,8 +3459,7 @@ namespace te
 
 										if (!WithinBounds(m_tlsPeekBuffer, position + 1, bytesTransferred, 2))
 										{
-											Kill();
-											return;
+											return false;
 										}
 
 										// Get extensions length.
@@ -1770,8 +3470,7 @@ namespace te
 
 										if (!WithinBounds(m_tlsPeekBuffer, position, bytesTransferred, 3))
 										{
-											Kill();
-											return;
+											return false;
 										}
 
 										// Parse each extension till we hopefully find SNI
@@ -1780,8 +3479,7 @@ namespace te
 										{
 											if (!WithinBounds(m_tlsPeekBuffer, position + 4, bytesTransferred, 4))
 											{
-												Kill();
-												return;
+												return false;
 											}
 
 											// Get the extension type.
@@ -1801,16 +3499,14 @@ namespace te
 
 												if (!WithinBounds(m_tlsPeekBuffer, position + 4, bytesTransferred, 5))
 												{
-													Kill();
-													return;
+													return false;
 												}
 
 												while (position < bytesTransferred && notDone)
 												{
 													if (!WithinBounds(m_tlsPeekBuffer, position + 3, bytesTransferred, 6))
 													{
-														Kill();
-														return;
+														return false;
 													}
 
 													// Get SNI part length.
@@ -1836,50 +3532,32 @@ namespace te
 
 											m_upstreamHost = hostName.to_string();
 
-											// XXX TODO - See notes in the version of ::OnResolve(...), specialized for TLS clients.
+											// XXX TODO - See notes in ConnectionFlow::Run(...), specialized for TLS clients.
 											m_upstreamHostPort = 443;
 
-											std::string extractedSniMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - ");
+											// Hosts we never filter skip interception entirely. They're still resolved
+											// and connected to as usual, but no handshake is done on either side.
+											m_tlsPassthrough = m_filteringEngine->ShouldPassthroughTls(m_upstreamHost);
+
+											std::string extractedSniMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::ReadSniHost(const boost::system::error_code&, const size_t) - ");
 											extractedSniMessage.append(u8"Extracted SNI hostname: ").append(hostName.to_string()).append(u8".");
 											ReportInfo(extractedSniMessage);
 
-											try
-											{
-												boost::asio::ip::tcp::resolver::query query(m_upstreamHost, "https");
-												m_resolver.async_resolve(
-													query, 
-													m_upstreamStrand.wrap(
-														std::bind(
-															&TlsCapableHttpBridge::OnResolve, 
-															shared_from_this(), 
-															std::placeholders::_1, 
-															std::placeholders::_2
-															)
-														)
-													);
-
-												return;
-											}
-											catch (std::exception& e)
-											{
-												std::string errorMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - Got Error:\t");
-												errorMessage.append(e.what());
-												ReportError(errorMessage);
-											}
+											return true;
 										}
 										else
 										{
-											ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - Failed to extract hostname from SNI extension.");
+											ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::ReadSniHost(const boost::system::error_code&, const size_t) - Failed to extract hostname from SNI extension.");
 										}
 									}
 									else
 									{
-										ReportWarning(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - Not a TLS client hello.");
+										ReportWarning(u8"In TlsCapableHttpBridge<network::TlsSocket>::ReadSniHost(const boost::system::error_code&, const size_t) - Not a TLS client hello.");
 									}
 								}
 								else
 								{
-									ReportWarning(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - Not a TLS client.");
+									ReportWarning(u8"In TlsCapableHttpBridge<network::TlsSocket>::ReadSniHost(const boost::system::error_code&, const size_t) - Not a TLS client.");
 								}
 							}
 						}
@@ -1887,17 +3565,17 @@ namespace te
 						{							
 							if (error)
 							{
-								std::string errorMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - Got Error:\t");
+								std::string errorMessage(u8"In TlsCapableHttpBridge<network::TlsSocket>::ReadSniHost(const boost::system::error_code&, const size_t) - Got Error:\t");
 								errorMessage.append(error.message());
 								ReportError(errorMessage);
 							}
 							else if(!m_tlsPeekBuffer)
 							{
-								ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::OnTlsPeek(const boost::system::error_code&, const size_t) - TLS peek buffer is nullptr!");
+								ReportError(u8"In TlsCapableHttpBridge<network::TlsSocket>::ReadSniHost(const boost::system::error_code&, const size_t) - TLS peek buffer is nullptr!");
 							}
 						}
 
-						Kill();
+						return false;
 					}
 
 					/// <summary>
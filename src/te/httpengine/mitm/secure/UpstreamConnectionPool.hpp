@@ -0,0 +1,400 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include "../../network/SocketTypes.hpp"
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace mitm
+		{
+			namespace secure
+			{
+
+				/// <summary>
+				/// A snapshot of the counters kept by an UpstreamConnectionPool.
+				/// </summary>
+				struct UpstreamConnectionPoolStats
+				{
+					/// <summary>
+					/// The number of times a bridge was handed a warm connection from the pool.
+					/// </summary>
+					uint64_t hits = 0;
+
+					/// <summary>
+					/// The number of times a bridge asked for a connection that the pool did not
+					/// have, and had to connect on its own.
+					/// </summary>
+					uint64_t misses = 0;
+
+					/// <summary>
+					/// The number of connections handed back to the pool by finished bridges.
+					/// </summary>
+					uint64_t checkIns = 0;
+
+					/// <summary>
+					/// The number of idle connections closed by the pool, because they sat idle for
+					/// too long, were found closed by the server, or pushed out by newer ones.
+					/// </summary>
+					uint64_t evictions = 0;
+
+					/// <summary>
+					/// The number of idle connections held by the pool when the snapshot was taken.
+					/// </summary>
+					uint64_t idle = 0;
+				};
+
+				/// <summary>
+				/// Holds idle, keep-alive upstream connections left behind by bridges whose client
+				/// went away, so that a later bridge to the same host can pick one up instead of
+				/// doing the TCP connect, and for TLS the handshake, all over again. Browsers open
+				/// and close a great many short connections to the same few hosts, so this saves a
+				/// round trip or three on most new connections.
+				/// 
+				/// Connections are keyed by host and port. There is one pool per socket type, so
+				/// TLS and plain connections are never mixed up, and since the SNI sent upstream is
+				/// always the host, the host covers the SNI as well. The pool holds no more than a
+				/// fixed number of idle connections, dropping the oldest first, and closes any that
+				/// sit idle longer than a fixed time. Connections are checked for having been
+				/// closed by the server before being handed out.
+				/// 
+				/// All members are safe to call from any thread.
+				/// </summary>
+				template<class SocketType>
+				class UpstreamConnectionPool
+				{
+
+					/// <summary>
+					/// Enforce use of this class to the only two types of sockets it is intended to be
+					/// used with.
+					/// </summary>
+					static_assert((std::is_same<SocketType, network::TcpSocket> ::value || std::is_same<SocketType, network::TlsSocket>::value), "UpstreamConnectionPool can only hold boost::asio::ip::tcp::socket or boost::asio::ssl::stream<boost::asio::ip::tcp::socket> as valid template parameters.");
+
+				public:
+
+					/// <summary>
+					/// The default maximum number of idle connections held.
+					/// </summary>
+					static constexpr size_t DefaultMaxIdleConnections = 64;
+
+					/// <summary>
+					/// The default number of seconds a connection may sit idle in the pool. Kept
+					/// under the keep-alive timeout of most servers, so that connections handed out
+					/// are rarely ones the server is just about to drop.
+					/// </summary>
+					static constexpr uint32_t DefaultMaxIdleSeconds = 30;
+
+					/// <summary>
+					/// Constructs a new, empty UpstreamConnectionPool.
+					/// </summary>
+					/// <param name="maxIdleConnections">
+					/// The maximum number of idle connections to hold.
+					/// </param>
+					/// <param name="maxIdleSeconds">
+					/// The maximum number of seconds a connection may sit idle in the pool.
+					/// </param>
+					UpstreamConnectionPool(
+						const size_t maxIdleConnections = DefaultMaxIdleConnections, 
+						const uint32_t maxIdleSeconds = DefaultMaxIdleSeconds
+						)
+						:
+						m_maxIdleConnections(maxIdleConnections),
+						m_maxIdleTime(std::chrono::seconds(maxIdleSeconds))
+					{
+
+					}
+
+					/// <summary>
+					/// No copy no move no thx.
+					/// </summary>
+					UpstreamConnectionPool(const UpstreamConnectionPool&) = delete;
+					UpstreamConnectionPool(UpstreamConnectionPool&&) = delete;
+					UpstreamConnectionPool& operator=(const UpstreamConnectionPool&) = delete;
+
+					/// <summary>
+					/// Default destructor. Any idle connections still held are closed.
+					/// </summary>
+					~UpstreamConnectionPool()
+					{
+
+					}
+
+					/// <summary>
+					/// Takes an idle connection to the given host and port out of the pool, if
+					/// there is one. The most recently used connection is handed out first.
+					/// </summary>
+					/// <param name="host">
+					/// The upstream host the connection must be to.
+					/// </param>
+					/// <param name="port">
+					/// The upstream port the connection must be to.
+					/// </param>
+					/// <param name="service">
+					/// The io_service the connection must have been opened on, which is the one
+					/// the caller's own handlers run on.
+					/// </param>
+					/// <returns>
+					/// A connected, and for TLS fully handshaken, socket that the caller now owns,
+					/// or nullptr if the pool has no usable connection to the host.
+					/// </returns>
+					std::unique_ptr<SocketType> CheckOut(const std::string& host, const uint16_t port, boost::asio::io_service& service)
+					{
+						const std::string key = MakeKey(host, port);
+
+						ScopedLock lock(m_poolMutex);
+
+						EvictExpired();
+
+						for (auto it = m_idle.rbegin(); it != m_idle.rend(); ++it)
+						{
+							// Connections opened on another io_service are left for bridges running
+							// there, so that no connection's handlers hop between threads.
+							if (it->key.compare(key) != 0 || &it->socket->lowest_layer().get_io_service() != &service)
+							{
+								continue;
+							}
+
+							std::unique_ptr<SocketType> socket = std::move(it->socket);
+							m_idle.erase(std::next(it).base());
+
+							if (!IsStillOpen(*socket))
+							{
+								// The server has given up on it, and since the most recent
+								// connection is tried first, any older ones are likely gone too.
+								++m_evictions;
+								break;
+							}
+
+							++m_hits;
+							return socket;
+						}
+
+						++m_misses;
+						return nullptr;
+					}
+
+					/// <summary>
+					/// Hands a connection that is idle and may be reused back to the pool. The
+					/// caller must ensure that no operation is outstanding on the socket and that
+					/// every response that was requested has been read in full.
+					/// </summary>
+					/// <param name="host">
+					/// The upstream host the connection is to.
+					/// </param>
+					/// <param name="port">
+					/// The upstream port the connection is to.
+					/// </param>
+					/// <param name="socket">
+					/// The connection to hold on to.
+					/// </param>
+					void CheckIn(const std::string& host, const uint16_t port, std::unique_ptr<SocketType> socket)
+					{
+						if (socket == nullptr || m_maxIdleConnections == 0)
+						{
+							return;
+						}
+
+						ScopedLock lock(m_poolMutex);
+
+						EvictExpired();
+
+						while (m_idle.size() >= m_maxIdleConnections)
+						{
+							m_idle.pop_front();
+							++m_evictions;
+						}
+
+						m_idle.push_back(IdleConnection{ MakeKey(host, port), std::move(socket), std::chrono::steady_clock::now() });
+
+						++m_checkIns;
+					}
+
+					/// <summary>
+					/// Closes every idle connection held.
+					/// </summary>
+					void Clear()
+					{
+						ScopedLock lock(m_poolMutex);
+						m_idle.clear();
+					}
+
+					/// <summary>
+					/// Gets a snapshot of the pool counters.
+					/// </summary>
+					/// <returns>
+					/// The pool counters as they were at the time of the call.
+					/// </returns>
+					UpstreamConnectionPoolStats GetStats()
+					{
+						ScopedLock lock(m_poolMutex);
+
+						UpstreamConnectionPoolStats stats;
+						stats.hits = m_hits;
+						stats.misses = m_misses;
+						stats.checkIns = m_checkIns;
+						stats.evictions = m_evictions;
+						stats.idle = m_idle.size();
+
+						return stats;
+					}
+
+				private:
+
+					using ScopedLock = std::lock_guard<std::mutex>;
+
+					/// <summary>
+					/// An idle connection along with its key and the time it became idle.
+					/// </summary>
+					struct IdleConnection
+					{
+						std::string key;
+						std::unique_ptr<SocketType> socket;
+						std::chrono::steady_clock::time_point idleSince;
+					};
+
+					/// <summary>
+					/// The maximum number of idle connections to hold.
+					/// </summary>
+					const size_t m_maxIdleConnections;
+
+					/// <summary>
+					/// The maximum amount of time a connection may sit idle in the pool.
+					/// </summary>
+					const std::chrono::steady_clock::duration m_maxIdleTime;
+
+					/// <summary>
+					/// Idle connections, oldest first. Lookups simply scan the list, since it's
+					/// small and bounded, and it keeps eviction by age trivial.
+					/// </summary>
+					std::list<IdleConnection> m_idle;
+
+					/// <summary>
+					/// Guards m_idle and the counters.
+					/// </summary>
+					std::mutex m_poolMutex;
+
+					uint64_t m_hits = 0;
+					uint64_t m_misses = 0;
+					uint64_t m_checkIns = 0;
+					uint64_t m_evictions = 0;
+
+					/// <summary>
+					/// Builds the key under which connections to the given host and port are held.
+					/// </summary>
+					static std::string MakeKey(const std::string& host, const uint16_t port)
+					{
+						std::string key(host);
+						key.append(u8":").append(std::to_string(port));
+						return key;
+					}
+
+					/// <summary>
+					/// Closes connections that have been idle for longer than allowed. Must be
+					/// called with m_poolMutex held.
+					/// </summary>
+					void EvictExpired()
+					{
+						const auto now = std::chrono::steady_clock::now();
+
+						while (!m_idle.empty() && (now - m_idle.front().idleSince) > m_maxIdleTime)
+						{
+							m_idle.pop_front();
+							++m_evictions;
+						}
+					}
+
+					/// <summary>
+					/// Gets the TCP socket underlying the given connection.
+					/// </summary>
+					static network::TcpSocket& TcpLayer(network::TcpSocket& socket)
+					{
+						return socket;
+					}
+
+					/// <summary>
+					/// Gets the TCP socket underlying the given connection.
+					/// </summary>
+					static network::TcpSocket& TcpLayer(network::TlsSocket& socket)
+					{
+						return socket.next_layer();
+					}
+
+					/// <summary>
+					/// Checks that the server hasn't closed an idle connection, by peeking at it
+					/// without blocking. A healthy idle connection has nothing to read. End of
+					/// stream, an error, or unsolicited data all mean it can't be used.
+					/// </summary>
+					static bool IsStillOpen(SocketType& socket)
+					{
+						network::TcpSocket& tcpSocket = TcpLayer(socket);
+
+						if (!tcpSocket.is_open())
+						{
+							return false;
+						}
+
+						boost::system::error_code ec;
+						const bool wasNonBlocking = tcpSocket.non_blocking();
+
+						tcpSocket.non_blocking(true, ec);
+
+						if (ec)
+						{
+							return false;
+						}
+
+						char probe = 0;
+						tcpSocket.receive(boost::asio::buffer(&probe, 1), boost::asio::ip::tcp::socket::message_peek, ec);
+
+						boost::system::error_code restoreEc;
+						tcpSocket.non_blocking(wasNonBlocking, restoreEc);
+
+						return ec == boost::asio::error::would_block;
+					}
+				};
+
+			} /* namespace secure */
+		} /* namespace mitm */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,1046 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "AsyncDnsResolver.hpp"
+
+#include <boost/predef/os.h>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cctype>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <openssl/rand.h>
+
+#if BOOST_OS_WINDOWS
+	#include <Iphlpapi.h>
+#endif
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			namespace
+			{
+				const uint16_t TypeA = 1;
+				const uint16_t TypeAaaa = 28;
+				const uint16_t ClassIn = 1;
+
+				const size_t HeaderLength = 12;
+
+				const uint8_t RcodeNameError = 3;
+
+				/// <summary>
+				/// Lower cases the given host name and drops any trailing dot, so that names can
+				/// be compared as the resolver would.
+				/// </summary>
+				inline std::string NormalizeHostName(std::string host)
+				{
+					if (!host.empty() && host.back() == '.')
+					{
+						host.pop_back();
+					}
+
+					std::transform(host.begin(), host.end(), host.begin(), [](const char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+
+					return host;
+				}
+
+				/// <summary>
+				/// Checks whether the given normalized host name is the given domain, or a name
+				/// under it.
+				/// </summary>
+				inline bool IsWithinDomain(const std::string& host, const std::string& domain)
+				{
+					if (host.size() == domain.size())
+					{
+						return host.compare(domain) == 0;
+					}
+
+					return host.size() > domain.size() && host[host.size() - domain.size() - 1] == '.' && host.compare(host.size() - domain.size(), domain.size(), domain) == 0;
+				}
+
+				/// <summary>
+				/// Reads a big-endian 16 bit value.
+				/// </summary>
+				inline uint16_t ReadUint16(const uint8_t* data)
+				{
+					return static_cast<uint16_t>((data[0] << 8) | data[1]);
+				}
+
+				/// <summary>
+				/// Reads a big-endian 32 bit value.
+				/// </summary>
+				inline uint32_t ReadUint32(const uint8_t* data)
+				{
+					return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) | (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+				}
+
+				/// <summary>
+				/// Appends a big-endian 16 bit value.
+				/// </summary>
+				inline void WriteUint16(std::vector<uint8_t>& out, const uint16_t value)
+				{
+					out.push_back(static_cast<uint8_t>(value >> 8));
+					out.push_back(static_cast<uint8_t>(value & 0xFF));
+				}
+
+				/// <summary>
+				/// Moves past a possibly compressed domain name.
+				/// </summary>
+				/// <returns>
+				/// True if the name was well formed and lies within the message, false otherwise.
+				/// </returns>
+				bool SkipName(const uint8_t* data, const size_t size, size_t& position)
+				{
+					// A name can't have more labels than this, so anything longer is garbage.
+					for (size_t labels = 0; labels < 128 && position < size; ++labels)
+					{
+						const uint8_t length = data[position];
+
+						if (length == 0)
+						{
+							++position;
+							return true;
+						}
+
+						if ((length & 0xC0) == 0xC0)
+						{
+							// Compression pointer, which always ends the name.
+							position += 2;
+							return position <= size;
+						}
+
+						if ((length & 0xC0) != 0)
+						{
+							return false;
+						}
+
+						position += 1 + length;
+					}
+
+					return false;
+				}
+
+				/// <summary>
+				/// Builds a recursive query for the given name and record type.
+				/// </summary>
+				/// <returns>
+				/// True if the name could be encoded, false if it isn't a valid domain name.
+				/// </returns>
+				bool BuildQuery(const std::string& host, const uint16_t id, const uint16_t type, std::vector<uint8_t>& out)
+				{
+					if (host.empty() || host.size() > 253)
+					{
+						return false;
+					}
+
+					out.clear();
+					out.reserve(HeaderLength + host.size() + 6);
+
+					WriteUint16(out, id);
+					WriteUint16(out, 0x0100); // Recursion desired.
+					WriteUint16(out, 1);
+					WriteUint16(out, 0);
+					WriteUint16(out, 0);
+					WriteUint16(out, 0);
+
+					size_t labelStart = 0;
+
+					while (labelStart <= host.size())
+					{
+						size_t labelEnd = host.find('.', labelStart);
+
+						if (labelEnd == std::string::npos)
+						{
+							labelEnd = host.size();
+						}
+
+						const size_t labelLength = labelEnd - labelStart;
+
+						if (labelLength == 0)
+						{
+							// Only a single trailing dot is allowed.
+							if (labelEnd != host.size() || labelStart == 0)
+							{
+								return false;
+							}
+
+							break;
+						}
+
+						if (labelLength > 63)
+						{
+							return false;
+						}
+
+						out.push_back(static_cast<uint8_t>(labelLength));
+						out.insert(out.end(), host.begin() + labelStart, host.begin() + labelEnd);
+
+						labelStart = labelEnd + 1;
+					}
+
+					out.push_back(0);
+
+					WriteUint16(out, type);
+					WriteUint16(out, ClassIn);
+
+					return true;
+				}
+
+				/// <summary>
+				/// Maps the services bridges resolve with to port numbers.
+				/// </summary>
+				/// <returns>
+				/// True if the service is known or numeric, false otherwise.
+				/// </returns>
+				bool ServiceToPort(const std::string& service, uint16_t& port)
+				{
+					if (service.compare(u8"http") == 0)
+					{
+						port = 80;
+						return true;
+					}
+
+					if (service.compare(u8"https") == 0)
+					{
+						port = 443;
+						return true;
+					}
+
+					if (service.empty() || service.size() > 5 || !std::all_of(service.begin(), service.end(), [](const char c) { return c >= '0' && c <= '9'; }))
+					{
+						return false;
+					}
+
+					const unsigned long value = std::stoul(service);
+
+					if (value == 0 || value > std::numeric_limits<uint16_t>::max())
+					{
+						return false;
+					}
+
+					port = static_cast<uint16_t>(value);
+					return true;
+				}
+			}
+
+			class AsyncDnsResolver::Lookup : public std::enable_shared_from_this<AsyncDnsResolver::Lookup>
+			{
+
+			public:
+
+				Lookup(
+					AsyncDnsResolver& owner,
+					const std::string& host,
+					const std::string& service,
+					const uint16_t port,
+					ResolveHandler handler
+					)
+					:
+					m_owner(owner),
+					m_host(host),
+					m_service(service),
+					m_port(port),
+					m_handler(std::move(handler)),
+					m_udpSocket(*owner.m_service),
+					m_tcpSocket(*owner.m_service),
+					m_timer(*owner.m_service),
+					m_strand(*owner.m_service)
+				{
+					m_queries[0].type = TypeA;
+					m_queries[1].type = TypeAaaa;
+				}
+
+				/// <summary>
+				/// Builds the queries and sends them to the first nameserver.
+				/// </summary>
+				void Start()
+				{
+					for (auto& query : m_queries)
+					{
+						query.id = m_owner.NextQueryId();
+
+						if (!BuildQuery(m_host, query.id, query.type, query.packet))
+						{
+							Finish(boost::asio::error::host_not_found);
+							return;
+						}
+					}
+
+					m_strand.dispatch(std::bind(&Lookup::SendUdp, shared_from_this()));
+				}
+
+			private:
+
+				/// <summary>
+				/// A query for one record type and what became of it.
+				/// </summary>
+				struct Query
+				{
+					uint16_t type = 0;
+					uint16_t id = 0;
+					std::vector<uint8_t> packet;
+					bool answered = false;
+					bool truncated = false;
+				};
+
+				AsyncDnsResolver& m_owner;
+
+				const std::string m_host;
+
+				const std::string m_service;
+
+				const uint16_t m_port;
+
+				ResolveHandler m_handler;
+
+				boost::asio::ip::udp::socket m_udpSocket;
+
+				boost::asio::ip::tcp::socket m_tcpSocket;
+
+				boost::asio::deadline_timer m_timer;
+
+				/// <summary>
+				/// Keeps the socket and timer handlers of this lookup from running concurrently.
+				/// </summary>
+				boost::asio::strand m_strand;
+
+				std::array<Query, 2> m_queries;
+
+				/// <summary>
+				/// Large enough for any UDP answer, since no EDNS buffer size is advertised and
+				/// servers therefore truncate at 512 bytes.
+				/// </summary>
+				std::array<uint8_t, 512> m_udpBuffer;
+
+				boost::asio::ip::udp::endpoint m_sender;
+
+				std::array<uint8_t, 2> m_tcpLength;
+
+				std::vector<uint8_t> m_tcpBuffer;
+
+				size_t m_tcpQueryIndex = 0;
+
+				size_t m_nameserverIndex = 0;
+
+				uint32_t m_attempt = 0;
+
+				std::vector<boost::asio::ip::tcp::endpoint> m_v4Endpoints;
+
+				std::vector<boost::asio::ip::tcp::endpoint> m_v6Endpoints;
+
+				uint32_t m_ttl = std::numeric_limits<uint32_t>::max();
+
+				bool m_nameError = false;
+
+				bool m_done = false;
+
+				const boost::asio::ip::udp::endpoint& Nameserver() const
+				{
+					return m_owner.m_nameservers[m_nameserverIndex];
+				}
+
+				/// <summary>
+				/// Sends every query that is still unanswered to the current nameserver, from a
+				/// fresh socket, then waits for the answers.
+				/// </summary>
+				void SendUdp()
+				{
+					boost::system::error_code ec;
+
+					m_udpSocket.close(ec);
+					m_udpSocket.open(Nameserver().protocol(), ec);
+
+					if (ec)
+					{
+						NextNameserver();
+						return;
+					}
+
+					bool sentAny = false;
+
+					for (auto& query : m_queries)
+					{
+						if (query.answered)
+						{
+							continue;
+						}
+
+						// Datagrams this small go straight out, so there's nothing to gain from
+						// an asynchronous send.
+						m_udpSocket.send_to(boost::asio::buffer(query.packet), Nameserver(), 0, ec);
+
+						sentAny = sentAny || !ec;
+					}
+
+					if (!sentAny)
+					{
+						NextNameserver();
+						return;
+					}
+
+					ArmTimer();
+					ReceiveUdp();
+				}
+
+				void ReceiveUdp()
+				{
+					m_udpSocket.async_receive_from(
+						boost::asio::buffer(m_udpBuffer),
+						m_sender,
+						m_strand.wrap(
+							std::bind(
+								&Lookup::OnUdpReceive,
+								shared_from_this(),
+								std::placeholders::_1,
+								std::placeholders::_2
+								)
+							)
+						);
+				}
+
+				void OnUdpReceive(const boost::system::error_code& error, const size_t bytesTransferred)
+				{
+					if (m_done || error == boost::asio::error::operation_aborted)
+					{
+						return;
+					}
+
+					if (error)
+					{
+						// Usually an ICMP port unreachable, meaning nothing is listening there.
+						NextNameserver();
+						return;
+					}
+
+					if (m_sender != Nameserver())
+					{
+						ReceiveUdp();
+						return;
+					}
+
+					bool serverFailed = false;
+
+					if (!HandleAnswer(m_udpBuffer.data(), bytesTransferred, true, serverFailed))
+					{
+						// Stray or malformed datagram. Keep waiting for the real answer.
+						ReceiveUdp();
+						return;
+					}
+
+					if (serverFailed)
+					{
+						NextNameserver();
+						return;
+					}
+
+					if (!AllAnswered())
+					{
+						ReceiveUdp();
+						return;
+					}
+
+					boost::system::error_code ec;
+					m_udpSocket.close(ec);
+
+					StartTcpIfTruncated();
+				}
+
+				/// <summary>
+				/// Moves on to the next nameserver, or through the list again, keeping whatever
+				/// answers were already received.
+				/// </summary>
+				void NextNameserver()
+				{
+					if (++m_nameserverIndex >= m_owner.m_nameservers.size())
+					{
+						m_nameserverIndex = 0;
+
+						if (++m_attempt >= m_owner.m_attempts)
+						{
+							Finish(boost::asio::error::timed_out);
+							return;
+						}
+					}
+
+					SendUdp();
+				}
+
+				void ArmTimer()
+				{
+					m_timer.expires_from_now(m_owner.m_queryTimeout);
+					m_timer.async_wait(
+						m_strand.wrap(
+							std::bind(
+								&Lookup::OnTimeout,
+								shared_from_this(),
+								std::placeholders::_1
+								)
+							)
+						);
+				}
+
+				void OnTimeout(const boost::system::error_code& error)
+				{
+					if (m_done || error == boost::asio::error::operation_aborted)
+					{
+						return;
+					}
+
+					if (m_tcpSocket.is_open())
+					{
+						// Whatever we already have from UDP will have to do.
+						Finish(boost::asio::error::timed_out);
+						return;
+					}
+
+					NextNameserver();
+				}
+
+				/// <summary>
+				/// Re-sends the first truncated query over TCP, or finishes if there is none.
+				/// </summary>
+				void StartTcpIfTruncated()
+				{
+					for (m_tcpQueryIndex = 0; m_tcpQueryIndex < m_queries.size(); ++m_tcpQueryIndex)
+					{
+						if (m_queries[m_tcpQueryIndex].truncated)
+						{
+							break;
+						}
+					}
+
+					if (m_tcpQueryIndex >= m_queries.size())
+					{
+						Finish(boost::system::error_code());
+						return;
+					}
+
+					boost::system::error_code ec;
+					m_tcpSocket.close(ec);
+
+					ArmTimer();
+
+					m_tcpSocket.async_connect(
+						boost::asio::ip::tcp::endpoint(Nameserver().address(), Nameserver().port()),
+						m_strand.wrap(
+							std::bind(
+								&Lookup::OnTcpConnect,
+								shared_from_this(),
+								std::placeholders::_1
+								)
+							)
+						);
+				}
+
+				void OnTcpConnect(const boost::system::error_code& error)
+				{
+					if (m_done)
+					{
+						return;
+					}
+
+					if (error)
+					{
+						Finish(error);
+						return;
+					}
+
+					const auto& packet = m_queries[m_tcpQueryIndex].packet;
+
+					m_tcpLength[0] = static_cast<uint8_t>(packet.size() >> 8);
+					m_tcpLength[1] = static_cast<uint8_t>(packet.size() & 0xFF);
+
+					std::array<boost::asio::const_buffer, 2> buffers = { { boost::asio::buffer(m_tcpLength), boost::asio::buffer(packet) } };
+
+					boost::asio::async_write(
+						m_tcpSocket,
+						buffers,
+						m_strand.wrap(
+							std::bind(
+								&Lookup::OnTcpWrite,
+								shared_from_this(),
+								std::placeholders::_1
+								)
+							)
+						);
+				}
+
+				void OnTcpWrite(const boost::system::error_code& error)
+				{
+					if (m_done)
+					{
+						return;
+					}
+
+					if (error)
+					{
+						Finish(error);
+						return;
+					}
+
+					boost::asio::async_read(
+						m_tcpSocket,
+						boost::asio::buffer(m_tcpLength),
+						m_strand.wrap(
+							std::bind(
+								&Lookup::OnTcpLength,
+								shared_from_this(),
+								std::placeholders::_1
+								)
+							)
+						);
+				}
+
+				void OnTcpLength(const boost::system::error_code& error)
+				{
+					if (m_done)
+					{
+						return;
+					}
+
+					const size_t length = ReadUint16(m_tcpLength.data());
+
+					if (error || length < HeaderLength)
+					{
+						Finish(error ? error : boost::asio::error::invalid_argument);
+						return;
+					}
+
+					m_tcpBuffer.resize(length);
+
+					boost::asio::async_read(
+						m_tcpSocket,
+						boost::asio::buffer(m_tcpBuffer),
+						m_strand.wrap(
+							std::bind(
+								&Lookup::OnTcpRead,
+								shared_from_this(),
+								std::placeholders::_1
+								)
+							)
+						);
+				}
+
+				void OnTcpRead(const boost::system::error_code& error)
+				{
+					if (m_done)
+					{
+						return;
+					}
+
+					bool serverFailed = false;
+
+					if (error || !HandleAnswer(m_tcpBuffer.data(), m_tcpBuffer.size(), false, serverFailed))
+					{
+						Finish(error ? error : boost::asio::error::invalid_argument);
+						return;
+					}
+
+					// Whatever the server said, this query is as answered as it's going to get.
+					m_queries[m_tcpQueryIndex].truncated = false;
+
+					boost::system::error_code ec;
+					m_tcpSocket.close(ec);
+
+					StartTcpIfTruncated();
+				}
+
+				bool AllAnswered() const
+				{
+					return std::all_of(m_queries.begin(), m_queries.end(), [](const Query& q) { return q.answered; });
+				}
+
+				/// <summary>
+				/// Matches an answer to one of our queries and collects its address records.
+				/// </summary>
+				/// <param name="overUdp">
+				/// Whether the answer arrived over UDP, in which case it may be truncated.
+				/// </param>
+				/// <param name="serverFailed">
+				/// Set to true if the nameserver could not answer, and another should be asked.
+				/// </param>
+				/// <returns>
+				/// True if the message was an answer to one of our outstanding queries, false if
+				/// it should be ignored.
+				/// </returns>
+				bool HandleAnswer(const uint8_t* data, const size_t size, const bool overUdp, bool& serverFailed)
+				{
+					if (size < HeaderLength)
+					{
+						return false;
+					}
+
+					const uint16_t id = ReadUint16(data);
+					const uint16_t flags = ReadUint16(data + 2);
+
+					auto query = std::find_if(m_queries.begin(), m_queries.end(), [id](const Query& q) { return q.id == id; });
+
+					if (query == m_queries.end() || (!overUdp ? !query->truncated : query->answered) || (flags & 0x8000) == 0)
+					{
+						return false;
+					}
+
+					// The question must be echoed back exactly as we asked it.
+					const size_t questionLength = query->packet.size() - HeaderLength;
+
+					if (ReadUint16(data + 4) != 1 || size < HeaderLength + questionLength || !std::equal(query->packet.begin() + HeaderLength, query->packet.end(), data + HeaderLength))
+					{
+						return false;
+					}
+
+					const uint8_t rcode = static_cast<uint8_t>(flags & 0x000F);
+
+					if (rcode != 0 && rcode != RcodeNameError)
+					{
+						serverFailed = true;
+						return true;
+					}
+
+					query->answered = true;
+
+					if (overUdp && (flags & 0x0200) != 0)
+					{
+						query->truncated = true;
+						return true;
+					}
+
+					if (rcode == RcodeNameError)
+					{
+						m_nameError = true;
+						return true;
+					}
+
+					const uint16_t answerCount = ReadUint16(data + 6);
+					size_t position = HeaderLength + questionLength;
+
+					for (uint16_t i = 0; i < answerCount; ++i)
+					{
+						if (!SkipName(data, size, position) || position + 10 > size)
+						{
+							break;
+						}
+
+						const uint16_t type = ReadUint16(data + position);
+						const uint16_t recordClass = ReadUint16(data + position + 2);
+						const uint32_t ttl = ReadUint32(data + position + 4);
+						const uint16_t dataLength = ReadUint16(data + position + 8);
+
+						position += 10;
+
+						if (position + dataLength > size)
+						{
+							break;
+						}
+
+						if (recordClass == ClassIn)
+						{
+							// CNAMEs along the way count towards the TTL as well, since the
+							// addresses are only valid for as long as the alias is.
+							m_ttl = std::min(m_ttl, ttl);
+
+							if (type == TypeA && dataLength == 4)
+							{
+								boost::asio::ip::address_v4::bytes_type bytes;
+								std::copy(data + position, data + position + 4, bytes.begin());
+								m_v4Endpoints.emplace_back(boost::asio::ip::address_v4(bytes), m_port);
+							}
+							else if (type == TypeAaaa && dataLength == 16)
+							{
+								boost::asio::ip::address_v6::bytes_type bytes;
+								std::copy(data + position, data + position + 16, bytes.begin());
+								m_v6Endpoints.emplace_back(boost::asio::ip::address_v6(bytes), m_port);
+							}
+						}
+
+						position += dataLength;
+					}
+
+					return true;
+				}
+
+				/// <summary>
+				/// Hands whatever was collected to the handler. Addresses found are delivered
+				/// even if the lookup ended with an error, since one address family answering is
+				/// enough to connect.
+				/// </summary>
+				void Finish(boost::system::error_code error)
+				{
+					if (m_done)
+					{
+						return;
+					}
+
+					m_done = true;
+
+					boost::system::error_code ec;
+					m_timer.cancel(ec);
+					m_udpSocket.close(ec);
+					m_tcpSocket.close(ec);
+
+					std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+					endpoints.reserve(m_v4Endpoints.size() + m_v6Endpoints.size());
+					endpoints.insert(endpoints.end(), m_v4Endpoints.begin(), m_v4Endpoints.end());
+					endpoints.insert(endpoints.end(), m_v6Endpoints.begin(), m_v6Endpoints.end());
+
+					uint32_t ttl = 0;
+
+					if (!endpoints.empty())
+					{
+						error = boost::system::error_code();
+						ttl = m_ttl;
+					}
+					else if (!error)
+					{
+						error = m_nameError ? boost::asio::error::host_not_found : boost::asio::error::no_data;
+					}
+
+					m_owner.m_service->post(
+						std::bind(
+							m_handler,
+							error,
+							boost::asio::ip::tcp::resolver::iterator::create(endpoints.begin(), endpoints.end(), m_host, m_service),
+							ttl
+							)
+						);
+				}
+			};
+
+			AsyncDnsResolver::AsyncDnsResolver(
+				boost::asio::io_service* service,
+				std::vector<boost::asio::ip::udp::endpoint> nameservers,
+				const uint32_t queryTimeoutMsec,
+				const uint32_t attempts
+				)
+				:
+				m_service(service),
+				m_nameservers(nameservers.empty() ? LoadSystemNameservers() : std::move(nameservers)),
+				m_queryTimeout(queryTimeoutMsec),
+				m_attempts(attempts > 0 ? attempts : 1),
+				m_hostsFileNames(LoadHostsFileNames())
+			{
+				#ifndef NDEBUG
+					assert(m_service != nullptr && u8"In AsyncDnsResolver::AsyncDnsResolver(boost::asio::io_service*, std::vector<boost::asio::ip::udp::endpoint>, const uint32_t, const uint32_t) - Supplied io_service pointer is nullptr!");
+				#else
+					if (m_service == nullptr)
+					{
+						throw std::runtime_error(u8"In AsyncDnsResolver::AsyncDnsResolver(boost::asio::io_service*, std::vector<boost::asio::ip::udp::endpoint>, const uint32_t, const uint32_t) - Supplied io_service pointer is nullptr!");
+					}
+				#endif
+			}
+
+			AsyncDnsResolver::~AsyncDnsResolver()
+			{
+
+			}
+
+			const bool AsyncDnsResolver::HasNameservers() const
+			{
+				return !m_nameservers.empty();
+			}
+
+			const bool AsyncDnsResolver::DefersToSystem(const std::string& host) const
+			{
+				const std::string name = NormalizeHostName(host);
+
+				if (name.find('.') == std::string::npos)
+				{
+					// Single label names, localhost among them.
+					return true;
+				}
+
+				if (IsWithinDomain(name, u8"localhost") || IsWithinDomain(name, u8"local"))
+				{
+					return true;
+				}
+
+				return m_hostsFileNames.find(name) != m_hostsFileNames.end();
+			}
+
+			void AsyncDnsResolver::AsyncResolve(const std::string& host, const std::string& service, ResolveHandler handler)
+			{
+				uint16_t port = 0;
+
+				if (!ServiceToPort(service, port))
+				{
+					m_service->post(std::bind(handler, boost::asio::error::service_not_found, boost::asio::ip::tcp::resolver::iterator(), 0));
+					return;
+				}
+
+				// Literal addresses need no lookup. They never change, so they can be cached for
+				// as long as anyone likes.
+				boost::system::error_code addressEc;
+				auto address = boost::asio::ip::address::from_string(host, addressEc);
+
+				if (!addressEc)
+				{
+					boost::asio::ip::tcp::endpoint endpoint(address, port);
+					m_service->post(std::bind(handler, boost::system::error_code(), boost::asio::ip::tcp::resolver::iterator::create(endpoint, host, service), std::numeric_limits<uint32_t>::max()));
+					return;
+				}
+
+				if (m_nameservers.empty())
+				{
+					m_service->post(std::bind(handler, boost::asio::error::host_not_found_try_again, boost::asio::ip::tcp::resolver::iterator(), 0));
+					return;
+				}
+
+				std::make_shared<Lookup>(*this, host, service, port, std::move(handler))->Start();
+			}
+
+			std::vector<boost::asio::ip::udp::endpoint> AsyncDnsResolver::LoadSystemNameservers()
+			{
+				std::vector<boost::asio::ip::udp::endpoint> nameservers;
+
+				auto AddNameserver = [&nameservers](const std::string& addressString)
+				{
+					boost::system::error_code ec;
+
+					// Drop any IPv6 zone index, which the address parser doesn't accept.
+					auto address = boost::asio::ip::address::from_string(addressString.substr(0, addressString.find('%')), ec);
+
+					if (!ec && !address.is_unspecified())
+					{
+						nameservers.push_back(boost::asio::ip::udp::endpoint(address, DnsPort));
+					}
+				};
+
+				#if BOOST_OS_WINDOWS
+					ULONG bufferSize = 0;
+
+					if (GetNetworkParams(nullptr, &bufferSize) == ERROR_BUFFER_OVERFLOW)
+					{
+						std::vector<char> buffer(bufferSize);
+						auto info = reinterpret_cast<FIXED_INFO*>(buffer.data());
+
+						if (GetNetworkParams(info, &bufferSize) == ERROR_SUCCESS)
+						{
+							for (IP_ADDR_STRING* entry = &info->DnsServerList; entry != nullptr; entry = entry->Next)
+							{
+								AddNameserver(std::string(entry->IpAddress.String));
+							}
+						}
+					}
+				#else
+					std::ifstream resolvConf(u8"/etc/resolv.conf");
+					std::string line;
+
+					while (std::getline(resolvConf, line))
+					{
+						std::istringstream fields(line);
+						std::string keyword;
+						std::string value;
+
+						if ((fields >> keyword >> value) && keyword.compare(u8"nameserver") == 0)
+						{
+							AddNameserver(value);
+						}
+					}
+				#endif
+
+				return nameservers;
+			}
+
+			std::unordered_set<std::string> AsyncDnsResolver::LoadHostsFileNames()
+			{
+				std::unordered_set<std::string> names;
+
+				#if BOOST_OS_WINDOWS
+					std::array<char, MAX_PATH> systemDirectory;
+					const UINT length = GetSystemDirectoryA(systemDirectory.data(), static_cast<UINT>(systemDirectory.size()));
+
+					if (length == 0 || length >= systemDirectory.size())
+					{
+						return names;
+					}
+
+					std::string hostsPath(systemDirectory.data(), length);
+					hostsPath.append(u8"\\drivers\\etc\\hosts");
+				#else
+					std::string hostsPath(u8"/etc/hosts");
+				#endif
+
+				std::ifstream hostsFile(hostsPath);
+				std::string line;
+
+				while (std::getline(hostsFile, line))
+				{
+					line = line.substr(0, line.find('#'));
+
+					std::istringstream fields(line);
+					std::string address;
+					std::string name;
+
+					// The first field is the address, every field after it a name for it.
+					if (!(fields >> address))
+					{
+						continue;
+					}
+
+					while (fields >> name)
+					{
+						names.insert(NormalizeHostName(name));
+					}
+				}
+
+				return names;
+			}
+
+			uint16_t AsyncDnsResolver::NextQueryId()
+			{
+				std::array<unsigned char, 2> bytes;
+
+				{
+					std::lock_guard<std::mutex> lock(m_idMutex);
+
+					if (RAND_bytes(bytes.data(), static_cast<int>(bytes.size())) == 1)
+					{
+						return ReadUint16(bytes.data());
+					}
+				}
+
+				// OpenSSL could not be seeded, which shouldn't ever happen. The system's own
+				// source is still far better than anything predictable.
+				std::random_device device;
+				return static_cast<uint16_t>(device() & 0xFFFF);
+			}
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
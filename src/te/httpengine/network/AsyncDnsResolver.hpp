@@ -0,0 +1,249 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <boost/asio.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// A resolver that speaks DNS to the configured nameservers directly, with the
+			/// queries sent and answers received on the io_service itself. The asio resolver
+			/// instead calls the blocking getaddrinfo on a single hidden thread per io_service,
+			/// so every lookup in the proxy would wait its turn behind every other one.
+			/// 
+			/// A and AAAA queries are sent together over UDP, to each nameserver in turn until
+			/// one answers. Answers that were truncated are fetched again over TCP. Unlike the
+			/// system resolver, the smallest TTL among the answer records is handed back along
+			/// with the endpoints, so that cached answers can honor it.
+			/// 
+			/// Querying nameservers directly skips everything else the system resolver does
+			/// before and beside DNS: the hosts file, localhost, multicast DNS, the DNS suffix
+			/// search list and any split DNS rules. Names that depend on those are reported by
+			/// ::DefersToSystem(...), and must be handed to the system resolver instead.
+			/// 
+			/// All members are safe to call from any thread. The resolver must outlive every
+			/// lookup it starts.
+			/// </summary>
+			class AsyncDnsResolver
+			{
+
+			public:
+
+				/// <summary>
+				/// The completion handler signature. The same as the one for
+				/// ::asio::ip::tcp::resolver::async_resolve(...), plus the number of seconds the
+				/// answer may be cached for.
+				/// </summary>
+				using ResolveHandler = std::function<void(const boost::system::error_code&, boost::asio::ip::tcp::resolver::iterator, uint32_t)>;
+
+				/// <summary>
+				/// The well known DNS port.
+				/// </summary>
+				static constexpr uint16_t DnsPort = 53;
+
+				/// <summary>
+				/// The default number of milliseconds to wait on a nameserver before moving on
+				/// to the next one.
+				/// </summary>
+				static constexpr uint32_t DefaultQueryTimeoutMsec = 2000;
+
+				/// <summary>
+				/// The default number of times the list of nameservers is gone through before a
+				/// lookup fails.
+				/// </summary>
+				static constexpr uint32_t DefaultAttempts = 2;
+
+				/// <summary>
+				/// Constructs a new AsyncDnsResolver.
+				/// </summary>
+				/// <param name="service">
+				/// A valid pointer to the io_service that lookups are run on.
+				/// </param>
+				/// <param name="nameservers">
+				/// The nameservers to query, in order of preference. If empty, the nameservers
+				/// configured on the system are used. Supplying a local endpoint here is also how
+				/// the resolver can be pointed at a stub server.
+				/// </param>
+				/// <param name="queryTimeoutMsec">
+				/// The number of milliseconds to wait on a nameserver before moving on to the
+				/// next one.
+				/// </param>
+				/// <param name="attempts">
+				/// The number of times the list of nameservers is gone through before a lookup
+				/// fails.
+				/// </param>
+				AsyncDnsResolver(
+					boost::asio::io_service* service,
+					std::vector<boost::asio::ip::udp::endpoint> nameservers = std::vector<boost::asio::ip::udp::endpoint>(),
+					const uint32_t queryTimeoutMsec = DefaultQueryTimeoutMsec,
+					const uint32_t attempts = DefaultAttempts
+					);
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				AsyncDnsResolver(const AsyncDnsResolver&) = delete;
+				AsyncDnsResolver(AsyncDnsResolver&&) = delete;
+				AsyncDnsResolver& operator=(const AsyncDnsResolver&) = delete;
+
+				/// <summary>
+				/// Default destructor.
+				/// </summary>
+				~AsyncDnsResolver();
+
+				/// <summary>
+				/// Indicates whether or not any nameservers were supplied or found on the system.
+				/// A resolver without nameservers fails every lookup, so callers should fall back
+				/// to the system resolver instead.
+				/// </summary>
+				/// <returns>
+				/// True if there is at least one nameserver to query, false otherwise.
+				/// </returns>
+				const bool HasNameservers() const;
+
+				/// <summary>
+				/// Indicates whether or not the given host must be resolved by the system
+				/// resolver rather than by this one. That is the case for names listed in the
+				/// hosts file, localhost and names under it, names under .local, which belong to
+				/// multicast DNS, and single label names, which the system expands with its DNS
+				/// suffix search list.
+				/// </summary>
+				/// <param name="host">
+				/// The host name to check.
+				/// </param>
+				/// <returns>
+				/// True if the host must be resolved by the system resolver, false otherwise.
+				/// </returns>
+				const bool DefersToSystem(const std::string& host) const;
+
+				/// <summary>
+				/// Resolves the given host and service. Hosts that are already IP addresses are
+				/// answered without any query being sent.
+				/// </summary>
+				/// <param name="host">
+				/// The host name to resolve.
+				/// </param>
+				/// <param name="service">
+				/// The service, either "http", "https" or a port number, with which the resolved
+				/// endpoints are preconfigured.
+				/// </param>
+				/// <param name="handler">
+				/// The handler to invoke once the answer is known. Never invoked from within this
+				/// call.
+				/// </param>
+				void AsyncResolve(const std::string& host, const std::string& service, ResolveHandler handler);
+
+				/// <summary>
+				/// Reads the nameservers configured on the system. On Windows these come from the
+				/// network parameters of the IP helper API, elsewhere from /etc/resolv.conf.
+				/// </summary>
+				/// <returns>
+				/// The configured nameservers, in order of preference. Empty if none could be
+				/// found.
+				/// </returns>
+				static std::vector<boost::asio::ip::udp::endpoint> LoadSystemNameservers();
+
+				/// <summary>
+				/// Reads the names listed in the system's hosts file. On Windows the file is
+				/// drivers\etc\hosts under the system directory, elsewhere /etc/hosts.
+				/// </summary>
+				/// <returns>
+				/// The listed names, in lower case. Empty if the file could not be read.
+				/// </returns>
+				static std::unordered_set<std::string> LoadHostsFileNames();
+
+			private:
+
+				/// <summary>
+				/// The state of a single lookup, which lives until its handler is invoked.
+				/// </summary>
+				class Lookup;
+
+				/// <summary>
+				/// The io_service that lookups are run on.
+				/// </summary>
+				boost::asio::io_service* m_service;
+
+				/// <summary>
+				/// The nameservers to query, in order of preference.
+				/// </summary>
+				const std::vector<boost::asio::ip::udp::endpoint> m_nameservers;
+
+				/// <summary>
+				/// How long to wait on a nameserver before moving on to the next one.
+				/// </summary>
+				const boost::posix_time::milliseconds m_queryTimeout;
+
+				/// <summary>
+				/// How many times the list of nameservers is gone through.
+				/// </summary>
+				const uint32_t m_attempts;
+
+				/// <summary>
+				/// The names listed in the hosts file when the resolver was constructed.
+				/// </summary>
+				const std::unordered_set<std::string> m_hostsFileNames;
+
+				/// <summary>
+				/// Serializes calls into OpenSSL's random number generator, which is only safe
+				/// to call concurrently once OpenSSL's locking callbacks are in place. Nothing
+				/// guarantees that before the first ssl context is built.
+				/// </summary>
+				std::mutex m_idMutex;
+
+				/// <summary>
+				/// Gets a new query ID from OpenSSL's cryptographically secure random number
+				/// generator. Unpredictable IDs, along with a fresh source port for every
+				/// lookup, are what make forged answers hard to slip in, and the output of a
+				/// general purpose generator can be predicted from enough IDs seen on the wire.
+				/// </summary>
+				uint16_t NextQueryId();
+
+			};
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
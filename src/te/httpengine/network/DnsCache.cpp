@@ -0,0 +1,247 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "DnsCache.hpp"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			DnsCache::DnsCache(
+				boost::asio::io_service* service,
+				AsyncDnsResolver* resolver,
+				const uint32_t ttlSeconds,
+				const uint32_t negativeTtlSeconds,
+				const uint32_t prefetchSeconds
+				)
+				:
+				m_service(service),
+				m_resolver(resolver),
+				m_ttl(std::chrono::seconds(ttlSeconds)),
+				m_negativeTtl(std::chrono::seconds(negativeTtlSeconds)),
+				m_prefetchWindow(std::chrono::seconds(prefetchSeconds))
+			{
+				#ifndef NDEBUG
+					assert(m_service != nullptr && u8"In DnsCache::DnsCache(boost::asio::io_service*, AsyncDnsResolver*, const uint32_t, const uint32_t, const uint32_t) - Supplied io_service pointer is nullptr!");
+				#else
+					if (m_service == nullptr)
+					{
+						throw std::runtime_error(u8"In DnsCache::DnsCache(boost::asio::io_service*, AsyncDnsResolver*, const uint32_t, const uint32_t, const uint32_t) - Supplied io_service pointer is nullptr!");
+					}
+				#endif
+			}
+
+			DnsCache::~DnsCache()
+			{
+
+			}
+
+			void DnsCache::AsyncResolve(const std::string& host, const std::string& service, ResolveHandler handler)
+			{
+				std::string key(host);
+				key.append(u8":").append(service);
+
+				ScopedLock lock(m_cacheMutex);
+
+				const auto now = Clock::now();
+
+				auto entry = m_entries.find(key);
+
+				if (entry != m_entries.end())
+				{
+					if (entry->second.expires > now)
+					{
+						// Refresh answers that are about to expire ahead of time, so that the
+						// next bridge for a busy host doesn't have to wait on a lookup.
+						if (!entry->second.error && (entry->second.expires - now) < m_prefetchWindow && m_pending.find(key) == m_pending.end())
+						{
+							m_pending[key];
+							StartLookup(key, host, service);
+						}
+
+						m_service->post(std::bind(handler, entry->second.error, entry->second.endpoints));
+						return;
+					}
+
+					m_entries.erase(entry);
+				}
+
+				auto pending = m_pending.find(key);
+
+				if (pending != m_pending.end())
+				{
+					// Someone is already resolving this name, so just wait on their answer.
+					pending->second.push_back(std::move(handler));
+					return;
+				}
+
+				m_pending[key].push_back(std::move(handler));
+				StartLookup(key, host, service);
+			}
+
+			void DnsCache::Clear()
+			{
+				ScopedLock lock(m_cacheMutex);
+				m_entries.clear();
+			}
+
+			void DnsCache::StartLookup(const std::string& key, const std::string& host, const std::string& service)
+			{
+				if (m_resolver != nullptr && !m_resolver->DefersToSystem(host))
+				{
+					m_resolver->AsyncResolve(
+						host,
+						service,
+						[this, key, host, service](const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator endpoints, uint32_t ttlSeconds)
+						{
+							if (IsNegativeAnswer(error))
+							{
+								// Public DNS not knowing the name doesn't mean the system doesn't,
+								// for instance through split DNS rules that send it to a VPN's
+								// nameservers. Only the system resolver's answer is cached as final.
+								StartSystemLookup(key, host, service);
+								return;
+							}
+
+							if (ttlSeconds > MaxTtlSeconds)
+							{
+								ttlSeconds = MaxTtlSeconds;
+							}
+
+							OnLookupComplete(key, error, endpoints, std::chrono::seconds(ttlSeconds));
+						}
+						);
+
+					return;
+				}
+
+				StartSystemLookup(key, host, service);
+			}
+
+			void DnsCache::StartSystemLookup(const std::string& key, const std::string& host, const std::string& service)
+			{
+				// Each lookup gets its own resolver, kept alive by the completion handler, so
+				// that lookups for different names run independently of one another.
+				auto resolver = std::make_shared<boost::asio::ip::tcp::resolver>(*m_service);
+
+				boost::asio::ip::tcp::resolver::query query(host, service);
+
+				resolver->async_resolve(
+					query,
+					[this, key, resolver](const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator endpoints)
+					{
+						OnLookupComplete(key, error, endpoints, m_ttl);
+					}
+					);
+			}
+
+			void DnsCache::OnLookupComplete(const std::string& key, const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator endpoints, const Clock::duration ttl)
+			{
+				std::vector<ResolveHandler> waiters;
+
+				{
+					ScopedLock lock(m_cacheMutex);
+
+					const auto now = Clock::now();
+
+					if (!error || IsNegativeAnswer(error))
+					{
+						auto existing = m_entries.find(key);
+
+						if (existing == m_entries.end())
+						{
+							MakeRoom(now);
+						}
+
+						Entry& entry = m_entries[key];
+						entry.error = error;
+						entry.endpoints = endpoints;
+						entry.expires = now + (error ? m_negativeTtl : ttl);
+					}
+
+					// A transient failure leaves any answer from before a prefetch in place, to
+					// be handed out until it expires.
+
+					auto pending = m_pending.find(key);
+
+					if (pending != m_pending.end())
+					{
+						waiters = std::move(pending->second);
+						m_pending.erase(pending);
+					}
+				}
+
+				for (auto& waiter : waiters)
+				{
+					m_service->post(std::bind(waiter, error, endpoints));
+				}
+			}
+
+			void DnsCache::MakeRoom(const Clock::time_point now)
+			{
+				if (m_entries.size() < MaxEntries)
+				{
+					return;
+				}
+
+				for (auto it = m_entries.begin(); it != m_entries.end();)
+				{
+					if (it->second.expires <= now)
+					{
+						it = m_entries.erase(it);
+					}
+					else
+					{
+						++it;
+					}
+				}
+
+				if (m_entries.size() >= MaxEntries)
+				{
+					m_entries.erase(m_entries.begin());
+				}
+			}
+
+			bool DnsCache::IsNegativeAnswer(const boost::system::error_code& error)
+			{
+				return error == boost::asio::error::host_not_found || error == boost::asio::error::no_data;
+			}
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
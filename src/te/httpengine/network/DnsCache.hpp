@@ -0,0 +1,267 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include "AsyncDnsResolver.hpp"
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// A cache of host name resolutions, shared by every bridge, that sits in front of
+			/// the resolver. Browsers open many connections to the same few hosts in quick
+			/// succession, and without the cache every one of them pays for its own lookup.
+			/// 
+			/// Successful answers are held for as long as their records' TTL allows, and answers
+			/// saying that a host does not exist are held briefly. Lookups for a name that is
+			/// already being resolved don't start a second lookup, but wait for the first one
+			/// to complete. When an answer is handed out close to its expiry, a fresh lookup is
+			/// started in the background, so that busy hosts rarely miss the cache at all.
+			/// 
+			/// All members are safe to call from any thread. Completion handlers are always
+			/// posted to the io_service, never invoked from within ::AsyncResolve(...).
+			/// </summary>
+			class DnsCache
+			{
+
+			public:
+
+				/// <summary>
+				/// The completion handler signature, the same as the one for
+				/// ::asio::ip::tcp::resolver::async_resolve(...).
+				/// </summary>
+				using ResolveHandler = std::function<void(const boost::system::error_code&, boost::asio::ip::tcp::resolver::iterator)>;
+
+				/// <summary>
+				/// The default number of seconds a successful answer from the system resolver is
+				/// held. The system resolver doesn't tell us the record TTLs, so this is kept
+				/// short enough that hosts moving between addresses aren't missed for long.
+				/// </summary>
+				static constexpr uint32_t DefaultTtlSeconds = 60;
+
+				/// <summary>
+				/// The longest a successful answer is held, whatever its records' TTL says.
+				/// </summary>
+				static constexpr uint32_t MaxTtlSeconds = 3600;
+
+				/// <summary>
+				/// The default number of seconds an answer saying that a host does not exist is
+				/// held.
+				/// </summary>
+				static constexpr uint32_t DefaultNegativeTtlSeconds = 5;
+
+				/// <summary>
+				/// The default number of seconds before expiry within which handing out an answer
+				/// starts a background lookup to refresh it.
+				/// </summary>
+				static constexpr uint32_t DefaultPrefetchSeconds = 10;
+
+				/// <summary>
+				/// The maximum number of answers held.
+				/// </summary>
+				static constexpr size_t MaxEntries = 4096;
+
+				/// <summary>
+				/// Constructs a new, empty DnsCache.
+				/// </summary>
+				/// <param name="service">
+				/// A valid pointer to the io_service that lookups are run on, and that completion
+				/// handlers are posted to.
+				/// </param>
+				/// <param name="resolver">
+				/// An optional pointer to the resolver that lookups are made with. If nullptr,
+				/// lookups are made with the system resolver through asio. Even when supplied,
+				/// names the resolver defers to the system, or reports as not existing, are
+				/// looked up with the system resolver.
+				/// </param>
+				/// <param name="ttlSeconds">
+				/// The number of seconds a successful answer from the system resolver is held.
+				/// </param>
+				/// <param name="negativeTtlSeconds">
+				/// The number of seconds an answer saying that a host does not exist is held.
+				/// </param>
+				/// <param name="prefetchSeconds">
+				/// The number of seconds before expiry within which handing out an answer starts
+				/// a background lookup to refresh it. Zero disables prefetching.
+				/// </param>
+				DnsCache(
+					boost::asio::io_service* service,
+					AsyncDnsResolver* resolver = nullptr,
+					const uint32_t ttlSeconds = DefaultTtlSeconds,
+					const uint32_t negativeTtlSeconds = DefaultNegativeTtlSeconds,
+					const uint32_t prefetchSeconds = DefaultPrefetchSeconds
+					);
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				DnsCache(const DnsCache&) = delete;
+				DnsCache(DnsCache&&) = delete;
+				DnsCache& operator=(const DnsCache&) = delete;
+
+				/// <summary>
+				/// Default destructor.
+				/// </summary>
+				~DnsCache();
+
+				/// <summary>
+				/// Resolves the given host and service, answering from the cache when possible.
+				/// </summary>
+				/// <param name="host">
+				/// The host name to resolve.
+				/// </param>
+				/// <param name="service">
+				/// The service name or port number, such as "http" or "https", with which the
+				/// resolved endpoints are preconfigured.
+				/// </param>
+				/// <param name="handler">
+				/// The handler to post once the answer is known.
+				/// </param>
+				void AsyncResolve(const std::string& host, const std::string& service, ResolveHandler handler);
+
+				/// <summary>
+				/// Drops every cached answer. Lookups in progress are left to complete.
+				/// </summary>
+				void Clear();
+
+			private:
+
+				using Clock = std::chrono::steady_clock;
+
+				using ScopedLock = std::lock_guard<std::mutex>;
+
+				/// <summary>
+				/// A cached answer, either a list of endpoints or the error the lookup ended
+				/// with, along with the time it expires.
+				/// </summary>
+				struct Entry
+				{
+					boost::system::error_code error;
+					boost::asio::ip::tcp::resolver::iterator endpoints;
+					Clock::time_point expires;
+				};
+
+				/// <summary>
+				/// The io_service that lookups are run on.
+				/// </summary>
+				boost::asio::io_service* m_service;
+
+				/// <summary>
+				/// The resolver that lookups are made with. May be nullptr, in which case the
+				/// system resolver is used.
+				/// </summary>
+				AsyncDnsResolver* m_resolver;
+
+				/// <summary>
+				/// How long a successful answer from the system resolver is held.
+				/// </summary>
+				const Clock::duration m_ttl;
+
+				/// <summary>
+				/// How long an answer saying that a host does not exist is held.
+				/// </summary>
+				const Clock::duration m_negativeTtl;
+
+				/// <summary>
+				/// How long before expiry handing out an answer starts a background lookup.
+				/// </summary>
+				const Clock::duration m_prefetchWindow;
+
+				/// <summary>
+				/// Cached answers, keyed by host and service.
+				/// </summary>
+				std::unordered_map<std::string, Entry> m_entries;
+
+				/// <summary>
+				/// Lookups in progress, keyed by host and service, with the handlers waiting on
+				/// each. Background prefetches have no waiters.
+				/// </summary>
+				std::unordered_map<std::string, std::vector<ResolveHandler>> m_pending;
+
+				/// <summary>
+				/// Guards m_entries and m_pending.
+				/// </summary>
+				std::mutex m_cacheMutex;
+
+				/// <summary>
+				/// Starts a lookup for the given host and service, with the resolver if there is
+				/// one and it can answer for the host, or else with the system resolver. Names
+				/// the resolver reports as not existing are looked up again with the system
+				/// resolver. Must be called with m_cacheMutex held, and with an entry for the key
+				/// already in m_pending.
+				/// </summary>
+				void StartLookup(const std::string& key, const std::string& host, const std::string& service);
+
+				/// <summary>
+				/// Starts a lookup for the given host and service with the system resolver,
+				/// through asio. Must be called with an entry for the key already in m_pending.
+				/// </summary>
+				void StartSystemLookup(const std::string& key, const std::string& host, const std::string& service);
+
+				/// <summary>
+				/// Stores the answer to a completed lookup for as long as the given TTL, then
+				/// posts it to every handler that was waiting on it.
+				/// </summary>
+				void OnLookupComplete(const std::string& key, const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator endpoints, const Clock::duration ttl);
+
+				/// <summary>
+				/// Makes room for a new answer, dropping expired answers first and, if that's
+				/// not enough, an arbitrary one. Must be called with m_cacheMutex held.
+				/// </summary>
+				void MakeRoom(const Clock::time_point now);
+
+				/// <summary>
+				/// Determines whether or not a failed lookup is a definitive answer that may be
+				/// cached, rather than a transient failure that should be retried next time.
+				/// </summary>
+				static bool IsNegativeAnswer(const boost::system::error_code& error);
+
+			};
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,230 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// A small set of fixed size slots that the memory for a bridge's asynchronous
+			/// operations is carved from. Every read and write asio starts on a bridge's behalf
+			/// needs a block of memory to hold the operation and its handler until it completes,
+			/// and by default each block is a trip to the heap. A bridge only ever has a handful
+			/// of operations outstanding at once, so the same few slots are simply handed out
+			/// again and again. Requests too big for a slot, or made while every slot is taken,
+			/// fall back to the heap.
+			/// 
+			/// Allocate and Deallocate are safe to call from any thread.
+			/// </summary>
+			class HandlerArena
+			{
+
+			public:
+
+				/// <summary>
+				/// The number of slots. Enough for a read and a write in each direction, plus
+				/// the operations asio queues on strands when handlers complete.
+				/// </summary>
+				static constexpr size_t SlotCount = 8;
+
+				/// <summary>
+				/// The size of each slot, in bytes. Large enough for a TLS read or write along
+				/// with a strand wrapped handler.
+				/// </summary>
+				static constexpr size_t SlotSize = 512;
+
+				/// <summary>
+				/// Constructs a new HandlerArena with every slot free.
+				/// </summary>
+				HandlerArena()
+				{
+					for (auto& inUse : m_inUse)
+					{
+						inUse.store(false);
+					}
+				}
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				HandlerArena(const HandlerArena&) = delete;
+				HandlerArena(HandlerArena&&) = delete;
+				HandlerArena& operator=(const HandlerArena&) = delete;
+
+				/// <summary>
+				/// Allocates a block of the given size, from a free slot if one is available and
+				/// large enough, or else from the heap.
+				/// </summary>
+				/// <param name="size">
+				/// The size of the block, in bytes.
+				/// </param>
+				/// <returns>
+				/// Pointer to the block, to be handed back with ::Deallocate(...).
+				/// </returns>
+				void* Allocate(const size_t size)
+				{
+					if (size <= SlotSize)
+					{
+						for (size_t i = 0; i < SlotCount; ++i)
+						{
+							bool expected = false;
+
+							if (!m_inUse[i].load(std::memory_order_relaxed) && m_inUse[i].compare_exchange_strong(expected, true, std::memory_order_acquire))
+							{
+								return &m_slots[i];
+							}
+						}
+					}
+
+					return ::operator new(size);
+				}
+
+				/// <summary>
+				/// Frees a block allocated with ::Allocate(...).
+				/// </summary>
+				/// <param name="pointer">
+				/// Pointer to the block.
+				/// </param>
+				void Deallocate(void* pointer)
+				{
+					Slot* slot = static_cast<Slot*>(pointer);
+
+					if (slot >= m_slots.data() && slot < m_slots.data() + SlotCount)
+					{
+						m_inUse[slot - m_slots.data()].store(false, std::memory_order_release);
+						return;
+					}
+
+					::operator delete(pointer);
+				}
+
+			private:
+
+				using Slot = std::aligned_storage<SlotSize>::type;
+
+				/// <summary>
+				/// The slots themselves.
+				/// </summary>
+				std::array<Slot, SlotCount> m_slots;
+
+				/// <summary>
+				/// Whether each slot is currently handed out.
+				/// </summary>
+				std::array<std::atomic<bool>, SlotCount> m_inUse;
+
+			};
+
+			/// <summary>
+			/// Wraps a completion handler so that asio allocates the memory for the operation
+			/// it's supplied to, and for any intermediate operations and strand dispatches along
+			/// the way, from a HandlerArena. The arena must outlive every copy of the handler,
+			/// which holds for a bridge's own arena since its handlers keep the bridge alive.
+			/// </summary>
+			template<typename Handler>
+			class ArenaHandler
+			{
+
+			public:
+
+				ArenaHandler(HandlerArena& arena, Handler handler)
+					:
+					m_arena(&arena),
+					m_handler(std::move(handler))
+				{
+
+				}
+
+				template<typename... Args>
+				void operator()(Args&&... args)
+				{
+					m_handler(std::forward<Args>(args)...);
+				}
+
+				/// <summary>
+				/// Allocation hook found by asio through argument dependent lookup.
+				/// </summary>
+				friend void* asio_handler_allocate(std::size_t size, ArenaHandler<Handler>* thisHandler)
+				{
+					return thisHandler->m_arena->Allocate(size);
+				}
+
+				/// <summary>
+				/// Deallocation hook found by asio through argument dependent lookup.
+				/// </summary>
+				friend void asio_handler_deallocate(void* pointer, std::size_t /*size*/, ArenaHandler<Handler>* thisHandler)
+				{
+					thisHandler->m_arena->Deallocate(pointer);
+				}
+
+			private:
+
+				HandlerArena* m_arena;
+
+				Handler m_handler;
+
+			};
+
+			/// <summary>
+			/// Wraps the given handler so that its operations are allocated from the given arena.
+			/// </summary>
+			/// <param name="arena">
+			/// The arena to allocate from.
+			/// </param>
+			/// <param name="handler">
+			/// The completion handler to wrap.
+			/// </param>
+			/// <returns>
+			/// The wrapped handler.
+			/// </returns>
+			template<typename Handler>
+			inline ArenaHandler<typename std::decay<Handler>::type> MakeArenaHandler(HandlerArena& arena, Handler&& handler)
+			{
+				return ArenaHandler<typename std::decay<Handler>::type>(arena, std::forward<Handler>(handler));
+			}
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
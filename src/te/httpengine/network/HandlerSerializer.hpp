@@ -0,0 +1,306 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/asio/detail/handler_alloc_helpers.hpp>
+#include <boost/asio/detail/handler_cont_helpers.hpp>
+#include <boost/asio/detail/handler_invoke_helpers.hpp>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// Ensures that the handlers wrapped through it are never executed concurrently.
+			/// When the io_service the handlers complete on is run by several threads, that
+			/// takes a strand. When it's run by a single thread, as each shard of an
+			/// IoServicePool is, the io_service itself gives the same guarantee for free, so
+			/// handlers are dispatched straight through it and no strand is built at all.
+			/// Either way, a handler that completes on some other io_service, such as one
+			/// posted by the DnsCache, is still brought back onto the right thread.
+			/// </summary>
+			class HandlerSerializer
+			{
+
+			public:
+
+				template<typename Handler>
+				class SerializedHandler;
+
+				/// <summary>
+				/// Constructs a new HandlerSerializer for the given io_service.
+				/// </summary>
+				/// <param name="service">
+				/// The io_service that wrapped handlers are to be executed by.
+				/// </param>
+				/// <param name="singleThreaded">
+				/// Whether the io_service is run by exactly one thread. If true, no strand is
+				/// used.
+				/// </param>
+				HandlerSerializer(boost::asio::io_service& service, const bool singleThreaded = false)
+					:
+					m_service(service),
+					m_strand(singleThreaded ? nullptr : new boost::asio::io_service::strand(service))
+				{
+
+				}
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				HandlerSerializer(const HandlerSerializer&) = delete;
+				HandlerSerializer(HandlerSerializer&&) = delete;
+				HandlerSerializer& operator=(const HandlerSerializer&) = delete;
+
+				/// <summary>
+				/// Gets the io_service that wrapped handlers are executed by.
+				/// </summary>
+				/// <returns>
+				/// The io_service that wrapped handlers are executed by.
+				/// </returns>
+				boost::asio::io_service& get_io_service()
+				{
+					return m_service;
+				}
+
+				/// <summary>
+				/// Executes the given function, immediately if that can be done without breaking
+				/// the guarantee, or else later from the io_service.
+				/// </summary>
+				/// <param name="function">
+				/// The function to execute.
+				/// </param>
+				template<typename Function>
+				void dispatch(Function&& function)
+				{
+					if (m_strand != nullptr)
+					{
+						m_strand->dispatch(std::forward<Function>(function));
+					}
+					else
+					{
+						m_service.dispatch(std::forward<Function>(function));
+					}
+				}
+
+				/// <summary>
+				/// Checks whether the calling thread is already executing a handler dispatched
+				/// through the strand. Always false when no strand is used, since the
+				/// io_service offers no such check.
+				/// </summary>
+				/// <returns>
+				/// True if the strand is running in this thread, false otherwise.
+				/// </returns>
+				bool running_in_this_thread() const
+				{
+					return m_strand != nullptr && m_strand->running_in_this_thread();
+				}
+
+				/// <summary>
+				/// Wraps the given handler so that it is dispatched through this serializer when
+				/// it's invoked. Used in the same way as boost::asio::strand::wrap(...).
+				/// </summary>
+				/// <param name="handler">
+				/// The completion handler to wrap.
+				/// </param>
+				/// <returns>
+				/// The wrapped handler.
+				/// </returns>
+				template<typename Handler>
+				SerializedHandler<typename std::decay<Handler>::type> wrap(Handler&& handler)
+				{
+					return SerializedHandler<typename std::decay<Handler>::type>(*this, std::forward<Handler>(handler));
+				}
+
+			private:
+
+				/// <summary>
+				/// The io_service that wrapped handlers are executed by.
+				/// </summary>
+				boost::asio::io_service& m_service;
+
+				/// <summary>
+				/// The strand that handlers are dispatched through, or nullptr if the
+				/// io_service is run by a single thread.
+				/// </summary>
+				std::unique_ptr<boost::asio::io_service::strand> m_strand;
+
+			};
+
+			/// <summary>
+			/// A completion handler wrapped by a HandlerSerializer. Mirrors the handler
+			/// boost::asio::strand::wrap(...) returns: invoking it dispatches the wrapped
+			/// handler through the serializer, the intermediate handlers of composed
+			/// operations such as async_write and SSL stream operations are dispatched the
+			/// same way, and allocation is left to the wrapped handler.
+			/// </summary>
+			template<typename Handler>
+			class HandlerSerializer::SerializedHandler
+			{
+
+			public:
+
+				SerializedHandler(HandlerSerializer& serializer, Handler handler)
+					:
+					m_serializer(&serializer),
+					m_handler(std::move(handler))
+				{
+
+				}
+
+				void operator()()
+				{
+					m_serializer->dispatch(m_handler);
+				}
+
+				template<typename Arg1>
+				void operator()(const Arg1& arg1)
+				{
+					m_serializer->dispatch(boost::asio::detail::bind_handler(m_handler, arg1));
+				}
+
+				template<typename Arg1, typename Arg2>
+				void operator()(const Arg1& arg1, const Arg2& arg2)
+				{
+					m_serializer->dispatch(boost::asio::detail::bind_handler(m_handler, arg1, arg2));
+				}
+
+				/// <summary>
+				/// Allocation hook found by asio through argument dependent lookup.
+				/// </summary>
+				friend void* asio_handler_allocate(std::size_t size, SerializedHandler<Handler>* thisHandler)
+				{
+					return boost_asio_handler_alloc_helpers::allocate(size, thisHandler->m_handler);
+				}
+
+				/// <summary>
+				/// Deallocation hook found by asio through argument dependent lookup.
+				/// </summary>
+				friend void asio_handler_deallocate(void* pointer, std::size_t size, SerializedHandler<Handler>* thisHandler)
+				{
+					boost_asio_handler_alloc_helpers::deallocate(pointer, size, thisHandler->m_handler);
+				}
+
+				/// <summary>
+				/// Continuation hook found by asio through argument dependent lookup.
+				/// </summary>
+				friend bool asio_handler_is_continuation(SerializedHandler<Handler>* thisHandler)
+				{
+					return thisHandler->m_serializer->running_in_this_thread() || boost_asio_handler_cont_helpers::is_continuation(thisHandler->m_handler);
+				}
+
+				/// <summary>
+				/// Invocation hook found by asio through argument dependent lookup, so that the
+				/// intermediate handlers of composed operations are serialized as well.
+				/// </summary>
+				template<typename Function>
+				friend void asio_handler_invoke(Function& function, SerializedHandler<Handler>* thisHandler)
+				{
+					thisHandler->m_serializer->dispatch(Rewrapped<Function>(function, thisHandler->m_handler));
+				}
+
+				template<typename Function>
+				friend void asio_handler_invoke(const Function& function, SerializedHandler<Handler>* thisHandler)
+				{
+					thisHandler->m_serializer->dispatch(Rewrapped<Function>(function, thisHandler->m_handler));
+				}
+
+			private:
+
+				/// <summary>
+				/// An intermediate handler of a composed operation, on its way through the
+				/// serializer. Its hooks go to the wrapped handler rather than back to the
+				/// SerializedHandler, which would only dispatch it through the serializer again,
+				/// endlessly.
+				/// </summary>
+				template<typename Function>
+				class Rewrapped
+				{
+
+				public:
+
+					Rewrapped(const Function& function, const Handler& handler)
+						:
+						m_function(function),
+						m_handler(handler)
+					{
+
+					}
+
+					void operator()()
+					{
+						m_function();
+					}
+
+					friend void* asio_handler_allocate(std::size_t size, Rewrapped<Function>* thisHandler)
+					{
+						return boost_asio_handler_alloc_helpers::allocate(size, thisHandler->m_handler);
+					}
+
+					friend void asio_handler_deallocate(void* pointer, std::size_t size, Rewrapped<Function>* thisHandler)
+					{
+						boost_asio_handler_alloc_helpers::deallocate(pointer, size, thisHandler->m_handler);
+					}
+
+					template<typename InnerFunction>
+					friend void asio_handler_invoke(InnerFunction& function, Rewrapped<Function>* thisHandler)
+					{
+						boost_asio_handler_invoke_helpers::invoke(function, thisHandler->m_handler);
+					}
+
+				private:
+
+					Function m_function;
+
+					Handler m_handler;
+
+				};
+
+				HandlerSerializer* m_serializer;
+
+				Handler m_handler;
+
+			};
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
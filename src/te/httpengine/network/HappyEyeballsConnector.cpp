@@ -0,0 +1,306 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "HappyEyeballsConnector.hpp"
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			const std::array<uint32_t, ConnectTimeHistogram::BucketCount - 1> ConnectTimeHistogram::BucketUpperBoundsMsec{ { 10, 25, 50, 100, 250, 500, 1000, 2500, 5000 } };
+
+			ConnectTimeHistogram::ConnectTimeHistogram()
+			{
+				for (auto& count : m_counts)
+				{
+					count.store(0, std::memory_order_relaxed);
+				}
+
+				m_failures.store(0, std::memory_order_relaxed);
+			}
+
+			void ConnectTimeHistogram::RecordConnect(const std::chrono::steady_clock::duration elapsed)
+			{
+				const auto elapsedMsec = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+
+				size_t bucket = 0;
+
+				while (bucket < BucketUpperBoundsMsec.size() && elapsedMsec > BucketUpperBoundsMsec[bucket])
+				{
+					++bucket;
+				}
+
+				m_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+			}
+
+			void ConnectTimeHistogram::RecordFailure()
+			{
+				m_failures.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			std::array<uint64_t, ConnectTimeHistogram::BucketCount> ConnectTimeHistogram::GetCounts() const
+			{
+				std::array<uint64_t, BucketCount> counts;
+
+				for (size_t i = 0; i < counts.size(); ++i)
+				{
+					counts[i] = m_counts[i].load(std::memory_order_relaxed);
+				}
+
+				return counts;
+			}
+
+			uint64_t ConnectTimeHistogram::GetFailures() const
+			{
+				return m_failures.load(std::memory_order_relaxed);
+			}
+
+			HappyEyeballsConnector::HappyEyeballsConnector(
+				boost::asio::io_service& service,
+				std::vector<boost::asio::ip::tcp::endpoint> endpoints,
+				ConnectTimeHistogram* connectTimes,
+				const uint32_t timeoutMsec,
+				const uint32_t attemptDelayMsec
+				)
+				:
+				m_service(service),
+				m_endpoints(InterleaveFamilies(endpoints)),
+				m_connectTimes(connectTimes),
+				m_timeout(timeoutMsec),
+				m_attemptDelay(attemptDelayMsec),
+				m_attemptTimer(service),
+				m_deadlineTimer(service),
+				m_strand(service)
+			{
+				m_attempts.reserve(m_endpoints.size());
+			}
+
+			HappyEyeballsConnector::~HappyEyeballsConnector()
+			{
+
+			}
+
+			void HappyEyeballsConnector::AsyncConnect(ConnectHandler handler)
+			{
+				m_handler = std::move(handler);
+				m_strand.post(std::bind(&HappyEyeballsConnector::Start, shared_from_this()));
+			}
+
+			void HappyEyeballsConnector::Start()
+			{
+				m_started = std::chrono::steady_clock::now();
+
+				if (m_endpoints.empty())
+				{
+					Finish(boost::asio::error::host_not_found, nullptr);
+					return;
+				}
+
+				m_deadlineTimer.expires_from_now(m_timeout);
+				m_deadlineTimer.async_wait(
+					m_strand.wrap(
+						std::bind(
+							&HappyEyeballsConnector::OnDeadline,
+							shared_from_this(),
+							std::placeholders::_1
+							)
+						)
+					);
+
+				StartNextAttempt();
+			}
+
+			void HappyEyeballsConnector::StartNextAttempt()
+			{
+				if (m_attempts.size() >= m_endpoints.size())
+				{
+					return;
+				}
+
+				const size_t index = m_attempts.size();
+
+				m_attempts.push_back(std::make_shared<TcpSocket>(m_service));
+				++m_pendingAttempts;
+
+				m_attempts[index]->async_connect(
+					m_endpoints[index],
+					m_strand.wrap(
+						std::bind(
+							&HappyEyeballsConnector::OnAttemptConnect,
+							shared_from_this(),
+							index,
+							std::placeholders::_1
+							)
+						)
+					);
+
+				if (m_attempts.size() < m_endpoints.size())
+				{
+					// Re-arming also cancels any wait still pending from the previous attempt.
+					m_attemptTimer.expires_from_now(m_attemptDelay);
+					m_attemptTimer.async_wait(
+						m_strand.wrap(
+							std::bind(
+								&HappyEyeballsConnector::OnAttemptDelay,
+								shared_from_this(),
+								std::placeholders::_1
+								)
+							)
+						);
+				}
+			}
+
+			void HappyEyeballsConnector::OnAttemptConnect(const size_t index, const boost::system::error_code& error)
+			{
+				--m_pendingAttempts;
+
+				if (m_done)
+				{
+					return;
+				}
+
+				if (!error)
+				{
+					Finish(error, m_attempts[index]);
+					return;
+				}
+
+				m_lastError = error;
+
+				boost::system::error_code closeEc;
+				m_attempts[index]->close(closeEc);
+
+				if (m_attempts.size() < m_endpoints.size())
+				{
+					// No sense waiting out the delay when this one has already failed.
+					StartNextAttempt();
+					return;
+				}
+
+				if (m_pendingAttempts == 0)
+				{
+					Finish(m_lastError, nullptr);
+				}
+			}
+
+			void HappyEyeballsConnector::OnAttemptDelay(const boost::system::error_code& error)
+			{
+				if (m_done || error == boost::asio::error::operation_aborted)
+				{
+					return;
+				}
+
+				StartNextAttempt();
+			}
+
+			void HappyEyeballsConnector::OnDeadline(const boost::system::error_code& error)
+			{
+				if (m_done || error == boost::asio::error::operation_aborted)
+				{
+					return;
+				}
+
+				Finish(boost::asio::error::timed_out, nullptr);
+			}
+
+			void HappyEyeballsConnector::Finish(const boost::system::error_code& error, std::shared_ptr<TcpSocket> winner)
+			{
+				m_done = true;
+
+				boost::system::error_code ec;
+				m_attemptTimer.cancel(ec);
+				m_deadlineTimer.cancel(ec);
+
+				for (auto& attempt : m_attempts)
+				{
+					if (attempt != winner)
+					{
+						attempt->close(ec);
+					}
+				}
+
+				if (m_connectTimes != nullptr)
+				{
+					if (winner != nullptr)
+					{
+						m_connectTimes->RecordConnect(std::chrono::steady_clock::now() - m_started);
+					}
+					else
+					{
+						m_connectTimes->RecordFailure();
+					}
+				}
+
+				auto handler = std::move(m_handler);
+				m_handler = nullptr;
+
+				if (handler)
+				{
+					handler(error, winner);
+				}
+			}
+
+			std::vector<boost::asio::ip::tcp::endpoint> HappyEyeballsConnector::InterleaveFamilies(const std::vector<boost::asio::ip::tcp::endpoint>& endpoints)
+			{
+				std::vector<boost::asio::ip::tcp::endpoint> v6;
+				std::vector<boost::asio::ip::tcp::endpoint> v4;
+
+				for (const auto& endpoint : endpoints)
+				{
+					(endpoint.address().is_v6() ? v6 : v4).push_back(endpoint);
+				}
+
+				std::vector<boost::asio::ip::tcp::endpoint> ordered;
+				ordered.reserve(endpoints.size());
+
+				for (size_t i = 0; i < v6.size() || i < v4.size(); ++i)
+				{
+					if (i < v6.size())
+					{
+						ordered.push_back(v6[i]);
+					}
+
+					if (i < v4.size())
+					{
+						ordered.push_back(v4[i]);
+					}
+				}
+
+				return ordered;
+			}
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
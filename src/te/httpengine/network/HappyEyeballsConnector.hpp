@@ -0,0 +1,257 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include "SocketTypes.hpp"
+
+#include <boost/asio.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// Counts successful upstream connects by how long they took, in a fixed set of
+			/// buckets, along with connects that failed altogether. Safe to record into and read
+			/// from any thread.
+			/// </summary>
+			class ConnectTimeHistogram
+			{
+
+			public:
+
+				/// <summary>
+				/// The number of buckets, the last one counting everything slower than the
+				/// largest bound.
+				/// </summary>
+				static constexpr size_t BucketCount = 10;
+
+				/// <summary>
+				/// The upper bound of each bucket but the last, in milliseconds.
+				/// </summary>
+				static const std::array<uint32_t, BucketCount - 1> BucketUpperBoundsMsec;
+
+				/// <summary>
+				/// Constructs a new ConnectTimeHistogram with every count at zero.
+				/// </summary>
+				ConnectTimeHistogram();
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				ConnectTimeHistogram(const ConnectTimeHistogram&) = delete;
+				ConnectTimeHistogram(ConnectTimeHistogram&&) = delete;
+				ConnectTimeHistogram& operator=(const ConnectTimeHistogram&) = delete;
+
+				/// <summary>
+				/// Counts a successful connect that took the given time.
+				/// </summary>
+				void RecordConnect(const std::chrono::steady_clock::duration elapsed);
+
+				/// <summary>
+				/// Counts a connect that failed on every endpoint.
+				/// </summary>
+				void RecordFailure();
+
+				/// <summary>
+				/// Gets the count of each bucket.
+				/// </summary>
+				std::array<uint64_t, BucketCount> GetCounts() const;
+
+				/// <summary>
+				/// Gets the number of connects that failed on every endpoint.
+				/// </summary>
+				uint64_t GetFailures() const;
+
+			private:
+
+				std::array<std::atomic<uint64_t>, BucketCount> m_counts;
+
+				std::atomic<uint64_t> m_failures;
+
+			};
+
+			/// <summary>
+			/// Connects to the first responsive of several endpoints for the same host, racing
+			/// the attempts as RFC 8305 "Happy Eyeballs" describes. Connecting to one endpoint
+			/// at a time means a dead IPv6 route, or a single slow address, costs the entire
+			/// connect timeout before anything else is tried.
+			/// 
+			/// Endpoints are ordered so that address families alternate, IPv6 first. The first
+			/// attempt is started at once, and each following one either after a short delay or
+			/// as soon as the previous attempt fails, whichever comes first. The first attempt
+			/// to succeed wins and every other is cancelled. If no attempt succeeds within the
+			/// overall timeout, the connect fails with timed_out.
+			/// 
+			/// Instances must be owned by a std::shared_ptr, and keep themselves alive until
+			/// their handler has been invoked.
+			/// </summary>
+			class HappyEyeballsConnector : public std::enable_shared_from_this<HappyEyeballsConnector>
+			{
+
+			public:
+
+				/// <summary>
+				/// The completion handler signature. On success, the socket is the connected
+				/// winner, which the handler takes over. On failure, it is nullptr.
+				/// </summary>
+				using ConnectHandler = std::function<void(const boost::system::error_code&, std::shared_ptr<TcpSocket>)>;
+
+				/// <summary>
+				/// The default delay between starting attempts, as recommended by RFC 8305.
+				/// </summary>
+				static constexpr uint32_t DefaultAttemptDelayMsec = 250;
+
+				/// <summary>
+				/// Constructs a new HappyEyeballsConnector.
+				/// </summary>
+				/// <param name="service">
+				/// The io_service that the attempts are run on.
+				/// </param>
+				/// <param name="endpoints">
+				/// The endpoints to connect to, in order of preference within each family.
+				/// </param>
+				/// <param name="connectTimes">
+				/// An optional pointer to the histogram to record the outcome into.
+				/// </param>
+				/// <param name="timeoutMsec">
+				/// The number of milliseconds after which, if no attempt has succeeded, the
+				/// connect fails.
+				/// </param>
+				/// <param name="attemptDelayMsec">
+				/// The number of milliseconds to wait on an attempt before starting the next.
+				/// </param>
+				HappyEyeballsConnector(
+					boost::asio::io_service& service,
+					std::vector<boost::asio::ip::tcp::endpoint> endpoints,
+					ConnectTimeHistogram* connectTimes = nullptr,
+					const uint32_t timeoutMsec = 5000,
+					const uint32_t attemptDelayMsec = DefaultAttemptDelayMsec
+					);
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				HappyEyeballsConnector(const HappyEyeballsConnector&) = delete;
+				HappyEyeballsConnector(HappyEyeballsConnector&&) = delete;
+				HappyEyeballsConnector& operator=(const HappyEyeballsConnector&) = delete;
+
+				/// <summary>
+				/// Default destructor.
+				/// </summary>
+				~HappyEyeballsConnector();
+
+				/// <summary>
+				/// Starts racing the attempts. May only be called once.
+				/// </summary>
+				/// <param name="handler">
+				/// The handler to invoke with the outcome. Never invoked from within this call.
+				/// </param>
+				void AsyncConnect(ConnectHandler handler);
+
+			private:
+
+				boost::asio::io_service& m_service;
+
+				std::vector<boost::asio::ip::tcp::endpoint> m_endpoints;
+
+				ConnectTimeHistogram* m_connectTimes;
+
+				const boost::posix_time::milliseconds m_timeout;
+
+				const boost::posix_time::milliseconds m_attemptDelay;
+
+				/// <summary>
+				/// One socket per attempt started, at the same index as its endpoint. Sockets
+				/// are shared so that the winner can be handed off without a copy.
+				/// </summary>
+				std::vector<std::shared_ptr<TcpSocket>> m_attempts;
+
+				/// <summary>
+				/// Fires when it's time to start the next attempt.
+				/// </summary>
+				boost::asio::deadline_timer m_attemptTimer;
+
+				/// <summary>
+				/// Fires when the whole connect has taken too long.
+				/// </summary>
+				boost::asio::deadline_timer m_deadlineTimer;
+
+				/// <summary>
+				/// Keeps the attempt and timer handlers from running concurrently.
+				/// </summary>
+				boost::asio::strand m_strand;
+
+				ConnectHandler m_handler;
+
+				std::chrono::steady_clock::time_point m_started;
+
+				size_t m_pendingAttempts = 0;
+
+				boost::system::error_code m_lastError;
+
+				bool m_done = false;
+
+				void Start();
+
+				void StartNextAttempt();
+
+				void OnAttemptConnect(const size_t index, const boost::system::error_code& error);
+
+				void OnAttemptDelay(const boost::system::error_code& error);
+
+				void OnDeadline(const boost::system::error_code& error);
+
+				void Finish(const boost::system::error_code& error, std::shared_ptr<TcpSocket> winner);
+
+				/// <summary>
+				/// Reorders endpoints so that address families alternate, starting with IPv6,
+				/// while keeping the order within each family.
+				/// </summary>
+				static std::vector<boost::asio::ip::tcp::endpoint> InterleaveFamilies(const std::vector<boost::asio::ip::tcp::endpoint>& endpoints);
+
+			};
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,136 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include "IoServicePool.hpp"
+
+#include <functional>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			IoServicePool::IoServicePool(
+				const size_t shardCount,
+				const uint32_t tickMsec
+				)
+			{
+				size_t count = shardCount > 0 ? shardCount : 1;
+
+				m_shards.reserve(count);
+
+				for (size_t i = 0; i < count; ++i)
+				{
+					Shard shard;
+
+					shard.service.reset(new boost::asio::io_service(1));
+					shard.work.reset(new boost::asio::io_service::work(*shard.service));
+					shard.timingWheel.reset(new TimingWheel(shard.service.get(), 1, tickMsec));
+
+					m_shards.push_back(std::move(shard));
+				}
+			}
+
+			IoServicePool::~IoServicePool()
+			{
+				Stop();
+			}
+
+			void IoServicePool::Run()
+			{
+				if (m_threads.size() > 0)
+				{
+					return;
+				}
+
+				for (auto& shard : m_shards)
+				{
+					m_threads.emplace_back(
+						std::thread
+							{
+								std::bind(
+								static_cast<size_t(boost::asio::io_service::*)()>(&boost::asio::io_service::run),
+									std::ref(*shard.service.get())
+									)
+							}
+					);
+				}
+			}
+
+			void IoServicePool::Stop()
+			{
+				for (auto& shard : m_shards)
+				{
+					shard.service->stop();
+				}
+
+				for (auto& t : m_threads)
+				{
+					t.join();
+				}
+
+				m_threads.clear();
+
+				// Ready every io_service to be run again.
+				for (auto& shard : m_shards)
+				{
+					shard.service->reset();
+				}
+			}
+
+			const size_t IoServicePool::GetSize() const
+			{
+				return m_shards.size();
+			}
+
+			const size_t IoServicePool::Next()
+			{
+				return m_nextShard.fetch_add(1) % m_shards.size();
+			}
+
+			boost::asio::io_service* IoServicePool::GetService(const size_t shard)
+			{
+				return m_shards[shard % m_shards.size()].service.get();
+			}
+
+			TimingWheel* IoServicePool::GetTimingWheel(const size_t shard)
+			{
+				return m_shards[shard % m_shards.size()].timingWheel.get();
+			}
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,186 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#pragma once
+
+#include "TimingWheel.hpp"
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// A pool of io_services, each run by exactly one thread of its own and each with its
+			/// own timing wheel. Bridges are dealt out to the shards in turn, and every socket,
+			/// strand, timer and handler of a bridge belongs to its shard, so a connection lives
+			/// entirely on one thread. The shards share no reactor queue, and because only one
+			/// thread ever runs any given shard, the bridges' strands never contend.
+			/// 
+			/// Listeners stay on a separate io_service. An accepted socket is simply opened on
+			/// the io_service of the shard its bridge was built on.
+			/// </summary>
+			class IoServicePool
+			{
+
+			public:
+
+				/// <summary>
+				/// Constructs a new IoServicePool. No shard runs until ::Run() is called.
+				/// </summary>
+				/// <param name="shardCount">
+				/// The number of shards, ideally one per core. Zero is treated as one.
+				/// </param>
+				/// <param name="tickMsec">
+				/// The number of milliseconds between ticks of every shard's timing wheel.
+				/// </param>
+				IoServicePool(
+					const size_t shardCount,
+					const uint32_t tickMsec = TimingWheel::DefaultTickMsec
+					);
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				IoServicePool(const IoServicePool&) = delete;
+				IoServicePool(IoServicePool&&) = delete;
+				IoServicePool& operator=(const IoServicePool&) = delete;
+
+				/// <summary>
+				/// Default destructor. Stops every shard.
+				/// </summary>
+				~IoServicePool();
+
+				/// <summary>
+				/// Starts one thread for every shard, running the shard's io_service until
+				/// ::Stop() is called. Does nothing if the shards are already running.
+				/// </summary>
+				void Run();
+
+				/// <summary>
+				/// Stops every shard's io_service and waits on the threads running them. Handlers
+				/// that have not run yet are kept, and run once ::Run() is called again.
+				/// </summary>
+				void Stop();
+
+				/// <summary>
+				/// Gets the number of shards.
+				/// </summary>
+				/// <returns>
+				/// The number of shards.
+				/// </returns>
+				const size_t GetSize() const;
+
+				/// <summary>
+				/// Picks the shard that the next bridge should be built on, taking each in turn.
+				/// </summary>
+				/// <returns>
+				/// The index of the picked shard.
+				/// </returns>
+				const size_t Next();
+
+				/// <summary>
+				/// Gets the io_service of the shard at the given index.
+				/// </summary>
+				/// <param name="shard">
+				/// The index of the shard, as returned by ::Next().
+				/// </param>
+				/// <returns>
+				/// The shard's io_service.
+				/// </returns>
+				boost::asio::io_service* GetService(const size_t shard);
+
+				/// <summary>
+				/// Gets the timing wheel of the shard at the given index, which ticks on the
+				/// shard's own io_service.
+				/// </summary>
+				/// <param name="shard">
+				/// The index of the shard, as returned by ::Next().
+				/// </param>
+				/// <returns>
+				/// The shard's timing wheel.
+				/// </returns>
+				TimingWheel* GetTimingWheel(const size_t shard);
+
+			private:
+
+				struct Shard
+				{
+					/// <summary>
+					/// The io_service, constructed with a concurrency hint of one, since only one
+					/// thread will ever run it.
+					/// </summary>
+					std::unique_ptr<boost::asio::io_service> service;
+
+					/// <summary>
+					/// Keeps the io_service running while it has nothing else to do.
+					/// </summary>
+					std::unique_ptr<boost::asio::io_service::work> work;
+
+					/// <summary>
+					/// The shard's timing wheel. Declared last, so that it is destroyed before the
+					/// io_service it ticks on.
+					/// </summary>
+					std::unique_ptr<TimingWheel> timingWheel;
+				};
+
+				/// <summary>
+				/// The shards. Never resized after construction.
+				/// </summary>
+				std::vector<Shard> m_shards;
+
+				/// <summary>
+				/// The threads running the shards while the pool is running, one per shard.
+				/// </summary>
+				std::vector<std::thread> m_threads;
+
+				/// <summary>
+				/// Counter from which ::Next() picks shards in turn.
+				/// </summary>
+				std::atomic<size_t> m_nextShard{ 0 };
+
+			};
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,248 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "TimingWheel.hpp"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			TimingWheel::TimingWheel(
+				boost::asio::io_service* service,
+				const size_t shardCount,
+				const uint32_t tickMsec
+				)
+				:
+				m_tickTimer(*service),
+				m_tickMsec(tickMsec > 0 ? tickMsec : 1),
+				m_epoch(Clock::now())
+			{
+				#ifndef NDEBUG
+					assert(service != nullptr && u8"In TimingWheel::TimingWheel(boost::asio::io_service*, const size_t, const uint32_t) - Supplied io_service pointer is nullptr!");
+				#else
+					if (service == nullptr)
+					{
+						throw std::runtime_error(u8"In TimingWheel::TimingWheel(boost::asio::io_service*, const size_t, const uint32_t) - Supplied io_service pointer is nullptr!");
+					}
+				#endif
+
+				size_t count = shardCount > 0 ? shardCount : 1;
+
+				for (size_t i = 0; i < count; ++i)
+				{
+					m_shards.emplace_back(new Shard());
+				}
+
+				ScheduleTick();
+			}
+
+			TimingWheel::~TimingWheel()
+			{
+				boost::system::error_code ignored;
+				m_tickTimer.cancel(ignored);
+			}
+
+			TimingWheel::TimeoutHandle TimingWheel::Register(ExpiryHandler handler)
+			{
+				auto timeout = std::make_shared<Timeout>();
+
+				timeout->handler = std::move(handler);
+				timeout->shard = m_nextShard.fetch_add(1) % m_shards.size();
+
+				return timeout;
+			}
+
+			void TimingWheel::Arm(const TimeoutHandle& timeout, const uint32_t msecFromNow)
+			{
+				if (timeout == nullptr)
+				{
+					return;
+				}
+
+				int64_t deadline = (ElapsedMsec() + msecFromNow + m_tickMsec - 1) / m_tickMsec;
+
+				timeout->deadline.store(deadline);
+
+				if (timeout->scheduled.load() <= deadline)
+				{
+					// The slot the timeout already sits in comes around no later than the new
+					// deadline, at which point the timeout is moved along. This is the common
+					// case of a timeout being pushed back, which requires no locking at all.
+					return;
+				}
+
+				Shard& shard = *m_shards[timeout->shard];
+
+				ScopedLock lock(shard.mutex);
+
+				if (timeout->scheduled.load() > deadline)
+				{
+					Schedule(shard, timeout, deadline);
+				}
+			}
+
+			void TimingWheel::Disarm(const TimeoutHandle& timeout)
+			{
+				if (timeout != nullptr)
+				{
+					timeout->deadline.store(Never);
+				}
+			}
+
+			int64_t TimingWheel::ElapsedMsec() const
+			{
+				return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - m_epoch).count();
+			}
+
+			void TimingWheel::ScheduleTick()
+			{
+				m_tickTimer.expires_from_now(boost::posix_time::milliseconds(m_tickMsec));
+				m_tickTimer.async_wait(std::bind(&TimingWheel::OnTick, this, std::placeholders::_1));
+			}
+
+			void TimingWheel::OnTick(const boost::system::error_code& error)
+			{
+				if (error == boost::asio::error::operation_aborted)
+				{
+					return;
+				}
+
+				std::vector<TimeoutHandle> expired;
+
+				int64_t now = ElapsedMsec() / m_tickMsec;
+
+				while (m_lastTick < now)
+				{
+					++m_lastTick;
+
+					for (auto& shard : m_shards)
+					{
+						ProcessTick(*shard, m_lastTick, expired);
+					}
+				}
+
+				ScheduleTick();
+
+				for (auto& timeout : expired)
+				{
+					if (timeout->handler)
+					{
+						timeout->handler();
+					}
+				}
+			}
+
+			void TimingWheel::ProcessTick(Shard& shard, const int64_t tick, std::vector<TimeoutHandle>& expired)
+			{
+				ScopedLock lock(shard.mutex);
+
+				shard.lastTick = tick;
+
+				auto& slot = shard.slots[static_cast<size_t>(tick % SlotCount)];
+
+				std::vector<SlotEntry> entries;
+				entries.swap(slot);
+
+				for (auto& entry : entries)
+				{
+					if (entry.tick > tick)
+					{
+						// Belongs to a later turn of the wheel.
+						slot.push_back(entry);
+						continue;
+					}
+
+					auto timeout = entry.timeout.lock();
+
+					if (timeout == nullptr || timeout->scheduled.load() != entry.tick)
+					{
+						// Either the owner let go of the timeout, or it was armed to expire
+						// sooner and has already been moved to an earlier slot.
+						continue;
+					}
+
+					int64_t deadline = timeout->deadline.load();
+
+					while (deadline <= tick)
+					{
+						// Only expire the timeout if it wasn't armed again in the meantime.
+						if (timeout->deadline.compare_exchange_weak(deadline, Never))
+						{
+							expired.push_back(timeout);
+							deadline = Never;
+						}
+					}
+
+					// Disarmed timeouts are passed over for a whole turn of the wheel, so that
+					// they don't need to be found and put back when armed again.
+					Schedule(shard, timeout, deadline == Never ? tick + static_cast<int64_t>(SlotCount) : deadline);
+
+					// The timeout may have been armed to expire sooner while we were moving it,
+					// having seen the old slot and so not taken the lock.
+					deadline = timeout->deadline.load();
+
+					if (deadline < timeout->scheduled.load())
+					{
+						Schedule(shard, timeout, deadline);
+					}
+				}
+
+				if (slot.empty())
+				{
+					// Hang on to the allocation for the next turn of the wheel.
+					entries.clear();
+					slot.swap(entries);
+				}
+			}
+
+			void TimingWheel::Schedule(Shard& shard, const TimeoutHandle& timeout, int64_t tick)
+			{
+				if (tick <= shard.lastTick)
+				{
+					tick = shard.lastTick + 1;
+				}
+
+				timeout->scheduled.store(tick);
+
+				shard.slots[static_cast<size_t>(tick % SlotCount)].push_back(SlotEntry{ timeout, tick });
+			}
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
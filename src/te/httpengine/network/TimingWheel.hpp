@@ -0,0 +1,370 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#pragma once
+
+#include <boost/asio.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace te
+{
+	namespace httpengine
+	{
+		namespace network
+		{
+
+			/// <summary>
+			/// The phases of a bridge's life, each of which may be given a different amount of
+			/// time to make progress before the bridge is considered hung and terminated.
+			/// </summary>
+			enum class StreamPhase
+			{
+				/// <summary>
+				/// Resolving and connecting to the upstream host.
+				/// </summary>
+				Connect,
+
+				/// <summary>
+				/// Negotiating TLS with either the client or the upstream host.
+				/// </summary>
+				Handshake,
+
+				/// <summary>
+				/// Waiting on the client to send a request on a connection that is otherwise
+				/// idle, either freshly accepted or kept alive after a completed transaction.
+				/// </summary>
+				IdleKeepAlive,
+
+				/// <summary>
+				/// Reading or writing headers and payloads in the middle of a transaction.
+				/// </summary>
+				Body
+			};
+
+			/// <summary>
+			/// The number of milliseconds a bridge is given to make progress in each
+			/// StreamPhase.
+			/// </summary>
+			struct StreamTimeouts
+			{
+				uint32_t connectMsec = 5000;
+				uint32_t handshakeMsec = 10000;
+				uint32_t idleKeepAliveMsec = 10000;
+				uint32_t bodyMsec = 5000;
+
+				/// <summary>
+				/// Gets the timeout for the given phase.
+				/// </summary>
+				/// <param name="phase">
+				/// The phase to get the timeout for.
+				/// </param>
+				/// <returns>
+				/// The number of milliseconds allowed in the given phase.
+				/// </returns>
+				uint32_t Get(const StreamPhase phase) const
+				{
+					switch (phase)
+					{
+						case StreamPhase::Connect:
+							return connectMsec;
+
+						case StreamPhase::Handshake:
+							return handshakeMsec;
+
+						case StreamPhase::IdleKeepAlive:
+							return idleKeepAliveMsec;
+
+						default:
+							return bodyMsec;
+					}
+				}
+			};
+
+			/// <summary>
+			/// A hashed timing wheel that keeps the stream timeouts of every bridge, driven by a
+			/// single timer ticking on the io_service. Arming a deadline_timer for every async
+			/// operation costs a trip through the io_service's timer queue, plus an allocated
+			/// handler, every time. Here arming a timeout that has only moved later, by far the
+			/// most common case, is nothing but an atomic store.
+			/// 
+			/// Timeouts are checked lazily, once per tick, so they expire up to one tick late.
+			/// A timeout is only ever moved between slots when its slot comes around and it
+			/// turns out not to have expired, or when it is armed to expire sooner than the
+			/// slot it sits in.
+			/// 
+			/// Timeouts are spread over a number of shards, each with its own lock and slots, so
+			/// that io_service threads arming timeouts at the same time rarely contend.
+			/// 
+			/// All members are safe to call from any thread. Expiry handlers are invoked on
+			/// whichever io_service thread runs the tick, without any lock held.
+			/// </summary>
+			class TimingWheel
+			{
+
+			private:
+
+				/// <summary>
+				/// A registered timeout. Defined below.
+				/// </summary>
+				struct Timeout;
+
+			public:
+
+				/// <summary>
+				/// Handle to a registered timeout. The timeout is dropped from the wheel, and
+				/// its handler never invoked again, once the last copy of the handle is gone.
+				/// </summary>
+				using TimeoutHandle = std::shared_ptr<Timeout>;
+
+				/// <summary>
+				/// The handler invoked when an armed timeout expires.
+				/// </summary>
+				using ExpiryHandler = std::function<void()>;
+
+				/// <summary>
+				/// The default number of milliseconds between ticks.
+				/// </summary>
+				static constexpr uint32_t DefaultTickMsec = 100;
+
+				/// <summary>
+				/// The number of slots in every shard. Timeouts further out than this many ticks
+				/// are simply passed over until the wheel comes around to them again.
+				/// </summary>
+				static constexpr size_t SlotCount = 512;
+
+				/// <summary>
+				/// Constructs a new TimingWheel and starts it ticking.
+				/// </summary>
+				/// <param name="service">
+				/// A valid pointer to the io_service to tick on.
+				/// </param>
+				/// <param name="shardCount">
+				/// The number of shards to spread timeouts over. Ideally the number of threads
+				/// running the io_service. Zero is treated as one.
+				/// </param>
+				/// <param name="tickMsec">
+				/// The number of milliseconds between ticks, which is also how late a timeout
+				/// may expire. Zero is treated as one.
+				/// </param>
+				TimingWheel(
+					boost::asio::io_service* service,
+					const size_t shardCount = 1,
+					const uint32_t tickMsec = DefaultTickMsec
+					);
+
+				/// <summary>
+				/// No copy no move no thx.
+				/// </summary>
+				TimingWheel(const TimingWheel&) = delete;
+				TimingWheel(TimingWheel&&) = delete;
+				TimingWheel& operator=(const TimingWheel&) = delete;
+
+				/// <summary>
+				/// Default destructor. Stops the wheel ticking.
+				/// </summary>
+				~TimingWheel();
+
+				/// <summary>
+				/// Registers a new timeout. The timeout starts out disarmed.
+				/// </summary>
+				/// <param name="handler">
+				/// The handler to invoke whenever the timeout expires. It must not own whatever
+				/// owns the returned handle, or neither will ever be freed.
+				/// </param>
+				/// <returns>
+				/// Handle to the new timeout.
+				/// </returns>
+				TimeoutHandle Register(ExpiryHandler handler);
+
+				/// <summary>
+				/// Arms the given timeout to expire the given number of milliseconds from now,
+				/// replacing whatever it was armed with before.
+				/// </summary>
+				/// <param name="timeout">
+				/// The timeout to arm.
+				/// </param>
+				/// <param name="msecFromNow">
+				/// The number of milliseconds from now until the timeout expires.
+				/// </param>
+				void Arm(const TimeoutHandle& timeout, const uint32_t msecFromNow);
+
+				/// <summary>
+				/// Disarms the given timeout, so that it never expires until it is armed again.
+				/// </summary>
+				/// <param name="timeout">
+				/// The timeout to disarm.
+				/// </param>
+				void Disarm(const TimeoutHandle& timeout);
+
+			private:
+
+				using Clock = std::chrono::steady_clock;
+
+				using ScopedLock = std::lock_guard<std::mutex>;
+
+				/// <summary>
+				/// The tick of a timeout that is disarmed, or is not in any slot.
+				/// </summary>
+				static constexpr int64_t Never = std::numeric_limits<int64_t>::max();
+
+				struct Timeout
+				{
+					/// <summary>
+					/// The handler to invoke when the timeout expires.
+					/// </summary>
+					ExpiryHandler handler;
+
+					/// <summary>
+					/// The index of the shard the timeout belongs to.
+					/// </summary>
+					size_t shard = 0;
+
+					/// <summary>
+					/// The tick the timeout expires at, or Never if disarmed. Written without
+					/// any lock whenever the timeout is armed.
+					/// </summary>
+					std::atomic<int64_t> deadline{ Never };
+
+					/// <summary>
+					/// The tick whose slot currently holds the timeout. Only ever written with
+					/// the shard lock held, but read without it when arming.
+					/// </summary>
+					std::atomic<int64_t> scheduled{ Never };
+				};
+
+				/// <summary>
+				/// A timeout's place in a slot. A timeout may be left behind in a slot when it
+				/// is moved to an earlier one, in which case its tick no longer matches the
+				/// timeout's scheduled tick and it is dropped when the slot comes around.
+				/// </summary>
+				struct SlotEntry
+				{
+					std::weak_ptr<Timeout> timeout;
+					int64_t tick;
+				};
+
+				/// <summary>
+				/// An independently locked set of slots.
+				/// </summary>
+				struct Shard
+				{
+					/// <summary>
+					/// Guards the slots and lastTick.
+					/// </summary>
+					std::mutex mutex;
+
+					/// <summary>
+					/// The last tick whose slot was processed.
+					/// </summary>
+					int64_t lastTick = 0;
+
+					/// <summary>
+					/// The slots, with the one for any tick found at the tick modulo SlotCount.
+					/// </summary>
+					std::array<std::vector<SlotEntry>, SlotCount> slots;
+				};
+
+				/// <summary>
+				/// Timer driving the ticks.
+				/// </summary>
+				boost::asio::deadline_timer m_tickTimer;
+
+				/// <summary>
+				/// The number of milliseconds between ticks.
+				/// </summary>
+				const uint32_t m_tickMsec;
+
+				/// <summary>
+				/// The time of tick zero.
+				/// </summary>
+				const Clock::time_point m_epoch;
+
+				/// <summary>
+				/// The last tick processed by ::OnTick(...). Only touched by the tick handler,
+				/// of which there is only ever one pending.
+				/// </summary>
+				int64_t m_lastTick = 0;
+
+				/// <summary>
+				/// The shards. Held by pointer since they aren't movable.
+				/// </summary>
+				std::vector<std::unique_ptr<Shard>> m_shards;
+
+				/// <summary>
+				/// For handing out shards to newly registered timeouts in turn.
+				/// </summary>
+				std::atomic<size_t> m_nextShard{ 0 };
+
+				/// <summary>
+				/// Gets the number of milliseconds elapsed since tick zero.
+				/// </summary>
+				int64_t ElapsedMsec() const;
+
+				/// <summary>
+				/// Starts the wait for the next tick.
+				/// </summary>
+				void ScheduleTick();
+
+				/// <summary>
+				/// Completion handler for the tick timer, which processes every tick that has
+				/// elapsed since the last one processed.
+				/// </summary>
+				void OnTick(const boost::system::error_code& error);
+
+				/// <summary>
+				/// Processes the slot for the given tick in the given shard, moving timeouts
+				/// that have yet to expire to their proper slots and collecting the handlers of
+				/// those that have.
+				/// </summary>
+				void ProcessTick(Shard& shard, const int64_t tick, std::vector<TimeoutHandle>& expired);
+
+				/// <summary>
+				/// Puts the given timeout into the slot for the given tick, which is never
+				/// earlier than the tick after the shard's last processed tick. Must be called
+				/// with the shard lock held.
+				/// </summary>
+				void Schedule(Shard& shard, const TimeoutHandle& timeout, int64_t tick);
+
+			};
+
+		} /* namespace network */
+	} /* namespace httpengine */
+} /* namespace te */
@@ -0,0 +1,757 @@
+/*
+* Copyright (c) 2016 Jesse Nicholson.
+*
+* This file is part of Http Filtering Engine.
+*
+* Http Filtering Engine is free software: you can redistribute it and/or
+* modify it under the terms of the GNU General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or (at
+* your option) any later version.
+*
+* In addition, as a special exception, the copyright holders give
+* permission to link the code of portions of this program with the OpenSSL
+* library.
+*
+* You must obey the GNU General Public License in all respects for all of
+* the code used other than OpenSSL. If you modify file(s) with this
+* exception, you may extend this exception to your version of the file(s),
+* but you are not obligated to do so. If you do not wish to do so, delete
+* this exception statement from your version. If you delete this exception
+* statement from all source files in the program, then also delete it
+* here.
+*
+* Http Filtering Engine is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Http Filtering Engine. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#define BOOST_TEST_MODULE AsyncDnsResolverTests
+
+#include <boost/test/included/unit_test.hpp>
+#include <boost/asio.hpp>
+#include "../../../../src/te/httpengine/network/AsyncDnsResolver.hpp"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using te::httpengine::network::AsyncDnsResolver;
+
+namespace
+{
+
+	const uint16_t TypeA = 1;
+	const uint16_t TypeAaaa = 28;
+
+	const uint16_t FlagTruncated = 0x0200;
+	const uint16_t RcodeServerFailure = 2;
+	const uint16_t RcodeNameError = 3;
+
+	using Message = std::vector<uint8_t>;
+
+	void WriteUint16(Message& out, const uint16_t value)
+	{
+		out.push_back(static_cast<uint8_t>(value >> 8));
+		out.push_back(static_cast<uint8_t>(value & 0xFF));
+	}
+
+	void WriteUint32(Message& out, const uint32_t value)
+	{
+		WriteUint16(out, static_cast<uint16_t>(value >> 16));
+		WriteUint16(out, static_cast<uint16_t>(value & 0xFFFF));
+	}
+
+	/// <summary>
+	/// A query as the stub server received it.
+	/// </summary>
+	struct Query
+	{
+		uint16_t id = 0;
+
+		uint16_t type = 0;
+
+		/// <summary>
+		/// The question section, exactly as sent.
+		/// </summary>
+		Message question;
+	};
+
+	/// <summary>
+	/// A resource record to put in an answer.
+	/// </summary>
+	struct Record
+	{
+		uint16_t type = 0;
+
+		uint32_t ttl = 0;
+
+		Message data;
+
+		/// <summary>
+		/// The record's name. If empty, a compression pointer to the question's name.
+		/// </summary>
+		Message name;
+
+		/// <summary>
+		/// If not negative, written as the length of the record data instead of its actual
+		/// length.
+		/// </summary>
+		int lengthOverride = -1;
+	};
+
+	Record ARecord(const std::string& address, const uint32_t ttl)
+	{
+		auto bytes = boost::asio::ip::address_v4::from_string(address).to_bytes();
+
+		Record record;
+		record.type = TypeA;
+		record.ttl = ttl;
+		record.data.assign(bytes.begin(), bytes.end());
+		return record;
+	}
+
+	Record AaaaRecord(const std::string& address, const uint32_t ttl)
+	{
+		auto bytes = boost::asio::ip::address_v6::from_string(address).to_bytes();
+
+		Record record;
+		record.type = TypeAaaa;
+		record.ttl = ttl;
+		record.data.assign(bytes.begin(), bytes.end());
+		return record;
+	}
+
+	/// <summary>
+	/// Builds an answer to the given query. The answer count is the number of records,
+	/// unless given.
+	/// </summary>
+	Message BuildAnswer(const Query& query, const uint16_t flags, const std::vector<Record>& records, const int answerCount = -1)
+	{
+		Message out;
+
+		WriteUint16(out, query.id);
+		WriteUint16(out, static_cast<uint16_t>(0x8180 | flags)); // Response, recursion desired and available.
+		WriteUint16(out, 1);
+		WriteUint16(out, static_cast<uint16_t>(answerCount < 0 ? records.size() : answerCount));
+		WriteUint16(out, 0);
+		WriteUint16(out, 0);
+
+		out.insert(out.end(), query.question.begin(), query.question.end());
+
+		for (const auto& record : records)
+		{
+			if (record.name.empty())
+			{
+				// Pointer to the name in the question, right after the header.
+				out.push_back(0xC0);
+				out.push_back(0x0C);
+			}
+			else
+			{
+				out.insert(out.end(), record.name.begin(), record.name.end());
+			}
+
+			WriteUint16(out, record.type);
+			WriteUint16(out, 1);
+			WriteUint32(out, record.ttl);
+			WriteUint16(out, static_cast<uint16_t>(record.lengthOverride < 0 ? record.data.size() : record.lengthOverride));
+			out.insert(out.end(), record.data.begin(), record.data.end());
+		}
+
+		return out;
+	}
+
+	/// <summary>
+	/// A nameserver listening on UDP and TCP on the same loopback port, like a real one,
+	/// that answers whatever its responders say. Each responder returns the messages to
+	/// send back for a query, in order. Over TCP, only the first is sent.
+	/// </summary>
+	class StubDnsServer
+	{
+
+	public:
+
+		using Responder = std::function<std::vector<Message>(const Query&)>;
+
+		explicit StubDnsServer(boost::asio::io_service& service)
+			:
+			m_service(service),
+			m_udpSocket(service),
+			m_strangerSocket(service),
+			m_acceptor(service)
+		{
+			// An ephemeral UDP port may be taken on TCP, so keep trying until both bind.
+			for (int attempt = 0; ; ++attempt)
+			{
+				m_udpSocket.open(boost::asio::ip::udp::v4());
+				m_udpSocket.bind(boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+				boost::system::error_code ec;
+				m_acceptor.open(boost::asio::ip::tcp::v4());
+				m_acceptor.bind(boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), m_udpSocket.local_endpoint().port()), ec);
+
+				if (!ec)
+				{
+					break;
+				}
+
+				BOOST_REQUIRE(attempt < 32);
+
+				m_udpSocket.close();
+				m_acceptor.close();
+			}
+
+			m_acceptor.listen();
+
+			m_strangerSocket.open(boost::asio::ip::udp::v4());
+			m_strangerSocket.bind(boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+			ReceiveUdp();
+			Accept();
+		}
+
+		boost::asio::ip::udp::endpoint Endpoint() const
+		{
+			return m_udpSocket.local_endpoint();
+		}
+
+		/// <summary>
+		/// Sends the given message to whoever sent the last UDP query, but from another port
+		/// than the one the query went to.
+		/// </summary>
+		void SendFromStranger(const Message& message)
+		{
+			m_strangerSocket.send_to(boost::asio::buffer(message), m_client);
+		}
+
+		Responder onUdp;
+
+		Responder onTcp;
+
+		size_t udpQueries = 0;
+
+		size_t tcpQueries = 0;
+
+	private:
+
+		boost::asio::io_service& m_service;
+
+		boost::asio::ip::udp::socket m_udpSocket;
+
+		boost::asio::ip::udp::socket m_strangerSocket;
+
+		boost::asio::ip::tcp::acceptor m_acceptor;
+
+		std::array<uint8_t, 512> m_udpBuffer;
+
+		boost::asio::ip::udp::endpoint m_client;
+
+		static Query ParseQuery(const uint8_t* data, const size_t size)
+		{
+			BOOST_REQUIRE(size > 12 + 4);
+
+			Query query;
+			query.id = static_cast<uint16_t>((data[0] << 8) | data[1]);
+			query.question.assign(data + 12, data + size);
+			query.type = static_cast<uint16_t>((data[size - 4] << 8) | data[size - 3]);
+			return query;
+		}
+
+		void ReceiveUdp()
+		{
+			m_udpSocket.async_receive_from(boost::asio::buffer(m_udpBuffer), m_client, [this](const boost::system::error_code& error, const size_t bytesTransferred)
+			{
+				if (error)
+				{
+					return;
+				}
+
+				++udpQueries;
+
+				if (onUdp)
+				{
+					for (const auto& message : onUdp(ParseQuery(m_udpBuffer.data(), bytesTransferred)))
+					{
+						m_udpSocket.send_to(boost::asio::buffer(message), m_client);
+					}
+				}
+
+				ReceiveUdp();
+			});
+		}
+
+		/// <summary>
+		/// One query over TCP, read and answered.
+		/// </summary>
+		struct TcpExchange
+		{
+			explicit TcpExchange(boost::asio::io_service& service) : socket(service)
+			{
+
+			}
+
+			boost::asio::ip::tcp::socket socket;
+
+			std::array<uint8_t, 2> length;
+
+			Message query;
+
+			Message answer;
+		};
+
+		void Accept()
+		{
+			auto exchange = std::make_shared<TcpExchange>(m_service);
+
+			m_acceptor.async_accept(exchange->socket, [this, exchange](const boost::system::error_code& error)
+			{
+				if (error)
+				{
+					return;
+				}
+
+				boost::asio::async_read(exchange->socket, boost::asio::buffer(exchange->length), [this, exchange](const boost::system::error_code& error, const size_t)
+				{
+					if (error)
+					{
+						return;
+					}
+
+					exchange->query.resize((exchange->length[0] << 8) | exchange->length[1]);
+
+					boost::asio::async_read(exchange->socket, boost::asio::buffer(exchange->query), [this, exchange](const boost::system::error_code& error, const size_t)
+					{
+						if (error)
+						{
+							return;
+						}
+
+						++tcpQueries;
+
+						auto answers = onTcp ? onTcp(ParseQuery(exchange->query.data(), exchange->query.size())) : std::vector<Message>();
+
+						if (answers.empty())
+						{
+							return;
+						}
+
+						WriteUint16(exchange->answer, static_cast<uint16_t>(answers.front().size()));
+						exchange->answer.insert(exchange->answer.end(), answers.front().begin(), answers.front().end());
+
+						boost::asio::async_write(exchange->socket, boost::asio::buffer(exchange->answer), [exchange](const boost::system::error_code&, const size_t) {});
+					});
+				});
+
+				Accept();
+			});
+		}
+
+	};
+
+	/// <summary>
+	/// What a lookup handed to its handler.
+	/// </summary>
+	struct Result
+	{
+		bool completed = false;
+
+		boost::system::error_code error;
+
+		std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+
+		uint32_t ttl = 0;
+	};
+
+	/// <summary>
+	/// A stub server and a resolver that only knows about it. Queries time out quickly
+	/// and are sent only once, so that a test that goes wrong fails rather than hangs.
+	/// </summary>
+	struct StubFixture
+	{
+		static constexpr uint32_t QueryTimeoutMsec = 300;
+
+		boost::asio::io_service service;
+
+		StubDnsServer server{ service };
+
+		AsyncDnsResolver resolver{ &service, { server.Endpoint() }, QueryTimeoutMsec, 1 };
+
+		/// <summary>
+		/// Resolves the given host and runs the io_service until the handler is invoked.
+		/// </summary>
+		Result Resolve(const std::string& host, const std::string& serviceName = u8"https")
+		{
+			Result result;
+
+			boost::asio::deadline_timer watchdog(service, boost::posix_time::seconds(5));
+			watchdog.async_wait([this](const boost::system::error_code& error)
+			{
+				if (!error)
+				{
+					service.stop();
+				}
+			});
+
+			resolver.AsyncResolve(host, serviceName, [this, &result](const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator endpoints, uint32_t ttl)
+			{
+				result.completed = true;
+				result.error = error;
+				result.ttl = ttl;
+
+				for (boost::asio::ip::tcp::resolver::iterator end; endpoints != end; ++endpoints)
+				{
+					result.endpoints.push_back(*endpoints);
+				}
+
+				service.stop();
+			});
+
+			service.run();
+			service.reset();
+
+			BOOST_REQUIRE(result.completed);
+
+			return result;
+		}
+	};
+
+	boost::asio::ip::tcp::endpoint Endpoint(const std::string& address, const uint16_t port)
+	{
+		return boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(address), port);
+	}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(AsyncDnsResolverStubTests, StubFixture)
+
+BOOST_AUTO_TEST_CASE(CollectsAAndAaaaAnswersWithTheSmallestTtl)
+{
+	server.onUdp = [](const Query& query)
+	{
+		if (query.type == TypeA)
+		{
+			return std::vector<Message>{ BuildAnswer(query, 0, { ARecord(u8"192.0.2.1", 300), ARecord(u8"192.0.2.2", 600) }) };
+		}
+
+		return std::vector<Message>{ BuildAnswer(query, 0, { AaaaRecord(u8"2001:db8::1", 120) }) };
+	};
+
+	auto result = Resolve(u8"www.example.test");
+
+	BOOST_CHECK(!result.error);
+	BOOST_REQUIRE_EQUAL(result.endpoints.size(), 3u);
+	BOOST_CHECK(result.endpoints[0] == Endpoint(u8"192.0.2.1", 443));
+	BOOST_CHECK(result.endpoints[1] == Endpoint(u8"192.0.2.2", 443));
+	BOOST_CHECK(result.endpoints[2] == Endpoint(u8"2001:db8::1", 443));
+	BOOST_CHECK_EQUAL(result.ttl, 120u);
+	BOOST_CHECK_EQUAL(server.udpQueries, 2u);
+	BOOST_CHECK_EQUAL(server.tcpQueries, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(OneAddressFamilyIsEnough)
+{
+	server.onUdp = [](const Query& query)
+	{
+		if (query.type == TypeA)
+		{
+			return std::vector<Message>{ BuildAnswer(query, 0, { ARecord(u8"192.0.2.7", 60) }, 1) };
+		}
+
+		return std::vector<Message>{ BuildAnswer(query, 0, {}) };
+	};
+
+	auto result = Resolve(u8"v4only.example.test", u8"8080");
+
+	BOOST_CHECK(!result.error);
+	BOOST_REQUIRE_EQUAL(result.endpoints.size(), 1u);
+	BOOST_CHECK(result.endpoints[0] == Endpoint(u8"192.0.2.7", 8080));
+	BOOST_CHECK_EQUAL(result.ttl, 60u);
+}
+
+BOOST_AUTO_TEST_CASE(NameErrorIsHostNotFound)
+{
+	server.onUdp = [](const Query& query)
+	{
+		return std::vector<Message>{ BuildAnswer(query, RcodeNameError, {}) };
+	};
+
+	auto result = Resolve(u8"missing.example.test");
+
+	BOOST_CHECK(result.error == boost::asio::error::host_not_found);
+	BOOST_CHECK(result.endpoints.empty());
+	BOOST_CHECK_EQUAL(result.ttl, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(NoRecordsIsNoData)
+{
+	server.onUdp = [](const Query& query)
+	{
+		return std::vector<Message>{ BuildAnswer(query, 0, {}) };
+	};
+
+	auto result = Resolve(u8"empty.example.test");
+
+	BOOST_CHECK(result.error == boost::asio::error::no_data);
+	BOOST_CHECK(result.endpoints.empty());
+}
+
+BOOST_AUTO_TEST_CASE(TruncatedAnswerIsFetchedAgainOverTcp)
+{
+	server.onUdp = [](const Query& query)
+	{
+		if (query.type == TypeA)
+		{
+			// Whatever made it into a truncated answer must not be used.
+			return std::vector<Message>{ BuildAnswer(query, FlagTruncated, { ARecord(u8"198.51.100.99", 30) }) };
+		}
+
+		return std::vector<Message>{ BuildAnswer(query, 0, {}) };
+	};
+
+	server.onTcp = [](const Query& query)
+	{
+		BOOST_CHECK_EQUAL(query.type, TypeA);
+
+		return std::vector<Message>{ BuildAnswer(query, 0, { ARecord(u8"192.0.2.10", 90), ARecord(u8"192.0.2.11", 90) }) };
+	};
+
+	auto result = Resolve(u8"big.example.test");
+
+	BOOST_CHECK(!result.error);
+	BOOST_REQUIRE_EQUAL(result.endpoints.size(), 2u);
+	BOOST_CHECK(result.endpoints[0] == Endpoint(u8"192.0.2.10", 443));
+	BOOST_CHECK(result.endpoints[1] == Endpoint(u8"192.0.2.11", 443));
+	BOOST_CHECK_EQUAL(result.ttl, 90u);
+	BOOST_CHECK_EQUAL(server.tcpQueries, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(MalformedTcpAnswerFailsTheLookup)
+{
+	server.onUdp = [](const Query& query)
+	{
+		return std::vector<Message>{ BuildAnswer(query, FlagTruncated, {}) };
+	};
+
+	server.onTcp = [](const Query& query)
+	{
+		// Shorter than a header.
+		return std::vector<Message>{ Message{ static_cast<uint8_t>(query.id >> 8), static_cast<uint8_t>(query.id & 0xFF), 0x81 } };
+	};
+
+	auto result = Resolve(u8"broken-tcp.example.test");
+
+	BOOST_CHECK(result.error);
+	BOOST_CHECK(result.endpoints.empty());
+}
+
+BOOST_AUTO_TEST_CASE(AnswersThatDoNotMatchAreIgnored)
+{
+	server.onUdp = [this](const Query& query)
+	{
+		// The right ID and question, but not from the nameserver's port.
+		server.SendFromStranger(BuildAnswer(query, 0, { ARecord(u8"203.0.113.1", 30) }));
+
+		// The wrong ID.
+		Query wrongId = query;
+		wrongId.id = static_cast<uint16_t>(query.id ^ 0x5A5A);
+
+		// The right ID, but another question.
+		Query wrongQuestion = query;
+		wrongQuestion.question[1] = static_cast<uint8_t>(wrongQuestion.question[1] ^ 0x20);
+
+		// Not a response at all, but the query echoed back.
+		Message echoedQuery = BuildAnswer(query, 0, {});
+		echoedQuery[2] &= 0x7F;
+
+		const std::string forged = query.type == TypeA ? u8"203.0.113.2" : u8"2001:db8::bad";
+		const std::string genuine = query.type == TypeA ? u8"192.0.2.20" : u8"2001:db8::20";
+
+		auto ForgedRecord = [&forged, &query]() { return query.type == TypeA ? ARecord(forged, 30) : AaaaRecord(forged, 30); };
+		auto GenuineRecord = [&genuine, &query]() { return query.type == TypeA ? ARecord(genuine, 300) : AaaaRecord(genuine, 300); };
+
+		return std::vector<Message>{
+			BuildAnswer(wrongId, 0, { ForgedRecord() }),
+			BuildAnswer(wrongQuestion, 0, { ForgedRecord() }),
+			echoedQuery,
+			BuildAnswer(query, 0, { GenuineRecord() }),
+			BuildAnswer(query, 0, { ForgedRecord() })
+		};
+	};
+
+	auto result = Resolve(u8"target.example.test");
+
+	BOOST_CHECK(!result.error);
+	BOOST_REQUIRE_EQUAL(result.endpoints.size(), 2u);
+	BOOST_CHECK(result.endpoints[0] == Endpoint(u8"192.0.2.20", 443));
+	BOOST_CHECK(result.endpoints[1] == Endpoint(u8"2001:db8::20", 443));
+	BOOST_CHECK_EQUAL(result.ttl, 300u);
+}
+
+BOOST_AUTO_TEST_CASE(MalformedAndOversizedRecordsAreSkipped)
+{
+	server.onUdp = [](const Query& query)
+	{
+		if (query.type == TypeA)
+		{
+			// A runt datagram is ignored outright. In the answer, an A record of the wrong
+			// size is skipped, and a record claiming more data than the message holds ends
+			// the parse, as it would have anyway, given the answer count runs past the
+			// records actually present.
+			Record wrongSize = ARecord(u8"198.51.100.1", 200);
+			wrongSize.data.push_back(0);
+
+			Record overrun = ARecord(u8"198.51.100.2", 30);
+			overrun.lengthOverride = 0xFFFF;
+
+			return std::vector<Message>{
+				Message{ 0x00, 0x01, 0x02 },
+				BuildAnswer(query, 0, { ARecord(u8"192.0.2.30", 200), wrongSize, overrun }, 40)
+			};
+		}
+
+		// A name with reserved label bits ends the parse before anything is collected. The
+		// question is still answered, though.
+		Record badName = AaaaRecord(u8"2001:db8::30", 30);
+		badName.name = Message{ 0x80, 0x00 };
+
+		return std::vector<Message>{ BuildAnswer(query, 0, { badName }) };
+	};
+
+	auto result = Resolve(u8"odd.example.test");
+
+	BOOST_CHECK(!result.error);
+	BOOST_REQUIRE_EQUAL(result.endpoints.size(), 1u);
+	BOOST_CHECK(result.endpoints[0] == Endpoint(u8"192.0.2.30", 443));
+	BOOST_CHECK_EQUAL(result.ttl, 200u);
+}
+
+BOOST_AUTO_TEST_CASE(NamesRunningPastTheMessageEndTheParse)
+{
+	server.onUdp = [](const Query& query)
+	{
+		if (query.type == TypeA)
+		{
+			// A label that claims more bytes than are left.
+			Message runaway = BuildAnswer(query, 0, { ARecord(u8"192.0.2.31", 200) }, 2);
+			runaway.push_back(0x3F);
+			runaway.push_back('a');
+
+			return std::vector<Message>{ runaway };
+		}
+
+		// A compression pointer cut in half.
+		Message halfPointer = BuildAnswer(query, 0, {}, 1);
+		halfPointer.push_back(0xC0);
+
+		return std::vector<Message>{ halfPointer };
+	};
+
+	auto result = Resolve(u8"runaway.example.test");
+
+	BOOST_CHECK(!result.error);
+	BOOST_REQUIRE_EQUAL(result.endpoints.size(), 1u);
+	BOOST_CHECK(result.endpoints[0] == Endpoint(u8"192.0.2.31", 443));
+}
+
+BOOST_AUTO_TEST_CASE(SilentNameserverTimesOut)
+{
+	auto result = Resolve(u8"silent.example.test");
+
+	BOOST_CHECK(result.error == boost::asio::error::timed_out);
+	BOOST_CHECK(result.endpoints.empty());
+	BOOST_CHECK_EQUAL(server.udpQueries, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(LiteralAddressNeedsNoQuery)
+{
+	auto result = Resolve(u8"192.0.2.40", u8"http");
+
+	BOOST_CHECK(!result.error);
+	BOOST_REQUIRE_EQUAL(result.endpoints.size(), 1u);
+	BOOST_CHECK(result.endpoints[0] == Endpoint(u8"192.0.2.40", 80));
+	BOOST_CHECK_EQUAL(server.udpQueries, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(UnknownServiceIsRejected)
+{
+	auto result = Resolve(u8"www.example.test", u8"gopher");
+
+	BOOST_CHECK(result.error == boost::asio::error::service_not_found);
+	BOOST_CHECK_EQUAL(server.udpQueries, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(NamesTheSystemOwnsAreDeferred)
+{
+	BOOST_CHECK(resolver.DefersToSystem(u8"localhost"));
+	BOOST_CHECK(resolver.DefersToSystem(u8"api.localhost"));
+	BOOST_CHECK(resolver.DefersToSystem(u8"printer.local."));
+	BOOST_CHECK(resolver.DefersToSystem(u8"intranet"));
+	BOOST_CHECK(!resolver.DefersToSystem(u8"www.example.test"));
+	BOOST_CHECK(!resolver.DefersToSystem(u8"notlocal.test"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_CASE(FailingNameserverIsPassedOver)
+{
+	boost::asio::io_service service;
+	StubDnsServer failing(service);
+	StubDnsServer working(service);
+
+	failing.onUdp = [](const Query& query)
+	{
+		return std::vector<Message>{ BuildAnswer(query, RcodeServerFailure, {}) };
+	};
+
+	working.onUdp = [](const Query& query)
+	{
+		if (query.type == TypeA)
+		{
+			return std::vector<Message>{ BuildAnswer(query, 0, { ARecord(u8"192.0.2.50", 100) }) };
+		}
+
+		return std::vector<Message>{ BuildAnswer(query, 0, {}) };
+	};
+
+	AsyncDnsResolver resolver(&service, { failing.Endpoint(), working.Endpoint() }, StubFixture::QueryTimeoutMsec, 1);
+
+	Result result;
+
+	resolver.AsyncResolve(u8"www.example.test", u8"http", [&service, &result](const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator endpoints, uint32_t ttl)
+	{
+		result.completed = true;
+		result.error = error;
+		result.ttl = ttl;
+
+		for (boost::asio::ip::tcp::resolver::iterator end; endpoints != end; ++endpoints)
+		{
+			result.endpoints.push_back(*endpoints);
+		}
+
+		service.stop();
+	});
+
+	boost::asio::deadline_timer watchdog(service, boost::posix_time::seconds(5));
+	watchdog.async_wait([&service](const boost::system::error_code& error)
+	{
+		if (!error)
+		{
+			service.stop();
+		}
+	});
+
+	service.run();
+
+	BOOST_REQUIRE(result.completed);
+	BOOST_CHECK(!result.error);
+	BOOST_REQUIRE_EQUAL(result.endpoints.size(), 1u);
+	BOOST_CHECK(result.endpoints[0] == Endpoint(u8"192.0.2.50", 80));
+	BOOST_CHECK_GE(failing.udpQueries, 1u);
+	BOOST_CHECK_EQUAL(working.udpQueries, 2u);
+}